@@ -2,33 +2,42 @@
 #ifndef MINIBACKUP_BACKUPENGINE_H
 #define MINIBACKUP_BACKUPENGINE_H
 
+#include <cstdint>
 #include <string>
 #include <filesystem>
 #include <vector>
+#include <fstream>
+#include <memory>
 
 namespace fs = std::filesystem;
 
+class FilterExpr;
+
 // 定义文件类型
-enum class FileType {
+enum class FileType : uint8_t {
     REGULAR,    // 普通文件
     DIRECTORY,  // 目录
     SYMLINK,    // 软链接
     OTHER       // 其他
 };
 
-// 定义文件记录结构
+// 定义文件记录结构 (定长字段按大小排列, 不留填充)
 struct FileRecord {
     std::string relPath;    // 相对路径
     std::string absPath;    // 绝对路径
-    FileType type;          // 类型
-    uint64_t size;          // 大小 (或链接长度)
     std::string linkTarget; // 软链接指向的目标
+    uint64_t size = 0;      // 大小 (或链接长度)
 
-    // --- 元数据 ---
-    uint32_t mode = 0;   // 权限
-    int64_t mtime = 0;   // 修改时间 (时间戳)
-    uint32_t uid = 0;    // 用户ID
-    uint32_t gid = 0;    // 组ID
+    // --- 元数据 (扫描时一次 statx 取全) ---
+    int64_t mtime = 0;      // 修改时间 (秒)
+    uint32_t mtimeNsec = 0; // 修改时间的纳秒部分
+    uint32_t mode = 0;      // 权限位 (含 setuid/setgid/sticky)
+    uint32_t uid = 0;       // 用户ID
+    uint32_t gid = 0;       // 组ID
+    uint64_t ino = 0;       // [新增] inode 号 (按物理位置排读取顺序时用; Windows 上为 0)
+    int64_t ctime = 0;      // [新增] 状态改变时间 (秒) 和纳秒部分, 增量备份判断有没有变时用; Windows 上为 0
+    uint32_t ctimeNsec = 0;
+    FileType type = FileType::OTHER;
 };
 
 // [新增] 加密模式枚举
@@ -41,7 +50,8 @@ enum class EncryptionMode {
 // 压缩模式枚举
 enum class CompressionMode {
     NONE,
-    RLE
+    RLE,
+    LZ77  // [新增] 支持用训练好的字典预热
 };
 
 struct FilterOptions {
@@ -64,12 +74,136 @@ struct FilterOptions {
 
     // 6. 用户筛选: 只备份属于指定 UID (User ID) 的文件 (-1表示不限制)
     int targetUid = -1;
+
+    // 7. [新增] 排除目录: 名字完全相同的目录连同子树都不扫描 (如 node_modules / .git)
+    std::vector<std::string> excludeDirs;
+
+    // 8. [新增] 编译好的筛选规则 (include / exclude glob、正则、元数据谓词, 见 FilterExpr.h), 和上面的条件同时生效
+    std::shared_ptr<const FilterExpr> expr;
+
+    // 9. [新增] 扫描时每个目录里读的忽略文件 (gitignore 语义, 可以层层嵌套), 空表示不读
+    std::string ignoreFile = ".backupignore";
+};
+
+// [新增] 目录扫描选项 (多线程 work-stealing 扫描器)
+struct ScanOptions {
+    // 扫描线程数, 0 表示按 CPU 数; 1 表示单线程
+    unsigned threads = 0;
+
+    // 扫完按相对路径排序, 每次输出顺序相同 (关掉则是各线程批次的拼接顺序)
+    bool sorted = true;
+
+    // [新增] 跳过缓存目录: 带 CACHEDIR.TAG (标准签名开头) 的目录本身保留, 里面的内容不扫
+    bool skipCaches = true;
+
+    // [新增] 跳过带 nodump 属性 (chattr +d) 的文件和目录 (整棵子树)
+    bool skipNodump = true;
+
+    // [新增] 不跨文件系统: 挂载点目录本身记录, 不往里走
+    bool oneFileSystem = false;
+
+    // [新增] 扫描缓存文件 (见 ScanCache.h), 空表示不用; 没变的目录不再读目录项, 扫完写回
+    // 只对 Linux 原生扫描生效
+    std::string cacheFile;
+
+    // [新增] 信任扫描缓存: 没变的目录里的普通文件直接用上次的 stat, 不再逐个 statx
+    // (原地改写、没换名的文件会被当作没变, 只适合写完不再改的归档树)
+    bool trustCache = false;
+
+    // [新增] 变动日志 (见 ChangeJournal.h, 由 watch 命令写), 要和 cacheFile 一起用:
+    // 日志里没提到的条目和子目录直接用扫描缓存里的, 不再 stat; 监视进程没一直在跑时照常扫描
+    std::string journalFile;
+};
+
+// [新增] 打包时读文件的顺序
+// 机械盘上按目录遍历顺序读, 磁头来回跳; 按物理位置排好再读, 磁头基本单向扫过去
+// 目录和软链接不读数据, 总是按原顺序排在最前面
+enum class ReadOrder {
+    SCAN,   // 扫描顺序 (默认, -stream 时可以边扫边打包)
+    INODE,  // 按 inode 号 (ext4 / XFS 上 inode 号和数据的分配位置大致相关, 不需要额外系统调用)
+    EXTENT  // 按第一个物理区段 (FS_IOC_FIEMAP, 每个文件一次 open + ioctl; 拿不到的文件排在后面按 inode 号)
 };
 
+// [新增] 打包选项 (固实模式等)
+struct PackOptions {
+    // 固实模式: 连续的小文件合并成大块, 整块压缩+加密, 包尾写中央索引
+    bool solid = false;
+
+    // 固实块的目标大小 (默认 4 MiB)
+    uint64_t solidBlockSize = 4ull << 20;
+
+    // 只有小于此大小的文件才并入固实块, 大文件单独成块
+    uint64_t solidFileLimit = 256ull << 10;
+
+    // [新增] 扫描时抽样训练共享字典, 存在包头里, 每次 LZ77 压缩都用它预热 (只对 LZ77 有效)
+    bool trainDictionary = false;
+
+    // 字典大小上限 (不超过 LZ77 窗口 64 KiB)
+    size_t dictionarySize = 32 << 10;
+
+    ScanOptions scan;
+
+    // [新增] 边扫边打包: 扫描线程经有界队列把条目交给打包线程, 不等扫完, 内存也不随文件数增长
+    // 条目按发现顺序进包 (父目录仍在子项前面, 多线程扫描时每次顺序可能不同), 不看 scan.sorted;
+    // 默认关掉: 先扫完再按 scan.sorted 排序打包, 同一棵树每次打出的包相同。训练字典时要先看过样本, 总是先扫完
+    bool streaming = false;
+
+    // [新增] 读文件的顺序; 不是 SCAN 时要先扫完才能排序, 不走流式。包里条目的顺序不影响还原
+    // (流式包按条目里的路径还原, 目录的元数据最后才设; 固实包的中央索引仍按路径排)
+    ReadOrder readOrder = ReadOrder::SCAN;
+
+    // [新增] 差量包: 相对这个旧的固实包打包, 没变的文件只存引用, 改过的存差量 (隐含 solid)
+    // 基准包要和新包放在同一目录, 解包时按文件名找它
+    std::string basePack;
+};
+
+// [新增] 基础备份选项
+struct BackupOptions {
+    // 增量模式: 与上次的 index.txt 比较大小 / mtime / ctime / inode, 没变的文件不复制也不重算 CRC
+    bool incremental = false;
+
+    // 增量模式下, 上次备份过但源里已经删除的文件也从备份目录删掉
+    bool deleteRemoved = true;
+
+    // [新增] 硬链接快照: 与这个旧快照目录 (它的 index.txt) 比较, 没变的文件硬链接过去,
+    // 只有变化的文件占新空间; 设置后自动按增量方式比较
+    std::string linkDest;
+
+    // [新增] 差量模式: 变化的大文件只把改动的块写进备份副本 (rsync 式滚动校验),
+    // 每个副本的块签名存在 <dst>/.minibackup/sig/ 下, 下次不用重读副本。
+    // 副本只有一个链接时就地改写 (中间插入数据时, 插入点之后整体后移, 只能重写);
+    // 和旧快照共用 inode 时写成新文件再换上, 旧快照不受影响
+    bool delta = false;
+    uint64_t deltaMinSize = 8ull << 20;
+
+    // [新增] 变动日志 (见 ChangeJournal.h, 由 watch 命令写): 增量模式下只看日志里提到的路径,
+    // 上次清单里其余的文件原样沿用, 不重新扫描; 日志要求整棵重扫 / 监视进程没一直在跑时照常扫描
+    std::string journal;
+
+    ScanOptions scan;
+};
+
+// [新增] 仓库垃圾回收选项
+struct GcOptions {
+    // 只保留最新的 N 个快照, 0 表示不删快照
+    size_t keepLast = 0;
+
+    // pack 中存活数据占比低于此值才重写
+    double liveThreshold = 0.5;
+
+    // 单次运行最多搬运的字节数, 压缩分多次完成, 不会占满备份窗口
+    uint64_t ioBudget = 256ull << 20;
+};
+
+class SampleReservoir;
+class FileCatalog;
+class RecordSource;
+
 class BackupEngine {
 public:
     // === 基础功能 ===
-    static void backup(const std::string& srcPath, const std::string& destPath);
+    static void backup(const std::string& srcPath, const std::string& destPath,
+                       const BackupOptions& options = BackupOptions());
     static std::string verify(const std::string& dest);
     static void restore(const std::string& srcPath, const std::string& destPath);
 
@@ -80,18 +214,50 @@ public:
                      const std::string& password = "",
                      EncryptionMode encMode = EncryptionMode::NONE,
                      const FilterOptions& filter = FilterOptions(),
-                     CompressionMode compMode = CompressionMode::NONE); // 默认全选
+                     CompressionMode compMode = CompressionMode::NONE, // 默认全选
+                     const PackOptions& options = PackOptions());
 
     // unpack: 只需要密码，模式由文件头自动识别
     static void unpack(const std::string& packFile, const std::string& destPath,
                        const std::string& password = "");
 
+    // [新增] extract: 从固实包中只取出一个文件 (只解码它所在的块)
+    static void extract(const std::string& packFile, const std::string& relPath,
+                        const std::string& destPath, const std::string& password = "");
+
+    // === [新增] 去重仓库 (FastCDC 分块, 每个唯一块只存一次) ===
+
+    // repoBackup: 把 srcPath 存成仓库里的一个新快照, 返回快照 ID
+    static std::string repoBackup(const std::string& srcPath, const std::string& repoPath,
+                                  const FilterOptions& filter = FilterOptions(),
+                                  CompressionMode compMode = CompressionMode::NONE);
+
+    // repoRestore: 还原快照 (snapshotId 为 "latest" 时取最新的)
+    static void repoRestore(const std::string& repoPath, const std::string& snapshotId,
+                            const std::string& destPath);
+
+    static std::vector<std::string> listSnapshots(const std::string& repoPath);
+
+    // repoGc: 按保留策略删旧快照, 回收无引用的块, 压缩稀疏的 pack
+    static void repoGc(const std::string& repoPath, const GcOptions& options = GcOptions());
+
 private:
     // 内部辅助函数
-    static std::vector<FileRecord> scanDirectory(const std::string& sourcePath, const FilterOptions& filter);
-    static void packFiles(const std::vector<FileRecord>& files, const std::string& outputFile,
+    static FileCatalog scanDirectory(const std::string& sourcePath, const FilterOptions& filter,
+                                     SampleReservoir* sampler = nullptr,
+                                     const ScanOptions& scan = ScanOptions());
+    static void packFiles(RecordSource& files, const std::string& outputFile,
                           const std::string& password, EncryptionMode encMode,
-                          CompressionMode compMode);
+                          CompressionMode compMode, const std::string& dict);
+#ifndef _WIN32
+    static void packFilesDirect(RecordSource& files, const std::string& outputFile);
+#endif
+    static void packFilesSolid(RecordSource& files, const std::string& outputFile,
+                               const std::string& password, EncryptionMode encMode,
+                               CompressionMode compMode, const PackOptions& options,
+                               const std::string& dict);
+    static void unpackSolid(const std::string& packFile, const fs::path& destRoot,
+                            const std::string& password, const std::string& onlyPath);
 };
 
 #endif //MINIBACKUP_BACKUPENGINE_H
\ No newline at end of file
@@ -0,0 +1,25 @@
+// include/ByteBuffer.h
+#ifndef MINIBACKUP_BYTEBUFFER_H
+#define MINIBACKUP_BYTEBUFFER_H
+
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+// 二进制序列化小工具: 定长字段按本机字节序直接拷贝 (与 .pck 元数据一致)
+template <typename T>
+void appendPod(std::vector<char>& buf, const T& value) {
+    auto p = reinterpret_cast<const char*>(&value);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+T readPod(const std::vector<char>& buf, size_t& pos) {
+    if (pos + sizeof(T) > buf.size()) throw std::runtime_error("Corrupted binary record");
+    T value;
+    std::memcpy(&value, buf.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+}
+
+#endif //MINIBACKUP_BYTEBUFFER_H
@@ -15,19 +15,33 @@ class CRC32 {
 public:
     // 计算内存数据的 CRC32
     static uint32_t calculate(const char* data, size_t size) {
-        uint32_t crc = 0xFFFFFFFF;
-        for (size_t i = 0; i < size; ++i) {
-            auto byte = static_cast<uint8_t>(data[i]);
-            crc ^= byte;
-            for (int j = 0; j < 8; ++j) {
-                constexpr uint32_t polynomial = 0xEDB88320;
-                uint32_t mask = -static_cast<int>(crc & 1);
-                crc = (crc >> 1) ^ (polynomial & mask);
-            }
+        return update(0, data, size);
+    }
+
+    // [新增] 分段计算: previous 传上一段的结果 (第一段传 0), 与整段一次算的结果相同
+    // 查表法 (slicing-by-8): 每次处理 8 个字节, 比逐位计算快一个数量级
+    static uint32_t update(uint32_t previous, const char* data, size_t size) {
+        const auto& t = tables();
+        auto p = reinterpret_cast<const uint8_t*>(data);
+        uint32_t crc = ~previous;
+        while (size >= 8) {
+            const uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24));
+            crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+                  t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+            p += 8;
+            size -= 8;
         }
+        while (size--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
         return ~crc;
     }
 
+    // [新增] 与 getFileCRC 相同的 8 位大写十六进制格式
+    static std::string toHex(uint32_t crc) {
+        std::stringstream ss;
+        ss << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << crc;
+        return ss.str();
+    }
+
     // [修改] 参数改为 std::filesystem::path，完美支持中文
     static std::string getFileCRC(const std::filesystem::path& filepath) {
         // 直接传入 path 对象，Windows 下会自动调用宽字符接口
@@ -36,25 +50,34 @@ public:
         // 如果打开失败，返回全0
         if (!file.is_open()) return "00000000";
 
-        char buffer[4096];
-        uint32_t crc = 0xFFFFFFFF;
+        std::vector<char> buffer(64 << 10);
+        uint32_t crc = 0;
+        while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+            crc = update(crc, buffer.data(), static_cast<size_t>(file.gcount()));
+        }
+        return toHex(crc);
+    }
 
-        while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
-            for (std::streamsize i = 0; i < file.gcount(); ++i) {
-                auto byte = static_cast<uint8_t>(buffer[i]);
-                crc ^= byte;
+private:
+    // t[0] 是标准的逐字节表, t[k][i] = 字节 i 后面再跟 k 个 0 字节的 CRC
+    using Tables = uint32_t[8][256];
+    static const Tables& tables() {
+        static const auto* built = [] {
+            static Tables t;
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
                 for (int j = 0; j < 8; ++j) {
                     constexpr uint32_t polynomial = 0xEDB88320;
-                    uint32_t mask = -static_cast<int>(crc & 1);
-                    crc = (crc >> 1) ^ (polynomial & mask);
+                    crc = (crc >> 1) ^ (polynomial & (0u - (crc & 1)));
                 }
+                t[0][i] = crc;
             }
-        }
-        crc = ~crc;
-
-        std::stringstream ss;
-        ss << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << crc;
-        return ss.str();
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (int k = 1; k < 8; ++k) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            }
+            return &t;
+        }();
+        return *built;
     }
 };
 
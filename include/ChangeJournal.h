@@ -0,0 +1,93 @@
+// include/ChangeJournal.h
+#ifndef MINIBACKUP_CHANGEJOURNAL_H
+#define MINIBACKUP_CHANGEJOURNAL_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ==========================================
+// 变动日志 (监视进程写, 增量 backup / pack 读)
+// ==========================================
+// 监视进程 (Watcher.h) 把去抖合并后的变动一行一条追加到日志里, 每批 fdatasync:
+//   M|相对路径   这个条目自己变了 (新建 / 写入 / 属性)
+//   T|相对路径   整棵子树都要重新看 (删除 / 移入移出 / 新建的目录 / 事件队列溢出); 路径为空表示整个根目录
+// 读取方先 take(): 把日志改名成 <日志>.taken 后读出来 (追加和改名都在 flock 下进行),
+// 处理成功再 commit() 删掉; 中途失败的话 .taken 留着, 下次和新日志合并再读。
+// 监视进程活着的时候一直锁着 <日志>.lock; 读取方发现没人锁着, 说明中间有一段时间没在监视,
+// 日志不完整, 只能整棵树重新扫。
+// 一份日志只能有一个读取方 (backup 和 pack 要用各自的日志, 监视进程可以同时写几份)。
+//
+// [新增] 水位: 还在去抖窗口里、没写进日志的变动读取方也要看到。监视进程每轮读完事件后 (有变化时, 没变化也至少
+// 每秒一次) 把 <日志>.pending 整个换掉: 第一行 W|<读完事件的时刻, 纳秒>, 后面是此刻还攒着的变动
+// 和没有监视的子树 (别的文件系统的挂载点, 那里的变动 inotify 看不到), 格式同上。
+// take() 把这些也算进来但不取走 (去抖结束后它们还会正常写进日志, 下次再处理一遍, 无害)。
+// 水位超过 PENDING_STALE_MS 没更新说明监视进程卡住了, 只能整棵树重新扫。
+// 剩下的滞后: 水位之后才到的事件 (最多一轮 poll, 200 毫秒以内) 这次看不到, 下次读取时一定在。
+
+// 读出来的变动集合
+struct DirtySet {
+    bool everything = false;                 // 整棵树都要重新扫
+    int64_t watermarkNs = 0;                 // 监视进程最近一次读完事件的时刻 (0 = 没有)
+    std::unordered_set<std::string> paths;    // M: 条目自己
+    std::unordered_set<std::string> subtrees; // T: 整棵子树
+    std::unordered_set<std::string> parents;  // 上面两种路径的所有上级目录 (不含根)
+
+    void add(char op, const std::string& relPath);
+    size_t size() const { return paths.size() + subtrees.size(); }
+
+    // rel 自己或某个上级在 subtrees 里
+    bool inSubtree(const std::string& rel) const;
+
+    // rel 和它下面都没有变动, 上次记下的样子还能用
+    bool clean(const std::string& rel) const {
+        return !everything && !paths.count(rel) && !parents.count(rel) && !inSubtree(rel);
+    }
+};
+
+// 水位多久没更新算监视进程卡住 (它至少每秒更新一次)
+constexpr int64_t PENDING_STALE_MS = 10000;
+
+class ChangeJournal {
+public:
+    struct Change {
+        char op; // 'M' 或 'T'
+        std::string path;
+    };
+
+    explicit ChangeJournal(fs::path file) : file_(std::move(file)) {}
+    ~ChangeJournal();
+
+    ChangeJournal(const ChangeJournal&) = delete;
+    ChangeJournal& operator=(const ChangeJournal&) = delete;
+
+    const fs::path& file() const { return file_; }
+
+    // 监视进程: 锁住 <日志>.lock 直到析构; 已经有别的监视进程在写这份日志时抛 std::runtime_error
+    void lockWriter();
+
+    // 监视进程: 追加一批变动并落盘
+    void append(const std::vector<Change>& changes);
+
+    // 监视进程: 换掉水位文件 (drainedNs: 读完事件的时刻; pending: 还在去抖的变动和没监视的子树)
+    void publishPending(const std::vector<Change>& pending, int64_t drainedNs);
+
+    // 读取方: 取走目前为止的全部变动 (连同上次没 commit 的, 再加上水位文件里还没写进日志的);
+    // 没有监视进程在跑、或者水位太旧时 everything = true
+    DirtySet take();
+
+    // 读取方: 这批变动已经处理完
+    void commit();
+
+private:
+    fs::path file_;
+    int lockFd_ = -1;
+
+    fs::path sibling(const char* suffix) const;
+};
+
+#endif //MINIBACKUP_CHANGEJOURNAL_H
@@ -0,0 +1,117 @@
+// include/ChunkIndex.h
+#ifndef MINIBACKUP_CHUNKINDEX_H
+#define MINIBACKUP_CHUNKINDEX_H
+
+#include "SHA256.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+using ChunkHash = SHA256::Digest;
+
+struct ChunkHashHasher {
+    size_t operator()(const ChunkHash& h) const {
+        size_t v;
+        std::memcpy(&v, h.data(), sizeof(v)); // 哈希本身已均匀分布
+        return v;
+    }
+};
+
+// 块在 pack 文件中的位置
+struct ChunkLocation {
+    uint32_t packId = 0;
+    uint64_t offset = 0;     // 数据 (不含记录头) 在 pack 内的偏移
+    uint32_t storedSize = 0; // 压缩后长度
+    uint32_t rawSize = 0;    // 原始长度
+    uint8_t codec = 0;       // 0=不压缩 1=RLE 2=LZ77
+};
+
+// ==========================================
+// 磁盘块索引 (mmap 哈希表 + 内存 Bloom 过滤器)
+// ==========================================
+// index.tbl: 开放寻址 (线性探测) 的定长槽位哈希表, 整个文件 mmap 进来,
+//            常驻内存的只有操作系统缓存的热页, 不随块数增长
+// index.bloom: Bloom 过滤器的持久化副本 (每键约 10 位, 误判率 ~1%)
+//            首次备份时绝大多数块都是新的, 被过滤器直接拒掉, 不碰磁盘
+
+// 查询统计 (用于观察过滤器效果和磁盘查询延迟)
+struct ChunkIndexStats {
+    uint64_t lookups = 0;        // 总查询次数
+    uint64_t bloomRejects = 0;   // 被 Bloom 过滤器直接否定
+    uint64_t tableLookups = 0;   // 查了哈希表
+    uint64_t tableHits = 0;      // 哈希表里确实有
+    uint64_t probedSlots = 0;    // 线性探测走过的槽位总数
+    uint64_t tableNanos = 0;     // 哈希表查询总耗时
+    uint64_t latencyLog2[40] = {}; // 哈希表查询耗时直方图, 第 k 格 = [2^k, 2^(k+1)) ns
+
+    uint64_t falsePositives() const { return tableLookups - tableHits; }
+    // 近似分位数 (取所在直方图格子的上界), 单位 ns
+    uint64_t latencyPercentile(double p) const;
+    void print(std::ostream& out) const;
+};
+
+class ChunkIndex {
+public:
+    // bloomMaxBytes: Bloom 过滤器内存上限, 块数超出设计容量后误判率上升, 但内存不再增长
+    explicit ChunkIndex(const fs::path& dir, uint64_t bloomMaxBytes = 256ull << 20);
+    ~ChunkIndex();
+
+    ChunkIndex(const ChunkIndex&) = delete;
+    ChunkIndex& operator=(const ChunkIndex&) = delete;
+
+    bool find(const ChunkHash& hash, ChunkLocation* loc = nullptr);
+
+    // 插入或覆盖
+    void insert(const ChunkHash& hash, const ChunkLocation& loc);
+
+    // 删除 (线性探测的反向移位删除, 不留墓碑); Bloom 过滤器删不掉, 需要时调用 rebuildBloom
+    bool erase(const ChunkHash& hash);
+    void rebuildBloom();
+
+    // 哈希表与 Bloom 过滤器落盘
+    void sync();
+
+    // 按槽位顺序遍历所有项
+    void forEach(const std::function<void(const ChunkHash&, const ChunkLocation&)>& fn) const;
+
+    uint64_t size() const;
+    uint64_t bloomBytes() const { return bloom_.size() * sizeof(uint64_t); }
+    const ChunkIndexStats& stats() const { return stats_; }
+    void resetStats() { stats_ = ChunkIndexStats(); }
+
+private:
+    class MappedFile;
+
+    fs::path dir_;
+    uint64_t bloomMaxBytes_;
+    std::unique_ptr<MappedFile> table_;
+    uint64_t slotCount_ = 0;   // 2 的幂
+    uint64_t used_ = 0;
+
+    std::vector<uint64_t> bloom_;
+    uint64_t bloomBits_ = 0;
+    bool bloomDirty_ = false;
+
+    ChunkIndexStats stats_;
+
+    uint8_t* slot(uint64_t i) const;
+    bool locate(const ChunkHash& hash, uint64_t* index, uint64_t* probes) const;
+    void openTable();
+    void grow();
+    void placeInto(uint8_t* base, uint64_t slotCount, const ChunkHash& hash, const ChunkLocation& loc, bool* isNew);
+
+    void resetBloom(uint64_t expectedKeys);
+    void bloomAdd(const ChunkHash& hash);
+    bool bloomMayContain(const ChunkHash& hash) const;
+    bool loadBloom();
+    void saveBloom();
+};
+
+#endif //MINIBACKUP_CHUNKINDEX_H
@@ -0,0 +1,150 @@
+// include/ChunkStore.h
+#ifndef MINIBACKUP_CHUNKSTORE_H
+#define MINIBACKUP_CHUNKSTORE_H
+
+#include "BackupEngine.h"
+#include "ChunkIndex.h"
+#include "Chunker.h"
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// ==========================================
+// 去重仓库 (内容定义分块 + 块存储)
+// ==========================================
+// 目录结构:
+//   repo/config             仓库参数 (分块参数 / 压缩算法)
+//   repo/packs/pack-N.dat   块数据 (每个唯一块只存一次)
+//   repo/index.tbl          块索引: 哈希 -> 所在 pack 与偏移 (mmap 哈希表, 见 ChunkIndex.h)
+//   repo/index.bloom        块索引前面的 Bloom 过滤器
+//   repo/snapshots/<id>     快照清单: 备份的源目录, 每个文件的元数据和引用哪些块
+//   repo/lock               [新增] 仓库锁 (排他 flock): 备份 / 还原 / GC 同时只有一个在动仓库,
+//                           GC 不会删掉另一个进程刚写进去、还没进快照的块
+
+// 快照中的一个条目
+struct SnapshotEntry {
+    uint8_t typeCode = 0;    // 1=文件 2=目录 3=软链接 (与 .pck 一致)
+    std::string relPath;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint32_t mode = 0;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    std::string linkTarget;
+    std::vector<ChunkHash> chunks;
+    // [新增] 下次备份判断文件有没有变 (同镜像备份的清单): 纳秒 mtime、ctime、inode; 旧格式的快照里为 0
+    uint32_t mtimeNsec = 0;
+    int64_t ctime = 0;
+    uint32_t ctimeNsec = 0;
+    uint64_t ino = 0;
+};
+
+// 垃圾回收结果
+struct GcStats {
+    uint64_t liveChunks = 0;
+    uint64_t removedChunks = 0;     // 从索引里删掉的无引用块
+    uint64_t deletedPacks = 0;      // 完全没有存活块, 直接删除的 pack
+    uint64_t rewrittenPacks = 0;    // 存活率低于阈值, 搬走存活块后删除的 pack
+    uint64_t copiedBytes = 0;       // 本次搬运的数据量 (受 I/O 预算限制)
+    uint64_t reclaimedBytes = 0;    // 释放的磁盘空间
+    uint64_t deferredPacks = 0;     // 超出本次预算, 留给下次的待压缩 pack
+};
+
+class ChunkStore {
+public:
+    // 打开仓库, 不存在时按给定参数新建; 先锁住仓库 (别的进程占着就等), 对象在时一直锁着
+    explicit ChunkStore(const std::string& repoPath,
+                        CompressionMode compMode = CompressionMode::NONE,
+                        const ChunkerParams& params = ChunkerParams());
+    ~ChunkStore();
+
+    ChunkStore(const ChunkStore&) = delete;
+    ChunkStore& operator=(const ChunkStore&) = delete;
+
+    // 打开仓库。常驻模式 (daemon) 下同一个仓库的块索引 (mmap 哈希表 + Bloom 过滤器) 一直开着:
+    // 用完时数据落盘、封上当前 pack, 下次直接用; 别的进程动过仓库 (索引 / pack 目录变了) 时重新打开。
+    // 同一个仓库同时只能有一个使用者; 常驻时仓库锁只在调用方用着的时候锁, 任务之间别的进程也能用
+    static std::shared_ptr<ChunkStore> open(const std::string& repoPath,
+                                            CompressionMode compMode = CompressionMode::NONE);
+
+    // 打开常驻模式 (daemon 启动时调用); 关掉时关闭所有常驻的仓库
+    static void setResident(bool on);
+    static size_t residentCount();
+
+    const Chunker& chunker() const { return chunker_; }
+
+    bool contains(const ChunkHash& hash);
+
+    // 存一个块; 已存在时什么都不写, 返回 false
+    bool put(const ChunkHash& hash, const char* data, size_t size);
+
+    // 读一个块 (会校验哈希)
+    std::vector<char> get(const ChunkHash& hash);
+
+    // 把缓冲的 pack 数据和新索引项落盘
+    void flush();
+
+    // === 快照 ===
+    // source: 备份的源目录 (绝对路径), 下次备份同一个目录时按它找上一个快照
+    std::string writeSnapshot(const std::vector<SnapshotEntry>& entries, const std::string& source = std::string());
+    std::vector<SnapshotEntry> readSnapshot(const std::string& id) const;
+    // [新增] 只读快照头里的源目录 (旧格式的快照返回空串)
+    std::string snapshotSource(const std::string& id) const;
+    std::vector<std::string> listSnapshots() const; // 按时间从旧到新
+    void removeSnapshot(const std::string& id);
+
+    // === 垃圾回收 ===
+    // 标记: 所有快照引用的块; 清除: 索引里其余的块
+    // 压缩: 存活率低于 liveThreshold 的 pack 把存活块搬进新 pack 后删除,
+    //       按存活率从低到高处理, 本次搬运量不超过 ioBudget (至少处理一个, 保证有进展)
+    GcStats collectGarbage(double liveThreshold, uint64_t ioBudget);
+
+    size_t chunkCount() const { return index_.size() + pending_.size(); }
+    const ChunkIndex& index() const { return index_; }
+
+private:
+    // [新增] <repo>/lock 上的排他 flock (Windows 上不锁)
+    class RepoLock {
+    public:
+        explicit RepoLock(const fs::path& root);
+        ~RepoLock();
+        RepoLock(const RepoLock&) = delete;
+        RepoLock& operator=(const RepoLock&) = delete;
+
+        void lock(); // 别人占着时先提示再等
+        void unlock();
+
+    private:
+        fs::path path_;
+        int fd_ = -1;
+        bool held_ = false;
+    };
+
+    fs::path root_;
+    CompressionMode compMode_;
+    Chunker chunker_;
+
+    RepoLock lock_; // 在索引之前构造: 锁住之后才碰仓库里的文件
+    ChunkIndex index_;
+    // 还没写进索引的新项: 对应的 pack 数据落盘前不能进索引, 否则崩溃后索引会指向不存在的数据
+    std::unordered_map<ChunkHash, ChunkLocation, ChunkHashHasher> pending_;
+
+    uint32_t writePackId_ = 0;
+    uint64_t writeOffset_ = 0;
+    std::ofstream writePack_;
+    std::vector<uint32_t> unsyncedPacks_; // [新增] 上次 flush 之后写过的 pack, 进索引前要 fsync
+    bool newPackFile_ = false;            // [新增] 建过新 pack 文件, packs 目录也要 fsync
+
+    uint32_t readPackId_ = 0;
+    std::ifstream readPack_;
+
+    fs::path packPath(uint32_t id) const;
+    void openNextPack();
+    void sealPack(); // 关掉正在写的 pack, 之后的新块写进下一个
+    // 往当前 pack 追加一条块记录, 返回数据的位置
+    ChunkLocation appendRecord(const ChunkHash& hash, uint8_t codec, uint32_t rawSize,
+                               const char* stored, size_t storedSize);
+};
+
+#endif //MINIBACKUP_CHUNKSTORE_H
@@ -0,0 +1,78 @@
+// include/Chunker.h
+#ifndef MINIBACKUP_CHUNKER_H
+#define MINIBACKUP_CHUNKER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// ==========================================
+// 内容定义分块 (FastCDC, Gear 滚动哈希)
+// ==========================================
+// 位置 i 的哈希只由 [i-63, i] 这 64 字节决定, 所以:
+//   1. 文件中间插入/删除数据后, 后面的块边界会重新对齐, 未改动的块可以去重
+//   2. 可以把一段数据切成几条 lane 并行找切点 (SIMD), 结果与逐字节扫描完全一致
+//   3. 大文件可以分段多线程分块, 再在自然边界处拼接, 结果也与单线程一致
+
+struct ChunkerParams {
+    uint32_t minSize = 2 << 10;   // 最小块 2 KiB
+    uint32_t avgSize = 8 << 10;   // 平均块 8 KiB (必须是 2 的幂)
+    uint32_t maxSize = 64 << 10;  // 最大块 64 KiB
+};
+
+// 切点查找内核
+enum class ChunkerKernel {
+    AUTO,    // 默认内核 (目前是 LANES, 见 chunker_bench 实测)
+    SCALAR,  // 逐字节 (参考实现)
+    LANES,   // 4 条 lane 交错的标量实现 (不依赖指令集)
+    AVX2     // AVX2 前缀倍增, 一次推进 8 个位置
+};
+
+class Chunker {
+public:
+    explicit Chunker(const ChunkerParams& params = ChunkerParams(),
+                     ChunkerKernel kernel = ChunkerKernel::AUTO);
+
+    // 在 data[0, len) 中找第一个切点, 返回块长度
+    // 调用方要保证 len >= maxSize, 或者 data 已经是文件末尾
+    size_t cut(const uint8_t* data, size_t len) const;
+
+    // 把 data[0, len) 切成若干块, 块长度追加到 lengths, 返回消耗的字节数
+    // eof=false 时, 末尾不足一个最大块的部分留给下次 (需要更多数据才能确定切点)
+    // pool 不为空且数据足够大时分段并行, 结果与单线程完全一致
+    size_t split(const uint8_t* data, size_t len, bool eof, std::vector<size_t>& lengths,
+                 ThreadPool* pool = nullptr) const;
+
+    // 流式分块一个文件, 每切出一块回调一次; 返回文件总长度
+    uint64_t chunkFile(const std::string& path,
+                       const std::function<void(const char* data, size_t size)>& onChunk,
+                       ThreadPool* pool = nullptr) const;
+
+    const ChunkerParams& params() const { return params_; }
+    ChunkerKernel kernel() const { return kernel_; }
+
+    static bool avx2Supported();
+    static const char* kernelName(ChunkerKernel kernel);
+
+    // Gear 表 (固定种子生成, 仓库格式依赖它, 不能改)
+    static const uint64_t* gearTable();
+
+private:
+    ChunkerParams params_;
+    ChunkerKernel kernel_;
+    uint64_t maskS_; // 未到平均长度前用更严格的掩码 (更难切)
+    uint64_t maskL_; // 超过平均长度后用更宽松的掩码 (更易切)
+
+    // 返回 [from, to) 中第一个满足 (H(i) & mask) == 0 的位置, 没有则返回 to
+    size_t search(const uint8_t* data, size_t from, size_t to, uint64_t mask) const;
+
+    // 从 start 开始顺序切, 直到切点 >= stop; 切点 (绝对位置) 追加到 cuts
+    void splitRange(const uint8_t* data, size_t start, size_t stop, size_t len,
+                    std::vector<size_t>& cuts) const;
+};
+
+#endif //MINIBACKUP_CHUNKER_H
@@ -0,0 +1,53 @@
+// include/Codec.h
+#ifndef MINIBACKUP_CODEC_H
+#define MINIBACKUP_CODEC_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <random>
+
+// ==========================================
+// 压缩算法 (RLE / LZ77) 与字典训练
+// ==========================================
+
+// RLE: [次数][字节] 成对存储
+void rleCompress(const std::vector<char>& input, std::vector<char>& output);
+void rleDecompress(const std::vector<char>& input, std::vector<char>& output);
+
+// LZ77 (类 LZ4 格式, 64 KiB 窗口)
+// dict 不为空时用它预热窗口: 输入开头就能引用字典里的内容, 解压时必须传同一个字典
+void lzCompress(const std::vector<char>& input, std::vector<char>& output,
+                const std::string& dict = "");
+void lzDecompress(const std::vector<char>& input, std::vector<char>& output,
+                  const std::string& dict = "");
+
+// LZ77 窗口大小, 字典超过它也只有末尾这一段有用
+constexpr size_t LZ_WINDOW = 65535;
+
+// 从样本中训练共享字典 (简化版 COVER: 选出被最多样本共享的片段)
+std::string trainDictionary(const std::vector<std::string>& samples, size_t dictSize);
+
+// 字典训练样本采集: 扫描时做蓄水池抽样, 只记路径, 训练前再读内容
+class SampleReservoir {
+public:
+    explicit SampleReservoir(size_t capacity = 2000, uint64_t maxFileSize = 16 << 10)
+        : capacity_(capacity), maxFileSize_(maxFileSize) {}
+
+    // 扫描到一个普通文件时调用
+    void offer(const std::string& absPath, uint64_t size);
+
+    // 读出所有样本内容
+    std::vector<std::string> load() const;
+
+    size_t size() const { return paths_.size(); }
+
+private:
+    size_t capacity_;
+    uint64_t maxFileSize_;
+    uint64_t seen_ = 0;
+    std::vector<std::string> paths_;
+    std::mt19937_64 rng_{0x5eed};
+};
+
+#endif //MINIBACKUP_CODEC_H
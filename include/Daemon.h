@@ -0,0 +1,114 @@
+// include/Daemon.h
+#ifndef MINIBACKUP_DAEMON_H
+#define MINIBACKUP_DAEMON_H
+
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <functional>
+#include <iosfwd>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ==========================================
+// 常驻进程: 定时任务 + 本地套接字提交任务
+// ==========================================
+// 一个进程一直跑着, 扫描缓存 (ScanCache)、块索引 (ChunkStore) 和线程池在任务之间都留在内存里,
+// 重复的小备份不用每次重新读缓存文件、Bloom 过滤器, 也不用重新开线程。
+//
+// 任务文件每行一个定时任务 (空行和 # 开头的行忽略):
+//   <分> <时> <日> <月> <周> [jitter=秒] <命令> <参数>...
+//   例: */15 * * * * jitter=60 backup /home /mnt/mirror -inc -scan-cache /var/tmp/home.cache
+// 时间段和 cron 一样 (数字、*、a-b、/步长、逗号列表; 周 0 和 7 都是周日; 日和周都限定时满足一个就行),
+// 也可以用 @hourly / @daily / @weekly / @monthly 代替前五段。
+// 到点后再随机推迟 0..jitter 秒, 很多机器同一时刻的任务不会一起打到同一个仓库上。
+// 命令就是命令行上的命令 (backup / pack / repo-backup / repo-gc ...), 带空格的参数用双引号括起来。
+//
+// 套接字协议: 客户端连上后发一行 (格式同任务文件里的命令部分), daemon 把任务输出原样发回,
+// 最后一行是 "#exit <返回码>"。另有几个内部命令: status (定时任务和下次运行时间)、reload (重读任务文件)、
+// shutdown。只接受同一用户 (或 root) 的连接。
+// 任务一个接一个地跑, 同一时刻只有一个任务在用常驻的缓存和仓库; 运行期间新的连接在套接字队列里等着。
+
+// cron 式的时间表 (本地时间, 精确到分钟)
+class CronSchedule {
+public:
+    // 五段时间或 @hourly 之类; 格式不对时抛 std::runtime_error
+    static CronSchedule parse(const std::string& spec);
+
+    // after 之后 (不含) 第一个符合的整分钟; 找不到 (比如 2 月 30 日) 返回 -1
+    std::time_t next(std::time_t after) const;
+
+private:
+    std::bitset<60> minutes_;
+    std::bitset<24> hours_;
+    std::bitset<32> days_;     // 1..31
+    std::bitset<13> months_;   // 1..12
+    std::bitset<7> weekdays_;  // 0 = 周日
+    bool anyDay_ = true;
+    bool anyWeekday_ = true;
+
+    bool dayMatches(const std::tm& tm) const;
+};
+
+struct DaemonOptions {
+    fs::path socket;
+    fs::path jobsFile; // 可以为空: 只接受提交
+};
+
+class Daemon {
+public:
+    // 执行一条命令 (参数和命令行上的一样, 不含程序名), 返回退出码; 输出写到 std::cout / std::cerr
+    using Runner = std::function<int(const std::vector<std::string>& args)>;
+
+    Daemon(const DaemonOptions& options, Runner runner);
+    ~Daemon();
+
+    Daemon(const Daemon&) = delete;
+    Daemon& operator=(const Daemon&) = delete;
+
+    // 监听套接字、跑定时任务, 直到 stop() 或收到 shutdown; 套接字建不起来 / 任务文件有错时抛 std::runtime_error
+    void run();
+
+    // 可以从信号处理函数里调用 (正在跑的任务跑完才退出)
+    void stop() { stopped_ = true; }
+
+    // 客户端: 发一条命令, 把任务输出写到 out, 返回任务的退出码
+    static int submit(const fs::path& socket, const std::vector<std::string>& args, std::ostream& out);
+
+    // 按空白切分, 双引号里的空白不切 (引号里 \" 和 \\ 转义); joinArgs 是反过来
+    static std::vector<std::string> splitArgs(const std::string& line);
+    static std::string joinArgs(const std::vector<std::string>& args);
+
+private:
+    struct Job {
+        std::string line;               // 任务文件里的原文
+        CronSchedule schedule;
+        unsigned jitter = 0;            // 秒
+        std::vector<std::string> args;
+        std::time_t due = -1;           // 下次运行时间 (已含随机推迟), -1 = 不会再运行
+        uint64_t runs = 0;
+        uint64_t failures = 0;
+        int lastExit = 0;
+    };
+
+    DaemonOptions options_;
+    Runner runner_;
+    std::vector<Job> jobs_;
+    std::mt19937 random_;
+    int listenFd_ = -1;
+    std::atomic<bool> stopped_{false};
+
+    void loadJobs();
+    void schedule(Job& job, std::time_t now);
+    void runDue();
+    void serve(int fd);
+    void status(std::ostream& out) const;
+    int execute(const std::vector<std::string>& args);
+};
+
+#endif //MINIBACKUP_DAEMON_H
@@ -0,0 +1,87 @@
+// include/Delta.h
+#ifndef MINIBACKUP_DELTA_H
+#define MINIBACKUP_DELTA_H
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+// ==========================================
+// rsync 式差量 (滚动弱校验 + 强校验)
+// ==========================================
+// 1. 旧版本按定长块算签名: 每块一个弱校验 (可滚动) 和一个强校验 (SHA-256 前 16 字节)
+// 2. 新版本逐字节滚动弱校验, 命中后再比强校验, 确认是旧版本的哪一块
+// 3. 输出 copy (引用旧版本的一块) / literal (新数据) 操作序列
+
+struct BlockSignature {
+    uint32_t weak = 0;
+    std::array<uint8_t, 16> strong{};
+};
+
+struct FileSignature {
+    uint32_t blockSize = 0;
+    uint64_t fileSize = 0;
+    std::vector<BlockSignature> blocks; // 最后一块可能不满
+
+    // 按文件大小选块大小: 约 sqrt(size), 取 2 的幂, 限制在 [4 KiB, 128 KiB]
+    static uint32_t chooseBlockSize(uint64_t fileSize);
+
+    // 签名文件: 记录生成签名时目标文件的大小和 mtime, 对不上说明文件被别人改过, 签名作废
+    void save(const std::filesystem::path& path, int64_t targetMtimeNs) const;
+    static bool load(const std::filesystem::path& path, uint64_t targetSize, int64_t targetMtimeNs,
+                     FileSignature& out);
+};
+
+// 顺序喂数据, 按定长块生成签名
+class SignatureBuilder {
+public:
+    explicit SignatureBuilder(uint32_t blockSize);
+    void update(const char* data, size_t size);
+    FileSignature finish();
+
+private:
+    FileSignature sig_;
+    std::vector<char> pending_;
+};
+
+FileSignature computeSignature(std::istream& in, uint32_t blockSize);
+
+// rsync 弱校验 (Adler-32 变体): 低 16 位 = 字节和, 高 16 位 = 加权和
+uint32_t weakChecksum(const char* data, size_t size);
+std::array<uint8_t, 16> strongChecksum(const char* data, size_t size);
+
+// 差量操作的接收方
+struct DeltaSink {
+    // 新版本 [dstOffset, dstOffset+length) = 旧版本 [srcOffset, srcOffset+length)
+    std::function<void(uint64_t srcOffset, uint64_t length, uint64_t dstOffset)> copy;
+    // 新版本 [dstOffset, dstOffset+size) = data
+    std::function<void(const char* data, size_t size, uint64_t dstOffset)> literal;
+};
+
+struct DeltaStats {
+    uint64_t matchedBytes = 0;
+    uint64_t literalBytes = 0;
+};
+
+// 流式读新版本, 对照旧版本签名产生操作 (内存只占一个读缓冲)
+// inPlace=true 时只接受 srcOffset >= dstOffset 的块引用: 顺序就地写入旧文件时, 要读的旧数据还没被覆盖
+// onData 按顺序看到新版本的每个字节 (用来顺便算 CRC / 新签名)
+DeltaStats encodeDelta(const FileSignature& base, std::istream& in, const DeltaSink& sink, bool inPlace,
+                       const std::function<void(const char* data, size_t size)>& onData = nullptr);
+
+// 内存版: 新版本已经整个在内存里 (打包时)
+DeltaStats encodeDelta(const FileSignature& base, const char* data, size_t size, const DeltaSink& sink);
+
+// ==========================================
+// 紧凑差量格式 (.pck 里的差量条目, 类 VCDIFF 的 copy/insert)
+// ==========================================
+// [C][源偏移 8][长度 8]     从基准内容复制
+// [I][长度 8][数据]         插入新数据
+std::vector<char> makeBinaryDelta(const std::vector<char>& base, const std::vector<char>& target);
+std::vector<char> applyBinaryDelta(const std::vector<char>& base, const std::vector<char>& delta);
+
+#endif //MINIBACKUP_DELTA_H
@@ -0,0 +1,157 @@
+// include/FileCatalog.h
+#ifndef MINIBACKUP_FILECATALOG_H
+#define MINIBACKUP_FILECATALOG_H
+
+#include "BackupEngine.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ==========================================
+// 扫描结果清单 (名字 arena + 按列存的定长记录)
+// ==========================================
+// FileRecord 每条自带 relPath / absPath / linkTarget 三个堆字符串, 前两个还是同一串字节的重复,
+// 千万级文件时光小块分配就是几个 GB。这里换一种存法:
+//   - 目录前缀只存一次: 目录表每行是 (父目录 id, 名字), 条目是 (所在目录 id, 名字);
+//   - 名字和软链接目标都追加进按块分配的 arena (块不搬动), 条目里只记 8 字节的偏移;
+//   - 定长元数据按列存 (struct-of-arrays), 每个条目七十来字节, 没有任何指针;
+//   - 完整路径只在用到时拼出来 (relPath / absPath / record)。
+// 条目数和目录数上限都是 2^32 - 1。
+
+class FileCatalog {
+public:
+    using DirId = uint32_t;
+    static constexpr DirId ROOT = 0; // 扫描根 (相对路径为空)
+
+    // root: 扫描根的路径, absPath() 拼在它后面
+    explicit FileCatalog(std::string root = std::string());
+
+    FileCatalog(FileCatalog&&) noexcept = default;
+    FileCatalog& operator=(FileCatalog&&) noexcept = default;
+
+    const std::string& root() const { return root_; }
+
+    // 目录表: 登记 parent 下的一个子目录, 返回它的 id (parent 必须已登记, 所以父目录 id 总比子目录小)
+    // 不查重: 扫描时每个目录只会被发现一次
+    DirId addDir(DirId parent, std::string_view name);
+    size_t dirCount() const { return dirParent_.size(); }
+
+    // 加一个条目: 路径 = dir 的路径 / name; 类型和元数据取自 meta, 软链接目标取 meta.linkTarget
+    // (meta 的 relPath / absPath 不看)
+    void add(DirId dir, std::string_view name, const FileRecord& meta);
+
+    // 并入 other 的条目: arena 整块接管, 名字不复制
+    // other 的条目引用的目录 id 必须属于本目录表 (扫描时各线程共用一张目录表, 条目各记各的)
+    void append(FileCatalog&& other);
+
+    // 按相对路径排序, 结果和对完整路径字符串排序相同 (父目录排在子项前面)
+    void sortByPath();
+
+    size_t size() const { return type_.size(); }
+    bool empty() const { return type_.empty(); }
+
+    // 定长字段直接按列读
+    FileType type(size_t i) const { return static_cast<FileType>(type_[i]); }
+    uint64_t fileSize(size_t i) const { return size_[i]; }
+    int64_t mtime(size_t i) const { return mtime_[i]; }
+    uint32_t mtimeNsec(size_t i) const { return mtimeNsec_[i]; }
+    int64_t ctime(size_t i) const { return ctime_[i]; }
+    uint32_t ctimeNsec(size_t i) const { return ctimeNsec_[i]; }
+    uint32_t mode(size_t i) const { return mode_[i]; }
+    uint32_t uid(size_t i) const { return uid_[i]; }
+    uint32_t gid(size_t i) const { return gid_[i]; }
+    uint64_t ino(size_t i) const { return ino_[i]; }
+    std::string_view name(size_t i) const { return {nameLen_[i] ? arena_.at(name_[i]) : "", nameLen_[i]}; }
+    std::string_view linkTarget(size_t i) const;
+
+    // 按需拼路径; appendXxx 追加到 out 后面, 循环里复用同一个缓冲就不会反复分配
+    void appendDirPath(DirId dir, std::string& out) const;
+    void appendRelPath(size_t i, std::string& out) const;
+    std::string relPath(size_t i) const;
+    std::string absPath(size_t i) const;
+
+    // 还原成完整的 FileRecord (打包时逐个临时生成, 用完即弃)
+    FileRecord record(size_t i) const;
+
+    // 占用的内存 (arena 块 + 各列的容量), 字节
+    size_t memoryUsage() const;
+
+private:
+    // 只追加的 arena: 固定大小的块, 写进去的字节地址不变; 引用 = 块号 * BLOCK + 块内偏移
+    class Arena {
+    public:
+        static constexpr size_t BLOCK = 256u << 10;
+
+        uint64_t store(const char* data, size_t size);
+        const char* at(uint64_t ref) const { return blocks_[ref / BLOCK].get() + ref % BLOCK; }
+
+        // 接管 other 的所有块, 返回 other 里的引用要加上的偏移
+        uint64_t adopt(Arena&& other);
+
+        size_t bytes() const { return blocks_.size() * BLOCK; }
+
+    private:
+        std::vector<std::unique_ptr<char[]>> blocks_;
+        size_t used_ = BLOCK; // 最后一块已用的字节 (初始视为已满, 第一次写时才分配)
+    };
+
+    static constexpr uint64_t NO_LINK = UINT64_MAX;
+
+    std::string root_;
+    Arena arena_;
+
+    // 目录表
+    std::vector<DirId> dirParent_;
+    std::vector<uint64_t> dirName_;
+    std::vector<uint16_t> dirNameLen_;
+
+    // 条目 (每列一个数组, 同一下标是同一个条目)
+    std::vector<DirId> dir_;
+    std::vector<uint64_t> name_;
+    std::vector<uint16_t> nameLen_;
+    std::vector<uint8_t> type_;
+    std::vector<uint16_t> mode_;
+    std::vector<uint32_t> mtimeNsec_;
+    std::vector<uint64_t> size_;
+    std::vector<int64_t> mtime_;
+    std::vector<uint32_t> uid_;
+    std::vector<uint32_t> gid_;
+    std::vector<uint64_t> ino_;
+    std::vector<int64_t> ctime_;
+    std::vector<uint32_t> ctimeNsec_;
+    std::vector<uint64_t> link_; // 软链接目标: arena 里 [长度 4][字节], 不是软链接为 NO_LINK
+
+    std::string_view dirName(DirId d) const { return {dirNameLen_[d] ? arena_.at(dirName_[d]) : "", dirNameLen_[d]}; }
+};
+
+// [新增] 打包时逐个取条目的来源: 扫完的清单 (CatalogSource), 或边扫边出的流 (ScanStream, 见 Scanner.h)
+class RecordSource {
+public:
+    virtual ~RecordSource() = default;
+
+    // 取下一个条目 (覆盖 record 的全部字段), 取完返回 false
+    virtual bool next(FileRecord& record) = 0;
+};
+
+class CatalogSource : public RecordSource {
+public:
+    // order: 按这个顺序取 (下标排列), 为空则按清单顺序
+    explicit CatalogSource(const FileCatalog& files, std::vector<uint32_t> order = {})
+        : files_(files), order_(std::move(order)) {}
+
+    bool next(FileRecord& record) override {
+        if (pos_ >= files_.size()) return false;
+        record = files_.record(order_.empty() ? pos_ : order_[pos_]);
+        pos_++;
+        return true;
+    }
+
+private:
+    const FileCatalog& files_;
+    std::vector<uint32_t> order_;
+    size_t pos_ = 0;
+};
+
+#endif //MINIBACKUP_FILECATALOG_H
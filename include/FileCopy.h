@@ -0,0 +1,68 @@
+// include/FileCopy.h
+#ifndef MINIBACKUP_FILECOPY_H
+#define MINIBACKUP_FILECOPY_H
+
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <stdexcept>
+
+// ==========================================
+// 文件复制引擎 (尽量让内核 / 文件系统来搬数据)
+// ==========================================
+// 依次尝试, 不支持就退到下一种:
+// 1. FICLONE          btrfs / XFS 同卷写时复制, 只复制元数据, 瞬间完成
+// 2. copy_file_range  内核内复制 (NFS / XFS 等还能在服务端 / 存储层完成)
+// 3. sendfile         内核内复制, 老内核或跨文件系统时
+// 4. 用户态缓冲循环   其他平台 / 以上都不行; 数据经过用户态, 顺便算 CRC
+
+enum class CopyMethod : uint8_t {
+    CLONE = 0,
+    COPY_FILE_RANGE = 1,
+    SENDFILE = 2,
+    BUFFERED = 3,
+};
+
+const char* copyMethodName(CopyMethod method);
+
+struct CopyResult {
+    CopyMethod method = CopyMethod::BUFFERED;
+    uint64_t bytes = 0;
+    bool hasCrc = false; // 只有缓冲复制会顺便算出 CRC, 其他方式需要另外读一遍源文件
+    uint32_t crc = 0;
+};
+
+// [新增] 源文件这一侧出的错 (打不开 / 读出错): 目标没问题, 调用方可以只跳过这一个文件
+// 写目标出的错 (磁盘满 / 超出文件大小上限等) 仍是普通的 std::runtime_error
+struct CopySourceError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// 各方式复制了多少文件 / 字节
+struct CopyStats {
+    uint64_t files[4] = {};
+    uint64_t bytes[4] = {};
+
+    void add(const CopyResult& r);
+    void print(std::ostream& out) const;
+};
+
+// 复制 source 到 target (已存在则覆盖), 保留权限位; 失败抛 std::runtime_error
+CopyResult copyFileFast(const std::filesystem::path& source, const std::filesystem::path& target);
+
+// [新增] 文件第一个数据区段在磁盘上的物理偏移 (Linux FS_IOC_FIEMAP, 不强制刷盘)
+// 打不开 / 文件系统不支持 / 没有数据 / 数据还没落盘或内联在 inode 里时返回 false
+bool firstPhysicalOffset(const std::filesystem::path& path, uint64_t& physical);
+
+#ifndef _WIN32
+// [新增] 打包直通路径: 把 source 开头的最多 maxBytes 字节追加到 outFd 的当前位置 (不做 reflink)
+// target 只用于报错信息; 返回实际搬运的字节数 (源文件变短时会少于 maxBytes)
+// 源文件打不开 / 读出错抛 CopySourceError
+CopyResult appendFileTo(const std::filesystem::path& source, int outFd, uint64_t maxBytes,
+                        const std::filesystem::path& target);
+
+// [新增] 用 pread 读 fd 的 [offset, offset+size) 算 CRC32 (不移动文件位置, 可多线程共用一个 fd)
+uint32_t crc32OfRange(int fd, uint64_t offset, uint64_t size, const std::filesystem::path& path);
+#endif
+
+#endif //MINIBACKUP_FILECOPY_H
@@ -0,0 +1,168 @@
+// include/FilterExpr.h
+#ifndef MINIBACKUP_FILTEREXPR_H
+#define MINIBACKUP_FILTEREXPR_H
+
+#include "BackupEngine.h"
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <regex>
+#include <string>
+#include <vector>
+
+// ==========================================
+// 筛选规则语言 (编译成字节码 + 合并的 glob DFA)
+// ==========================================
+// 规则文本一行一条:
+//   # 注释
+//   exclude <glob>      (也可写成 "- <glob>") 命中的条目不要; 命中的目录整棵子树不扫描
+//   include <glob>      (也可写成 "+ <glob>") 有 include 时, 只要命中任一 include 的条目
+//   where <表达式>      每条 where 都必须成立
+// glob: * ? [a-z] [!a-z] \转义 只在一级路径内匹配, ** 可以跨目录 ("**/" 匹配零或多级目录)
+//       不含 '/' 时匹配文件名, 含 '/' 时匹配整个相对路径 (开头的 '/' 可省略); 结尾的 '/' 表示只匹配目录
+// 表达式: 用 and / or / not (&& / || / !) 和括号组合下面的谓词 (运算符两边要有空格)
+//   name <glob>        path <glob>        name ~ "正则"      path ~ "正则" (ECMAScript, 部分匹配)
+//   size <op> 10M      age <op> 7d        mtime <op> <Unix秒> uid <op> 1000   gid <op> 100
+//   type file|dir|link                    op: < <= > >= == !=   大小单位 K/M/G/T   时间单位 s/m/h/d/w
+//
+// 所有 name glob 合并成一个 DFA, 所有 path glob 合并成另一个: 每个条目各走一遍, 代价只和名字长度有关;
+// 同一组的 include / exclude glob 共用一个标签, 字节码里只占一条指令, 规则再多每个条目的代价也不变。
+// 布尔组合编译成带短路跳转的字节码, 按三值逻辑求值: stat 之前 (元数据未知) 就能断定不选的条目, 连 stat 都不做
+
+// 一组 glob 合并成的 DFA (前缀共享的 NFA 做子集构造, 字节按等价类压缩转移表)
+class GlobSet {
+public:
+    // 新建一个标签 (匹配结果位图里的一位); 多个 glob 可以共用一个标签, 任一匹配就置位
+    uint32_t newLabel() { return labels_++; }
+
+    // 加入一个 glob, 整个匹配时置 label 位; 必须在 build() 之前
+    void add(const std::string& glob, uint32_t label);
+
+    // 构造 DFA; 状态数超过上限时退回 NFA 模拟 (结果相同, 只是慢)
+    void build();
+
+    // 匹配整个 text, 返回命中的标签位图 (words() 个 64 位字)
+    // DFA 模式下直接指向转移表旁边的常量位图; NFA 模式下写进 scratch
+    const uint64_t* match(const std::string& text, std::vector<uint64_t>& scratch) const;
+
+    size_t size() const { return globs_; }
+    size_t words() const { return words_; }
+    size_t dfaStates() const { return dfa_ ? acceptBits_.size() / (words_ ? words_ : 1) : 0; }
+
+private:
+    using ByteSet = std::bitset<256>;
+    struct NfaState {
+        std::vector<std::pair<ByteSet, uint32_t>> edges;
+        std::vector<uint32_t> eps;
+        std::vector<uint32_t> accepts;               // 到这里就匹配了哪些标签
+        std::map<std::string, uint32_t> children;    // glob 元素 -> 后继状态 (前缀相同的 glob 共用状态)
+    };
+
+    size_t globs_ = 0;
+    uint32_t labels_ = 0;
+    std::vector<NfaState> nfa_ = std::vector<NfaState>(1); // 0 号是所有 glob 共同的起点
+
+    bool dfa_ = false;
+    uint32_t start_ = 0;            // DFA 起始状态 (0 号是死状态)
+    uint32_t classes_ = 0;          // 字节等价类个数
+    uint8_t classOf_[256] = {};
+    std::vector<uint32_t> table_;   // [状态 * classes_ + 类] -> 下一状态
+    std::vector<uint64_t> acceptBits_; // [状态 * words_ + k]
+    size_t words_ = 0;
+
+    uint32_t newState();
+    uint32_t addItem(uint32_t from, const std::string& glob, size_t& i);
+    void closure(std::vector<uint32_t>& set, std::vector<char>& mark) const;
+    void acceptsOf(const std::vector<uint32_t>& set, uint64_t* bits) const;
+};
+
+class FilterExpr {
+public:
+    // 编译规则文本; 语法错误抛 std::runtime_error (带行号和原文)
+    static std::shared_ptr<const FilterExpr> compile(const std::string& rules);
+
+    // 读规则文件的内容 (-filter-file), 可以和其他规则文本拼接后再编译
+    static std::string readRules(const std::string& path);
+
+    // stat 之前: 只凭相对路径和文件名就能断定不选时返回 false
+    bool mayMatch(const std::string& relPath, const std::string& name) const;
+
+    // 目录剪枝: 命中某条 exclude 的目录
+    bool prunes(const std::string& relPath, const std::string& name) const;
+    bool canPrune() const { return !prune_.code.empty(); }
+
+    // stat 之后的完整判断
+    bool matches(const FileRecord& record) const;
+
+    void describe(std::ostream& out) const;
+
+private:
+    friend class FilterCompiler;
+
+    enum class Op : uint8_t {
+        NAME_GLOB, PATH_GLOB,   // arg = 标签
+        NAME_REGEX, PATH_REGEX, // arg = 正则编号
+        TYPE,                   // value = FileType
+        SIZE, MTIME, UID, GID,  // cmp + value
+        NOT, AND, OR,
+        JUMP_FALSE, JUMP_TRUE,  // 栈顶为假 / 真时跳到 arg (不出栈), 实现短路
+    };
+    enum class Cmp : uint8_t { LT, LE, GT, GE, EQ, NE };
+
+    struct Insn {
+        Op op;
+        Cmp cmp = Cmp::EQ;
+        uint32_t arg = 0;
+        int64_t value = 0;
+    };
+    struct Program {
+        std::vector<Insn> code; // 为空表示恒真
+    };
+    struct Subject;
+
+    GlobSet names_;
+    GlobSet paths_;
+    std::vector<std::regex> regexes_;
+    Program select_; // 选不选
+    Program prune_;  // 目录剪枝 (exclude 规则的 or)
+    size_t rules_ = 0;
+
+    uint8_t run(const Program& program, Subject& subject) const;
+};
+
+// ==========================================
+// [新增] 分层忽略文件 (.backupignore, gitignore 语义)
+// ==========================================
+// 扫描时每个目录里的忽略文件编译成一层, 串在父目录那一层后面; 没有忽略文件的目录直接沿用父目录的那一层,
+// 每个文件只编译一次, 目录再深也不重复。判断时从最深的一层往上找: 哪层有规则命中就听哪层, 同一层里最后命中的规则算数。
+//   # 注释          空行忽略          \# \! 表示字面的 # !        结尾的空格去掉 (除非写成 "\ ")
+//   !<glob>         重新包含 (父目录已被忽略时无效, 和 git 一样)
+//   <glob>/         只匹配目录
+//   开头或中间有 '/' 的 glob 相对忽略文件所在目录匹配路径, 否则匹配任意一级的名字; ** 可跨目录
+class IgnoreMatcher {
+public:
+    // 在 parent 之上叠加一层; dirRel 是忽略文件所在目录 (相对扫描根, 空 = 根)
+    static std::shared_ptr<const IgnoreMatcher> compile(const std::string& text, const std::string& dirRel,
+                                                        std::shared_ptr<const IgnoreMatcher> parent);
+
+    // relPath 相对扫描根, 必须在 dirRel 之下
+    bool ignored(const std::string& relPath, const std::string& name, bool isDir) const;
+
+    size_t rules() const { return flags_.size(); }
+
+private:
+    enum : uint8_t { NEGATE = 1, DIR_ONLY = 2 };
+
+    std::shared_ptr<const IgnoreMatcher> parent_;
+    std::string base_; // dirRel + '/' (根目录为空)
+    GlobSet names_;    // 不带 '/' 的规则: 匹配名字
+    GlobSet paths_;    // 带 '/' 的规则: 匹配相对 base_ 的路径
+    std::vector<uint8_t> flags_; // 第 i 条规则 (两个 GlobSet 里的标签 i)
+
+    // 这一层最后命中的规则, 没有返回 -1
+    int lastMatch(const std::string& relPath, const std::string& name, bool isDir) const;
+};
+
+#endif //MINIBACKUP_FILTEREXPR_H
@@ -0,0 +1,115 @@
+// include/ScanCache.h
+#ifndef MINIBACKUP_SCANCACHE_H
+#define MINIBACKUP_SCANCACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ==========================================
+// 持久化的扫描缓存 (按目录的 inode / mtime / ctime 判断有没有变)
+// ==========================================
+// 目录里增删改名都会更新目录自己的 mtime / ctime, 所以目录的这三样和上次一样, 它的子项名单就没变:
+// 不用再 getdents, 直接用上次记下的名单 (连同每个子项的 stat 结果)。
+// 子项自己的内容改了目录并不知道, 所以默认仍逐个 statx; 和缓存里相同的子项不再 readlink。
+// 信任模式下连普通文件的 statx 也省掉 (只 stat 子目录, 好判断下一层变没变),
+// 只适合文件写完就不再原地修改的归档树 (原地改写 / 追加的文件会被漏掉, 换名保存的不会)。
+// 配合变动日志 (ChangeJournal.h) 时, 日志里没提到的子项 (包括子目录) 都直接用缓存, 干净的子树一次 stat 都不做。
+//
+// 缓存只记录原始的目录内容, 与筛选条件无关, 同一个根目录的 pack / backup 可以共用一个缓存文件。
+// 文件格式: [magic 8][根路径][目录数 8] 之后每个目录 [相对路径][DirStamp][子项列表], 字符串都是 [长度 4][字节]
+// 常驻模式 (daemon) 下缓存留在内存里, save() 之后直接当作下一次的旧缓存, 不用再读文件。
+
+// 判断目录有没有变的三样 (纳秒时间)
+struct DirStamp {
+    uint64_t ino = 0;
+    int64_t mtime = 0;
+    uint32_t mtimeNsec = 0;
+    int64_t ctime = 0;
+    uint32_t ctimeNsec = 0;
+
+    bool operator==(const DirStamp& o) const {
+        return ino == o.ino && mtime == o.mtime && mtimeNsec == o.mtimeNsec && ctime == o.ctime &&
+               ctimeNsec == o.ctimeNsec;
+    }
+};
+
+class ScanCache {
+public:
+    // 目录里的一个子项
+    struct Child {
+        std::string name;
+        uint8_t dtype = 0;     // getdents 给的 d_type
+        bool hasStat = false;  // 上次 statx 过 (按名字筛掉 / 剪掉的子项没有), 下面的字段才有效
+        bool nodump = false;
+        uint32_t mode = 0;     // 含类型位 (S_IFMT)
+        uint32_t uid = 0;
+        uint32_t gid = 0;
+        uint64_t size = 0;
+        uint64_t ino = 0;
+        uint64_t dev = 0;      // 所在设备 (子目录判断挂载点用)
+        int64_t mtime = 0;
+        uint32_t mtimeNsec = 0;
+        int64_t ctime = 0;
+        uint32_t ctimeNsec = 0;
+        std::string linkTarget; // 软链接目标
+
+        // stat 结果和 o 相同 (mtime / ctime / 大小 / inode / 权限都没变)
+        bool sameStat(const Child& o) const;
+    };
+
+    explicit ScanCache(fs::path file) : file_(std::move(file)) {}
+
+    // 读入上次的缓存; 文件不存在 / 格式不对 / 根目录不同时当作空缓存
+    void load(const std::string& root);
+
+    // 打开 file 对应的缓存并 load(root); 常驻模式下同一个文件沿用内存里的实例
+    // (文件被别的进程改过 / 根目录不同时重新读)。同一个缓存同时只能有一次扫描在用
+    static std::shared_ptr<ScanCache> open(const fs::path& file, const std::string& root);
+
+    // 打开常驻模式 (daemon 启动时调用); 关掉时丢弃所有常驻的缓存
+    static void setResident(bool on);
+    static size_t residentCount();
+
+    // relDir 上次记录的 stamp 和这次相同时取出它的子项名单 (线程安全: 扫描期间旧缓存只读)
+    bool find(const std::string& relDir, const DirStamp& stamp, std::vector<Child>& children) const;
+
+    // 记下这次读到的目录 (线程安全, 每个目录一次)
+    void put(const std::string& relDir, const DirStamp& stamp, const std::vector<Child>& children);
+
+    // 只写这次 put 过的目录 (没扫到的目录下次重新读), 先写临时文件再改名;
+    // 常驻的实例随后把这次的结果当作旧缓存
+    void save();
+
+    size_t loaded() const { return old_.size(); }
+
+private:
+    struct Entry {
+        DirStamp stamp;
+        std::string children; // 编码后的子项列表, 命中时才解开
+    };
+
+    fs::path file_;
+    std::string root_;
+    std::unordered_map<std::string, Entry> old_;
+
+    std::mutex mutex_;
+    std::vector<std::pair<std::string, Entry>> fresh_;
+
+    // 常驻实例: 内存里的旧缓存对应的文件修改时间和大小, 对不上说明别的进程写过
+    bool resident_ = false;
+    int64_t diskTime_ = -1;
+    uint64_t diskSize_ = 0;
+
+    bool diskUnchanged() const;
+    void noteDisk();
+};
+
+#endif //MINIBACKUP_SCANCACHE_H
@@ -0,0 +1,192 @@
+// include/Scanner.h
+#ifndef MINIBACKUP_SCANNER_H
+#define MINIBACKUP_SCANNER_H
+
+#include "BackupEngine.h"
+#include "ChangeJournal.h"
+#include "FileCatalog.h"
+#include "ScanCache.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// ==========================================
+// 多线程目录扫描 (work-stealing)
+// ==========================================
+// 每个线程有自己的目录双端队列: 新发现的子目录压到自己队尾, 自己从队尾取 (深度优先, 局部性好);
+// 自己的队列空了就从别的线程队头偷 (偷到的是较浅的大目录, 一次偷走一大片工作)。
+// 读到的条目先攒在线程自己的清单里 (FileCatalog, 名字进各自的 arena), 扫完整块并入, 扫描过程中不争同一把锁;
+// 只有登记新发现的子目录时才短暂锁一下共用的目录表, 每个目录一次。
+// 在 NFS / 多盘阵列上, 多个目录的读取可以同时在途, 不再一个等一个。
+// Linux 上直接用 getdents64 读目录, 每个条目一次 statx 拿全类型 / 大小 / 时间,
+// 不再对同一个文件分别 file_size / last_write_time / is_xxx 多次 stat。
+
+class IgnoreMatcher;
+
+// 路径转 UTF-8 字符串 (C++20 起 u8string 返回 u8string)
+std::string pathToString(const fs::path& p);
+
+// 读取一个路径的大小 / 修改时间 / 权限
+void fillMetadata(const fs::path& fullPath, FileRecord& record);
+
+// 分阶段的筛选 (都在工作线程里调用, 必须线程安全; 为空表示不筛)
+struct ScanFilter {
+    // 1. stat 之前, 只看相对路径和文件名: 不通过的文件连 stat 都不做;
+    //    不通过的目录不收集, 但还会往下扫 (里面的文件可能通过)
+    std::function<bool(const std::string& relPath, const std::string& name)> byName;
+
+    // 2. 目录剪枝: 返回 true 的目录连同整个子树都跳过, 不会被打开 (node_modules / .git 之类)
+    std::function<bool(const std::string& relPath, const std::string& name)> pruneDir;
+
+    // 3. stat 之后: 类型 / 大小 / 时间 / 属主
+    std::function<bool(const FileRecord&)> byMetadata;
+
+    // [新增] 每个目录里要读的忽略文件名 (gitignore 语义, 见 FilterExpr.h), 空表示不读
+    // 命中的条目在所有阶段之前就跳过, 命中的目录整棵子树不扫描
+    std::string ignoreFile;
+};
+
+struct ScanStats {
+    uint64_t directories = 0; // 读过的目录数
+    uint64_t entries = 0;     // 读到的条目数 (过滤前)
+    uint64_t steals = 0;      // 从别的线程偷来的目录数
+    uint64_t errors = 0;      // 打不开的目录数 (权限等, 跳过)
+    uint64_t syscalls = 0;    // 读目录 + 取元数据的系统调用次数 (Linux 原生扫描才统计)
+    uint64_t nameSkipped = 0; // 按名字筛掉、没做 stat 的条目数
+    uint64_t pruned = 0;      // 剪掉的目录 (子树) 数
+    uint64_t ignoreFiles = 0; // 读到的忽略文件数
+    uint64_t ignored = 0;     // 被忽略文件排除的条目数 (目录算一个)
+    uint64_t cacheDirs = 0;   // 带 CACHEDIR.TAG 没往下扫的目录数
+    uint64_t nodump = 0;      // 带 nodump 属性跳过的条目数
+    uint64_t mountPoints = 0; // oneFileSystem 时没进去的挂载点数
+    uint64_t cachedDirs = 0;  // 没变、名单直接取自扫描缓存的目录数
+    uint64_t cachedStats = 0; // 信任模式 / 变动日志下沿用缓存、没做 statx 的条目数
+    bool journal = false;        // 读了变动日志
+    bool journalFull = false;    // 日志要求整棵树重扫 (或监视进程没一直在跑)
+    uint64_t journalChanges = 0; // 日志里的变动数
+};
+
+// [新增] 流式扫描的出口: 工作线程每攒一批 (或读完一个目录) 就交出去, 可以阻塞 (背压); 返回 false 让扫描尽快停下
+using ScanSink = std::function<bool(std::vector<FileRecord>&& batch)>;
+
+class Scanner {
+public:
+    explicit Scanner(const ScanOptions& options = ScanOptions());
+    ~Scanner();
+
+    // 扫描 root 下的所有条目 (不含 root 本身), 路径相对 root
+    FileCatalog scan(const fs::path& root, const ScanFilter& filter = ScanFilter());
+
+    // [新增] 流式扫描: 条目 (带 relPath / absPath) 按发现顺序分批交给 sink, 不排序也不留在内存里;
+    // 目录的条目总在它里面的条目之前交出。sink 在工作线程里调用, 扫完才返回
+    void scan(const fs::path& root, const ScanFilter& filter, const ScanSink& sink);
+
+    const ScanStats& stats() const { return stats_; }
+
+    // [新增] 不扫描整棵树, 只看 root 下的 relPath 照扫描规则会不会被扫到: 从根往下每一级都要过
+    // (缓存目录 / nodump / 忽略文件 / 剪枝 / oneFileSystem 时的挂载点; 按名字和元数据的筛选不在这里)。
+    // 变动日志驱动的增量只看日志里的路径, 用它代替逐级扫描。已经不存在的路径返回 false;
+    // descend 返回能不能往它里面扫 (挂载点和缓存目录自己照常记录, 里面的不要)
+    bool admits(const fs::path& root, const std::string& relPath, const ScanFilter& filter = ScanFilter(),
+                bool* descend = nullptr) const;
+
+private:
+    struct DirTask {
+        DirTask() = default;
+        DirTask(fs::path abs, fs::path rel, std::shared_ptr<const IgnoreMatcher> ig, bool chk,
+                FileCatalog::DirId d = FileCatalog::ROOT)
+            : absPath(std::move(abs)), relPath(std::move(rel)), ignore(std::move(ig)), checked(chk), dir(d) {}
+
+        fs::path absPath;
+        fs::path relPath; // 空 = 根目录
+        std::shared_ptr<const IgnoreMatcher> ignore; // 从根到这里的忽略规则 (父目录的那一层直接共用)
+        bool checked = false; // 父目录已经 stat 过它 (nodump / 设备号判断过了)
+        FileCatalog::DirId dir = FileCatalog::ROOT; // 在目录表里的 id, 它的条目都挂在这下面
+        DirStamp stamp;       // 父目录 stat 时顺带拿到的 inode / mtime / ctime (查扫描缓存用)
+        bool stamped = false;
+    };
+    struct Worker;
+
+    ScanOptions options_;
+    ScanStats stats_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    uint64_t rootDevice_ = 0;          // 根目录所在设备 (oneFileSystem)
+    std::atomic<uint64_t> pending_{0}; // 已入队但还没扫完的目录数, 归零即全部完成
+    FileCatalog* catalog_ = nullptr;   // 扫描期间的结果清单, 各线程共用它的目录表
+    std::mutex dirMutex_;              // 保护 catalog_ 的目录表
+    const ScanSink* sink_ = nullptr;   // 流式扫描时的出口 (此时 catalog_ 为空)
+    std::atomic<bool> stopped_{false}; // sink 要求停下: 剩下的目录出队后直接丢掉
+    std::atomic<bool> firstOut_{false}; // 第一批已经交出
+    std::shared_ptr<ScanCache> cache_;  // 设置了 options_.cacheFile 才有
+    int64_t racyAfterNs_ = 0;           // mtime / ctime 晚于这个时刻的目录可能还在变, 不记进缓存
+    std::unique_ptr<ChangeJournal> journal_; // 设置了 options_.journalFile (且用缓存) 才有
+    DirtySet dirty_;                         // 从日志里取出的变动; everything 时不信任缓存
+
+    void run(const fs::path& root, const ScanFilter& filter);
+
+    void workerLoop(size_t self, const ScanFilter& filter);
+    bool takeTask(size_t self, DirTask& task);
+    void scanOne(size_t self, const DirTask& task, const ScanFilter& filter);
+    void queueSubdirs(Worker& w, const DirTask& task, std::vector<DirTask>& subdirs);
+    void emit(Worker& w, const DirTask& task, const std::string& name, FileRecord& record);
+    void flush(Worker& w);
+    std::shared_ptr<const IgnoreMatcher> loadIgnore(Worker& w, const DirTask& task, const ScanFilter& filter, int dirFd);
+};
+
+// ==========================================
+// [新增] 边扫边取: 后台线程扫描, 经有界队列交给调用方
+// ==========================================
+// 队列满了扫描线程就等着 (背压), 所以在途的条目最多 capacity 批, 内存和目录树大小无关;
+// 第一个目录读完, 调用方就能拿到条目开始干活。没取完就析构时让扫描线程尽快停下。
+class ScanStream : public RecordSource {
+public:
+    ScanStream(const fs::path& root, ScanFilter filter, const ScanOptions& options = ScanOptions(),
+               size_t capacity = 64);
+    ~ScanStream() override;
+
+    ScanStream(const ScanStream&) = delete;
+    ScanStream& operator=(const ScanStream&) = delete;
+
+    // 取下一个条目; 扫描线程出了异常在这里重新抛出
+    bool next(FileRecord& record) override;
+
+    // next() 返回 false 之后才完整
+    const ScanStats& stats() const { return scanner_.stats(); }
+    uint64_t delivered() const { return delivered_; }
+    double firstEntryMs() const { return firstEntryMs_; } // 从开始扫描到取到第一个条目 (没有条目为 -1)
+
+private:
+    Scanner scanner_;
+    ScanFilter filter_;
+    size_t capacity_;
+
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<std::vector<FileRecord>> queue_;
+    bool done_ = false;   // 扫描线程结束
+    bool closed_ = false; // 调用方不要了
+    std::exception_ptr error_;
+
+    std::vector<FileRecord> current_; // 正在被取的一批 (只有调用方线程碰)
+    size_t pos_ = 0;
+    uint64_t delivered_ = 0;
+    std::chrono::steady_clock::time_point started_ = std::chrono::steady_clock::now();
+    double firstEntryMs_ = -1;
+
+    std::thread thread_; // 最后构造: 启动时其他成员都已就绪
+
+    bool push(std::vector<FileRecord>&& batch);
+};
+
+#endif //MINIBACKUP_SCANNER_H
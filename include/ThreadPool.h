@@ -0,0 +1,126 @@
+// include/ThreadPool.h
+#ifndef MINIBACKUP_THREADPOOL_H
+#define MINIBACKUP_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 简单的固定大小线程池: submit 返回 future, 析构时等所有任务做完
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = defaultThreads()) {
+        if (threads == 0) threads = 1;
+        for (unsigned i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    auto submit(F&& fn) -> std::future<decltype(fn())> {
+        using R = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        std::future<R> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back([task] { (*task)(); });
+        }
+        cv_.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    static unsigned defaultThreads() {
+        unsigned n = std::thread::hardware_concurrency();
+        return n ? n : 4;
+    }
+
+    // 进程内共用的线程池 (第一次用时创建, 进程退出时销毁): daemon 里每个任务不用重新开线程
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (stopping_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// 借用线程池的一批任务: 析构时等这批提交的都做完 (任务可能引用调用方的局部变量),
+// 效果和用完就析构的局部线程池一样, 但线程是共用的
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::shared()) : pool_(pool) {}
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <typename F>
+    auto submit(F&& fn) -> std::future<decltype(fn())> {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_++;
+        }
+        return pool_.submit([this, fn = std::forward<F>(fn)]() mutable {
+            struct Done {
+                TaskGroup* group;
+                ~Done() { group->finished(); }
+            } done{this};
+            return fn();
+        });
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return running_ == 0; });
+    }
+
+private:
+    ThreadPool& pool_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t running_ = 0;
+
+    void finished() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--running_ == 0) cv_.notify_all(); // 持锁通知: wait() 返回后 TaskGroup 马上就可能析构
+    }
+};
+
+#endif //MINIBACKUP_THREADPOOL_H
@@ -0,0 +1,99 @@
+// include/Watcher.h
+#ifndef MINIBACKUP_WATCHER_H
+#define MINIBACKUP_WATCHER_H
+
+#include "ChangeJournal.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ==========================================
+// 实时监视 (Linux inotify), 变动写进变动日志
+// ==========================================
+// - 递归登记: 每个目录一个 watch; 新建 / 移入的目录马上登记, 并把整棵子树记为待重扫
+//   (登记之前里面可能已经有文件了);
+// - 去抖合并: 同一路径的一串事件 (编辑器保存、日志追加) 在安静 debounceMs 之后才写一条,
+//   一直在变的路径最多攒 maxDelayMs;
+// - 分片: 根目录自己一个 inotify 实例, 顶层子目录按名字哈希分到其余实例。某个实例的事件队列溢出时
+//   只把它负责的那几棵顶层子树补登记、记为待重扫, 不用整棵树重来。
+// 启动时 (和登记完所有目录后) 各写一条 "T|" (整棵树待重扫): 没在监视的那段时间发生了什么不知道。
+// [新增] 不跨文件系统: 别的文件系统挂在下面的目录不登记 (NFS / FUSE 上别人做的修改 inotify 本来就看不到),
+// 这些子树放进水位文件 (见 ChangeJournal.h), 读取方每次都整棵重看; 启动之后才挂上去的看不到 (挂载不产生事件)。
+// 每轮读完事件后更新水位文件, 还在去抖的变动读取方也能看到。
+
+struct WatchOptions {
+    unsigned debounceMs = 500;
+    unsigned maxDelayMs = 10000;
+    unsigned shards = 8; // inotify 实例数 (至少 1)
+};
+
+struct WatchStats {
+    uint64_t directories = 0; // 当前登记的目录数
+    uint64_t events = 0;      // 收到的 inotify 事件数
+    uint64_t changes = 0;     // 合并后写进日志的变动数
+    uint64_t overflows = 0;   // 事件队列溢出次数
+    uint64_t mountPoints = 0; // 没有登记的挂载点数
+};
+
+class Watcher {
+public:
+    // journals: 同时写这几份日志 (每个读取方一份)
+    Watcher(const fs::path& root, const std::vector<fs::path>& journals, const WatchOptions& options = WatchOptions());
+    ~Watcher();
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    // 登记所有目录, 然后一直监视到 stop(); 不支持 inotify 的平台抛 std::runtime_error
+    void run();
+
+    // 可以从别的线程或信号处理函数里调用
+    void stop() { stopped_ = true; }
+
+    const WatchStats& stats() const { return stats_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Shard {
+        int fd = -1;
+        std::unordered_map<int, std::string> dirs; // watch 描述符 -> 目录相对路径
+    };
+    struct Pending {
+        char op;
+        Clock::time_point first;
+        Clock::time_point last;
+    };
+
+    fs::path root_;
+    WatchOptions options_;
+    std::vector<std::unique_ptr<ChangeJournal>> journals_;
+    std::vector<Shard> shards_;
+    std::unordered_map<std::string, Pending> pending_;
+    std::unordered_set<std::string> unwatched_; // 没登记的挂载点 (相对路径)
+    uint64_t rootDevice_ = 0;
+    bool pendingChanged_ = true;    // 上次更新水位文件之后 pending_ / unwatched_ 变过
+    Clock::time_point published_;   // 上次更新水位文件的时刻
+    std::atomic<bool> stopped_{false};
+    WatchStats stats_;
+
+    size_t shardOf(const std::string& rel) const;
+    void addTree(const std::string& rel);
+    void removeTree(const std::string& rel);
+    void readEvents(size_t shard);
+    void overflow(size_t shard);
+    void note(char op, const std::string& rel);
+    void flush(bool all);
+    void publish();
+    void journal(const std::vector<ChangeJournal::Change>& changes);
+};
+
+#endif //MINIBACKUP_WATCHER_H
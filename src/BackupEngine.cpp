@@ -1,11 +1,30 @@
 // src/BackupEngine.cpp
 #include "BackupEngine.h"
+#include "ChangeJournal.h"
 #include "CRC32.h"
+#include "Codec.h"
+#include "ByteBuffer.h"
+#include "ChunkStore.h"
+#include "ThreadPool.h"
+#include "Delta.h"
+#include "FileCopy.h"
+#include "FileCatalog.h"
+#include "FilterExpr.h"
+#include "Scanner.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <numeric>
 #include <chrono> // [新增] 用于时间转换
+#include <iomanip>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <deque>
+#include <iterator>
 
 // [修改] 移除了 sys/stat.h 等底层头文件，改用 C++ 标准库
 #ifdef _WIN32
@@ -13,49 +32,11 @@
     #define chown(path, uid, gid) 0
 #else
     #include <unistd.h>
-    #include <utime.h>
     #include <sys/stat.h>
     #include <sys/types.h>
+    #include <fcntl.h>
 #endif
 
-// ==========================================
-// 🛠️ 辅助工具
-// ==========================================
-std::string pathToString(const fs::path& p) {
-#if __cplusplus >= 202002L
-    const auto& u8str = p.u8string();
-    return std::string(u8str.begin(), u8str.end());
-#else
-    return p.u8string();
-#endif
-}
-
-// 这种方式比 stat/_wstat 更稳定，支持 Windows 中文路径
-void fillMetadata(const fs::path& fullPath, FileRecord& record) {
-    std::error_code ec; // 用于捕获错误，防止程序崩溃
-
-    // 1. 获取大小
-    record.size = fs::file_size(fullPath, ec);
-    if (ec) record.size = 0;
-
-    // 2. 获取时间 (这是最稳的写法)
-    auto ftime = fs::last_write_time(fullPath, ec);
-    if (!ec) {
-        // 将 file_time_type 转换为系统时间戳 (Unix Timestamp)
-        auto sctp = std::chrono::time_point_cast<std::chrono::seconds>(
-            ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now()
-        );
-        record.mtime = sctp.time_since_epoch().count();
-    } else {
-        record.mtime = 0;
-    }
-
-    // 3. 填充默认权限 (Windows 下无实际意义，但为了兼容性保留)
-    record.mode = 0644;
-    record.uid = 0;
-    record.gid = 0;
-}
-
 // ==========================================
 // 核心算法
 // ==========================================
@@ -92,16 +73,25 @@ void xorEncrypt(char* buffer, const size_t size, const std::string& password) {
 }
 
 // 筛选器逻辑
-bool checkFilter(const FileRecord& record, const FilterOptions& opts) {
+// 第一阶段: 只看名字和路径, 扫描时在 stat 之前调用
+bool checkNameFilter(const std::string& relPath, const std::string& fileName, const FilterOptions& opts) {
     // 1. 文件名筛选
-    if (!opts.nameContains.empty()) {
-        std::string u8fname = pathToString(fs::path(fs::u8path(record.relPath)).filename());
-        if (u8fname.find(opts.nameContains) == std::string::npos) return false;
-    }
+    if (!opts.nameContains.empty() && fileName.find(opts.nameContains) == std::string::npos) return false;
     // 2. 路径筛选
-    if (!opts.pathContains.empty()) {
-        if (record.relPath.find(opts.pathContains) == std::string::npos) return false;
-    }
+    if (!opts.pathContains.empty() && relPath.find(opts.pathContains) == std::string::npos) return false;
+    // 筛选规则: 只凭名字就能断定不选的
+    if (opts.expr && !opts.expr->mayMatch(relPath, fileName)) return false;
+    return true;
+}
+
+// 目录剪枝: 名字在 excludeDirs 里的目录, 或者命中筛选规则里 exclude 的目录, 整个不进
+bool isExcludedDir(const std::string& relPath, const std::string& dirName, const FilterOptions& opts) {
+    if (std::find(opts.excludeDirs.begin(), opts.excludeDirs.end(), dirName) != opts.excludeDirs.end()) return true;
+    return opts.expr && opts.expr->prunes(relPath, dirName);
+}
+
+// 第二阶段: stat 之后的类型 / 大小 / 时间 / 属主
+bool checkMetadataFilter(const FileRecord& record, const FilterOptions& opts) {
     // 3. 类型筛选
     if (opts.type != -1) {
         if (opts.type == 0 && record.type != FileType::REGULAR) return false;
@@ -109,8 +99,15 @@ bool checkFilter(const FileRecord& record, const FilterOptions& opts) {
         if (opts.type == 2 && record.type != FileType::SYMLINK) return false;
     }
 
+    // 筛选规则 (目录也要过, 规则里可以写 type)
+    if (opts.expr && !opts.expr->matches(record)) return false;
+
     if (record.type == FileType::DIRECTORY) return true;
 
+    // 用户筛选 (只针对文件和软链接; 目录照常保留, 别人的目录里也可能有这个用户的文件)
+    // uid 扫描时已经取到, 这里不再 stat
+    if (opts.targetUid >= 0 && record.uid != static_cast<uint32_t>(opts.targetUid)) return false;
+
     // 4. 大小筛选 (只针对文件)
     if (record.type == FileType::REGULAR) {
         // 比如 minSize=1000, size=500 -> 500 < 1000 -> false (过滤掉)
@@ -128,76 +125,984 @@ bool checkFilter(const FileRecord& record, const FilterOptions& opts) {
     return true;
 }
 
-// RLE
-void rleCompress(const std::vector<char>& input, std::vector<char>& output) {
-    if (input.empty()) return;
-    for (size_t i = 0; i < input.size(); ++i) {
-        unsigned char count = 1;
-        while (i + 1 < input.size() && input[i] == input[i+1] && count < 255) {
-            count++; i++;
+bool checkFilter(const FileRecord& record, const FilterOptions& opts) {
+    const std::string fileName = pathToString(fs::u8path(record.relPath).filename());
+    return checkNameFilter(record.relPath, fileName, opts) && checkMetadataFilter(record, opts);
+}
+
+// ==========================================
+// 包格式辅助 (固实模式 / 中央索引)
+// ==========================================
+// 文件头第 9 字节: 低 4 位是压缩算法, 高位是格式标志
+constexpr uint8_t PACK_FLAG_RLE   = 0x01;
+constexpr uint8_t PACK_FLAG_LZ77  = 0x02;
+constexpr uint8_t PACK_FLAG_SOLID = 0x10;
+constexpr uint8_t PACK_FLAG_DICT  = 0x20; // 标志字节后跟 [字典长度 4][字典]
+constexpr uint8_t PACK_FLAG_BASE  = 0x40; // 差量包: (字典之后) [基准指纹 4][基准文件名长度 2][基准文件名]
+
+// 差量包的条目存储方式 (索引里每个条目多出 [方式 1][基准条目号 8][载荷长度 8])
+constexpr uint8_t ENTRY_DATA  = 0; // 数据在本包的块里
+constexpr uint8_t ENTRY_REF   = 1; // 与基准包的某个条目完全相同
+constexpr uint8_t ENTRY_DELTA = 2; // 本包的块里存的是相对基准条目的差量
+
+// 基准链最多这么深 (防止包互相引用死循环)
+constexpr int MAX_BASE_CHAIN = 64;
+
+// 比这小的改动文件直接存全量, 不值得算差量
+constexpr uint64_t PACK_DELTA_MIN_SIZE = 4u << 10;
+
+// 没有数据块的条目 (目录 / 空文件)
+constexpr uint32_t NO_BLOCK = 0xFFFFFFFF;
+
+// 包尾: [索引偏移 8][索引长度 8][魔数 8]
+const char SOLID_TAIL_MAGIC[8] = {'M', 'B', 'K', 'I', 'N', 'D', 'E', 'X'};
+
+struct SolidBlock {
+    uint64_t offset = 0;     // 块在包内的偏移
+    uint64_t storedSize = 0; // 压缩+加密后的长度
+    uint64_t rawSize = 0;    // 解压后的长度
+    uint32_t crc = 0;        // 压缩后 (加密前) 数据的 CRC
+};
+
+struct SolidEntry {
+    uint8_t typeCode = 0;
+    std::string relPath;
+    uint32_t blockId = NO_BLOCK;
+    uint64_t offset = 0;     // 在解压后块内的偏移
+    uint64_t size = 0;
+    uint32_t crc = 0;        // 原始内容的 CRC
+    uint32_t mode = 0;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    int64_t mtime = 0;
+
+    // 差量包才有
+    uint8_t storage = ENTRY_DATA;
+    uint64_t baseIndex = 0;   // 基准包里的条目号
+    uint64_t payloadSize = 0; // 块里存的字节数 (差量条目是差量长度)
+};
+
+// 每个块 / 索引用独立的密钥流, 这样可以单独解密任意一块
+void cipherSection(std::vector<char>& data, EncryptionMode encMode,
+                   const std::string& password, const std::string& section) {
+    if (password.empty() || data.empty()) return;
+    if (encMode == EncryptionMode::RC4) {
+        RC4 rc4;
+        rc4.init(password + "#" + section);
+        rc4.cipher(data.data(), data.size());
+    } else if (encMode == EncryptionMode::XOR) {
+        xorEncrypt(data.data(), data.size(), password);
+    }
+}
+
+// 解析后的包头
+struct PackHeader {
+    EncryptionMode encMode = EncryptionMode::NONE;
+    CompressionMode compMode = CompressionMode::NONE;
+    uint8_t flags = 0;
+    std::string dict; // 训练好的共享字典 (可能为空)
+
+    // 差量包的基准包 (文件名 + 索引指纹)
+    std::string baseName;
+    uint32_t baseFingerprint = 0;
+};
+
+char compressionFlag(CompressionMode compMode) {
+    if (compMode == CompressionMode::RLE) return PACK_FLAG_RLE;
+    if (compMode == CompressionMode::LZ77) return PACK_FLAG_LZ77;
+    return 0;
+}
+
+// 写包头: 魔数 + 标志字节 (+ 字典) (+ 基准包)
+void writePackHeader(std::ofstream& out, EncryptionMode encMode, CompressionMode compMode,
+                     uint8_t extraFlags, const std::string& password, const std::string& dict,
+                     const std::string& baseName = "", uint32_t baseFingerprint = 0) {
+    if (encMode == EncryptionMode::RC4) out.write("MINIBK_R", 8);
+    else if (encMode == EncryptionMode::XOR) out.write("MINIBK_X", 8);
+    else out.write("MINIBK10", 8);
+
+    if (!dict.empty()) extraFlags |= PACK_FLAG_DICT;
+    char compFlag = static_cast<char>(compressionFlag(compMode) | extraFlags);
+    out.write(&compFlag, 1);
+
+    if (!dict.empty()) {
+        std::vector<char> dictData(dict.begin(), dict.end());
+        cipherSection(dictData, encMode, password, "dict");
+        auto dictSize = static_cast<uint32_t>(dictData.size());
+        out.write(reinterpret_cast<const char*>(&dictSize), 4);
+        out.write(dictData.data(), dictData.size());
+    }
+
+    if (extraFlags & PACK_FLAG_BASE) {
+        std::vector<char> name(baseName.begin(), baseName.end());
+        cipherSection(name, encMode, password, "base");
+        auto nameSize = static_cast<uint16_t>(name.size());
+        out.write(reinterpret_cast<const char*>(&baseFingerprint), 4);
+        out.write(reinterpret_cast<const char*>(&nameSize), 2);
+        out.write(name.data(), name.size());
+    }
+}
+
+// 读包头: 魔数 (识别加密模式) + 标志字节 (+ 字典)
+PackHeader readPackHeader(std::ifstream& in, const std::string& password) {
+    char magic[9] = {0};
+    in.read(magic, 8);
+    std::string magicStr(magic);
+
+    PackHeader header;
+    if (magicStr == "MINIBK_R") header.encMode = EncryptionMode::RC4;
+    else if (magicStr == "MINIBK_X") header.encMode = EncryptionMode::XOR;
+    else if (magicStr != "MINIBK10") throw std::runtime_error("Unknown file format");
+
+    char compFlag = 0;
+    in.read(&compFlag, 1);
+    header.flags = static_cast<uint8_t>(compFlag);
+    if ((header.flags & 0x0F) == PACK_FLAG_RLE) header.compMode = CompressionMode::RLE;
+    else if ((header.flags & 0x0F) == PACK_FLAG_LZ77) header.compMode = CompressionMode::LZ77;
+
+    if (header.flags & PACK_FLAG_DICT) {
+        uint32_t dictSize = 0;
+        in.read(reinterpret_cast<char*>(&dictSize), 4);
+        if (!in || dictSize > LZ_WINDOW) throw std::runtime_error("Corrupted pack header");
+        std::vector<char> dictData(dictSize);
+        in.read(dictData.data(), dictSize);
+        cipherSection(dictData, header.encMode, password, "dict");
+        header.dict.assign(dictData.begin(), dictData.end());
+    }
+
+    if (header.flags & PACK_FLAG_BASE) {
+        uint16_t nameSize = 0;
+        in.read(reinterpret_cast<char*>(&header.baseFingerprint), 4);
+        in.read(reinterpret_cast<char*>(&nameSize), 2);
+        std::vector<char> name(nameSize);
+        in.read(name.data(), nameSize);
+        if (!in) throw std::runtime_error("Corrupted pack header");
+        cipherSection(name, header.encMode, password, "base");
+        header.baseName.assign(name.begin(), name.end());
+    }
+    return header;
+}
+
+// 按压缩模式压缩 / 解压 (字典只对 LZ77 有效)
+void compressData(CompressionMode compMode, std::vector<char>& data, const std::string& dict) {
+    if (data.empty() || compMode == CompressionMode::NONE) return;
+    std::vector<char> compressed;
+    if (compMode == CompressionMode::RLE) rleCompress(data, compressed);
+    else lzCompress(data, compressed, dict);
+    data.swap(compressed);
+}
+
+void decompressData(CompressionMode compMode, std::vector<char>& data, const std::string& dict) {
+    if (data.empty() || compMode == CompressionMode::NONE) return;
+    std::vector<char> dec;
+    if (compMode == CompressionMode::RLE) rleDecompress(data, dec);
+    else lzDecompress(data, dec, dict);
+    data.swap(dec);
+}
+
+// 打包统计
+void printPackStats(uint64_t rawBytes, uint64_t storedBytes) {
+    double ratio = storedBytes ? static_cast<double>(rawBytes) / storedBytes : 1.0;
+    std::cout << "[Pack] Raw: " << rawBytes << " bytes -> Stored: " << storedBytes
+              << " bytes (ratio " << std::fixed << std::setprecision(2) << ratio << "x)" << std::endl;
+}
+
+std::string formatMillis(double ms) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(ms < 10 ? 2 : 0) << ms << " ms";
+    return out.str();
+}
+
+// 读取一个条目的原始内容 (普通文件读数据, 软链接存目标路径)
+std::vector<char> loadEntryData(const FileRecord& rec) {
+    std::vector<char> fileData;
+    if (rec.type == FileType::REGULAR) {
+        std::ifstream inFile(fs::u8path(rec.absPath), std::ios::binary);
+        if (inFile) {
+            fileData.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
         }
-        output.push_back(static_cast<char>(count));
-        output.push_back(input[i]);
+    } else if (rec.type == FileType::SYMLINK) {
+        fileData.assign(rec.linkTarget.begin(), rec.linkTarget.end());
     }
+    return fileData;
 }
 
-void rleDecompress(const std::vector<char>& input, std::vector<char>& output) {
-    if (input.empty()) return;
-    for (size_t i = 0; i < input.size(); i += 2) {
-        if (i + 1 >= input.size()) break;
-        const auto count = static_cast<unsigned char>(input[i]);
-        char value = input[i+1];
-        for (int k = 0; k < count; ++k) output.push_back(value);
+// 流式包的条目头: [类型 1][路径长度 8][路径][数据长度 8][CRC 4][mode 4][uid 4][gid 4][mtime 8]
+constexpr size_t ENTRY_META_FIXED_SIZE = 1 + 8 + 8 + 4 + 20;
+
+std::vector<char> entryMetadata(const FileRecord& rec, uint64_t dataSize, uint32_t crc) {
+    std::vector<char> meta;
+    meta.reserve(ENTRY_META_FIXED_SIZE + rec.relPath.size());
+    const uint8_t typeCode = (rec.type == FileType::REGULAR ? 1 : (rec.type == FileType::DIRECTORY ? 2 : 3));
+    appendPod(meta, typeCode);
+    appendPod(meta, static_cast<uint64_t>(rec.relPath.size()));
+    meta.insert(meta.end(), rec.relPath.begin(), rec.relPath.end());
+    appendPod(meta, dataSize);
+    appendPod(meta, crc);
+    appendPod(meta, rec.mode);
+    appendPod(meta, rec.uid);
+    appendPod(meta, rec.gid);
+    appendPod(meta, rec.mtime);
+    return meta;
+}
+
+void applyMetadata(const fs::path& fullPath, uint32_t f_mode, uint32_t f_uid, uint32_t f_gid, int64_t f_mtime,
+                   uint32_t f_mtimeNsec = 0);
+
+// [新增] 目录的权限 / 属主 / 时间留到最后再设: 之后往里写文件会改掉目录的 mtime, 只读目录还会挡住后面的写入。
+// 这样包里条目的先后 (扫描顺序 / 按物理位置排的读取顺序) 对还原结果没有影响
+class DeferredDirs {
+public:
+    void add(fs::path path, uint32_t mode, uint32_t uid, uint32_t gid, int64_t mtime) {
+        dirs_.push_back({std::move(path), mode, uid, gid, mtime});
+    }
+
+    // 深的先设: 父目录先变成不可进入的话, 里面的就设不了了
+    void apply() {
+        std::sort(dirs_.begin(), dirs_.end(), [](const Dir& a, const Dir& b) {
+            return std::distance(a.path.begin(), a.path.end()) > std::distance(b.path.begin(), b.path.end());
+        });
+        for (const auto& d : dirs_) applyMetadata(d.path, d.mode, d.uid, d.gid, d.mtime);
+        dirs_.clear();
+    }
+
+private:
+    struct Dir {
+        fs::path path;
+        uint32_t mode, uid, gid;
+        int64_t mtime;
+    };
+    std::vector<Dir> dirs_;
+};
+
+// 还原一个条目 (创建目录 / 软链接 / 写文件) 并恢复元数据; 给了 dirs 时目录的元数据推迟到 dirs.apply()
+void restoreEntry(const fs::path& fullPath, uint8_t typeCode, const std::vector<char>& fileData,
+                  uint32_t f_mode, uint32_t f_uid, uint32_t f_gid, int64_t f_mtime, DeferredDirs* dirs = nullptr) {
+    if (typeCode == 2) {
+        fs::create_directories(fullPath);
+        if (dirs) {
+            dirs->add(fullPath, f_mode, f_uid, f_gid, f_mtime);
+            return;
+        }
+    } else if (typeCode == 3) {
+        std::string target(fileData.begin(), fileData.end());
+        if (fullPath.has_parent_path()) fs::create_directories(fullPath.parent_path());
+        if (fs::exists(fullPath) || fs::is_symlink(fullPath)) fs::remove(fullPath);
+        try { fs::create_symlink(target, fullPath); } catch(...) {}
+    } else if (typeCode == 1) {
+        if (fullPath.has_parent_path()) fs::create_directories(fullPath.parent_path());
+        std::ofstream outFile(fullPath, std::ios::binary);
+        outFile.write(fileData.data(), fileData.size());
     }
+
+    applyMetadata(fullPath, f_mode, f_uid, f_gid, f_mtime);
 }
 
+// 恢复权限 / 属主 / 修改时间 (软链接只改链接本身, 不能 chmod 穿到目标上)
+void applyMetadata(const fs::path& fullPath, uint32_t f_mode, uint32_t f_uid, uint32_t f_gid, int64_t f_mtime,
+                   uint32_t f_mtimeNsec) {
+    try {
+#ifdef _WIN32
+        struct __utimbuf64 new_times{}; // 双下划线
+        new_times.actime = f_mtime;
+        new_times.modtime = f_mtime;
+        _wutime64(fullPath.c_str(), &new_times);
+#else
+        struct stat st{};
+        const bool isLink = ::lstat(fullPath.c_str(), &st) == 0 && S_ISLNK(st.st_mode);
+        // 先改属主再改权限: chown 会清掉 setuid/setgid 位; 非 root 时 chown 失败, 忽略
+        if (isLink) {
+            (void)::lchown(fullPath.c_str(), f_uid, f_gid);
+        } else {
+            (void)::chown(fullPath.c_str(), f_uid, f_gid);
+            ::chmod(fullPath.c_str(), f_mode & 07777);
+        }
+        struct timespec times[2];
+        times[0].tv_sec = f_mtime;
+        times[0].tv_nsec = f_mtimeNsec;
+        times[1] = times[0];
+        ::utimensat(AT_FDCWD, fullPath.c_str(), times, AT_SYMLINK_NOFOLLOW);
+#endif
+    } catch (...) {}
+}
+
+// ==========================================
+// 固实包读取 (中央索引 + 按块解码; 差量包沿基准链取数据)
+// ==========================================
+class SolidReader {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // depth: 在基准链中的深度, 超过 MAX_BASE_CHAIN 说明包之间互相引用
+    SolidReader(const fs::path& packPath, const std::string& password, int depth = 0)
+        : path_(packPath), password_(password), depth_(depth) {
+        in_.open(packPath, std::ios::binary);
+        if (!in_.is_open()) throw std::runtime_error("Cannot open pack file: " + pathToString(packPath));
+        header_ = readPackHeader(in_, password);
+        if (!(header_.flags & PACK_FLAG_SOLID)) {
+            throw std::runtime_error("Not a solid pack (-solid): " + pathToString(packPath));
+        }
+        loadIndex();
+    }
+
+    const PackHeader& header() const { return header_; }
+    const std::vector<SolidEntry>& entries() const { return entries_; }
+
+    // 存储的 (加密后) 索引的 CRC, 差量包用它确认找到的基准包没被换掉
+    uint32_t fingerprint() const { return fingerprint_; }
+
+    size_t find(const std::string& relPath) const {
+        auto it = byPath_.find(relPath);
+        return it == byPath_.end() ? npos : it->second;
+    }
+
+    // 条目的原始内容 (引用 / 差量条目到基准包里取)
+    std::vector<char> readEntry(size_t id) {
+        if (id >= entries_.size()) throw std::runtime_error("Corrupted pack index");
+        const SolidEntry& e = entries_[id];
+
+        std::vector<char> data;
+        if (e.storage == ENTRY_REF) {
+            data = base().readEntry(e.baseIndex);
+        } else {
+            std::vector<char> payload;
+            if (e.blockId != NO_BLOCK) {
+                const auto& blockData = loadBlock(e.blockId);
+                if (e.offset + e.payloadSize > blockData.size()) throw std::runtime_error("Corrupted pack index");
+                payload.assign(blockData.begin() + e.offset, blockData.begin() + e.offset + e.payloadSize);
+            }
+            if (e.storage == ENTRY_DELTA) data = applyBinaryDelta(base().readEntry(e.baseIndex), payload);
+            else data.swap(payload);
+        }
+
+        if (data.size() != e.size) throw std::runtime_error("Corrupted pack entry: " + e.relPath);
+        if (!data.empty() && CRC32::calculate(data.data(), data.size()) != e.crc) {
+            std::cerr << "[Error] CRC Mismatch: " << e.relPath << std::endl;
+        }
+        return data;
+    }
+
+private:
+    fs::path path_;
+    std::string password_;
+    int depth_;
+    std::ifstream in_;
+    PackHeader header_;
+    uint32_t fingerprint_ = 0;
+    std::vector<SolidBlock> blocks_;
+    std::vector<SolidEntry> entries_;
+    std::unordered_map<std::string, size_t> byPath_;
+    std::unique_ptr<SolidReader> base_;
+
+    // 一次只缓存一个解码后的块 (同一块的成员在索引里是连续的)
+    uint32_t cachedId_ = NO_BLOCK;
+    std::vector<char> cached_;
+
+    void loadIndex() {
+        in_.seekg(0, std::ios::end);
+        const auto fileSize = static_cast<uint64_t>(in_.tellg());
+        if (fileSize < 9 + 24) throw std::runtime_error("Corrupted pack file");
+
+        std::vector<char> tail(24);
+        in_.seekg(static_cast<std::streamoff>(fileSize - 24));
+        in_.read(tail.data(), 24);
+        if (std::memcmp(tail.data() + 16, SOLID_TAIL_MAGIC, 8) != 0) throw std::runtime_error("Missing pack index");
+
+        size_t pos = 0;
+        const auto indexOffset = readPod<uint64_t>(tail, pos);
+        const auto indexSize = readPod<uint64_t>(tail, pos);
+        if (indexOffset + indexSize + 24 > fileSize) throw std::runtime_error("Corrupted pack index");
+
+        std::vector<char> index(indexSize);
+        in_.seekg(static_cast<std::streamoff>(indexOffset));
+        in_.read(index.data(), indexSize);
+        fingerprint_ = CRC32::calculate(index.data(), index.size());
+        cipherSection(index, header_.encMode, password_, "idx");
+
+        pos = 0;
+        blocks_.resize(readPod<uint32_t>(index, pos));
+        for (auto& blk : blocks_) {
+            blk.offset = readPod<uint64_t>(index, pos);
+            blk.storedSize = readPod<uint64_t>(index, pos);
+            blk.rawSize = readPod<uint64_t>(index, pos);
+            blk.crc = readPod<uint32_t>(index, pos);
+        }
+
+        const bool hasBase = header_.flags & PACK_FLAG_BASE;
+        const auto entryCount = readPod<uint64_t>(index, pos);
+        for (uint64_t n = 0; n < entryCount; ++n) {
+            SolidEntry e;
+            e.typeCode = readPod<uint8_t>(index, pos);
+            const auto pathLen = readPod<uint64_t>(index, pos);
+            if (pathLen > index.size() - pos) throw std::runtime_error("Corrupted pack index");
+            e.relPath.assign(index.data() + pos, pathLen);
+            pos += pathLen;
+            e.blockId = readPod<uint32_t>(index, pos);
+            e.offset = readPod<uint64_t>(index, pos);
+            e.size = readPod<uint64_t>(index, pos);
+            e.crc = readPod<uint32_t>(index, pos);
+            e.mode = readPod<uint32_t>(index, pos);
+            e.uid = readPod<uint32_t>(index, pos);
+            e.gid = readPod<uint32_t>(index, pos);
+            e.mtime = readPod<int64_t>(index, pos);
+            e.payloadSize = e.size;
+            if (hasBase) {
+                e.storage = readPod<uint8_t>(index, pos);
+                e.baseIndex = readPod<uint64_t>(index, pos);
+                e.payloadSize = readPod<uint64_t>(index, pos);
+                if (e.storage > ENTRY_DELTA) throw std::runtime_error("Corrupted pack index");
+            }
+            byPath_.emplace(e.relPath, entries_.size());
+            entries_.push_back(std::move(e));
+        }
+    }
+
+    const std::vector<char>& loadBlock(uint32_t id) {
+        if (id == cachedId_) return cached_;
+        if (id >= blocks_.size()) throw std::runtime_error("Corrupted pack index");
+        const auto& blk = blocks_[id];
+
+        std::vector<char> stored(blk.storedSize);
+        in_.seekg(static_cast<std::streamoff>(blk.offset));
+        in_.read(stored.data(), blk.storedSize);
+        cipherSection(stored, header_.encMode, password_, "blk" + std::to_string(id));
+
+        if (CRC32::calculate(stored.data(), stored.size()) != blk.crc) {
+            std::cerr << "[Error] CRC Mismatch: block " << id << std::endl;
+        }
+
+        decompressData(header_.compMode, stored, header_.dict);
+        cached_.swap(stored);
+        cachedId_ = id;
+        return cached_;
+    }
+
+    // 基准包和本包放在同一目录下, 按包头里记的文件名找
+    SolidReader& base() {
+        if (base_) return *base_;
+        if (!(header_.flags & PACK_FLAG_BASE)) throw std::runtime_error("Corrupted pack index");
+        if (depth_ + 1 >= MAX_BASE_CHAIN) throw std::runtime_error("Base pack chain too deep");
+
+        const fs::path basePath = path_.parent_path() / fs::u8path(header_.baseName);
+        if (!fs::exists(basePath)) throw std::runtime_error("Base pack not found: " + pathToString(basePath));
+        base_ = std::make_unique<SolidReader>(basePath, password_, depth_ + 1);
+        if (base_->fingerprint() != header_.baseFingerprint) {
+            base_.reset();
+            throw std::runtime_error("Base pack does not match: " + pathToString(basePath));
+        }
+        return *base_;
+    }
+};
+
 // ==========================================
 // 业务逻辑 (Backup, Restore, Verify)
 // ==========================================
 
-// 1. 基础备份 (支持单文件)
-void BackupEngine::backup(const std::string& srcPath, const std::string& destPath) {
+// index.txt 每行: "相对路径|CRC|大小|mtime(ns)|ctime(ns)|inode"
+// 旧版只有 "相对路径|CRC"; 路径里可能有 '|', 所以从右往左拆
+struct ManifestEntry {
+    std::string crc;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    int64_t ctimeNs = 0;
+    uint64_t ino = 0;
+    bool hasStamp = false; // 旧版清单没有后四列, 不能用来判断是否变化
+};
+
+static bool parseManifestLine(const std::string& line, std::string& relPath, ManifestEntry& entry) {
+    std::vector<size_t> bars;
+    for (size_t pos = line.rfind('|'); pos != std::string::npos && bars.size() < 5;
+         pos = (pos == 0) ? std::string::npos : line.rfind('|', pos - 1)) {
+        bars.push_back(pos);
+    }
+    if (bars.empty()) return false;
+
+    try {
+        if (bars.size() == 5) {
+            // bars 从右往左: [inode 前, ctime 前, mtime 前, 大小前, CRC 前]
+            relPath = line.substr(0, bars[4]);
+            entry.crc = line.substr(bars[4] + 1, bars[3] - bars[4] - 1);
+            entry.size = std::stoull(line.substr(bars[3] + 1, bars[2] - bars[3] - 1));
+            entry.mtimeNs = std::stoll(line.substr(bars[2] + 1, bars[1] - bars[2] - 1));
+            entry.ctimeNs = std::stoll(line.substr(bars[1] + 1, bars[0] - bars[1] - 1));
+            entry.ino = std::stoull(line.substr(bars[0] + 1));
+            entry.hasStamp = true;
+            return true;
+        }
+    } catch (...) {}
+
+    // 旧格式 (或者后四列坏了): 只要最后一个 '|' 后的 CRC
+    relPath = line.substr(0, bars[0]);
+    entry.crc = line.substr(bars[0] + 1);
+    entry.hasStamp = false;
+    return true;
+}
+
+// 判断文件是否变化用的 stat 信息 (Windows 下没有 ctime / inode, 只比较大小和 mtime)
+struct FileStamp {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    int64_t ctimeNs = 0;
+    uint64_t ino = 0;
+};
+
+static bool statStamp(const fs::path& path, FileStamp& stamp) {
+#ifdef _WIN32
+    std::error_code ec;
+    stamp.size = fs::file_size(path, ec);
+    if (ec) return false;
+    auto ftime = fs::last_write_time(path, ec);
+    if (ec) return false;
+    stamp.mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(ftime.time_since_epoch()).count();
+    return true;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    stamp.size = static_cast<uint64_t>(st.st_size);
+    stamp.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    stamp.ctimeNs = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+    stamp.ino = static_cast<uint64_t>(st.st_ino);
+    return true;
+#endif
+}
+
+// [新增] 扫描清单里已经有的 stat 结果 (statx 一次取全), 不用再 stat 一遍;
+// Windows 的扫描器给的是 Unix 秒, 和 statStamp 的时钟不同, 照旧 stat
+static bool catalogStamp(const FileCatalog& files, size_t i, FileStamp& stamp) {
+#ifdef _WIN32
+    (void)files;
+    (void)i;
+    (void)stamp;
+    return false;
+#else
+    stamp.size = files.fileSize(i);
+    stamp.mtimeNs = files.mtime(i) * 1000000000 + files.mtimeNsec(i);
+    stamp.ctimeNs = files.ctime(i) * 1000000000 + files.ctimeNsec(i);
+    stamp.ino = files.ino(i);
+    return true;
+#endif
+}
+
+// 备份目录里存放内部数据 (块签名等) 的子目录, 还原时跳过
+const char* const BACKUP_META_DIR = ".minibackup";
+
+static fs::path signaturePath(const fs::path& destination, const std::string& relPath) {
+    return destination / BACKUP_META_DIR / "sig" / (SHA256::toHex(SHA256::hash(relPath.data(), relPath.size())) + ".sig");
+}
+
+// [新增] 清单里哪些行来自软链接 (镜像备份复制的是目标的内容), 一行一个相对路径
+// 链接的目标变了 (可能在源目录之外) 链接自己不会有事件, 按变动日志增量时这些行每次都要重新看
+static fs::path linkListPath(const fs::path& destination) {
+    return destination / BACKUP_META_DIR / "links.txt";
+}
+
+// 差量更新一个备份副本, 返回新内容的 CRC
+// 副本只被这一处引用时就地改写 (只写变化的块); 是硬链接 (和旧快照共用) 时写到临时文件再替换
+static std::string deltaCopyFile(const fs::path& source, const fs::path& target, const fs::path& sigPath,
+                                 DeltaStats& stats) {
+    FileStamp targetStamp;
+    if (!statStamp(target, targetStamp)) throw std::runtime_error("Cannot stat " + target.string());
+
+    // 1. 旧副本的签名: 有效就直接用, 否则读一遍副本重算
+    FileSignature base;
+    if (!FileSignature::load(sigPath, targetStamp.size, targetStamp.mtimeNs, base)) {
+        std::ifstream old(target, std::ios::binary);
+        if (!old) throw std::runtime_error("Cannot open " + target.string());
+        base = computeSignature(old, FileSignature::chooseBlockSize(targetStamp.size));
+    }
+
+    std::ifstream in(source, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + source.string());
+
+    const bool inPlace = fs::hard_link_count(target) == 1;
+    const fs::path outPath = inPlace ? target : fs::path(target.string() + ".delta.tmp");
+    std::fstream out;
+    std::ifstream oldCopy;
+    if (inPlace) {
+        out.open(outPath, std::ios::binary | std::ios::in | std::ios::out);
+    } else {
+        out.open(outPath, std::ios::binary | std::ios::out | std::ios::trunc);
+        oldCopy.open(target, std::ios::binary);
+    }
+    if (!out) throw std::runtime_error("Cannot write " + outPath.string());
+    std::istream& oldData = inPlace ? static_cast<std::istream&>(out) : oldCopy;
+
+    // 2. 读新版本: 顺便算 CRC 和新签名, 差量操作直接落到目标文件
+    uint32_t crc = 0;
+    SignatureBuilder nextSig(FileSignature::chooseBlockSize(fs::file_size(source)));
+    std::vector<char> block;
+    DeltaSink sink;
+    sink.copy = [&](uint64_t src, uint64_t len, uint64_t dst) {
+        if (inPlace && src == dst) return; // 原地没变, 一个字节都不用写
+        block.resize(len);
+        oldData.clear();
+        oldData.seekg(static_cast<std::streamoff>(src));
+        oldData.read(block.data(), static_cast<std::streamsize>(len));
+        if (!oldData) throw std::runtime_error("Short read from " + target.string());
+        out.seekp(static_cast<std::streamoff>(dst));
+        out.write(block.data(), static_cast<std::streamsize>(len));
+    };
+    sink.literal = [&](const char* data, size_t size, uint64_t dst) {
+        out.seekp(static_cast<std::streamoff>(dst));
+        out.write(data, static_cast<std::streamsize>(size));
+    };
+    stats = encodeDelta(base, in, sink, inPlace, [&](const char* data, size_t size) {
+        crc = CRC32::update(crc, data, size);
+        nextSig.update(data, size);
+    });
+    FileSignature sig = nextSig.finish();
+
+    out.close();
+    oldCopy.close();
+    if (!out) throw std::runtime_error("Write failed: " + outPath.string());
+    // 新版本变短时截掉尾巴
+    if (fs::file_size(outPath) != sig.fileSize) fs::resize_file(outPath, sig.fileSize);
+    if (!inPlace) {
+        fs::remove(target);
+        fs::rename(outPath, target);
+    }
+
+    // 3. 存下新副本的签名
+    FileStamp newStamp;
+    if (statStamp(target, newStamp)) sig.save(sigPath, newStamp.mtimeNs);
+    return CRC32::toHex(crc);
+}
+
+// 1. 基础备份 (支持单文件; 增量模式只复制变化的文件)
+void BackupEngine::backup(const std::string& srcPath, const std::string& destPath, const BackupOptions& options) {
     fs::path source = fs::u8path(srcPath);
     fs::path destination = fs::u8path(destPath);
 
     if (!fs::exists(source)) throw std::runtime_error("Source not found");
     if (!fs::exists(destination)) fs::create_directories(destination);
 
-    std::ofstream indexFile(destination / "index.txt");
+    // 比较基准: 默认是目标目录自己上次的清单; link-dest 模式下是旧快照目录
+    const bool linkMode = !options.linkDest.empty();
+    const bool incremental = options.incremental || linkMode;
+    const fs::path baseDir = linkMode ? fs::u8path(options.linkDest) : destination;
+    if (linkMode) {
+        if (!fs::exists(baseDir / "index.txt")) throw std::runtime_error("link-dest has no index.txt: " + options.linkDest);
+        if (fs::equivalent(baseDir, destination)) throw std::runtime_error("link-dest must differ from destination");
+    }
+
+    // 上次的清单 (增量模式才读)
+    std::unordered_map<std::string, ManifestEntry> previous;
+    if (incremental) {
+        std::ifstream oldIndex(baseDir / "index.txt");
+        std::string line, rel;
+        while (std::getline(oldIndex, line)) {
+            ManifestEntry entry;
+            if (!line.empty() && parseManifestLine(line, rel, entry)) previous[rel] = entry;
+        }
+    }
+
+    // [新增] 变动日志: 只处理日志里提到的路径, 上次清单里其余的行原样沿用
+    // 日志要求整棵重扫、监视进程没一直在跑、或者没有上次的清单可沿用时, 照常全部扫描
+    std::unique_ptr<ChangeJournal> journal;
+    DirtySet dirty;
+    std::unordered_set<std::string> previousLinks;
+    if (!options.journal.empty() && options.incremental && !linkMode && fs::is_directory(source)) {
+        journal = std::make_unique<ChangeJournal>(fs::u8path(options.journal));
+        dirty = journal->take();
+        const bool oldFormat = std::any_of(previous.begin(), previous.end(), [](const auto& p) { return !p.second.hasStamp; });
+        std::ifstream links(linkListPath(destination));
+        for (std::string line; std::getline(links, line);) {
+            if (!line.empty()) previousLinks.insert(line);
+        }
+        // 没有链接名单 (旧版本的备份) 就分不出哪些行是软链接, 只能整棵重扫一次
+        if (previous.empty() || oldFormat || !links.is_open()) dirty.everything = true;
+        if (dirty.everything) {
+            std::cout << "[Journal] Full rescan (requested by the journal, or watcher not running / stalled)" << std::endl;
+        } else {
+            const auto now = std::chrono::system_clock::now().time_since_epoch();
+            const int64_t lagNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() - dirty.watermarkNs;
+            std::cout << "[Journal] " << dirty.size() << " changed paths (watcher state as of " << formatMillis(lagNs / 1e6)
+                      << " ago; later changes go to the next run)" << std::endl;
+        }
+    }
+    const bool useJournal = journal && !dirty.everything;
+
+    // 新清单先写临时文件, 完成后替换, 中途失败不会丢掉上次的清单
+    const fs::path indexPath = destination / "index.txt";
+    const fs::path tmpIndexPath = destination / "index.txt.tmp";
+    std::ofstream indexFile(tmpIndexPath);
     if (!indexFile.is_open()) throw std::runtime_error("Cannot create index file");
 
+    // 内核复制 (reflink 等) 的数据不经过用户态, CRC 交给后台线程读源文件算; 清单在最后统一写
+    struct ManifestRow {
+        std::string rel;
+        std::string crc;
+        std::future<std::string> pendingCrc;
+        FileStamp stamp;
+        bool link = false; // 源是软链接
+    };
+    std::vector<ManifestRow> rows;
+    TaskGroup hashPool;
+    CopyStats copyStats;
+
     std::cout << "Scanning and backing up..." << std::endl;
-    int successCount = 0;
+    int successCount = 0, copiedCount = 0, unchangedCount = 0, linkedCount = 0, removedCount = 0;
+    uint64_t deltaMatched = 0, deltaWritten = 0;
 
-    auto processOneFile = [&](const fs::path& filePath, const fs::path& relPath) {
+    // known: 扫描时已经拿到的 stat 结果 (没有就自己 stat, 软链接要看目标的)
+    auto processOneFile = [&](const fs::path& filePath, const fs::path& relPath, bool isLink,
+                              const FileStamp* known = nullptr) {
+        const std::string rel = pathToString(relPath);
         fs::path targetPath = destination / relPath;
-        if (targetPath.has_parent_path()) fs::create_directories(targetPath.parent_path());
-        fs::copy_file(filePath, targetPath, fs::copy_options::overwrite_existing);
+        FileStamp stamp;
+        const bool haveStamp = known ? (stamp = *known, true) : statStamp(filePath, stamp);
+
+        // 只比源文件的 stat 和上次清单, 不再 stat 备份副本 (副本被人动过由 verify 检查)
+        std::string checksum;
+        auto it = previous.find(rel);
+        if (incremental && haveStamp && it != previous.end()) {
+            const ManifestEntry& old = it->second;
+            if (old.hasStamp && old.size == stamp.size && old.mtimeNs == stamp.mtimeNs &&
+                old.ctimeNs == stamp.ctimeNs && old.ino == stamp.ino) {
+                checksum = old.crc; // 没变: 不复制, 沿用上次的 CRC
+            }
+        }
+        if (incremental) previous.erase(rel);
+
+        // 目标可能是指向旧快照的硬链接: 先删掉再写, 不能写穿到旧快照里
+        auto replaceTarget = [&] {
+            if (targetPath.has_parent_path()) fs::create_directories(targetPath.parent_path());
+            std::error_code ec;
+            if (fs::is_symlink(targetPath, ec) || fs::exists(targetPath, ec)) fs::remove(targetPath, ec);
+        };
+
+        if (!checksum.empty()) {
+            if (linkMode) {
+                replaceTarget();
+                std::error_code ec;
+                fs::create_hard_link(baseDir / relPath, targetPath, ec);
+                // 跨文件系统、旧快照里的副本没了等情况链不上: 下面照常从源文件复制
+                if (ec) checksum.clear();
+                else linkedCount++;
+            } else {
+                unchangedCount++;
+            }
+        }
 
-        // 使用 path 传递给 CRC32
-        std::string checksum = CRC32::getFileCRC(filePath);
-        indexFile << pathToString(relPath) << "|" << checksum << "\n";
+        ManifestRow row;
+        if (checksum.empty()) {
+            // 大文件且已有旧副本: 差量更新, 失败再整个复制
+            if (options.delta && !linkMode && haveStamp && stamp.size >= options.deltaMinSize &&
+                fs::is_regular_file(targetPath)) {
+                try {
+                    DeltaStats ds;
+                    checksum = deltaCopyFile(filePath, targetPath, signaturePath(destination, rel), ds);
+                    std::cout << "  [DELTA] " << relPath.string() << " (matched " << ds.matchedBytes
+                              << " bytes, wrote " << ds.literalBytes << " bytes)" << std::endl;
+                    deltaMatched += ds.matchedBytes;
+                    deltaWritten += ds.literalBytes;
+                } catch (const std::exception& ex) {
+                    std::cerr << "[Warn] Delta failed for " << rel << ", copying whole file: " << ex.what() << std::endl;
+                    checksum.clear();
+                }
+            }
+            if (checksum.empty()) {
+                replaceTarget();
+                const CopyResult copied = copyFileFast(filePath, targetPath);
+                copyStats.add(copied);
+                if (copied.hasCrc) {
+                    checksum = CRC32::toHex(copied.crc);
+                } else {
+                    // 内核复制不经过用户态, 校验值从刚写好的目标文件算: 记录的是镜像里真正的内容,
+                    // 源文件在复制后又被改写也不会对不上, 而且目标刚写过, 多半还在页缓存里
+                    row.pendingCrc = hashPool.submit([targetPath] { return CRC32::getFileCRC(targetPath); });
+                }
+                std::cout << "  [OK] " << relPath.string() << " (" << copyMethodName(copied.method) << ")" << std::endl;
+            }
+            copiedCount++;
+        }
 
-        std::cout << "  [OK] " << relPath.string() << std::endl;
+        row.rel = rel;
+        row.crc = checksum;
+        row.stamp = stamp;
+        row.link = isLink;
+        rows.push_back(std::move(row));
         successCount++;
     };
 
     if (fs::is_regular_file(source)) {
-        processOneFile(source, source.filename());
+        processOneFile(source, source.filename(), fs::is_symlink(source));
     } else if (fs::is_directory(source)) {
-        for (const auto& entry : fs::recursive_directory_iterator(source)) {
-            try {
-                fs::path relativePath = fs::relative(entry.path(), source);
-                if (fs::is_directory(entry.path())) {
-                    fs::create_directories(destination / relativePath);
-                } else {
-                    processOneFile(entry.path(), relativePath);
+        // 镜像备份跟随软链接: 指向文件的复制内容, 指向目录的只建空目录 (不递归进去)
+        // 扫描 dir (相对源目录是 prefix) 下的全部条目
+        auto backupTree = [&](const fs::path& dir, const fs::path& prefix, const ScanOptions& scan) {
+            // 类型和 stat 结果都用扫描清单里的, 只有软链接还要 stat 一次目标
+            const FileCatalog files = Scanner(scan).scan(dir);
+            for (size_t i = 0; i < files.size(); ++i) {
+                try {
+                    const fs::path absPath = fs::u8path(files.absPath(i));
+                    const fs::path relativePath = prefix / fs::u8path(files.relPath(i));
+                    const FileType type = files.type(i);
+                    if (type == FileType::DIRECTORY || (type == FileType::SYMLINK && fs::is_directory(absPath))) {
+                        fs::create_directories(destination / relativePath);
+                    } else if (type == FileType::SYMLINK) {
+                        processOneFile(absPath, relativePath, true);
+                    } else {
+                        FileStamp stamp;
+                        processOneFile(absPath, relativePath, false, catalogStamp(files, i, stamp) ? &stamp : nullptr);
+                    }
+                } catch (...) {}
+            }
+        };
+
+        if (!useJournal) {
+            backupTree(source, fs::path(), options.scan);
+        } else {
+            // 日志里的路径都要照扫描规则 (缓存目录 / nodump / 挂载点) 从根往下逐级过一遍:
+            // 不逐级扫描, 上级目录里的 CACHEDIR.TAG、带 nodump 的上级都看不到
+            const Scanner rules(options.scan);
+            auto parentOf = [](const std::string& rel) {
+                const size_t cut = rel.rfind('/');
+                return cut == std::string::npos ? std::string() : rel.substr(0, cut);
+            };
+            auto under = [](const std::string& rel, const std::string& dir) {
+                return rel.size() > dir.size() && rel.compare(0, dir.size(), dir) == 0 && rel[dir.size()] == '/';
+            };
+
+            // 0. 会改变一整个目录去留的变动: CACHEDIR.TAG 增删改 -> 它所在的目录整棵重看;
+            //    目录自己的属性变了 (比如 chattr +d) 且现在里面不该扫了 -> 里面沿用的行都作废;
+            //    现在该扫、上次却一行都没有 (比如刚去掉 nodump) -> 整棵重看
+            auto isCacheTag = [](const std::string& rel) {
+                const size_t cut = rel.rfind('/');
+                return rel.compare(cut == std::string::npos ? 0 : cut + 1, std::string::npos, "CACHEDIR.TAG") == 0;
+            };
+            std::vector<std::string> tags;
+            for (const auto* set : {&dirty.paths, &dirty.subtrees}) {
+                for (const auto& rel : *set) {
+                    if (options.scan.skipCaches && isCacheTag(rel)) tags.push_back(parentOf(rel));
                 }
-            } catch (...) {}
+            }
+            for (const auto& dir : tags) dirty.add('T', dir);
+
+            std::unordered_set<std::string> dirsWithRows;
+            std::vector<std::string> dropped;
+            for (const auto& rel : dirty.paths) {
+                if (dirty.inSubtree(rel)) continue;
+                std::error_code ec;
+                if (!fs::is_directory(fs::symlink_status(source / fs::u8path(rel), ec))) continue;
+                bool descend = false;
+                if (!rules.admits(source, rel, ScanFilter(), &descend) || !descend) {
+                    dropped.push_back(rel);
+                    continue;
+                }
+                if (dirsWithRows.empty()) {
+                    for (const auto& [row, entry] : previous) {
+                        for (std::string dir = parentOf(row); !dir.empty() && dirsWithRows.insert(dir).second;) {
+                            dir = parentOf(dir);
+                        }
+                    }
+                }
+                if (!dirsWithRows.count(rel)) dirty.add('T', rel);
+            }
+            if (dirty.everything) {
+                // CACHEDIR.TAG 在根目录: 和整棵重扫一样
+                backupTree(source, fs::path(), options.scan);
+                dirty.paths.clear();
+                dirty.subtrees.clear();
+            }
+
+            // 1. 日志里没提到的: 沿用上次清单的行, 源文件连 stat 都不做
+            //    软链接的行除外: 目标变了链接自己没有事件, 每次都重新看
+            for (auto it = previous.begin(); it != previous.end();) {
+                const bool gone = std::any_of(dropped.begin(), dropped.end(),
+                                              [&](const std::string& dir) { return under(it->first, dir); });
+                if (previousLinks.count(it->first) && !gone) dirty.add('M', it->first);
+                if (gone || !dirty.clean(it->first)) {
+                    ++it;
+                    continue;
+                }
+                ManifestRow row;
+                row.rel = it->first;
+                row.crc = it->second.crc;
+                row.stamp = {it->second.size, it->second.mtimeNs, it->second.ctimeNs, it->second.ino};
+                rows.push_back(std::move(row));
+                unchangedCount++;
+                successCount++;
+                it = previous.erase(it);
+            }
+
+            // 2. 提到的: 按现在的样子处理; 已经不在了 (或者现在按规则不该备份) 的留在 previous 里, 最后当作已删除
+            // 子树只扫那一部分 (扫描缓存的根对不上, 不用)
+            ScanOptions subtreeScan = options.scan;
+            subtreeScan.cacheFile.clear();
+            subtreeScan.journalFile.clear();
+            std::vector<std::pair<std::string, bool>> changed; // (路径, 整棵子树)
+            for (const auto& rel : dirty.subtrees) {
+                if (!dirty.inSubtree(parentOf(rel))) changed.emplace_back(rel, true);
+            }
+            for (const auto& rel : dirty.paths) {
+                if (!dirty.inSubtree(rel)) changed.emplace_back(rel, false);
+            }
+            std::sort(changed.begin(), changed.end());
+            for (const auto& [rel, subtree] : changed) {
+                try {
+                    bool descend = false;
+                    if (!rules.admits(source, rel, ScanFilter(), &descend)) continue;
+                    const fs::path relativePath = fs::u8path(rel);
+                    const fs::path absPath = source / relativePath;
+                    std::error_code ec;
+                    const fs::file_status st = fs::symlink_status(absPath, ec);
+                    if (ec || !fs::exists(st)) continue;
+                    if (fs::is_directory(st)) {
+                        fs::create_directories(destination / relativePath);
+                        // 只是目录自己的属性变了就不用往下看; 挂载点 / 缓存目录不往里走
+                        if (subtree && descend) backupTree(absPath, relativePath, subtreeScan);
+                    } else if (fs::is_directory(absPath, ec)) {
+                        fs::create_directories(destination / relativePath);
+                    } else {
+                        processOneFile(absPath, relativePath, fs::is_symlink(st));
+                    }
+                } catch (...) {}
+            }
         }
     }
+
+    std::string linkList;
+    for (auto& row : rows) {
+        if (row.pendingCrc.valid()) row.crc = row.pendingCrc.get();
+        indexFile << row.rel << "|" << row.crc << "|" << row.stamp.size << "|" << row.stamp.mtimeNs << "|"
+                  << row.stamp.ctimeNs << "|" << row.stamp.ino << "\n";
+        if (row.link) linkList += row.rel + "\n";
+    }
     indexFile.close();
-    std::cout << "[Backup] Complete. Success: " << successCount << std::endl;
+    if (!indexFile) throw std::runtime_error("Cannot write index file");
+    {
+        // 链接名单先于清单落地: 清单换了名单还是旧的, 下次按日志增量就会漏看新的链接
+        const fs::path linksPath = linkListPath(destination);
+        fs::create_directories(linksPath.parent_path());
+        std::ofstream links(linksPath.string() + ".tmp", std::ios::trunc);
+        links << linkList;
+        links.close();
+        if (!links) throw std::runtime_error("Cannot write " + linksPath.string());
+        fs::rename(linksPath.string() + ".tmp", linksPath);
+    }
+    fs::rename(tmpIndexPath, indexPath);
+    if (journal) journal->commit(); // 新清单已经包含这批变动
+
+    // 上次清单里有、这次没扫到的文件: 源里已删除 (只删清单里记录过的, 不碰用户自己放进去的文件)
+    if (options.incremental && !linkMode && options.deleteRemoved) {
+        for (const auto& [rel, entry] : previous) {
+            std::error_code ec;
+            fs::remove(signaturePath(destination, rel), ec);
+            if (fs::remove(destination / fs::u8path(rel), ec)) {
+                std::cout << "  [DEL] " << rel << std::endl;
+                removedCount++;
+            }
+        }
+    }
+
+    if (deltaMatched || deltaWritten) {
+        std::cout << "[Delta] Reused " << deltaMatched << " bytes of previous copies, wrote " << deltaWritten << " bytes" << std::endl;
+    }
+    copyStats.print(std::cout);
+    std::cout << "[Backup] Complete. Success: " << successCount << " (copied " << copiedCount
+              << ", unchanged " << unchangedCount << ", hard-linked " << linkedCount
+              << ", removed " << removedCount << ")" << std::endl;
 }
 
 // 2. 基础校验 (返回 string 错误信息)
@@ -214,11 +1119,11 @@ std::string BackupEngine::verify(const std::string& destPath) {
 
     while (std::getline(indexFile, line)) {
         if (line.empty()) continue;
-        size_t delimiterPos = line.find('|');
-        if (delimiterPos == std::string::npos) continue;
+        std::string relPath;
+        ManifestEntry entry;
+        if (!parseManifestLine(line, relPath, entry)) continue;
 
-        std::string relPath = line.substr(0, delimiterPos);
-        std::string expectedCRC = line.substr(delimiterPos + 1);
+        const std::string& expectedCRC = entry.crc;
         fs::path currentFile = destination / fs::u8path(relPath);
 
         try {
@@ -243,30 +1148,72 @@ void BackupEngine::restore(const std::string& srcPath, const std::string& destPa
     const fs::path targetDir = fs::u8path(destPath);
     if (!fs::exists(targetDir)) fs::create_directories(targetDir);
 
+    CopyStats copyStats;
     for (const auto& entry : fs::recursive_directory_iterator(backupDir)) {
         try {
             fs::path relativePath = fs::relative(entry.path(), backupDir);
-            if (relativePath.filename() == "index.txt") continue;
+            if (relativePath.filename() == "index.txt" || relativePath.filename() == "index.txt.tmp") continue;
+            if (*relativePath.begin() == BACKUP_META_DIR) continue;
 
             fs::path targetPath = targetDir / relativePath;
             if (fs::is_directory(entry.path())) {
                 fs::create_directories(targetPath);
             } else {
-                fs::copy_file(entry.path(), targetPath, fs::copy_options::overwrite_existing);
+                copyStats.add(copyFileFast(entry.path(), targetPath));
             }
         } catch (...) {}
     }
+    copyStats.print(std::cout);
 }
 
 // ==========================================
 // 4. 高级打包
 // ==========================================
 
-std::vector<FileRecord> BackupEngine::scanDirectory(const std::string& sourcePath, const FilterOptions& filter) {
-    std::vector<FileRecord> files;
+// 筛选条件拆成扫描的各个阶段 (名字 / 剪枝在 stat 之前, 元数据在 stat 之后); filter 要比扫描活得久
+ScanFilter makeScanStages(const FilterOptions& filter) {
+    ScanFilter stages;
+    if (!filter.nameContains.empty() || !filter.pathContains.empty() || filter.expr) {
+        stages.byName = [&filter](const std::string& rel, const std::string& name) {
+            return checkNameFilter(rel, name, filter);
+        };
+    }
+    if (!filter.excludeDirs.empty() || (filter.expr && filter.expr->canPrune())) {
+        stages.pruneDir = [&filter](const std::string& rel, const std::string& name) {
+            return isExcludedDir(rel, name, filter);
+        };
+    }
+    stages.byMetadata = [&filter](const FileRecord& r) { return checkMetadataFilter(r, filter); };
+    stages.ignoreFile = filter.ignoreFile;
+    return stages;
+}
+
+// [Scan] 统计行; result 说明结果去了哪 (清单占多少内存 / 边扫边打包)
+void printScanStats(const ScanStats& st, uint64_t selected, const std::string& result, const FilterOptions& filter) {
+    std::cout << "[Scan] " << st.directories << " dirs, " << st.entries << " entries, " << selected
+              << " selected (" << st.steals << " steals, " << result;
+    if (st.syscalls) std::cout << ", " << st.syscalls << " syscalls";
+    if (st.nameSkipped) std::cout << ", " << st.nameSkipped << " skipped by name";
+    if (st.pruned) std::cout << ", " << st.pruned << " dirs pruned";
+    if (st.cacheDirs) std::cout << ", " << st.cacheDirs << " cache dirs";
+    if (st.nodump) std::cout << ", " << st.nodump << " nodump";
+    if (st.mountPoints) std::cout << ", " << st.mountPoints << " mount points not crossed";
+    if (st.cachedDirs) std::cout << ", " << st.cachedDirs << " dirs from scan cache";
+    if (st.cachedStats) std::cout << ", " << st.cachedStats << " stats reused";
+    if (st.journal) {
+        if (st.journalFull) std::cout << ", journal: full rescan";
+        else std::cout << ", journal: " << st.journalChanges << " changes";
+    }
+    if (st.ignoreFiles) std::cout << ", " << st.ignored << " ignored by " << st.ignoreFiles << " " << filter.ignoreFile;
+    if (st.errors) std::cout << ", " << st.errors << " unreadable";
+    std::cout << ")" << std::endl;
+}
+
+FileCatalog BackupEngine::scanDirectory(const std::string& sourcePath, const FilterOptions& filter,
+                                        SampleReservoir* sampler, const ScanOptions& scan) {
     fs::path source = fs::u8path(sourcePath);
 
-    if (!fs::exists(source)) return files;
+    if (!fs::exists(source)) return FileCatalog();
 
     // 单文件
     if (fs::is_regular_file(source)) {
@@ -278,104 +1225,62 @@ std::vector<FileRecord> BackupEngine::scanDirectory(const std::string& sourcePat
         // 🔥 调用新的元数据获取逻辑
         fillMetadata(source, record);
 
-        if (checkFilter(record, filter)) files.push_back(record);
+        FileCatalog files(pathToString(source.parent_path()));
+        if (checkFilter(record, filter)) {
+            if (sampler) sampler->offer(record.absPath, record.size);
+            files.add(FileCatalog::ROOT, record.relPath, record);
+        }
         return files;
     }
 
-    // 目录
+    // 目录: 多线程扫描, 过滤在工作线程里做; 抽样器不是线程安全的, 扫完再喂
     if (fs::is_directory(source)) {
-        for (const auto& entry : fs::recursive_directory_iterator(source)) {
-            FileRecord record;
-            record.absPath = pathToString(entry.path());
-            record.relPath = pathToString(fs::relative(entry.path(), source));
-
-            // 🔥 调用新的元数据获取逻辑
-            fillMetadata(entry.path(), record);
-
-            if (fs::is_regular_file(entry.path())) {
-                record.type = FileType::REGULAR;
-            } else if (fs::is_directory(entry.path())) {
-                record.type = FileType::DIRECTORY;
-                record.size = 0;
-            } else if (fs::is_symlink(entry.path())) {
-                record.type = FileType::SYMLINK;
-                record.size = 0;
-                try { record.linkTarget = pathToString(fs::read_symlink(entry.path())); } catch (...) {}
-            } else { continue; }
-
-            if (checkFilter(record, filter)) files.push_back(record);
+        Scanner scanner(scan);
+        if (filter.expr) filter.expr->describe(std::cout);
+        FileCatalog files = scanner.scan(source, makeScanStages(filter));
+        if (sampler) {
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (files.type(i) == FileType::REGULAR) sampler->offer(files.absPath(i), files.fileSize(i));
+            }
         }
+        printScanStats(scanner.stats(), files.size(),
+                       "catalog " + std::to_string((files.memoryUsage() + 1023) / 1024) + " KB", filter);
+        return files;
     }
-    return files;
+    return FileCatalog();
 }
 
 // 打包 Files
-void BackupEngine::packFiles(const std::vector<FileRecord>& files, const std::string& outputFile,
-                             const std::string& password, EncryptionMode encMode, CompressionMode compMode) {
+void BackupEngine::packFiles(RecordSource& files, const std::string& outputFile,
+                             const std::string& password, EncryptionMode encMode, CompressionMode compMode,
+                             const std::string& dict) {
 
     std::ofstream out(fs::u8path(outputFile), std::ios::binary);
     if (!out.is_open()) throw std::runtime_error("Cannot create pack file");
 
-    if (encMode == EncryptionMode::RC4) out.write("MINIBK_R", 8);
-    else if (encMode == EncryptionMode::XOR) out.write("MINIBK_X", 8);
-    else out.write("MINIBK10", 8);
-
-    char compFlag = (compMode == CompressionMode::RLE) ? 1 : 0;
-    out.write(&compFlag, 1);
+    writePackHeader(out, encMode, compMode, 0, password, dict);
+    uint64_t rawBytes = 0, storedBytes = 0;
 
     RC4 rc4;
     if (encMode == EncryptionMode::RC4 && !password.empty()) rc4.init(password);
 
     int count = 0;
-    for (const auto& rec : files) {
+    FileRecord rec; // 完整路径只在这一轮里存在
+    while (files.next(rec)) {
         if (rec.type == FileType::OTHER) continue;
 
-        std::vector<char> fileData;
-        if (rec.type == FileType::REGULAR) {
-            std::ifstream inFile(fs::u8path(rec.absPath), std::ios::binary);
-            if (inFile) {
-                fileData.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
-            }
-        } else if (rec.type == FileType::SYMLINK) {
-            std::string target = rec.linkTarget;
-            fileData.assign(target.begin(), target.end());
-        }
+        std::vector<char> fileData = loadEntryData(rec);
 
-        if (compMode == CompressionMode::RLE && !fileData.empty()) {
-            std::vector<char> compressed;
-            rleCompress(fileData, compressed);
-            fileData = compressed;
-        }
+        rawBytes += fileData.size();
+        compressData(compMode, fileData, dict);
+        storedBytes += fileData.size();
 
         uint32_t fileCRC = 0;
         if (!fileData.empty()) {
             fileCRC = CRC32::calculate(fileData.data(), fileData.size());
         }
 
-        std::vector<char> metaBuffer;
-        uint8_t typeCode = (rec.type == FileType::REGULAR ? 1 : (rec.type == FileType::DIRECTORY ? 2 : 3));
-        metaBuffer.push_back(static_cast<char>(typeCode));
-
-        uint64_t pathLen = rec.relPath.size();
-        auto pLen = reinterpret_cast<const char*>(&pathLen);
-        metaBuffer.insert(metaBuffer.end(), pLen, pLen + 8);
-        metaBuffer.insert(metaBuffer.end(), rec.relPath.begin(), rec.relPath.end());
-
-        uint64_t finalSize = fileData.size();
-        auto pSize = reinterpret_cast<const char*>(&finalSize);
-        metaBuffer.insert(metaBuffer.end(), pSize, pSize + 8);
-
-        auto pCRC = reinterpret_cast<const char*>(&fileCRC);
-        metaBuffer.insert(metaBuffer.end(), pCRC, pCRC + 4);
-
-        auto pMode = reinterpret_cast<const char*>(&rec.mode);
-        metaBuffer.insert(metaBuffer.end(), pMode, pMode + 4);
-        auto pUid = reinterpret_cast<const char*>(&rec.uid);
-        metaBuffer.insert(metaBuffer.end(), pUid, pUid + 4);
-        auto pGid = reinterpret_cast<const char*>(&rec.gid);
-        metaBuffer.insert(metaBuffer.end(), pGid, pGid + 4);
-        auto pTime = reinterpret_cast<const char*>(&rec.mtime);
-        metaBuffer.insert(metaBuffer.end(), pTime, pTime + 8);
+        std::vector<char> metaBuffer = entryMetadata(rec, fileData.size(), fileCRC);
 
         if (encMode == EncryptionMode::RC4 && !password.empty()) rc4.cipher(metaBuffer.data(), metaBuffer.size());
         else if (encMode == EncryptionMode::XOR && !password.empty()) xorEncrypt(metaBuffer.data(), metaBuffer.size(), password);
@@ -390,13 +1295,446 @@ void BackupEngine::packFiles(const std::vector<FileRecord>& files, const std::st
     }
     out.close();
     std::cout << "[Pack] Done. Items: " << count << std::endl;
+    printPackStats(rawBytes, storedBytes);
+}
+
+#ifndef _WIN32
+// 直通打包时最多同时挂着多少个待回填的 CRC
+constexpr size_t MAX_PENDING_CRC = 1024;
+
+// [新增] 不压缩不加密时的直通打包: 数据由内核从源文件搬进包里 (copy_file_range / sendfile), 不经过用户态
+// 条目头先写占位 CRC, 数据落盘后由后台线程 pread 包内这段数据算 CRC, 最后 pwrite 回填
+void BackupEngine::packFilesDirect(RecordSource& files, const std::string& outputFile) {
+    const fs::path outPath = fs::u8path(outputFile);
+    {
+        std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) throw std::runtime_error("Cannot create pack file");
+        writePackHeader(out, EncryptionMode::NONE, CompressionMode::NONE, 0, "", "");
+        if (!out) throw std::runtime_error("Cannot write pack file");
+    }
+
+    const int fd = ::open(outPath.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Cannot open pack file");
+    struct Patch {
+        uint64_t crcOffset;
+        std::future<uint32_t> crc;
+    };
+    std::deque<Patch> patches; // 在途的 CRC 不超过 MAX_PENDING_CRC 个, 内存不随文件数增长
+    TaskGroup hashPool;
+    CopyStats copyStats;
+    uint64_t rawBytes = 0;
+    int count = 0;
+
+    try {
+        uint64_t offset = static_cast<uint64_t>(::lseek(fd, 0, SEEK_END));
+        auto writeAt = [&](const char* data, size_t size, uint64_t at) {
+            while (size > 0) {
+                const ssize_t n = ::pwrite(fd, data, size, static_cast<off_t>(at));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) throw std::runtime_error("Cannot write pack file");
+                data += n;
+                size -= static_cast<size_t>(n);
+                at += static_cast<uint64_t>(n);
+            }
+        };
+
+        // 最早的一个 CRC 算完就回填
+        auto backfill = [&]() {
+            const uint32_t crc = patches.front().crc.get();
+            writeAt(reinterpret_cast<const char*>(&crc), 4, patches.front().crcOffset);
+            patches.pop_front();
+        };
+
+        FileRecord rec;
+        while (files.next(rec)) {
+            if (rec.type == FileType::OTHER) continue;
+
+            if (rec.type != FileType::REGULAR) {
+                // 目录 / 软链接没有大块数据, 照常写
+                const std::vector<char> data = loadEntryData(rec);
+                const uint32_t crc = data.empty() ? 0 : CRC32::calculate(data.data(), data.size());
+                const std::vector<char> meta = entryMetadata(rec, data.size(), crc);
+                writeAt(meta.data(), meta.size(), offset);
+                writeAt(data.data(), data.size(), offset + meta.size());
+                offset += meta.size() + data.size();
+                rawBytes += data.size();
+                count++;
+                continue;
+            }
+
+            // 大小以打开时为准; 复制途中文件变短就补零, 保证包结构完整
+            std::error_code ec;
+            const uint64_t size = fs::file_size(fs::u8path(rec.absPath), ec);
+            if (ec) continue;
+            const std::vector<char> meta = entryMetadata(rec, size, 0);
+            writeAt(meta.data(), meta.size(), offset);
+            const uint64_t crcOffset = offset + 1 + 8 + rec.relPath.size() + 8;
+            const uint64_t dataOffset = offset + meta.size();
+
+            // 单个文件打不开 / 读出错只跳过它: offset 不前移, 下一个条目直接盖掉这里写了一半的头和数据
+            // 写包出错 (磁盘满等) 照样往外抛, 整个包作废
+            CopyResult copied;
+            try {
+                ::lseek(fd, static_cast<off_t>(dataOffset), SEEK_SET);
+                copied = appendFileTo(fs::u8path(rec.absPath), fd, size, outPath);
+            } catch (const CopySourceError& ex) {
+                std::cerr << "[Warn] Skipped " << rec.relPath << ": " << ex.what() << std::endl;
+                continue;
+            }
+            copyStats.add(copied);
+            if (copied.bytes < size) {
+                std::cerr << "[Warn] File shrank while packing, padded with zeros: " << rec.relPath << std::endl;
+                const std::vector<char> zeros(size - copied.bytes, 0);
+                writeAt(zeros.data(), zeros.size(), dataOffset + copied.bytes);
+            }
+
+            if (copied.hasCrc && copied.bytes == size) {
+                writeAt(reinterpret_cast<const char*>(&copied.crc), 4, crcOffset);
+            } else if (size > 0) {
+                patches.push_back({crcOffset, hashPool.submit([fd, dataOffset, size, outPath] {
+                    return crc32OfRange(fd, dataOffset, size, outPath);
+                })});
+                if (patches.size() > MAX_PENDING_CRC) backfill();
+            }
+            offset = dataOffset + size;
+            rawBytes += size;
+            count++;
+        }
+
+        while (!patches.empty()) backfill();
+        // 最后几个条目被跳过时, 包尾还留着它们写了一半的内容
+        if (::ftruncate(fd, static_cast<off_t>(offset)) != 0) throw std::runtime_error("Cannot write pack file");
+    } catch (...) {
+        for (auto& patch : patches) {
+            if (patch.crc.valid()) patch.crc.wait();
+        }
+        ::close(fd);
+        throw;
+    }
+    if (::close(fd) != 0) throw std::runtime_error("Cannot write pack file");
+
+    std::cout << "[Pack] Done. Items: " << count << " (zero-copy)" << std::endl;
+    copyStats.print(std::cout);
+    printPackStats(rawBytes, rawBytes);
+}
+#endif
+
+// 固实打包: 小文件合并成块, 整块压缩+加密, 包尾写中央索引
+void BackupEngine::packFilesSolid(RecordSource& files, const std::string& outputFile,
+                                  const std::string& password, EncryptionMode encMode,
+                                  CompressionMode compMode, const PackOptions& options,
+                                  const std::string& dict) {
+
+    // 差量包: 先读基准包的索引 (和新包放在同一目录, 解包时按文件名找它)
+    std::unique_ptr<SolidReader> base;
+    std::string baseName;
+    if (!options.basePack.empty()) {
+        const fs::path basePath = fs::u8path(options.basePack);
+        base = std::make_unique<SolidReader>(basePath, password);
+        baseName = pathToString(basePath.filename());
+        const fs::path outDir = fs::absolute(fs::u8path(outputFile)).parent_path();
+        if (fs::absolute(basePath).parent_path().lexically_normal() != outDir.lexically_normal()) {
+            std::cout << "[Pack] Note: keep " << baseName << " next to the new pack, unpack looks for it there" << std::endl;
+        }
+    }
+
+    std::ofstream out(fs::u8path(outputFile), std::ios::binary);
+    if (!out.is_open()) throw std::runtime_error("Cannot create pack file");
+
+    writePackHeader(out, encMode, compMode, PACK_FLAG_SOLID | (base ? PACK_FLAG_BASE : 0), password, dict,
+                    baseName, base ? base->fingerprint() : 0);
+
+    std::vector<SolidBlock> blocks;
+    std::vector<SolidEntry> entries;
+    std::vector<char> current; // 正在累积的块 (未压缩)
+    uint64_t offset = static_cast<uint64_t>(out.tellp());
+    const uint64_t dataStart = offset;
+    uint64_t rawBytes = 0;
+    uint64_t refCount = 0, refBytes = 0, deltaCount = 0, deltaRawBytes = 0, deltaBytes = 0;
+
+    // 当前块: 压缩 -> 算 CRC -> 加密 -> 写出
+    auto flushBlock = [&]() {
+        if (current.empty()) return;
+        SolidBlock blk;
+        blk.offset = offset;
+        blk.rawSize = current.size();
+
+        std::vector<char> stored;
+        stored.swap(current);
+        compressData(compMode, stored, dict);
+        blk.crc = CRC32::calculate(stored.data(), stored.size());
+
+        cipherSection(stored, encMode, password, "blk" + std::to_string(blocks.size()));
+        blk.storedSize = stored.size();
+        out.write(stored.data(), stored.size());
+        offset += stored.size();
+
+        rawBytes += blk.rawSize;
+        blocks.push_back(blk);
+        current.clear();
+    };
+
+    FileRecord rec;
+    while (files.next(rec)) {
+        if (rec.type == FileType::OTHER) continue;
+
+        std::vector<char> fileData = loadEntryData(rec);
+
+        SolidEntry entry;
+        entry.typeCode = (rec.type == FileType::REGULAR ? 1 : (rec.type == FileType::DIRECTORY ? 2 : 3));
+        entry.relPath = rec.relPath;
+        entry.size = fileData.size();
+        entry.mode = rec.mode;
+        entry.uid = rec.uid;
+        entry.gid = rec.gid;
+        entry.mtime = rec.mtime;
+
+        if (!fileData.empty()) {
+            entry.crc = CRC32::calculate(fileData.data(), fileData.size());
+
+            // 基准包里有同路径条目: 内容相同存引用, 改动不大存差量
+            const size_t baseId = base ? base->find(rec.relPath) : SolidReader::npos;
+            if (baseId != SolidReader::npos) {
+                const SolidEntry& prev = base->entries()[baseId];
+                std::vector<char> prevData;
+                bool prevLoaded = false;
+                if (prev.typeCode == entry.typeCode && prev.size == entry.size && prev.crc == entry.crc) {
+                    // CRC32 相同不等于内容相同 (碰撞, 或者有人故意构造): 和基准包里的内容逐字节比过才存引用
+                    prevData = base->readEntry(baseId);
+                    prevLoaded = true;
+                    if (prevData == fileData) {
+                        entry.storage = ENTRY_REF;
+                        entry.baseIndex = baseId;
+                        refCount++;
+                        refBytes += entry.size;
+                        entries.push_back(entry);
+                        continue;
+                    }
+                }
+                if (prev.typeCode == 1 && entry.typeCode == 1 && fileData.size() >= PACK_DELTA_MIN_SIZE) {
+                    if (!prevLoaded) prevData = base->readEntry(baseId);
+                    std::vector<char> delta = makeBinaryDelta(prevData, fileData);
+                    if (delta.size() < fileData.size() / 2) {
+                        entry.storage = ENTRY_DELTA;
+                        entry.baseIndex = baseId;
+                        deltaCount++;
+                        deltaRawBytes += fileData.size();
+                        deltaBytes += delta.size();
+                        fileData.swap(delta);
+                    }
+                }
+            }
+            entry.payloadSize = fileData.size();
+
+            // 大文件单独成块; 小文件放不下当前块时先封块
+            bool small = fileData.size() < options.solidFileLimit;
+            if (!small || current.size() + fileData.size() > options.solidBlockSize) flushBlock();
+
+            entry.blockId = static_cast<uint32_t>(blocks.size());
+            entry.offset = current.size();
+            current.insert(current.end(), fileData.begin(), fileData.end());
+
+            if (!small) flushBlock();
+        }
+        entries.push_back(entry);
+    }
+    flushBlock();
+
+    // 中央索引: 按物理位置读的时候条目顺序是乱的, 索引里还是按路径排 (解包 / 列表和原来一样)
+    if (options.readOrder != ReadOrder::SCAN) {
+        std::sort(entries.begin(), entries.end(),
+                  [](const SolidEntry& a, const SolidEntry& b) { return a.relPath < b.relPath; });
+    }
+    std::vector<char> index;
+    appendPod(index, static_cast<uint32_t>(blocks.size()));
+    for (const auto& blk : blocks) {
+        appendPod(index, blk.offset);
+        appendPod(index, blk.storedSize);
+        appendPod(index, blk.rawSize);
+        appendPod(index, blk.crc);
+    }
+    appendPod(index, static_cast<uint64_t>(entries.size()));
+    for (const auto& e : entries) {
+        appendPod(index, e.typeCode);
+        appendPod(index, static_cast<uint64_t>(e.relPath.size()));
+        index.insert(index.end(), e.relPath.begin(), e.relPath.end());
+        appendPod(index, e.blockId);
+        appendPod(index, e.offset);
+        appendPod(index, e.size);
+        appendPod(index, e.crc);
+        appendPod(index, e.mode);
+        appendPod(index, e.uid);
+        appendPod(index, e.gid);
+        appendPod(index, e.mtime);
+        if (base) {
+            appendPod(index, e.storage);
+            appendPod(index, e.baseIndex);
+            appendPod(index, e.payloadSize);
+        }
+    }
+    cipherSection(index, encMode, password, "idx");
+    out.write(index.data(), index.size());
+
+    std::vector<char> tail;
+    appendPod(tail, offset);
+    appendPod(tail, static_cast<uint64_t>(index.size()));
+    tail.insert(tail.end(), SOLID_TAIL_MAGIC, SOLID_TAIL_MAGIC + 8);
+    out.write(tail.data(), tail.size());
+
+    out.close();
+    std::cout << "[Pack] Done. Items: " << entries.size() << ", Solid blocks: " << blocks.size() << std::endl;
+    printPackStats(rawBytes, offset - dataStart);
+    if (base) {
+        std::cout << "[Pack] Base " << baseName << ": " << refCount << " unchanged (" << refBytes << " bytes referenced), "
+                  << deltaCount << " delta (" << deltaRawBytes << " -> " << deltaBytes << " bytes)" << std::endl;
+    }
+}
+
+// [新增] 读取顺序: 目录 / 软链接不读数据, 按清单顺序排在前面; 普通文件按 inode 号或第一个物理区段排
+std::vector<uint32_t> planReadOrder(const FileCatalog& files, ReadOrder order) {
+    struct Key {
+        uint8_t cls;  // 0 = 按物理偏移, 1 = 按 inode 号 (拿不到区段的排在后面)
+        uint64_t key;
+        uint32_t index;
+        bool operator<(const Key& o) const {
+            return cls != o.cls ? cls < o.cls : key != o.key ? key < o.key : index < o.index;
+        }
+    };
+    std::vector<uint32_t> plan;
+    std::vector<Key> keys;
+    for (uint32_t i = 0; i < files.size(); ++i) {
+        if (files.type(i) == FileType::REGULAR) keys.push_back({1, files.ino(i), i});
+        else plan.push_back(i);
+    }
+
+    uint64_t mapped = 0, before = 0, after = 0;
+    if (order == ReadOrder::EXTENT && !keys.empty()) {
+        // 每个文件一次 open + ioctl, 分段多线程查
+        constexpr size_t SLICE = 512;
+        std::vector<std::future<void>> jobs;
+        {
+            TaskGroup pool;
+            for (size_t from = 0; from < keys.size(); from += SLICE) {
+                jobs.push_back(pool.submit([&files, &keys, from] {
+                    const size_t to = std::min(keys.size(), from + SLICE);
+                    for (size_t k = from; k < to; ++k) {
+                        uint64_t physical = 0;
+                        if (firstPhysicalOffset(fs::u8path(files.absPath(keys[k].index)), physical)) {
+                            keys[k].cls = 0;
+                            keys[k].key = physical;
+                        }
+                    }
+                }));
+            }
+        }
+        for (auto& job : jobs) job.get();
+
+        // 磁头移动距离的粗略估计: 相邻两个文件起点之差的绝对值之和
+        auto travel = [](const std::vector<Key>& seq) {
+            uint64_t sum = 0, last = 0;
+            bool first = true;
+            for (const auto& k : seq) {
+                if (k.cls != 0) continue;
+                if (!first) sum += k.key > last ? k.key - last : last - k.key;
+                last = k.key;
+                first = false;
+            }
+            return sum;
+        };
+        for (const auto& k : keys) mapped += k.cls == 0;
+        before = travel(keys);
+        std::sort(keys.begin(), keys.end());
+        after = travel(keys);
+    } else {
+        std::sort(keys.begin(), keys.end());
+    }
+    for (const auto& k : keys) plan.push_back(k.index);
+
+    std::cout << "[Order] " << keys.size() << " files sorted by ";
+    if (order == ReadOrder::EXTENT) {
+        std::cout << "first extent (" << mapped << " mapped, " << keys.size() - mapped << " by inode), "
+                  << "estimated head travel " << (before >> 20) << " MB -> " << (after >> 20) << " MB";
+    } else {
+        std::cout << "inode";
+    }
+    std::cout << std::endl;
+    return plan;
+}
+
+// 用扫描时抽到的样本训练字典, 并在样本上对比有无字典的压缩率
+std::string trainPackDictionary(SampleReservoir& sampler, size_t dictionarySize) {
+    auto samples = sampler.load();
+    const std::string dict = trainDictionary(samples, std::min<size_t>(dictionarySize, LZ_WINDOW));
+
+    // 在样本上对比有无字典的压缩率
+    uint64_t raw = 0, plain = 0, primed = 0;
+    for (const auto& sample : samples) {
+        std::vector<char> data(sample.begin(), sample.end()), a, b;
+        lzCompress(data, a);
+        lzCompress(data, b, dict);
+        raw += data.size();
+        plain += a.size();
+        primed += b.size();
+    }
+    if (plain && primed) {
+        double before = static_cast<double>(raw) / plain, after = static_cast<double>(raw) / primed;
+        std::cout << "[Dict] Trained " << dict.size() << " bytes from " << samples.size() << " samples, "
+                  << "sample ratio " << std::fixed << std::setprecision(2) << before << "x -> " << after
+                  << "x (gain " << std::setprecision(1) << (after / before - 1.0) * 100 << "%)" << std::endl;
+    }
+    return dict;
 }
 
 void BackupEngine::pack(const std::string& srcPath, const std::string& outputFile,
                         const std::string& password, const EncryptionMode encMode,
-                        const FilterOptions& filter, const CompressionMode compMode) {
-    auto files = scanDirectory(srcPath, filter);
-    packFiles(files, outputFile, password, encMode, compMode);
+                        const FilterOptions& filter, const CompressionMode compMode,
+                        const PackOptions& options) {
+    // 字典只对 LZ77 有效: 扫描时顺便抽样, 扫完训练
+    const bool useDict = options.trainDictionary && compMode == CompressionMode::LZ77;
+    const fs::path source = fs::u8path(srcPath);
+    FileCatalog files;
+    std::unique_ptr<ScanStream> stream;
+    std::string dict;
+
+    if (options.streaming && !useDict && options.readOrder == ReadOrder::SCAN && fs::is_directory(source)) {
+        // 边扫边打包: 扫描线程把条目放进有界队列, 这个线程取出来就写, 不等整棵树扫完
+        if (filter.expr) filter.expr->describe(std::cout);
+        stream = std::make_unique<ScanStream>(source, makeScanStages(filter), options.scan);
+    } else {
+        SampleReservoir sampler;
+        files = scanDirectory(srcPath, filter, useDict ? &sampler : nullptr, options.scan);
+        if (useDict) dict = trainPackDictionary(sampler, options.dictionarySize);
+    }
+
+    CatalogSource catalog(files, options.readOrder == ReadOrder::SCAN ? std::vector<uint32_t>()
+                                                                      : planReadOrder(files, options.readOrder));
+    RecordSource& entries = stream ? static_cast<RecordSource&>(*stream) : catalog;
+
+    try {
+        if (options.solid || !options.basePack.empty()) {
+            packFilesSolid(entries, outputFile, password, encMode, compMode, options, dict);
+#ifndef _WIN32
+        } else if (encMode == EncryptionMode::NONE && compMode == CompressionMode::NONE) {
+            // 不压缩不加密: 数据原样进包, 走内核直通
+            packFilesDirect(entries, outputFile);
+#endif
+        } else {
+            packFiles(entries, outputFile, password, encMode, compMode, dict);
+        }
+    } catch (...) {
+        // 打到一半失败: 不留下截断的包, 免得之后被当成完整的包去解
+        std::error_code ec;
+        fs::remove(fs::u8path(outputFile), ec);
+        throw;
+    }
+
+    if (stream) {
+        // 一个条目都没有时没有 "第一个条目"
+        const double firstMs = stream->firstEntryMs();
+        printScanStats(stream->stats(), stream->delivered(),
+                       firstMs < 0 ? std::string("streamed, no entries") : "streamed, first entry after " + formatMillis(firstMs),
+                       filter);
+    }
 }
 
 // 解包
@@ -407,22 +1745,20 @@ void BackupEngine::unpack(const std::string& packFile, const std::string& destPa
     fs::path destRoot = fs::u8path(destPath);
     if (!fs::exists(destRoot)) fs::create_directories(destRoot);
 
-    char magic[9] = {0};
-    in.read(magic, 8);
-    std::string magicStr(magic);
+    const PackHeader header = readPackHeader(in, password);
+    const auto encMode = header.encMode;
 
-    auto encMode = EncryptionMode::NONE;
-    if (magicStr == "MINIBK_R") encMode = EncryptionMode::RC4;
-    else if (magicStr == "MINIBK_X") encMode = EncryptionMode::XOR;
-    else if (magicStr != "MINIBK10") throw std::runtime_error("Unknown file format");
-
-    char compFlag = 0;
-    in.read(&compFlag, 1);
-    bool isRLE = (compFlag == 1);
+    // 固实包: 走中央索引
+    if (header.flags & PACK_FLAG_SOLID) {
+        in.close();
+        unpackSolid(packFile, destRoot, password, "");
+        return;
+    }
 
     RC4 rc4;
     if (encMode == EncryptionMode::RC4) rc4.init(password);
 
+    DeferredDirs dirs;
     while (in.peek() != EOF) {
         char typeBuf[1]; in.read(typeBuf, 1);
         if (in.gcount() == 0) break;
@@ -472,40 +1808,206 @@ void BackupEngine::unpack(const std::string& packFile, const std::string& destPa
                 std::cerr << "[Error] CRC Mismatch: " << relPath << std::endl;
             }
 
-            if (isRLE) {
-                std::vector<char> dec;
-                rleDecompress(fileData, dec);
-                fileData = dec;
+            decompressData(header.compMode, fileData, header.dict);
+        }
+
+        restoreEntry(fullPath, typeCode, fileData, f_mode, f_uid, f_gid, f_mtime, &dirs);
+    }
+    dirs.apply();
+}
+
+// 固实包解包 (onlyPath 非空时只还原这一个条目)
+void BackupEngine::unpackSolid(const std::string& packFile, const fs::path& destRoot,
+                               const std::string& password, const std::string& onlyPath) {
+    SolidReader reader(fs::u8path(packFile), password);
+
+    if (!onlyPath.empty()) {
+        const size_t id = reader.find(onlyPath);
+        if (id == SolidReader::npos) throw std::runtime_error("Entry not found in pack: " + onlyPath);
+        const SolidEntry& e = reader.entries()[id];
+        restoreEntry(destRoot / fs::u8path(e.relPath), e.typeCode, reader.readEntry(id), e.mode, e.uid, e.gid, e.mtime);
+        return;
+    }
+
+    DeferredDirs dirs;
+    for (size_t id = 0; id < reader.entries().size(); ++id) {
+        const SolidEntry& e = reader.entries()[id];
+        restoreEntry(destRoot / fs::u8path(e.relPath), e.typeCode, reader.readEntry(id), e.mode, e.uid, e.gid, e.mtime,
+                     &dirs);
+    }
+    dirs.apply();
+}
+
+// 单文件提取 (只支持带中央索引的固实包)
+void BackupEngine::extract(const std::string& packFile, const std::string& relPath,
+                           const std::string& destPath, const std::string& password) {
+    std::ifstream in(fs::u8path(packFile), std::ios::binary);
+    if (!in.is_open()) throw std::runtime_error("Cannot open pack file");
+
+    const PackHeader header = readPackHeader(in, password);
+    if (!(header.flags & PACK_FLAG_SOLID)) throw std::runtime_error("Single-file extract needs a solid pack (-solid)");
+    in.close();
+
+    fs::path destRoot = fs::u8path(destPath);
+    if (!fs::exists(destRoot)) fs::create_directories(destRoot);
+
+    unpackSolid(packFile, destRoot, password, relPath);
+}
+
+// ==========================================
+// 5. 去重仓库
+// ==========================================
+
+// 超过这个大小的文件才多线程分块
+constexpr uint64_t PARALLEL_CHUNK_MIN_SIZE = 64ull << 20;
+
+std::string BackupEngine::repoBackup(const std::string& srcPath, const std::string& repoPath,
+                                     const FilterOptions& filter, CompressionMode compMode) {
+    auto store = ChunkStore::open(repoPath, compMode);
+
+    // 上一个快照: 同一个源目录最新的那个 (仓库里可能还有别的目录的快照).
+    // 里面大小、修改时间、ctime、inode 都没变的文件 (同镜像备份的清单), 直接沿用它的块列表, 不再读文件
+    const std::string source = pathToString(fs::absolute(fs::u8path(srcPath)).lexically_normal());
+    std::unordered_map<std::string, const SnapshotEntry*> parent;
+    std::vector<SnapshotEntry> parentEntries;
+    auto snapshots = store->listSnapshots();
+    for (auto it = snapshots.rbegin(); it != snapshots.rend(); ++it) {
+        if (store->snapshotSource(*it) != source) continue;
+        parentEntries = store->readSnapshot(*it);
+        for (const auto& e : parentEntries) parent[e.relPath] = &e;
+        break;
+    }
+
+    auto files = scanDirectory(srcPath, filter);
+    std::vector<SnapshotEntry> entries;
+    entries.reserve(files.size());
+
+    // 大文件分段多线程找切点 (切点与单线程一致); 单核机器上不开线程
+    ThreadPool* pool = ThreadPool::defaultThreads() > 1 ? &ThreadPool::shared() : nullptr;
+
+    uint64_t totalBytes = 0, newBytes = 0, newChunks = 0, dupChunks = 0, reusedFiles = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files.type(i) == FileType::OTHER) continue;
+        const FileRecord rec = files.record(i);
+
+        SnapshotEntry e;
+        e.typeCode = (rec.type == FileType::REGULAR ? 1 : (rec.type == FileType::DIRECTORY ? 2 : 3));
+        e.relPath = rec.relPath;
+        e.size = rec.size;
+        e.mtime = rec.mtime;
+        e.mtimeNsec = rec.mtimeNsec;
+        e.ctime = rec.ctime;
+        e.ctimeNsec = rec.ctimeNsec;
+        e.ino = rec.ino;
+        e.mode = rec.mode;
+        e.uid = rec.uid;
+        e.gid = rec.gid;
+        e.linkTarget = rec.linkTarget;
+
+        if (rec.type == FileType::REGULAR) {
+            totalBytes += rec.size;
+            auto it = parent.find(rec.relPath);
+            const SnapshotEntry* prev = it != parent.end() ? it->second : nullptr;
+            if (prev && prev->typeCode == 1 && prev->size == rec.size &&
+                prev->mtime == rec.mtime && prev->mtimeNsec == rec.mtimeNsec &&
+                prev->ctime == rec.ctime && prev->ctimeNsec == rec.ctimeNsec && prev->ino == rec.ino) {
+                e.chunks = prev->chunks;
+                reusedFiles++;
+            } else {
+                try {
+                    e.size = store->chunker().chunkFile(rec.absPath, [&](const char* data, size_t size) {
+                        ChunkHash hash = SHA256::hash(data, size);
+                        if (store->put(hash, data, size)) {
+                            newChunks++;
+                            newBytes += size;
+                        } else {
+                            dupChunks++;
+                        }
+                        e.chunks.push_back(hash);
+                    }, rec.size >= PARALLEL_CHUNK_MIN_SIZE ? pool : nullptr);
+                } catch (const std::exception& ex) {
+                    std::cerr << "[Warn] Skipped " << rec.relPath << ": " << ex.what() << std::endl;
+                    continue;
+                }
             }
         }
+        entries.push_back(std::move(e));
+    }
 
-        if (typeCode == 2) {
-            fs::create_directories(fullPath);
-        } else if (typeCode == 3) {
-            std::string target(fileData.begin(), fileData.end());
-            if (fullPath.has_parent_path()) fs::create_directories(fullPath.parent_path());
-            if (fs::exists(fullPath) || fs::is_symlink(fullPath)) fs::remove(fullPath);
-            try { fs::create_symlink(target, fullPath); } catch(...) {}
-        } else if (typeCode == 1) {
+    std::string id = store->writeSnapshot(entries, source);
+    std::cout << "[Repo] Snapshot " << id << ": " << entries.size() << " items, "
+              << totalBytes << " bytes (" << reusedFiles << " files unchanged)" << std::endl;
+    std::cout << "[Repo] New chunks: " << newChunks << " (" << newBytes << " bytes), "
+              << "deduplicated chunks: " << dupChunks << ", repository chunks: " << store->chunkCount() << std::endl;
+    store->index().stats().print(std::cout);
+    return id;
+}
+
+void BackupEngine::repoRestore(const std::string& repoPath, const std::string& snapshotId,
+                               const std::string& destPath) {
+    if (!fs::exists(fs::u8path(repoPath) / "config")) throw std::runtime_error("Not a repository: " + repoPath);
+    auto store = ChunkStore::open(repoPath);
+
+    std::string id = snapshotId;
+    if (id.empty() || id == "latest") {
+        auto snapshots = store->listSnapshots();
+        if (snapshots.empty()) throw std::runtime_error("Repository has no snapshots");
+        id = snapshots.back();
+    }
+
+    fs::path destRoot = fs::u8path(destPath);
+    if (!fs::exists(destRoot)) fs::create_directories(destRoot);
+
+    int count = 0;
+    DeferredDirs dirs;
+    for (const auto& e : store->readSnapshot(id)) {
+        fs::path fullPath = destRoot / fs::u8path(e.relPath);
+        if (e.typeCode == 1) {
+            // 逐块写出, 不把整个文件读进内存
             if (fullPath.has_parent_path()) fs::create_directories(fullPath.parent_path());
             std::ofstream outFile(fullPath, std::ios::binary);
-            outFile.write(fileData.data(), fileData.size());
+            if (!outFile) throw std::runtime_error("Cannot create " + e.relPath);
+            for (const auto& hash : e.chunks) {
+                std::vector<char> data = store->get(hash);
+                outFile.write(data.data(), data.size());
+            }
+            outFile.close();
+            applyMetadata(fullPath, e.mode, e.uid, e.gid, e.mtime);
+        } else {
+            std::vector<char> target(e.linkTarget.begin(), e.linkTarget.end());
+            restoreEntry(fullPath, e.typeCode, target, e.mode, e.uid, e.gid, e.mtime, &dirs);
         }
+        count++;
+    }
+    dirs.apply();
+    std::cout << "[Repo] Restored snapshot " << id << ": " << count << " items" << std::endl;
+}
 
-        try {
-#ifdef _WIN32
-            struct __utimbuf64 new_times{}; // 双下划线
-            new_times.actime = f_mtime;
-            new_times.modtime = f_mtime;
-            _wutime64(fullPath.c_str(), &new_times);
-#else
-            chmod(fullPath.c_str(), f_mode);
-            chown(fullPath.c_str(), f_uid, f_gid);
-            struct utimbuf new_times{};
-            new_times.actime = f_mtime;
-            new_times.modtime = f_mtime;
-            utime(fullPath.c_str(), &new_times);
-#endif
-        } catch (...) {}
+std::vector<std::string> BackupEngine::listSnapshots(const std::string& repoPath) {
+    if (!fs::exists(fs::u8path(repoPath) / "config")) throw std::runtime_error("Not a repository: " + repoPath);
+    auto store = ChunkStore::open(repoPath);
+    return store->listSnapshots();
+}
+
+void BackupEngine::repoGc(const std::string& repoPath, const GcOptions& options) {
+    if (!fs::exists(fs::u8path(repoPath) / "config")) throw std::runtime_error("Not a repository: " + repoPath);
+    auto store = ChunkStore::open(repoPath);
+
+    // 1. 保留策略: 从最旧的开始删
+    auto snapshots = store->listSnapshots();
+    size_t removed = 0;
+    if (options.keepLast > 0 && snapshots.size() > options.keepLast) {
+        removed = snapshots.size() - options.keepLast;
+        for (size_t i = 0; i < removed; ++i) store->removeSnapshot(snapshots[i]);
     }
-}
\ No newline at end of file
+    std::cout << "[GC] Snapshots: " << snapshots.size() - removed << " kept, " << removed << " removed" << std::endl;
+
+    // 2. 标记-清除 + 压缩
+    GcStats stats = store->collectGarbage(options.liveThreshold, options.ioBudget);
+    std::cout << "[GC] Chunks: " << stats.liveChunks << " live, " << stats.removedChunks << " removed" << std::endl;
+    std::cout << "[GC] Packs: " << stats.deletedPacks << " deleted, " << stats.rewrittenPacks << " rewritten ("
+              << stats.copiedBytes << " bytes copied), " << stats.reclaimedBytes << " bytes reclaimed" << std::endl;
+    if (stats.deferredPacks) {
+        std::cout << "[GC] " << stats.deferredPacks << " sparse packs left for the next run (I/O budget reached)" << std::endl;
+    }
+}
@@ -1,7 +1,13 @@
 // src/Bridge.cpp
 #include "BackupEngine.h"
+#include "ChangeJournal.h"
+#include "Daemon.h"
+#include "FilterExpr.h"
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 // === 跨平台导出宏定义 ===
 #ifdef _WIN32
@@ -22,6 +28,20 @@ struct CFilter {
     int targetUid;
 };
 
+// [新增] 打包选项 (与 PackOptions 对应, 只允许在末尾追加字段)
+struct CPackOptions {
+    int solid;
+    int _pad;
+    unsigned long long solidBlockSize;  // 0 表示默认值
+    unsigned long long solidFileLimit;  // 0 表示默认值
+    int trainDictionary;                // 只对 LZ77 (compMode=2) 有效
+    int _pad2;
+    unsigned long long dictionarySize;  // 0 表示默认值
+    int streaming;                      // [新增] 边扫边打包 (条目按发现顺序, 每次可能不同)
+    int readOrder;                      // [新增] 读文件的顺序: 0 = 扫描顺序, 1 = inode, 2 = 物理区段
+    const char* excludeDirs;            // [新增] 排除的目录名, 一行一个 (NULL 表示不排除)
+};
+
 extern "C" {
 
     // ==========================================
@@ -36,6 +56,16 @@ extern "C" {
         } catch (...) { return 0; }
     }
 
+    // [新增] 增量备份: 只复制上次以来变化的文件, 删除源里已删除的文件
+    LIBRARY_API int C_BackupIncremental(const char* src, const char* dest) {
+        try {
+            BackupOptions options;
+            options.incremental = true;
+            BackupEngine::backup(src, dest, options);
+            return 1;
+        } catch (...) { return 0; }
+    }
+
     // [修改] 改名为 C_RestoreSimple
     LIBRARY_API int C_RestoreSimple(const char* src, const char* dest) {
         try {
@@ -75,6 +105,7 @@ extern "C" {
 
             auto cppComp = CompressionMode::NONE;
             if (compMode == 1) cppComp = CompressionMode::RLE;
+            else if (compMode == 2) cppComp = CompressionMode::LZ77;
 
             FilterOptions opts;
             if (c_filter) {
@@ -116,6 +147,164 @@ extern "C" {
         }
     }
 
+    // [新增] 打包接口 (带打包选项, 例如固实模式)
+    LIBRARY_API int C_PackWithOptions(const char* src, const char* pckFile,
+                                      const char* pwd, const int encMode,
+                                      const CFilter* c_filter, int compMode,
+                                      const CPackOptions* c_options) {
+        try {
+            auto cppEnc = EncryptionMode::NONE;
+            if (encMode == 1) cppEnc = EncryptionMode::XOR;
+            else if (encMode == 2) cppEnc = EncryptionMode::RC4;
+
+            auto cppComp = CompressionMode::NONE;
+            if (compMode == 1) cppComp = CompressionMode::RLE;
+            else if (compMode == 2) cppComp = CompressionMode::LZ77;
+
+            FilterOptions opts;
+            if (c_filter) {
+                if (c_filter->nameContains) opts.nameContains = c_filter->nameContains;
+                if (c_filter->pathContains) opts.pathContains = c_filter->pathContains;
+                opts.type = c_filter->type;
+                opts.minSize = c_filter->minSize;
+                opts.maxSize = c_filter->maxSize;
+                opts.startTime = c_filter->startTime;
+                opts.targetUid = c_filter->targetUid;
+            }
+
+            PackOptions options;
+            if (c_options) {
+                options.solid = c_options->solid != 0;
+                if (c_options->solidBlockSize) options.solidBlockSize = c_options->solidBlockSize;
+                if (c_options->solidFileLimit) options.solidFileLimit = c_options->solidFileLimit;
+                options.trainDictionary = c_options->trainDictionary != 0;
+                if (c_options->dictionarySize) options.dictionarySize = c_options->dictionarySize;
+                options.streaming = c_options->streaming != 0;
+                if (c_options->readOrder == 1) options.readOrder = ReadOrder::INODE;
+                else if (c_options->readOrder == 2) options.readOrder = ReadOrder::EXTENT;
+                std::istringstream dirs(c_options->excludeDirs ? c_options->excludeDirs : "");
+                for (std::string name; std::getline(dirs, name);) {
+                    if (!name.empty()) opts.excludeDirs.push_back(name);
+                }
+            }
+
+            BackupEngine::pack(src, pckFile, pwd, cppEnc, opts, cppComp, options);
+            return 1;
+        } catch (const std::exception& e) {
+            std::cerr << "C++ Exception: " << e.what() << std::endl;
+            return 0;
+        } catch (...) {
+            return 0;
+        }
+    }
+
+    // [新增] 按筛选规则打包 (规则文本一行一条, 语法见 FilterExpr.h; rules 为空表示不筛)
+    LIBRARY_API int C_PackWithFilterExpr(const char* src, const char* pckFile,
+                                         const char* pwd, const int encMode,
+                                         const char* rules, int compMode) {
+        try {
+            auto cppEnc = EncryptionMode::NONE;
+            if (encMode == 1) cppEnc = EncryptionMode::XOR;
+            else if (encMode == 2) cppEnc = EncryptionMode::RC4;
+
+            auto cppComp = CompressionMode::NONE;
+            if (compMode == 1) cppComp = CompressionMode::RLE;
+            else if (compMode == 2) cppComp = CompressionMode::LZ77;
+
+            FilterOptions opts;
+            if (rules && *rules) opts.expr = FilterExpr::compile(rules);
+
+            BackupEngine::pack(src, pckFile, pwd, cppEnc, opts, cppComp);
+            return 1;
+        } catch (const std::exception& e) {
+            std::cerr << "C++ Exception: " << e.what() << std::endl;
+            return 0;
+        } catch (...) {
+            return 0;
+        }
+    }
+
+    // [新增] 检查筛选规则的语法, 返回错误信息 (空串表示没有错误), 给界面做即时校验
+    LIBRARY_API const char* C_CheckFilterExpr(const char* rules) {
+        static std::string g_lastFilterError;
+        try {
+            FilterExpr::compile(rules ? rules : "");
+            g_lastFilterError.clear();
+        } catch (const std::exception& e) {
+            g_lastFilterError = e.what();
+        }
+        return g_lastFilterError.c_str();
+    }
+
+    // [新增] 单文件提取接口 (固实包)
+    LIBRARY_API int C_ExtractOne(const char* pckFile, const char* relPath, const char* dest, const char* pwd) {
+        try {
+            BackupEngine::extract(pckFile, relPath, dest, pwd);
+            return 1;
+        } catch (...) { return 0; }
+    }
+
+    // [新增] 取走变动日志里的变动 (commit 非 0 时同时确认), 返回文本:
+    // 第一行 "everything|0" 或 "everything|1", 之后按路径排好序的 "M|路径" / "T|路径"
+    LIBRARY_API const char* C_JournalTake(const char* journal, int commit) {
+        static std::string g_lastJournal;
+        try {
+            ChangeJournal j(fs::u8path(journal));
+            const DirtySet dirty = j.take();
+            if (commit) j.commit();
+            std::vector<std::string> lines;
+            for (const auto& p : dirty.paths) lines.push_back("M|" + p);
+            for (const auto& p : dirty.subtrees) lines.push_back("T|" + p);
+            std::sort(lines.begin(), lines.end());
+            std::ostringstream out;
+            out << "everything|" << (dirty.everything ? 1 : 0) << "\n";
+            for (const auto& line : lines) out << line << "\n";
+            g_lastJournal = out.str();
+        } catch (const std::exception& e) {
+            g_lastJournal = std::string("error|") + e.what() + "\n";
+        }
+        return g_lastJournal.c_str();
+    }
+
+    // [新增] 按一组变动 (日志格式, 一行一条) 判断 rel: 第 0 位 = clean(), 第 1 位 = inSubtree()
+    LIBRARY_API int C_DirtyQuery(const char* changes, const char* rel) {
+        DirtySet dirty;
+        std::istringstream in(changes ? changes : "");
+        for (std::string line; std::getline(in, line);) {
+            if (line.size() >= 2 && line[1] == '|') dirty.add(line[0], line.substr(2));
+        }
+        const std::string path = rel ? rel : "";
+        return (dirty.clean(path) ? 1 : 0) | (dirty.inSubtree(path) ? 2 : 0);
+    }
+
+    // [新增] cron 时间表: after 之后第一次运行的时间 (Unix 秒), 找不到返回 -1, 格式不对返回 -2
+    LIBRARY_API long long C_CronNext(const char* spec, long long after) {
+        try {
+            return CronSchedule::parse(spec ? spec : "").next(static_cast<std::time_t>(after));
+        } catch (...) { return -2; }
+    }
+
+    // [新增] 任务命令行切分 / 拼接, 参数之间用 \x1f 分隔; 切分出错时返回 "error|原因"
+    LIBRARY_API const char* C_SplitArgs(const char* line) {
+        static std::string g_lastSplit;
+        try {
+            g_lastSplit.clear();
+            for (const auto& arg : Daemon::splitArgs(line ? line : "")) g_lastSplit += arg + '\x1f';
+        } catch (const std::exception& e) {
+            g_lastSplit = std::string("error|") + e.what();
+        }
+        return g_lastSplit.c_str();
+    }
+
+    LIBRARY_API const char* C_JoinArgs(const char* packed) {
+        static std::string g_lastJoin;
+        std::vector<std::string> args;
+        std::istringstream in(packed ? packed : "");
+        for (std::string arg; std::getline(in, arg, '\x1f');) args.push_back(arg);
+        g_lastJoin = Daemon::joinArgs(args);
+        return g_lastJoin.c_str();
+    }
+
     // 解包接口
     LIBRARY_API int C_Unpack(const char* pckFile, const char* dest, const char* pwd) {
         try {
@@ -0,0 +1,207 @@
+// src/ChangeJournal.cpp
+#include "ChangeJournal.h"
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+void DirtySet::add(char op, const std::string& relPath) {
+    if (op == 'T' && relPath.empty()) {
+        everything = true;
+        return;
+    }
+    if (relPath.empty()) return; // 根目录自己的属性不影响任何条目
+    if (op == 'T') subtrees.insert(relPath);
+    else paths.insert(relPath);
+    for (size_t cut = relPath.rfind('/'); cut != std::string::npos && cut > 0; cut = relPath.rfind('/', cut - 1)) {
+        if (!parents.insert(relPath.substr(0, cut)).second) break; // 再往上的已经登记过了
+    }
+}
+
+bool DirtySet::inSubtree(const std::string& rel) const {
+    if (everything) return true;
+    if (subtrees.empty()) return false;
+    if (subtrees.count(rel)) return true;
+    for (size_t cut = rel.rfind('/'); cut != std::string::npos && cut > 0; cut = rel.rfind('/', cut - 1)) {
+        if (subtrees.count(rel.substr(0, cut))) return true;
+    }
+    return false;
+}
+
+ChangeJournal::~ChangeJournal() {
+#ifndef _WIN32
+    if (lockFd_ >= 0) ::close(lockFd_); // 关闭即解锁
+#endif
+}
+
+fs::path ChangeJournal::sibling(const char* suffix) const {
+    fs::path p = file_;
+    p += suffix;
+    return p;
+}
+
+#ifndef _WIN32
+namespace {
+struct LockedFd {
+    int fd = -1;
+    ~LockedFd() { if (fd >= 0) ::close(fd); }
+};
+
+void writeAll(int fd, const std::string& data, const fs::path& path) {
+    size_t done = 0;
+    while (done < data.size()) {
+        const ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+        if (n < 0) throw std::runtime_error("Cannot write journal: " + path.string());
+        done += static_cast<size_t>(n);
+    }
+}
+
+std::string readAll(int fd) {
+    std::string text;
+    char buf[65536];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) text.append(buf, static_cast<size_t>(n));
+    return text;
+}
+}
+
+void ChangeJournal::lockWriter() {
+    const fs::path lockPath = sibling(".lock");
+    lockFd_ = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd_ < 0) throw std::runtime_error("Cannot open " + lockPath.string());
+    if (::flock(lockFd_, LOCK_EX | LOCK_NB) != 0) {
+        throw std::runtime_error("Another watcher is already writing " + file_.string());
+    }
+}
+
+void ChangeJournal::append(const std::vector<Change>& changes) {
+    if (changes.empty()) return;
+    std::string text;
+    for (const auto& c : changes) {
+        text += c.op;
+        text += '|';
+        text += c.path;
+        text += '\n';
+    }
+    // 锁住后确认打开的还是现在这个文件 (读取方可能刚把它改名拿走), 不是就重新打开
+    while (true) {
+        LockedFd f;
+        f.fd = ::open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (f.fd < 0) throw std::runtime_error("Cannot open journal: " + file_.string());
+        ::flock(f.fd, LOCK_EX);
+        struct stat opened{}, current{};
+        if (::fstat(f.fd, &opened) != 0 || ::stat(file_.c_str(), &current) != 0 || opened.st_ino != current.st_ino ||
+            opened.st_dev != current.st_dev) {
+            continue;
+        }
+        writeAll(f.fd, text, file_);
+        ::fdatasync(f.fd);
+        return;
+    }
+}
+
+void ChangeJournal::publishPending(const std::vector<Change>& pending, int64_t drainedNs) {
+    std::string text = "W|" + std::to_string(drainedNs) + "\n";
+    for (const auto& c : pending) {
+        text += c.op;
+        text += '|';
+        text += c.path;
+        text += '\n';
+    }
+    // 写临时文件再改名, 读取方不会读到写了一半的; 只在监视进程活着时有意义, 不用落盘
+    const fs::path pendingPath = sibling(".pending");
+    const fs::path tmp = sibling(".pending.tmp");
+    LockedFd f;
+    f.fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (f.fd < 0) throw std::runtime_error("Cannot write " + tmp.string());
+    writeAll(f.fd, text, tmp);
+    if (::rename(tmp.c_str(), pendingPath.c_str()) != 0) throw std::runtime_error("Cannot write " + pendingPath.string());
+}
+
+DirtySet ChangeJournal::take() {
+    DirtySet dirty;
+
+    // 1. 有没有监视进程一直在跑
+    bool watched = false;
+    {
+        LockedFd lock;
+        lock.fd = ::open(sibling(".lock").c_str(), O_RDONLY | O_CLOEXEC);
+        watched = lock.fd >= 0 && ::flock(lock.fd, LOCK_SH | LOCK_NB) != 0;
+    }
+
+    // 2. 新日志并进 .taken (上次没 commit 的还在里面), 再删掉新日志
+    const fs::path taken = sibling(".taken");
+    {
+        LockedFd f;
+        f.fd = ::open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (f.fd >= 0) {
+            ::flock(f.fd, LOCK_EX);
+            const std::string text = readAll(f.fd);
+            LockedFd out;
+            out.fd = ::open(taken.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+            if (out.fd < 0) throw std::runtime_error("Cannot write " + taken.string());
+            writeAll(out.fd, text, taken);
+            ::fdatasync(out.fd);
+            ::unlink(file_.c_str());
+        }
+    }
+
+    // 3. 读出全部变动
+    std::ifstream in(taken, std::ios::binary);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.size() >= 2 && line[1] == '|') dirty.add(line[0], line.substr(2));
+    }
+    if (!watched) {
+        dirty.everything = true;
+        return dirty;
+    }
+
+    // 4. 水位之前收到、还没写进日志的变动 (只读不取走)
+    std::ifstream pending(sibling(".pending"), std::ios::binary);
+    while (std::getline(pending, line)) {
+        if (line.size() < 2 || line[1] != '|') continue;
+        if (line[0] == 'W') {
+            try { dirty.watermarkNs = std::stoll(line.substr(2)); } catch (...) {}
+        } else {
+            dirty.add(line[0], line.substr(2));
+        }
+    }
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    const int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    if (nowNs - dirty.watermarkNs > PENDING_STALE_MS * 1000000) dirty.everything = true;
+    return dirty;
+}
+
+void ChangeJournal::commit() {
+    std::error_code ec;
+    fs::remove(sibling(".taken"), ec);
+}
+#else
+// Windows 上没有监视进程: 每次都整棵树重新扫
+void ChangeJournal::lockWriter() {
+    throw std::runtime_error("Change journal is not supported on this platform");
+}
+
+void ChangeJournal::append(const std::vector<Change>&) {
+    throw std::runtime_error("Change journal is not supported on this platform");
+}
+
+void ChangeJournal::publishPending(const std::vector<Change>&, int64_t) {
+    throw std::runtime_error("Change journal is not supported on this platform");
+}
+
+DirtySet ChangeJournal::take() {
+    DirtySet dirty;
+    dirty.everything = true;
+    return dirty;
+}
+
+void ChangeJournal::commit() {}
+#endif
@@ -0,0 +1,410 @@
+// src/ChunkIndex.cpp
+#include "ChunkIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+    // Windows 下没有 mmap: 整张表读进内存, sync 时整表写回 (没有内存上限保证)
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// 表头: [magic 8][槽位数 8][已用 8][保留 40]
+constexpr size_t TABLE_HEADER_SIZE = 64;
+const char TABLE_MAGIC[8] = {'M', 'B', 'C', 'I', 'D', 'X', '0', '1'};
+
+// 槽位: [哈希 32][packId 4][存储长度 4][偏移 8][原始长度 4][codec 1][占用 1][保留 2]
+constexpr size_t SLOT_SIZE = 56;
+constexpr size_t SLOT_PACK = 32, SLOT_STORED = 36, SLOT_OFFSET = 40, SLOT_RAW = 48, SLOT_CODEC = 52, SLOT_USED = 53;
+
+constexpr uint64_t INITIAL_SLOTS = 1u << 16;
+
+// 装载率超过 3/4 就翻倍 (线性探测在高装载率下探测长度急剧变长)
+static uint64_t maxLoad(uint64_t slotCount) { return slotCount / 4 * 3; }
+
+// Bloom 过滤器: 每键 10 位, 7 个哈希函数, 误判率约 0.8%
+constexpr uint64_t BLOOM_BITS_PER_KEY = 10;
+constexpr int BLOOM_HASHES = 7;
+const char BLOOM_MAGIC[8] = {'M', 'B', 'B', 'L', 'O', 'O', 'M', '1'};
+
+template <typename T>
+static T loadAt(const uint8_t* p) {
+    T v;
+    std::memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+template <typename T>
+static void storeAt(uint8_t* p, const T& v) {
+    std::memcpy(p, &v, sizeof(T));
+}
+
+// ==========================================
+// 可读写的文件映射
+// ==========================================
+class ChunkIndex::MappedFile {
+public:
+    // 打开 (不存在则创建) 文件, 长度不足 minSize 时补零到 minSize
+    MappedFile(const fs::path& path, uint64_t minSize) : path_(path) {
+#ifdef _WIN32
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (in) buf_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        if (buf_.size() < minSize) buf_.resize(minSize, 0);
+        data_ = buf_.data();
+        size_ = buf_.size();
+#else
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) throw std::runtime_error("Cannot open chunk index: " + path.string());
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            ::close(fd_);
+            throw std::runtime_error("Cannot stat chunk index: " + path.string());
+        }
+        size_ = static_cast<uint64_t>(st.st_size);
+        if (size_ < minSize) {
+            // 稀疏扩展: 空槽位全是 0, 不占磁盘
+            if (ftruncate(fd_, static_cast<off_t>(minSize)) != 0) {
+                ::close(fd_);
+                throw std::runtime_error("Cannot resize chunk index: " + path.string());
+            }
+            size_ = minSize;
+        }
+        void* p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("Cannot map chunk index: " + path.string());
+        }
+        data_ = static_cast<uint8_t*>(p);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        try { sync(); } catch (...) {}
+#else
+        munmap(data_, size_);
+        ::close(fd_);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    uint8_t* data() const { return data_; }
+    uint64_t size() const { return size_; }
+
+    void sync() {
+#ifdef _WIN32
+        std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(buf_.data()), buf_.size());
+        if (!out) throw std::runtime_error("Cannot write chunk index: " + path_.string());
+#else
+        if (msync(data_, size_, MS_SYNC) != 0) throw std::runtime_error("Cannot sync chunk index: " + path_.string());
+#endif
+    }
+
+private:
+    fs::path path_;
+    uint8_t* data_ = nullptr;
+    uint64_t size_ = 0;
+#ifdef _WIN32
+    std::vector<uint8_t> buf_;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// ==========================================
+// 统计
+// ==========================================
+uint64_t ChunkIndexStats::latencyPercentile(double p) const {
+    uint64_t total = 0;
+    for (uint64_t n : latencyLog2) total += n;
+    if (total == 0) return 0;
+    const uint64_t rank = static_cast<uint64_t>(p * total);
+    uint64_t seen = 0;
+    for (int k = 0; k < 40; ++k) {
+        seen += latencyLog2[k];
+        if (seen > rank) return 2ull << k;
+    }
+    return 2ull << 39;
+}
+
+void ChunkIndexStats::print(std::ostream& out) const {
+    const double rejectPct = lookups ? 100.0 * bloomRejects / lookups : 0.0;
+    const double fpPct = (lookups - tableHits) ? 100.0 * falsePositives() / (lookups - tableHits) : 0.0;
+    out << "[Index] Lookups: " << lookups << ", bloom rejected: " << bloomRejects
+        << " (" << static_cast<int>(rejectPct) << "%), table lookups: " << tableLookups
+        << ", false positives: " << falsePositives() << " (" << fpPct << "% of misses)" << std::endl;
+    if (tableLookups) {
+        out << "[Index] Table latency: avg " << tableNanos / tableLookups << " ns, p50 <= "
+            << latencyPercentile(0.5) << " ns, p99 <= " << latencyPercentile(0.99)
+            << " ns, avg probe " << static_cast<double>(probedSlots) / tableLookups << " slots" << std::endl;
+    }
+}
+
+// ==========================================
+// ChunkIndex
+// ==========================================
+ChunkIndex::ChunkIndex(const fs::path& dir, uint64_t bloomMaxBytes) : dir_(dir), bloomMaxBytes_(bloomMaxBytes) {
+    openTable();
+    // 过滤器丢失或与表不一致 (上次没正常关闭): 扫一遍表重建
+    if (!loadBloom()) rebuildBloom();
+}
+
+ChunkIndex::~ChunkIndex() {
+    try { sync(); } catch (...) {}
+}
+
+uint8_t* ChunkIndex::slot(uint64_t i) const {
+    return table_->data() + TABLE_HEADER_SIZE + i * SLOT_SIZE;
+}
+
+void ChunkIndex::openTable() {
+    const fs::path path = dir_ / "index.tbl";
+    const bool fresh = !fs::exists(path);
+    table_ = std::make_unique<MappedFile>(path, fresh ? TABLE_HEADER_SIZE + INITIAL_SLOTS * SLOT_SIZE : 0);
+
+    uint8_t* header = table_->data();
+    if (fresh) {
+        std::memcpy(header, TABLE_MAGIC, 8);
+        storeAt<uint64_t>(header + 8, INITIAL_SLOTS);
+        storeAt<uint64_t>(header + 16, 0);
+    }
+    if (table_->size() < TABLE_HEADER_SIZE || std::memcmp(header, TABLE_MAGIC, 8) != 0) {
+        throw std::runtime_error("Corrupted chunk index: " + path.string());
+    }
+    slotCount_ = loadAt<uint64_t>(header + 8);
+    used_ = loadAt<uint64_t>(header + 16);
+    if (slotCount_ == 0 || (slotCount_ & (slotCount_ - 1)) != 0 ||
+        table_->size() < TABLE_HEADER_SIZE + slotCount_ * SLOT_SIZE) {
+        throw std::runtime_error("Corrupted chunk index: " + path.string());
+    }
+}
+
+void ChunkIndex::placeInto(uint8_t* base, uint64_t slotCount, const ChunkHash& hash,
+                           const ChunkLocation& loc, bool* isNew) {
+    const uint64_t mask = slotCount - 1;
+    for (uint64_t i = ChunkHashHasher()(hash) & mask;; i = (i + 1) & mask) {
+        uint8_t* s = base + i * SLOT_SIZE;
+        const bool occupied = s[SLOT_USED] != 0;
+        if (occupied && std::memcmp(s, hash.data(), 32) != 0) continue;
+
+        std::memcpy(s, hash.data(), 32);
+        storeAt(s + SLOT_PACK, loc.packId);
+        storeAt(s + SLOT_STORED, loc.storedSize);
+        storeAt(s + SLOT_OFFSET, loc.offset);
+        storeAt(s + SLOT_RAW, loc.rawSize);
+        s[SLOT_CODEC] = loc.codec;
+        s[SLOT_USED] = 1;
+        *isNew = !occupied;
+        return;
+    }
+}
+
+bool ChunkIndex::locate(const ChunkHash& hash, uint64_t* index, uint64_t* probes) const {
+    const uint64_t mask = slotCount_ - 1;
+    for (uint64_t i = ChunkHashHasher()(hash) & mask;; i = (i + 1) & mask) {
+        ++*probes;
+        const uint8_t* s = slot(i);
+        if (!s[SLOT_USED]) return false;
+        if (std::memcmp(s, hash.data(), 32) == 0) {
+            *index = i;
+            return true;
+        }
+    }
+}
+
+bool ChunkIndex::find(const ChunkHash& hash, ChunkLocation* loc) {
+    stats_.lookups++;
+    if (!bloomMayContain(hash)) {
+        stats_.bloomRejects++;
+        return false;
+    }
+
+    stats_.tableLookups++;
+    const auto t0 = std::chrono::steady_clock::now();
+    uint64_t i = 0;
+    const bool found = locate(hash, &i, &stats_.probedSlots);
+    if (found && loc) {
+        const uint8_t* s = slot(i);
+        loc->packId = loadAt<uint32_t>(s + SLOT_PACK);
+        loc->storedSize = loadAt<uint32_t>(s + SLOT_STORED);
+        loc->offset = loadAt<uint64_t>(s + SLOT_OFFSET);
+        loc->rawSize = loadAt<uint32_t>(s + SLOT_RAW);
+        loc->codec = s[SLOT_CODEC];
+    }
+    const auto ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count());
+    stats_.tableNanos += ns;
+    int bucket = 0;
+    while (bucket < 39 && (ns >> (bucket + 1)) != 0) ++bucket;
+    stats_.latencyLog2[bucket]++;
+    if (found) stats_.tableHits++;
+    return found;
+}
+
+void ChunkIndex::insert(const ChunkHash& hash, const ChunkLocation& loc) {
+    if (used_ + 1 > maxLoad(slotCount_)) grow();
+    bool isNew = false;
+    placeInto(slot(0), slotCount_, hash, loc, &isNew);
+    if (isNew) {
+        used_++;
+        storeAt<uint64_t>(table_->data() + 16, used_);
+        bloomAdd(hash);
+        bloomDirty_ = true;
+    }
+}
+
+bool ChunkIndex::erase(const ChunkHash& hash) {
+    uint64_t hole = 0, probes = 0;
+    if (!locate(hash, &hole, &probes)) return false;
+
+    // 把后面 "本该放在空洞或更前面" 的项往前挪, 保证探测链不断
+    const uint64_t mask = slotCount_ - 1;
+    for (uint64_t j = (hole + 1) & mask; slot(j)[SLOT_USED]; j = (j + 1) & mask) {
+        ChunkHash other;
+        std::memcpy(other.data(), slot(j), 32);
+        const uint64_t home = ChunkHashHasher()(other) & mask;
+        // home 不在 (hole, j] 这段 (环形) 里, 说明它可以搬到空洞处
+        const bool between = (hole < j) ? (home > hole && home <= j) : (home > hole || home <= j);
+        if (between) continue;
+        std::memcpy(slot(hole), slot(j), SLOT_SIZE);
+        hole = j;
+    }
+    std::memset(slot(hole), 0, SLOT_SIZE);
+    used_--;
+    storeAt<uint64_t>(table_->data() + 16, used_);
+    return true;
+}
+
+void ChunkIndex::rebuildBloom() {
+    resetBloom(maxLoad(slotCount_));
+    forEach([this](const ChunkHash& h, const ChunkLocation&) { bloomAdd(h); });
+    bloomDirty_ = true;
+}
+
+void ChunkIndex::grow() {
+    // 1. 在新文件里建两倍大的表, 逐项重新放置
+    const uint64_t newSlots = slotCount_ * 2;
+    const fs::path path = dir_ / "index.tbl";
+    const fs::path tmp = dir_ / "index.tbl.tmp";
+    fs::remove(tmp);
+    {
+        MappedFile next(tmp, TABLE_HEADER_SIZE + newSlots * SLOT_SIZE);
+        uint8_t* header = next.data();
+        std::memcpy(header, TABLE_MAGIC, 8);
+        storeAt<uint64_t>(header + 8, newSlots);
+        storeAt<uint64_t>(header + 16, used_);
+
+        resetBloom(maxLoad(newSlots));
+        forEach([&](const ChunkHash& h, const ChunkLocation& loc) {
+            bool isNew = false;
+            placeInto(header + TABLE_HEADER_SIZE, newSlots, h, loc, &isNew);
+            bloomAdd(h);
+        });
+        next.sync();
+    }
+
+    // 2. 新表完整落盘后再替换旧表
+    table_.reset();
+    fs::rename(tmp, path);
+    openTable();
+    bloomDirty_ = true;
+}
+
+void ChunkIndex::forEach(const std::function<void(const ChunkHash&, const ChunkLocation&)>& fn) const {
+    for (uint64_t i = 0; i < slotCount_; ++i) {
+        const uint8_t* s = slot(i);
+        if (!s[SLOT_USED]) continue;
+        ChunkHash hash;
+        std::memcpy(hash.data(), s, 32);
+        ChunkLocation loc;
+        loc.packId = loadAt<uint32_t>(s + SLOT_PACK);
+        loc.storedSize = loadAt<uint32_t>(s + SLOT_STORED);
+        loc.offset = loadAt<uint64_t>(s + SLOT_OFFSET);
+        loc.rawSize = loadAt<uint32_t>(s + SLOT_RAW);
+        loc.codec = s[SLOT_CODEC];
+        fn(hash, loc);
+    }
+}
+
+uint64_t ChunkIndex::size() const {
+    return used_;
+}
+
+void ChunkIndex::sync() {
+    table_->sync();
+    if (bloomDirty_) saveBloom();
+}
+
+// ==========================================
+// Bloom 过滤器
+// ==========================================
+// 槽位用哈希的前 8 字节, 过滤器用后面两段, 彼此独立
+void ChunkIndex::resetBloom(uint64_t expectedKeys) {
+    uint64_t bits = std::max<uint64_t>(expectedKeys * BLOOM_BITS_PER_KEY, 1u << 16);
+    bits = std::min<uint64_t>(bits, std::max<uint64_t>(bloomMaxBytes_ * 8, 1u << 16));
+    bits = (bits + 63) / 64 * 64;
+    bloom_.assign(bits / 64, 0);
+    bloomBits_ = bits;
+}
+
+void ChunkIndex::bloomAdd(const ChunkHash& hash) {
+    const uint64_t h1 = loadAt<uint64_t>(hash.data() + 8);
+    const uint64_t h2 = loadAt<uint64_t>(hash.data() + 16) | 1;
+    for (int k = 0; k < BLOOM_HASHES; ++k) {
+        const uint64_t bit = (h1 + k * h2) % bloomBits_;
+        bloom_[bit / 64] |= 1ull << (bit % 64);
+    }
+}
+
+bool ChunkIndex::bloomMayContain(const ChunkHash& hash) const {
+    const uint64_t h1 = loadAt<uint64_t>(hash.data() + 8);
+    const uint64_t h2 = loadAt<uint64_t>(hash.data() + 16) | 1;
+    for (int k = 0; k < BLOOM_HASHES; ++k) {
+        const uint64_t bit = (h1 + k * h2) % bloomBits_;
+        if (!(bloom_[bit / 64] & (1ull << (bit % 64)))) return false;
+    }
+    return true;
+}
+
+// index.bloom: [magic 8][位数 8][对应表的槽位数 8][对应表的项数 8][位数组]
+bool ChunkIndex::loadBloom() {
+    std::ifstream in(dir_ / "index.bloom", std::ios::binary);
+    if (!in) return false;
+    char magic[8];
+    uint64_t bits = 0, slots = 0, used = 0;
+    in.read(magic, 8);
+    in.read(reinterpret_cast<char*>(&bits), 8);
+    in.read(reinterpret_cast<char*>(&slots), 8);
+    in.read(reinterpret_cast<char*>(&used), 8);
+    if (!in || std::memcmp(magic, BLOOM_MAGIC, 8) != 0 || slots != slotCount_ || used != used_) return false;
+
+    resetBloom(maxLoad(slotCount_));
+    if (bits != bloomBits_) return false;
+    in.read(reinterpret_cast<char*>(bloom_.data()), static_cast<std::streamsize>(bloom_.size() * 8));
+    return static_cast<bool>(in);
+}
+
+void ChunkIndex::saveBloom() {
+    const fs::path tmp = dir_ / "index.bloom.tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(BLOOM_MAGIC, 8);
+        out.write(reinterpret_cast<const char*>(&bloomBits_), 8);
+        out.write(reinterpret_cast<const char*>(&slotCount_), 8);
+        out.write(reinterpret_cast<const char*>(&used_), 8);
+        out.write(reinterpret_cast<const char*>(bloom_.data()), static_cast<std::streamsize>(bloom_.size() * 8));
+        if (!out) throw std::runtime_error("Cannot write bloom filter");
+    }
+    fs::rename(tmp, dir_ / "index.bloom");
+    bloomDirty_ = false;
+}
@@ -0,0 +1,591 @@
+// src/ChunkStore.cpp
+#include "ChunkStore.h"
+#include "ByteBuffer.h"
+#include "Codec.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <unordered_set>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <unistd.h>
+#endif
+
+// pack 文件写满后换下一个
+constexpr uint64_t PACK_SIZE_LIMIT = 64ull << 20;
+
+// pack 内每个块的记录头: [哈希 32][codec 1][原始长度 4][存储长度 4]
+constexpr size_t CHUNK_HEADER_SIZE = 32 + 1 + 4 + 4;
+
+// 旧版 index.dat 每条记录: [哈希 32][packId 4][偏移 8][存储长度 4][原始长度 4][codec 1]
+constexpr size_t INDEX_RECORD_SIZE = 32 + 4 + 8 + 4 + 4 + 1;
+
+// 未落盘的新块攒到这么多就自动 flush, 内存占用有上限
+constexpr size_t PENDING_FLUSH_LIMIT = 1u << 16;
+
+// 快照格式: [magic 8][源目录][条目数 8] 之后每个条目; 01 版没有源目录, 条目里也没有纳秒 mtime / ctime / inode
+const char SNAPSHOT_MAGIC[8] = {'M', 'B', 'S', 'N', 'A', 'P', '0', '2'};
+const char SNAPSHOT_MAGIC_V1[8] = {'M', 'B', 'S', 'N', 'A', 'P', '0', '1'};
+
+static std::vector<char> readWholeFile(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + path.string());
+    return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static fs::path ensureDirectory(const fs::path& path) {
+    fs::create_directories(path);
+    return path;
+}
+
+// [新增] 把文件 (或目录项) 刷到磁盘; Windows 上交给系统
+static void syncToDisk(const fs::path& path) {
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Cannot open for fsync: " + path.string());
+    const int rc = ::fsync(fd);
+    ::close(fd);
+    if (rc != 0) throw std::runtime_error("fsync failed: " + path.string());
+#else
+    (void)path;
+#endif
+}
+
+// ==========================================
+// 仓库锁
+// ==========================================
+ChunkStore::RepoLock::RepoLock(const fs::path& root) : path_(ensureDirectory(root) / "lock") {
+    lock();
+}
+
+ChunkStore::RepoLock::~RepoLock() {
+#ifndef _WIN32
+    if (fd_ >= 0) ::close(fd_); // 关闭即解锁
+#endif
+}
+
+#ifndef _WIN32
+void ChunkStore::RepoLock::lock() {
+    if (held_) return;
+    if (fd_ < 0) {
+        fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) throw std::runtime_error("Cannot open repository lock: " + path_.string());
+    }
+    if (::flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+        std::cout << "[Repo] Waiting for " << path_.string() << " (another backup / restore / gc is using the repository)"
+                  << std::endl;
+        while (::flock(fd_, LOCK_EX) != 0) {
+            if (errno != EINTR) throw std::runtime_error("Cannot lock repository: " + path_.string());
+        }
+    }
+    held_ = true;
+}
+
+void ChunkStore::RepoLock::unlock() {
+    if (!held_) return;
+    ::flock(fd_, LOCK_UN);
+    held_ = false;
+}
+#else
+void ChunkStore::RepoLock::lock() { held_ = true; }
+void ChunkStore::RepoLock::unlock() { held_ = false; }
+#endif
+
+ChunkStore::ChunkStore(const std::string& repoPath, CompressionMode compMode, const ChunkerParams& params)
+    : root_(fs::u8path(repoPath)), compMode_(compMode), chunker_(params), lock_(root_), index_(root_) {
+    fs::create_directories(root_ / "packs");
+    fs::create_directories(root_ / "snapshots");
+
+    // 1. 仓库参数: 分块参数必须与建库时一致, 否则旧块永远对不上
+    const fs::path configPath = root_ / "config";
+    if (fs::exists(configPath)) {
+        std::ifstream config(configPath);
+        std::string magic;
+        int version = 0;
+        ChunkerParams stored;
+        config >> magic >> version >> stored.minSize >> stored.avgSize >> stored.maxSize;
+        if (!config || magic != "minibackup-repo" || version != 1) {
+            throw std::runtime_error("Not a minibackup repository: " + repoPath);
+        }
+        chunker_ = Chunker(stored);
+    } else {
+        std::ofstream config(configPath);
+        config << "minibackup-repo 1\n"
+               << params.minSize << " " << params.avgSize << " " << params.maxSize << "\n";
+    }
+
+    // 2. 旧版仓库的追加式 index.dat 导入到磁盘哈希表
+    const fs::path indexPath = root_ / "index.dat";
+    if (fs::exists(indexPath)) {
+        std::vector<char> data = readWholeFile(indexPath);
+        size_t pos = 0;
+        while (pos + INDEX_RECORD_SIZE <= data.size()) {
+            ChunkHash hash;
+            std::memcpy(hash.data(), data.data() + pos, 32);
+            pos += 32;
+            ChunkLocation loc;
+            loc.packId = readPod<uint32_t>(data, pos);
+            loc.offset = readPod<uint64_t>(data, pos);
+            loc.storedSize = readPod<uint32_t>(data, pos);
+            loc.rawSize = readPod<uint32_t>(data, pos);
+            loc.codec = readPod<uint8_t>(data, pos);
+            index_.insert(hash, loc);
+        }
+        index_.sync();
+        fs::remove(indexPath);
+    }
+
+    // 3. 新数据总是写进一个新的 pack, 崩溃时不会弄坏旧 pack
+    for (const auto& entry : fs::directory_iterator(root_ / "packs")) {
+        unsigned id = 0;
+        if (std::sscanf(entry.path().filename().string().c_str(), "pack-%08u.dat", &id) == 1) {
+            writePackId_ = std::max<uint32_t>(writePackId_, id);
+        }
+    }
+}
+
+ChunkStore::~ChunkStore() {
+    try { flush(); } catch (...) {}
+}
+
+// ==========================================
+// 常驻模式
+// ==========================================
+namespace {
+// 仓库有没有被别的进程动过: 索引表和 pack 目录的修改时间 (新块进索引 / 新建 pack / GC 都会改)
+struct RepoStamp {
+    int64_t tableTime = -1;
+    uint64_t tableSize = 0;
+    int64_t packsTime = -1;
+
+    bool operator==(const RepoStamp& o) const {
+        return tableTime == o.tableTime && tableSize == o.tableSize && packsTime == o.packsTime;
+    }
+};
+
+RepoStamp repoStamp(const fs::path& root) {
+    RepoStamp s;
+    std::error_code ec;
+    auto time = fs::last_write_time(root / "index.tbl", ec);
+    if (!ec) {
+        s.tableTime = static_cast<int64_t>(time.time_since_epoch().count());
+        s.tableSize = fs::file_size(root / "index.tbl", ec);
+    }
+    time = fs::last_write_time(root / "packs", ec);
+    if (!ec) s.packsTime = static_cast<int64_t>(time.time_since_epoch().count());
+    return s;
+}
+
+struct ResidentStore {
+    std::shared_ptr<ChunkStore> store;
+    RepoStamp stamp; // 上次用完时的样子
+};
+
+std::mutex g_residentMutex;
+bool g_resident = false;
+std::unordered_map<std::string, ResidentStore> g_residentStores;
+}
+
+void ChunkStore::setResident(bool on) {
+    std::lock_guard<std::mutex> lock(g_residentMutex);
+    g_resident = on;
+    if (!on) g_residentStores.clear();
+}
+
+size_t ChunkStore::residentCount() {
+    std::lock_guard<std::mutex> lock(g_residentMutex);
+    return g_residentStores.size();
+}
+
+std::shared_ptr<ChunkStore> ChunkStore::open(const std::string& repoPath, CompressionMode compMode) {
+    std::lock_guard<std::mutex> lock(g_residentMutex);
+    if (!g_resident) return std::make_shared<ChunkStore>(repoPath, compMode);
+
+    const fs::path root = fs::absolute(fs::u8path(repoPath));
+    const std::string key = root.string();
+    ResidentStore& entry = g_residentStores[key];
+    if (entry.store) entry.store->lock_.lock(); // 先锁住再看仓库有没有被别人动过
+    if (!entry.store || !(entry.stamp == repoStamp(root))) {
+        entry.store.reset(); // 先关掉旧的 (落盘), 再按磁盘上现在的样子打开
+        entry.store = std::make_shared<ChunkStore>(repoPath, compMode);
+    }
+    entry.store->compMode_ = compMode;
+    entry.store->index_.resetStats();
+
+    // 调用方用完时: 落盘, 封上 pack (新数据总是写进新 pack), 记下此刻仓库的样子
+    std::shared_ptr<ChunkStore> held = entry.store;
+    ChunkStore* raw = held.get();
+    return std::shared_ptr<ChunkStore>(raw, [held, key](ChunkStore* store) {
+        std::lock_guard<std::mutex> lock(g_residentMutex);
+        auto it = g_residentStores.find(key);
+        const bool current = it != g_residentStores.end() && it->second.store == held;
+        try {
+            store->flush();
+            store->sealPack();
+            if (current) it->second.stamp = repoStamp(fs::path(key));
+            store->lock_.unlock(); // 任务之间让给别的进程
+        } catch (const std::exception& e) {
+            std::cerr << "[Warn] Closing repository " << key << ": " << e.what() << std::endl;
+            if (current) g_residentStores.erase(it); // 状态不明, 下次重新打开
+        }
+    });
+}
+
+fs::path ChunkStore::packPath(uint32_t id) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "pack-%08u.dat", id);
+    return root_ / "packs" / name;
+}
+
+void ChunkStore::openNextPack() {
+    if (writePack_.is_open()) writePack_.close();
+    writePackId_++;
+    writePack_.open(packPath(writePackId_), std::ios::binary | std::ios::trunc);
+    if (!writePack_.is_open()) throw std::runtime_error("Cannot create pack file in repository");
+    writeOffset_ = 0;
+    newPackFile_ = true;
+}
+
+void ChunkStore::sealPack() {
+    if (writePack_.is_open()) writePack_.close();
+}
+
+bool ChunkStore::contains(const ChunkHash& hash) {
+    return pending_.count(hash) > 0 || index_.find(hash);
+}
+
+ChunkLocation ChunkStore::appendRecord(const ChunkHash& hash, uint8_t codec, uint32_t rawSize,
+                                       const char* stored, size_t storedSize) {
+    if (!writePack_.is_open() || writeOffset_ >= PACK_SIZE_LIMIT) openNextPack();
+
+    std::vector<char> header(hash.begin(), hash.end());
+    appendPod(header, codec);
+    appendPod(header, rawSize);
+    appendPod(header, static_cast<uint32_t>(storedSize));
+    writePack_.write(header.data(), header.size());
+    writePack_.write(stored, static_cast<std::streamsize>(storedSize));
+    if (!writePack_) throw std::runtime_error("Write to repository pack failed");
+    if (unsyncedPacks_.empty() || unsyncedPacks_.back() != writePackId_) unsyncedPacks_.push_back(writePackId_);
+
+    ChunkLocation loc;
+    loc.packId = writePackId_;
+    loc.offset = writeOffset_ + CHUNK_HEADER_SIZE;
+    loc.storedSize = static_cast<uint32_t>(storedSize);
+    loc.rawSize = rawSize;
+    loc.codec = codec;
+    writeOffset_ += CHUNK_HEADER_SIZE + storedSize;
+    return loc;
+}
+
+bool ChunkStore::put(const ChunkHash& hash, const char* data, size_t size) {
+    if (contains(hash)) return false;
+
+    // 压缩后不变小就存原文
+    std::vector<char> stored(data, data + size);
+    uint8_t codec = 0;
+    if (compMode_ != CompressionMode::NONE && size > 0) {
+        std::vector<char> compressed;
+        if (compMode_ == CompressionMode::RLE) rleCompress(stored, compressed);
+        else lzCompress(stored, compressed);
+        if (compressed.size() < stored.size()) {
+            stored.swap(compressed);
+            codec = (compMode_ == CompressionMode::RLE) ? 1 : 2;
+        }
+    }
+
+    ChunkLocation loc = appendRecord(hash, codec, static_cast<uint32_t>(size), stored.data(), stored.size());
+    pending_.emplace(hash, loc);
+    if (pending_.size() >= PENDING_FLUSH_LIMIT) flush();
+    return true;
+}
+
+std::vector<char> ChunkStore::get(const ChunkHash& hash) {
+    ChunkLocation loc;
+    auto it = pending_.find(hash);
+    if (it != pending_.end()) loc = it->second;
+    else if (!index_.find(hash, &loc)) throw std::runtime_error("Chunk missing from repository: " + SHA256::toHex(hash));
+
+    if (writePack_.is_open() && loc.packId == writePackId_) writePack_.flush();
+    if (!readPack_.is_open() || readPackId_ != loc.packId) {
+        readPack_.close();
+        readPack_.clear();
+        readPack_.open(packPath(loc.packId), std::ios::binary);
+        if (!readPack_.is_open()) throw std::runtime_error("Missing pack file: " + packPath(loc.packId).string());
+        readPackId_ = loc.packId;
+    }
+
+    std::vector<char> stored(loc.storedSize);
+    readPack_.clear();
+    readPack_.seekg(static_cast<std::streamoff>(loc.offset));
+    readPack_.read(stored.data(), stored.size());
+    if (!readPack_) throw std::runtime_error("Truncated pack file: " + packPath(loc.packId).string());
+
+    std::vector<char> raw;
+    if (loc.codec == 1) rleDecompress(stored, raw);
+    else if (loc.codec == 2) lzDecompress(stored, raw);
+    else raw.swap(stored);
+
+    if (raw.size() != loc.rawSize || SHA256::hash(raw.data(), raw.size()) != hash) {
+        throw std::runtime_error("Chunk corrupted: " + SHA256::toHex(hash));
+    }
+    return raw;
+}
+
+void ChunkStore::flush() {
+    if (writePack_.is_open()) writePack_.flush();
+    if (pending_.empty()) return;
+    if (writePack_.is_open() && !writePack_) throw std::runtime_error("Write to repository pack failed");
+
+    // pack 数据先落盘 (fsync pack, 新建过 pack 时再 fsync 目录), 再进索引: 崩溃时最多丢掉没有索引的块
+    for (uint32_t id : unsyncedPacks_) syncToDisk(packPath(id));
+    if (newPackFile_) syncToDisk(root_ / "packs");
+    unsyncedPacks_.clear();
+    newPackFile_ = false;
+    for (const auto& [hash, loc] : pending_) index_.insert(hash, loc);
+    index_.sync();
+    pending_.clear();
+}
+
+// ==========================================
+// 快照清单
+// ==========================================
+std::string ChunkStore::writeSnapshot(const std::vector<SnapshotEntry>& entries, const std::string& source) {
+    // 快照引用的块必须先落盘
+    flush();
+
+    std::vector<char> buf(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + 8);
+    appendPod(buf, static_cast<uint64_t>(source.size()));
+    buf.insert(buf.end(), source.begin(), source.end());
+    appendPod(buf, static_cast<uint64_t>(entries.size()));
+    for (const auto& e : entries) {
+        appendPod(buf, e.typeCode);
+        appendPod(buf, static_cast<uint64_t>(e.relPath.size()));
+        buf.insert(buf.end(), e.relPath.begin(), e.relPath.end());
+        appendPod(buf, e.size);
+        appendPod(buf, e.mtime);
+        appendPod(buf, e.mtimeNsec);
+        appendPod(buf, e.ctime);
+        appendPod(buf, e.ctimeNsec);
+        appendPod(buf, e.ino);
+        appendPod(buf, e.mode);
+        appendPod(buf, e.uid);
+        appendPod(buf, e.gid);
+        appendPod(buf, static_cast<uint64_t>(e.linkTarget.size()));
+        buf.insert(buf.end(), e.linkTarget.begin(), e.linkTarget.end());
+        appendPod(buf, static_cast<uint64_t>(e.chunks.size()));
+        for (const auto& c : e.chunks) buf.insert(buf.end(), c.begin(), c.end());
+    }
+
+    // 快照 ID = 本地时间, 同一秒内重复时加序号; 序号接在这一秒最大的后面,
+    // 不填 GC 删出来的空位 (否则新快照排在旧快照前面, latest 就不对了)
+    std::time_t now = std::time(nullptr);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+    unsigned long last = 0;
+    for (const auto& entry : fs::directory_iterator(root_ / "snapshots")) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) name.resize(name.size() - 4);
+        if (name.compare(0, std::strlen(stamp), stamp) != 0) continue;
+        const std::string rest = name.substr(std::strlen(stamp));
+        if (rest.empty()) last = std::max(last, 1ul);
+        else if (rest.size() > 1 && rest[0] == '-') last = std::max(last, std::strtoul(rest.c_str() + 1, nullptr, 10));
+    }
+    const std::string id = last == 0 ? std::string(stamp) : std::string(stamp) + "-" + std::to_string(last + 1);
+
+    // 先写临时文件再改名, 不会留下半个快照; 同 flush() 一样, 改名前文件落盘, 改名后目录落盘,
+    // 掉电后不会出现改了名但内容是空的快照, 也不会丢掉已经报告成功的快照
+    const fs::path tmp = root_ / "snapshots" / (id + ".tmp");
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(buf.data(), buf.size());
+        if (!out) throw std::runtime_error("Cannot write snapshot");
+    }
+    syncToDisk(tmp);
+    fs::rename(tmp, root_ / "snapshots" / id);
+    syncToDisk(root_ / "snapshots");
+    return id;
+}
+
+std::vector<SnapshotEntry> ChunkStore::readSnapshot(const std::string& id) const {
+    const fs::path path = root_ / "snapshots" / fs::u8path(id);
+    if (!fs::exists(path)) throw std::runtime_error("Snapshot not found: " + id);
+
+    std::vector<char> buf = readWholeFile(path);
+    const bool v1 = buf.size() >= 8 && std::memcmp(buf.data(), SNAPSHOT_MAGIC_V1, 8) == 0;
+    if (buf.size() < 16 || (!v1 && std::memcmp(buf.data(), SNAPSHOT_MAGIC, 8) != 0)) {
+        throw std::runtime_error("Corrupted snapshot: " + id);
+    }
+
+    size_t pos = 8;
+    auto readString = [&](std::string& out) {
+        const auto len = readPod<uint64_t>(buf, pos);
+        if (len > buf.size() - pos) throw std::runtime_error("Corrupted snapshot: " + id);
+        out.assign(buf.data() + pos, len);
+        pos += len;
+    };
+
+    std::string source;
+    if (!v1) readString(source);
+    std::vector<SnapshotEntry> entries(readPod<uint64_t>(buf, pos));
+    for (auto& e : entries) {
+        e.typeCode = readPod<uint8_t>(buf, pos);
+        readString(e.relPath);
+        e.size = readPod<uint64_t>(buf, pos);
+        e.mtime = readPod<int64_t>(buf, pos);
+        if (!v1) {
+            e.mtimeNsec = readPod<uint32_t>(buf, pos);
+            e.ctime = readPod<int64_t>(buf, pos);
+            e.ctimeNsec = readPod<uint32_t>(buf, pos);
+            e.ino = readPod<uint64_t>(buf, pos);
+        }
+        e.mode = readPod<uint32_t>(buf, pos);
+        e.uid = readPod<uint32_t>(buf, pos);
+        e.gid = readPod<uint32_t>(buf, pos);
+        readString(e.linkTarget);
+        const auto count = readPod<uint64_t>(buf, pos);
+        if (count > (buf.size() - pos) / 32) throw std::runtime_error("Corrupted snapshot: " + id);
+        e.chunks.resize(count);
+        for (auto& c : e.chunks) {
+            std::memcpy(c.data(), buf.data() + pos, 32);
+            pos += 32;
+        }
+    }
+    return entries;
+}
+
+std::string ChunkStore::snapshotSource(const std::string& id) const {
+    std::ifstream in(root_ / "snapshots" / fs::u8path(id), std::ios::binary);
+    char magic[8];
+    uint64_t len = 0;
+    if (!in.read(magic, 8) || std::memcmp(magic, SNAPSHOT_MAGIC, 8) != 0) return std::string();
+    if (!in.read(reinterpret_cast<char*>(&len), sizeof(len)) || len > (1u << 16)) return std::string();
+    std::string source(len, '\0');
+    if (!in.read(&source[0], static_cast<std::streamsize>(len))) return std::string();
+    return source;
+}
+
+std::vector<std::string> ChunkStore::listSnapshots() const {
+    std::vector<std::string> ids;
+    for (const auto& entry : fs::directory_iterator(root_ / "snapshots")) {
+        if (entry.path().extension() == ".tmp") continue;
+        ids.push_back(entry.path().filename().string());
+    }
+    // ID 是时间戳, 直接按字符串排序就是时间顺序 (同一秒的序号按数值排)
+    std::sort(ids.begin(), ids.end(), [](const std::string& a, const std::string& b) {
+        if (a.size() != b.size() && a.compare(0, 15, b, 0, 15) == 0) return a.size() < b.size();
+        return a < b;
+    });
+    return ids;
+}
+
+void ChunkStore::removeSnapshot(const std::string& id) {
+    const fs::path path = root_ / "snapshots" / fs::u8path(id);
+    if (!fs::remove(path)) throw std::runtime_error("Snapshot not found: " + id);
+}
+
+// ==========================================
+// 垃圾回收
+// ==========================================
+GcStats ChunkStore::collectGarbage(double liveThreshold, uint64_t ioBudget) {
+    flush();
+    GcStats stats;
+
+    // 1. 标记: 所有快照引用到的块
+    std::unordered_set<ChunkHash, ChunkHashHasher> live;
+    for (const auto& id : listSnapshots()) {
+        for (const auto& e : readSnapshot(id)) live.insert(e.chunks.begin(), e.chunks.end());
+    }
+
+    // 2. 清除: 索引里没人引用的块直接删掉, 同时统计每个 pack 的存活字节数
+    std::unordered_map<uint32_t, uint64_t> liveBytes;
+    std::vector<ChunkHash> dead;
+    index_.forEach([&](const ChunkHash& hash, const ChunkLocation& loc) {
+        if (live.count(hash)) {
+            liveBytes[loc.packId] += CHUNK_HEADER_SIZE + loc.storedSize;
+            stats.liveChunks++;
+        } else {
+            dead.push_back(hash);
+        }
+    });
+    for (const auto& hash : dead) index_.erase(hash);
+    stats.removedChunks = dead.size();
+    live.clear();
+
+    // 3. 挑出要处理的 pack: 没有存活块的直接删; 存活率低的按存活率从低到高排队
+    struct Candidate { uint32_t id; uint64_t fileSize; uint64_t live; };
+    std::vector<Candidate> candidates;
+    std::vector<uint32_t> emptyPacks;
+    for (const auto& entry : fs::directory_iterator(root_ / "packs")) {
+        unsigned id = 0;
+        if (std::sscanf(entry.path().filename().string().c_str(), "pack-%08u.dat", &id) != 1) continue;
+        const uint64_t fileSize = entry.file_size();
+        const uint64_t liveSize = liveBytes.count(id) ? liveBytes[id] : 0;
+        if (liveSize == 0) emptyPacks.push_back(id);
+        else if (fileSize > 0 && static_cast<double>(liveSize) / fileSize < liveThreshold) {
+            candidates.push_back({id, fileSize, liveSize});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.live * b.fileSize < b.live * a.fileSize;
+    });
+
+    std::unordered_map<uint32_t, std::vector<std::pair<ChunkHash, ChunkLocation>>> moves;
+    for (const auto& c : candidates) {
+        if (!moves.empty() && stats.copiedBytes + c.live > ioBudget) {
+            stats.deferredPacks++;
+            continue;
+        }
+        moves[c.id];
+        stats.copiedBytes += c.live;
+    }
+
+    // 4. 搬运: 存活块原样 (不解压) 追加到新 pack, 按偏移顺序读旧 pack
+    if (!moves.empty()) {
+        index_.forEach([&](const ChunkHash& hash, const ChunkLocation& loc) {
+            auto it = moves.find(loc.packId);
+            if (it != moves.end()) it->second.emplace_back(hash, loc);
+        });
+        std::vector<char> record;
+        for (auto& [packId, chunks] : moves) {
+            std::sort(chunks.begin(), chunks.end(), [](const auto& a, const auto& b) {
+                return a.second.offset < b.second.offset;
+            });
+            std::ifstream in(packPath(packId), std::ios::binary);
+            if (!in) throw std::runtime_error("Missing pack file: " + packPath(packId).string());
+            for (const auto& [hash, loc] : chunks) {
+                record.resize(loc.storedSize);
+                in.seekg(static_cast<std::streamoff>(loc.offset));
+                in.read(record.data(), record.size());
+                if (!in) throw std::runtime_error("Truncated pack file: " + packPath(packId).string());
+                pending_[hash] = appendRecord(hash, loc.codec, loc.rawSize, record.data(), record.size());
+            }
+        }
+        // 新位置落盘并写进索引之后, 旧 pack 才能删
+        flush();
+    }
+
+    // 5. 删除旧 pack
+    readPack_.close();
+    for (const auto& [packId, chunks] : moves) {
+        stats.reclaimedBytes += fs::file_size(packPath(packId));
+        fs::remove(packPath(packId));
+        stats.rewrittenPacks++;
+    }
+    if (moves.size()) stats.reclaimedBytes -= stats.copiedBytes;
+    for (uint32_t id : emptyPacks) {
+        if (writePack_.is_open() && id == writePackId_) continue;
+        stats.reclaimedBytes += fs::file_size(packPath(id));
+        fs::remove(packPath(id));
+        stats.deletedPacks++;
+    }
+
+    index_.rebuildBloom();
+    index_.sync();
+    return stats;
+}
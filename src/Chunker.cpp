@@ -0,0 +1,310 @@
+// src/Chunker.cpp
+#include "Chunker.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    #include <immintrin.h>
+    #define MINIBACKUP_AVX2_KERNEL 1
+#endif
+
+namespace fs = std::filesystem;
+
+// Gear 滚动哈希的窗口: 每步左移一位, 64 步之前的字节已被移出
+constexpr size_t GEAR_WINDOW = 64;
+
+// lane 内核: 每条 lane 负责一段连续的 256 个位置, 4 条 lane 同时推进
+constexpr size_t LANE_COUNT = 4;
+constexpr size_t LANE_LEN = 256;
+
+// 数据量小于这个值时不值得分段并行
+constexpr size_t PARALLEL_MIN_BYTES = 4u << 20;
+
+const uint64_t* Chunker::gearTable() {
+    static const auto table = [] {
+        struct Table { uint64_t v[256]; } t{};
+        uint64_t seed = 0x6d696e696261636bull; // "minibac k"
+        for (auto& v : t.v) {
+            // splitmix64
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            v = z ^ (z >> 31);
+        }
+        return t;
+    }();
+    return table.v;
+}
+
+// 取高位做掩码: 左移哈希的高位混入了整个窗口的字节
+static uint64_t topBitsMask(int bits) {
+    if (bits <= 0) return 0;
+    if (bits >= 64) return ~0ull;
+    return ((1ull << bits) - 1) << (64 - bits);
+}
+
+// ==========================================
+// 切点查找内核
+// ==========================================
+// 三个内核都返回 [from, to) 中第一个 (H(i) & mask) == 0 的位置 i, 找不到返回 to
+// H(i) 从 from-64 开始预热, 调用方保证 from >= 64
+
+static size_t searchScalar(const uint8_t* data, size_t from, size_t to, uint64_t mask, const uint64_t* gear) {
+    uint64_t h = 0;
+    for (size_t i = from - GEAR_WINDOW; i < from; ++i) h = (h << 1) + gear[data[i]];
+    for (size_t i = from; i < to; ++i) {
+        h = (h << 1) + gear[data[i]];
+        if (!(h & mask)) return i;
+    }
+    return to;
+}
+
+// 4 条互不依赖的哈希链交错推进, 让 CPU 同时发射 (打破单条链的延迟瓶颈)
+static size_t searchLanes(const uint8_t* data, size_t from, size_t to, uint64_t mask, const uint64_t* gear) {
+    size_t p = from;
+    while (to - p >= LANE_COUNT * LANE_LEN) {
+        const uint8_t* base[LANE_COUNT];
+        uint64_t h[LANE_COUNT] = {0, 0, 0, 0};
+        for (size_t j = 0; j < LANE_COUNT; ++j) base[j] = data + p + j * LANE_LEN;
+
+        for (size_t w = GEAR_WINDOW; w > 0; --w) {
+            for (size_t j = 0; j < LANE_COUNT; ++j) h[j] = (h[j] << 1) + gear[base[j][-static_cast<ptrdiff_t>(w)]];
+        }
+
+        size_t hit[LANE_COUNT] = {LANE_LEN, LANE_LEN, LANE_LEN, LANE_LEN};
+        for (size_t t = 0; t < LANE_LEN; ++t) {
+            bool any = false;
+            for (size_t j = 0; j < LANE_COUNT; ++j) {
+                h[j] = (h[j] << 1) + gear[base[j][t]];
+                any |= !(h[j] & mask);
+            }
+            if (!any) continue;
+            for (size_t j = 0; j < LANE_COUNT; ++j) {
+                if (!(h[j] & mask) && hit[j] == LANE_LEN) hit[j] = t;
+            }
+            if (hit[0] != LANE_LEN) break; // 第一条 lane 命中, 后面的 lane 不可能更早
+        }
+        for (size_t j = 0; j < LANE_COUNT; ++j) {
+            if (hit[j] != LANE_LEN) return p + j * LANE_LEN + hit[j];
+        }
+        p += LANE_COUNT * LANE_LEN;
+    }
+    return searchScalar(data, p, to, mask, gear);
+}
+
+#ifdef MINIBACKUP_AVX2_KERNEL
+// 前缀倍增: h(i) = 2*h(i-1) + g(i), 所以已知 c = h(i-1) 时
+//   h(i+k) = (c << (k+1)) + P(k),  P(k) = sum_{t<=k} g(i+t) << (k-t)
+// P 只依赖 Gear 值, 可以在向量里用两次移位相加算出, 一次推进 8 个位置;
+// 串行依赖链只剩 "广播 c -> 移位 -> 相加", 每 8 字节一次, 而不是每字节一次
+__attribute__((target("avx2")))
+static inline __m256i prefixSum4(__m256i v) {
+    // 向高位 lane 平移 1 个 / 2 个 lane, 低位补 0
+    __m256i up1 = _mm256_blend_epi32(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(2, 1, 0, 0)),
+                                     _mm256_setzero_si256(), 0x03);
+    v = _mm256_add_epi64(v, _mm256_slli_epi64(up1, 1));
+    __m256i up2 = _mm256_permute2x128_si256(v, v, 0x08);
+    return _mm256_add_epi64(v, _mm256_slli_epi64(up2, 2));
+}
+
+__attribute__((target("avx2")))
+static size_t searchAvx2(const uint8_t* data, size_t from, size_t to, uint64_t mask, const uint64_t* gear) {
+    const __m256i maskV = _mm256_set1_epi64x(static_cast<long long>(mask));
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i shiftLo = _mm256_set_epi64x(4, 3, 2, 1);
+    const __m256i shiftHi = _mm256_set_epi64x(8, 7, 6, 5);
+
+    uint64_t c = 0;
+    for (size_t i = from - GEAR_WINDOW; i < from; ++i) c = (c << 1) + gear[data[i]];
+
+    size_t p = from;
+    alignas(32) uint64_t g[8];
+    while (to - p >= 8) {
+        for (int k = 0; k < 8; ++k) g[k] = gear[data[p + k]];
+        __m256i pLo = prefixSum4(_mm256_load_si256(reinterpret_cast<const __m256i*>(g)));
+        __m256i pHi = prefixSum4(_mm256_load_si256(reinterpret_cast<const __m256i*>(g + 4)));
+        // 后 4 个位置还要加上前 4 个的累计: P(3) << (1..4)
+        pHi = _mm256_add_epi64(pHi, _mm256_sllv_epi64(_mm256_permute4x64_epi64(pLo, 0xFF), shiftLo));
+
+        const __m256i cv = _mm256_set1_epi64x(static_cast<long long>(c));
+        const __m256i hLo = _mm256_add_epi64(_mm256_sllv_epi64(cv, shiftLo), pLo);
+        const __m256i hHi = _mm256_add_epi64(_mm256_sllv_epi64(cv, shiftHi), pHi);
+
+        const __m256i zLo = _mm256_cmpeq_epi64(_mm256_and_si256(hLo, maskV), zero);
+        const __m256i zHi = _mm256_cmpeq_epi64(_mm256_and_si256(hHi, maskV), zero);
+        const int bits = _mm256_movemask_pd(_mm256_castsi256_pd(zLo)) |
+                         (_mm256_movemask_pd(_mm256_castsi256_pd(zHi)) << 4);
+        if (bits) return p + __builtin_ctz(static_cast<unsigned>(bits));
+
+        c = static_cast<uint64_t>(_mm256_extract_epi64(hHi, 3));
+        p += 8;
+    }
+    for (; p < to; ++p) {
+        c = (c << 1) + gear[data[p]];
+        if (!(c & mask)) return p;
+    }
+    return to;
+}
+#endif
+
+bool Chunker::avx2Supported() {
+#ifdef MINIBACKUP_AVX2_KERNEL
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+const char* Chunker::kernelName(ChunkerKernel kernel) {
+    switch (kernel) {
+        case ChunkerKernel::SCALAR: return "scalar";
+        case ChunkerKernel::LANES: return "lanes";
+        case ChunkerKernel::AVX2: return "avx2";
+        default: return "auto";
+    }
+}
+
+// ==========================================
+// Chunker
+// ==========================================
+Chunker::Chunker(const ChunkerParams& params, ChunkerKernel kernel) : params_(params), kernel_(kernel) {
+    if (params_.minSize < GEAR_WINDOW || params_.minSize > params_.avgSize || params_.avgSize > params_.maxSize) {
+        throw std::invalid_argument("Invalid chunker parameters");
+    }
+    // 实测 (chunker_bench): Gear 查表是访存瓶颈, AVX2 省下的移位加法抵不过打包开销,
+    // 4 条 lane 交错的标量版在有无 AVX2 的机器上都最快, 所以默认用它
+    if (kernel_ == ChunkerKernel::AUTO) kernel_ = ChunkerKernel::LANES;
+    if (kernel_ == ChunkerKernel::AVX2 && !avx2Supported()) kernel_ = ChunkerKernel::LANES;
+
+    int bits = 0;
+    while ((1u << (bits + 1)) <= params_.avgSize) ++bits;
+    // 归一化分块 (FastCDC): 平均长度前后各偏移 2 位
+    maskS_ = topBitsMask(bits + 2);
+    maskL_ = topBitsMask(bits - 2);
+}
+
+size_t Chunker::search(const uint8_t* data, size_t from, size_t to, uint64_t mask) const {
+    if (from >= to) return to;
+    const uint64_t* gear = gearTable();
+    switch (kernel_) {
+#ifdef MINIBACKUP_AVX2_KERNEL
+        case ChunkerKernel::AVX2: return searchAvx2(data, from, to, mask, gear);
+#endif
+        case ChunkerKernel::LANES: return searchLanes(data, from, to, mask, gear);
+        default: return searchScalar(data, from, to, mask, gear);
+    }
+}
+
+size_t Chunker::cut(const uint8_t* data, size_t len) const {
+    if (len <= params_.minSize) return len;
+    const size_t end = std::min<size_t>(len, params_.maxSize);
+    const size_t normal = std::min<size_t>(params_.avgSize, end);
+
+    size_t i = search(data, params_.minSize, normal, maskS_);
+    if (i < normal) return i + 1;
+    i = search(data, normal, end, maskL_);
+    return i < end ? i + 1 : end;
+}
+
+void Chunker::splitRange(const uint8_t* data, size_t start, size_t stop, size_t len,
+                         std::vector<size_t>& cuts) const {
+    size_t pos = start;
+    while (pos < len) {
+        pos += cut(data + pos, len - pos);
+        cuts.push_back(pos);
+        if (pos >= stop) break;
+    }
+}
+
+size_t Chunker::split(const uint8_t* data, size_t len, bool eof, std::vector<size_t>& lengths,
+                      ThreadPool* pool) const {
+    std::vector<size_t> cuts;
+    const size_t threads = pool ? pool->size() : 1;
+
+    if (threads > 1 && len >= PARALLEL_MIN_BYTES) {
+        // 1. 分段: 每段假设自己从段首开始一个新块, 各自切到越过段尾为止
+        std::vector<size_t> bounds(threads + 1);
+        for (size_t k = 0; k <= threads; ++k) bounds[k] = len * k / threads;
+
+        std::vector<std::vector<size_t>> parts(threads);
+        std::vector<std::future<void>> jobs;
+        for (size_t k = 1; k < threads; ++k) {
+            jobs.push_back(pool->submit([&, k] { splitRange(data, bounds[k], bounds[k + 1], len, parts[k]); }));
+        }
+        splitRange(data, 0, bounds[1], len, cuts);
+
+        // 2. 拼接: 真实切点链从上一段延伸过来, 一旦与本段的某个切点重合,
+        //    之后的切点就完全相同 (切点只取决于块起点之后的内容)
+        for (size_t k = 1; k < threads; ++k) {
+            jobs[k - 1].get();
+            const auto& part = parts[k];
+            size_t pos = cuts.empty() ? 0 : cuts.back();
+            while (pos < len) {
+                auto it = std::lower_bound(part.begin(), part.end(), pos);
+                if (it != part.end() && *it == pos) {
+                    cuts.insert(cuts.end(), it + 1, part.end());
+                    break;
+                }
+                if (pos >= bounds[k + 1]) break; // 本段内没对齐, 交给下一段
+                pos += cut(data + pos, len - pos);
+                cuts.push_back(pos);
+            }
+        }
+    } else {
+        splitRange(data, 0, len, len, cuts);
+    }
+
+    // 3. 不是文件末尾时, 起点之后不足一个最大块的切点还不可靠, 留给下次
+    size_t prev = 0;
+    for (size_t c : cuts) {
+        if (!eof && len - prev < params_.maxSize) break;
+        lengths.push_back(c - prev);
+        prev = c;
+    }
+    return prev;
+}
+
+uint64_t Chunker::chunkFile(const std::string& path,
+                            const std::function<void(const char*, size_t)>& onChunk,
+                            ThreadPool* pool) const {
+    std::ifstream in(fs::u8path(path), std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open file: " + path);
+
+    // 多线程时每个线程至少分到几 MB, 否则分段拼接的开销不划算
+    size_t bufSize = std::max<size_t>(4u << 20, params_.maxSize * 4);
+    if (pool && pool->size() > 1) bufSize = std::max<size_t>(bufSize, pool->size() * (8u << 20));
+    std::vector<char> buf(bufSize);
+
+    size_t filled = 0;
+    uint64_t total = 0;
+    bool eof = false;
+    std::vector<size_t> lengths;
+
+    while (true) {
+        if (!eof) {
+            in.read(buf.data() + filled, static_cast<std::streamsize>(buf.size() - filled));
+            filled += static_cast<size_t>(in.gcount());
+            if (filled < buf.size()) eof = true;
+        }
+        if (filled == 0) break;
+
+        lengths.clear();
+        const size_t consumed = split(reinterpret_cast<const uint8_t*>(buf.data()), filled, eof, lengths, pool);
+        size_t pos = 0;
+        for (size_t n : lengths) {
+            onChunk(buf.data() + pos, n);
+            pos += n;
+        }
+        total += consumed;
+
+        std::memmove(buf.data(), buf.data() + consumed, filled - consumed);
+        filled -= consumed;
+        if (eof && filled == 0) break;
+    }
+    return total;
+}
@@ -0,0 +1,272 @@
+// src/Codec.cpp
+#include "Codec.h"
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+// ==========================================
+// RLE
+// ==========================================
+void rleCompress(const std::vector<char>& input, std::vector<char>& output) {
+    if (input.empty()) return;
+    for (size_t i = 0; i < input.size(); ++i) {
+        unsigned char count = 1;
+        while (i + 1 < input.size() && input[i] == input[i+1] && count < 255) {
+            count++; i++;
+        }
+        output.push_back(static_cast<char>(count));
+        output.push_back(input[i]);
+    }
+}
+
+void rleDecompress(const std::vector<char>& input, std::vector<char>& output) {
+    if (input.empty()) return;
+    for (size_t i = 0; i < input.size(); i += 2) {
+        if (i + 1 >= input.size()) break;
+        const auto count = static_cast<unsigned char>(input[i]);
+        char value = input[i+1];
+        for (int k = 0; k < count; ++k) output.push_back(value);
+    }
+}
+
+// ==========================================
+// LZ77
+// ==========================================
+// 序列格式: [token][字面量长度扩展][字面量][偏移 2 字节][匹配长度扩展]
+// token 高 4 位是字面量长度, 低 4 位是 (匹配长度 - 4), 等于 15 时后面跟 255 进位的扩展字节
+// 最后一个序列只有字面量, 没有偏移
+constexpr size_t LZ_MIN_MATCH = 4;
+constexpr int LZ_HASH_BITS = 16;
+constexpr uint32_t LZ_EMPTY = 0xFFFFFFFF;
+
+static void writeLength(std::vector<char>& out, size_t len) {
+    while (len >= 255) {
+        out.push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    out.push_back(static_cast<char>(len));
+}
+
+static void emitSequence(std::vector<char>& out, const uint8_t* literals, size_t litLen,
+                         size_t offset, size_t matchLen) {
+    const size_t litCode = std::min<size_t>(litLen, 15);
+    const size_t matchCode = matchLen ? std::min<size_t>(matchLen - LZ_MIN_MATCH, 15) : 0;
+    out.push_back(static_cast<char>((litCode << 4) | matchCode));
+    if (litCode == 15) writeLength(out, litLen - 15);
+    out.insert(out.end(), literals, literals + litLen);
+
+    if (matchLen == 0) return;
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>((offset >> 8) & 0xFF));
+    if (matchCode == 15) writeLength(out, matchLen - LZ_MIN_MATCH - 15);
+}
+
+void lzCompress(const std::vector<char>& input, std::vector<char>& output, const std::string& dict) {
+    if (input.empty()) return;
+
+    // 工作区 = 字典末尾 (最多一个窗口) + 输入, 匹配时不用区分两段
+    const size_t dictLen = std::min(dict.size(), LZ_WINDOW);
+    std::vector<uint8_t> buf;
+    buf.reserve(dictLen + input.size());
+    buf.insert(buf.end(), dict.end() - dictLen, dict.end());
+    buf.insert(buf.end(), input.begin(), input.end());
+
+    const uint8_t* src = buf.data();
+    const size_t n = buf.size();
+    std::vector<uint32_t> table(1u << LZ_HASH_BITS, LZ_EMPTY);
+
+    auto hash4 = [src](size_t p) {
+        uint32_t v;
+        std::memcpy(&v, src + p, 4);
+        return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+    };
+
+    // 预热: 字典里的位置先放进哈希表
+    for (size_t p = 0; p + LZ_MIN_MATCH <= dictLen; ++p) table[hash4(p)] = static_cast<uint32_t>(p);
+
+    size_t pos = dictLen;
+    size_t anchor = dictLen;
+    while (pos + LZ_MIN_MATCH <= n) {
+        const uint32_t h = hash4(pos);
+        const uint32_t cand = table[h];
+        table[h] = static_cast<uint32_t>(pos);
+
+        if (cand != LZ_EMPTY && pos - cand <= LZ_WINDOW && std::memcmp(src + cand, src + pos, LZ_MIN_MATCH) == 0) {
+            size_t len = LZ_MIN_MATCH;
+            while (pos + len < n && src[cand + len] == src[pos + len]) ++len;
+
+            emitSequence(output, src + anchor, pos - anchor, pos - cand, len);
+            for (size_t k = pos + 1; k < pos + len && k + LZ_MIN_MATCH <= n; ++k) {
+                table[hash4(k)] = static_cast<uint32_t>(k);
+            }
+            pos += len;
+            anchor = pos;
+        } else {
+            ++pos;
+        }
+    }
+    emitSequence(output, src + anchor, n - anchor, 0, 0);
+}
+
+void lzDecompress(const std::vector<char>& input, std::vector<char>& output, const std::string& dict) {
+    if (input.empty()) return;
+
+    const size_t dictLen = std::min(dict.size(), LZ_WINDOW);
+    std::vector<char> out(dict.end() - dictLen, dict.end());
+    out.reserve(dictLen + input.size() * 3);
+
+    const auto* in = reinterpret_cast<const uint8_t*>(input.data());
+    const size_t n = input.size();
+    size_t ip = 0;
+
+    auto readLength = [&](size_t len) {
+        uint8_t b;
+        do {
+            if (ip >= n) throw std::runtime_error("Corrupted LZ data");
+            b = in[ip++];
+            len += b;
+        } while (b == 255);
+        return len;
+    };
+
+    while (ip < n) {
+        const uint8_t token = in[ip++];
+        size_t litLen = token >> 4;
+        if (litLen == 15) litLen = readLength(litLen);
+        if (litLen > n - ip) throw std::runtime_error("Corrupted LZ data");
+        out.insert(out.end(), input.begin() + ip, input.begin() + ip + litLen);
+        ip += litLen;
+        if (ip >= n) break;
+
+        if (ip + 2 > n) throw std::runtime_error("Corrupted LZ data");
+        const size_t offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        size_t matchLen = token & 0x0F;
+        if (matchLen == 15) matchLen = readLength(matchLen);
+        matchLen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > out.size()) throw std::runtime_error("Corrupted LZ data");
+
+        // 逐字节复制, 允许源和目标重叠
+        const size_t from = out.size() - offset;
+        for (size_t k = 0; k < matchLen; ++k) out.push_back(out[from + k]);
+    }
+    output.insert(output.end(), out.begin() + dictLen, out.end());
+}
+
+// ==========================================
+// 字典训练
+// ==========================================
+// d-mer 正好 8 字节, 直接当 64 位整数用, 不用再哈希
+constexpr size_t DMER = 8;
+constexpr size_t SEGMENT = 64;
+
+static uint64_t loadDmer(const std::string& s, size_t pos) {
+    uint64_t v;
+    std::memcpy(&v, s.data() + pos, DMER);
+    return v;
+}
+
+std::string trainDictionary(const std::vector<std::string>& samples, size_t dictSize) {
+    if (dictSize == 0 || samples.empty()) return "";
+
+    // 1. 统计每个 d-mer 出现在多少个样本中 (同一样本只算一次)
+    std::unordered_map<uint64_t, uint32_t> freq;
+    for (const auto& s : samples) {
+        std::unordered_set<uint64_t> seen;
+        for (size_t i = 0; i + DMER <= s.size(); ++i) {
+            const uint64_t d = loadDmer(s, i);
+            if (seen.insert(d).second) freq[d]++;
+        }
+    }
+
+    // 片段得分 = 其中 (去重后) 被至少两个样本共享的 d-mer 的频次之和
+    auto score = [&](const std::string& s, size_t off, size_t len) {
+        uint64_t total = 0;
+        std::unordered_set<uint64_t> seen;
+        for (size_t i = off; i + DMER <= off + len; ++i) {
+            const uint64_t d = loadDmer(s, i);
+            if (!seen.insert(d).second) continue;
+            auto it = freq.find(d);
+            if (it != freq.end() && it->second >= 2) total += it->second;
+        }
+        return total;
+    };
+
+    struct Candidate {
+        uint64_t score;
+        uint32_t sample;
+        uint32_t offset;
+        uint32_t length;
+        bool operator<(const Candidate& o) const { return score < o.score; }
+    };
+
+    // 2. 每个样本按半个片段步长切出候选片段
+    std::priority_queue<Candidate> heap;
+    for (uint32_t si = 0; si < samples.size(); ++si) {
+        const auto& s = samples[si];
+        for (size_t off = 0; off + DMER <= s.size(); off += SEGMENT / 2) {
+            const size_t len = std::min(SEGMENT, s.size() - off);
+            const uint64_t sc = score(s, off, len);
+            if (sc > 0) heap.push({sc, si, static_cast<uint32_t>(off), static_cast<uint32_t>(len)});
+        }
+    }
+
+    // 3. 惰性贪心: 弹出后重新打分, 仍是最高分才选中, 选中后它的 d-mer 不再计分
+    std::vector<Candidate> chosen;
+    size_t total = 0;
+    while (total < dictSize && !heap.empty()) {
+        Candidate c = heap.top();
+        heap.pop();
+        const auto& s = samples[c.sample];
+        c.score = score(s, c.offset, c.length);
+        if (c.score == 0) continue;
+        if (!heap.empty() && c.score < heap.top().score) {
+            heap.push(c);
+            continue;
+        }
+        chosen.push_back(c);
+        total += c.length;
+        for (size_t i = c.offset; i + DMER <= c.offset + c.length; ++i) freq[loadDmer(s, i)] = 0;
+    }
+
+    // 4. 分数最高的片段放在字典末尾, 离数据最近, 偏移最短
+    std::string dict;
+    dict.reserve(total);
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+        dict.append(samples[it->sample], it->offset, it->length);
+    }
+    if (dict.size() > dictSize) dict.erase(0, dict.size() - dictSize);
+    return dict;
+}
+
+// ==========================================
+// 样本采集 (蓄水池抽样)
+// ==========================================
+void SampleReservoir::offer(const std::string& absPath, uint64_t size) {
+    if (size < DMER || size > maxFileSize_ || capacity_ == 0) return;
+    seen_++;
+    if (paths_.size() < capacity_) {
+        paths_.push_back(absPath);
+        return;
+    }
+    const uint64_t j = rng_() % seen_;
+    if (j < capacity_) paths_[j] = absPath;
+}
+
+std::vector<std::string> SampleReservoir::load() const {
+    std::vector<std::string> samples;
+    samples.reserve(paths_.size());
+    for (const auto& p : paths_) {
+        std::ifstream in(fs::u8path(p), std::ios::binary);
+        if (!in) continue;
+        samples.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    return samples;
+}
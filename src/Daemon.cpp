@@ -0,0 +1,544 @@
+// src/Daemon.cpp
+#include "Daemon.h"
+#include "ChunkStore.h"
+#include "ScanCache.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+
+#ifndef _WIN32
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+// ==========================================
+// 1. cron 时间表
+// ==========================================
+namespace {
+std::tm localTime(std::time_t t) {
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    return tm;
+}
+
+int parseNumber(const std::string& text, int lo, int hi, const std::string& field) {
+    if (text.empty() || text.size() > 4 ||
+        !std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        throw std::runtime_error("Bad schedule field: " + field);
+    }
+    const int value = std::stoi(text);
+    if (value < lo || value > hi) throw std::runtime_error("Schedule value out of range: " + field);
+    return value;
+}
+
+// 一段时间: 逗号分隔的 *、a、a-b, 每项可以带 /步长; wrap 之外的值 (周里的 7) 折回 0
+template <size_t N>
+void parseField(const std::string& field, int lo, int hi, std::bitset<N>& bits, int wrap = -1) {
+    bits.reset();
+    std::stringstream items(field);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        int step = 1;
+        const size_t slash = item.find('/');
+        if (slash != std::string::npos) {
+            step = parseNumber(item.substr(slash + 1), 1, hi, field);
+            item.erase(slash);
+        }
+        int from = lo, to = hi;
+        if (item != "*") {
+            const size_t dash = item.find('-');
+            from = parseNumber(item.substr(0, dash), lo, hi, field);
+            if (dash != std::string::npos) to = parseNumber(item.substr(dash + 1), from, hi, field);
+            else if (slash == std::string::npos) to = from; // "5/10" 和 cron 一样表示 5-最大值/10
+        }
+        for (int v = from; v <= to; v += step) bits.set(static_cast<size_t>(v == wrap ? 0 : v));
+    }
+    if (bits.none()) throw std::runtime_error("Bad schedule field: " + field);
+}
+}
+
+CronSchedule CronSchedule::parse(const std::string& spec) {
+    std::string text = spec;
+    if (text == "@hourly") text = "0 * * * *";
+    else if (text == "@daily" || text == "@midnight") text = "0 0 * * *";
+    else if (text == "@weekly") text = "0 0 * * 0";
+    else if (text == "@monthly") text = "0 0 1 * *";
+    else if (text == "@yearly" || text == "@annually") text = "0 0 1 1 *";
+
+    std::istringstream in(text);
+    std::vector<std::string> fields;
+    for (std::string f; in >> f;) fields.push_back(f);
+    if (fields.size() != 5) throw std::runtime_error("Schedule needs 5 fields (min hour day month weekday): " + spec);
+
+    CronSchedule s;
+    parseField(fields[0], 0, 59, s.minutes_);
+    parseField(fields[1], 0, 23, s.hours_);
+    parseField(fields[2], 1, 31, s.days_);
+    parseField(fields[3], 1, 12, s.months_);
+    parseField(fields[4], 0, 7, s.weekdays_, 7);
+    s.anyDay_ = fields[2][0] == '*';
+    s.anyWeekday_ = fields[4][0] == '*';
+    return s;
+}
+
+// 和 cron 一样: 日和周都限定了时满足其一即可, 否则两个都要满足
+bool CronSchedule::dayMatches(const std::tm& tm) const {
+    const bool day = days_[static_cast<size_t>(tm.tm_mday)];
+    const bool weekday = weekdays_[static_cast<size_t>(tm.tm_wday)];
+    if (!anyDay_ && !anyWeekday_) return day || weekday;
+    return day && weekday;
+}
+
+// 从 after 的下一分钟开始按真实时间往后找, 月 / 日不符合时用 mktime 跳到下一段的零点, 时 / 分按真实时间前进,
+// 所以返回值一定晚于 after: 夏令时开始时跳过的那一小时不会匹配, 结束时重复的那一小时走两遍。
+// 和 cron 一样, 每小时都跑的任务两遍都跑, 定了钟点的任务第二遍跳过
+std::time_t CronSchedule::next(std::time_t after) const {
+    std::time_t t = after - localTime(after).tm_sec + 60;
+    const int lastYear = localTime(after).tm_year + 8; // 闰年的 2 月 29 日最多隔 8 年
+    auto startOf = [](std::tm tm) {
+        tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+        return std::mktime(&tm);
+    };
+    for (std::tm tm = localTime(t); tm.tm_year <= lastYear; tm = localTime(t)) {
+        std::time_t n;
+        if (!months_[static_cast<size_t>(tm.tm_mon + 1)]) {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            n = startOf(tm);
+        } else if (!dayMatches(tm)) {
+            tm.tm_mday++;
+            n = startOf(tm);
+        } else if (!hours_[static_cast<size_t>(tm.tm_hour)]) {
+            n = t + (60 - tm.tm_min) * 60 - tm.tm_sec;
+        } else if (!minutes_[static_cast<size_t>(tm.tm_min)]) {
+            n = t + 60 - tm.tm_sec;
+        } else {
+            const std::tm before = localTime(t - 3600);
+            if (hours_.all() || before.tm_hour != tm.tm_hour || before.tm_mday != tm.tm_mday) return t;
+            n = t + 60; // 重复的那一小时, 定点任务第一遍已经跑过
+        }
+        if (n == -1) return -1;
+        t = n > t ? n : t + 60;
+    }
+    return -1;
+}
+
+// ==========================================
+// 2. 命令行切分
+// ==========================================
+std::vector<std::string> Daemon::splitArgs(const std::string& line) {
+    std::vector<std::string> args;
+    std::string cur;
+    bool inWord = false, quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        const char c = line[i];
+        if (quoted) {
+            if (c == '\\' && i + 1 < line.size() && (line[i + 1] == '"' || line[i + 1] == '\\')) cur += line[++i];
+            else if (c == '"') quoted = false;
+            else cur += c;
+        } else if (c == '"') {
+            quoted = inWord = true;
+        } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            if (inWord) args.push_back(std::move(cur));
+            cur.clear();
+            inWord = false;
+        } else {
+            cur += c;
+            inWord = true;
+        }
+    }
+    if (quoted) throw std::runtime_error("Unterminated quote: " + line);
+    if (inWord) args.push_back(std::move(cur));
+    return args;
+}
+
+std::string Daemon::joinArgs(const std::vector<std::string>& args) {
+    std::string line;
+    for (const auto& a : args) {
+        if (!line.empty()) line += ' ';
+        if (!a.empty() && a.find_first_of(" \t\r\n\"\\") == std::string::npos) {
+            line += a;
+            continue;
+        }
+        line += '"';
+        for (char c : a) {
+            if (c == '"' || c == '\\') line += '\\';
+            line += c;
+        }
+        line += '"';
+    }
+    return line;
+}
+
+// ==========================================
+// 3. 定时任务
+// ==========================================
+Daemon::Daemon(const DaemonOptions& options, Runner runner)
+    : options_(options), runner_(std::move(runner)), random_(std::random_device()()) {}
+
+void Daemon::loadJobs() {
+    std::vector<Job> jobs;
+    if (!options_.jobsFile.empty()) {
+        std::ifstream in(options_.jobsFile);
+        if (!in) throw std::runtime_error("Cannot open jobs file: " + options_.jobsFile.string());
+        std::string line;
+        for (int lineNo = 1; std::getline(in, line); ++lineNo) {
+            const std::string where = options_.jobsFile.string() + ":" + std::to_string(lineNo) + ": ";
+            const size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') continue;
+            try {
+                std::vector<std::string> tokens = splitArgs(line);
+
+                Job job;
+                job.line = line;
+                size_t pos = 1;
+                if (tokens[0][0] == '@') {
+                    job.schedule = CronSchedule::parse(tokens[0]);
+                } else {
+                    if (tokens.size() < 5) throw std::runtime_error("Schedule needs 5 fields");
+                    job.schedule = CronSchedule::parse(tokens[0] + " " + tokens[1] + " " + tokens[2] + " " +
+                                                       tokens[3] + " " + tokens[4]);
+                    pos = 5;
+                }
+                if (pos < tokens.size() && tokens[pos].rfind("jitter=", 0) == 0) {
+                    job.jitter = static_cast<unsigned>(std::stoul(tokens[pos].substr(7)));
+                    pos++;
+                }
+                if (pos >= tokens.size()) throw std::runtime_error("Missing command");
+                job.args.assign(tokens.begin() + static_cast<std::ptrdiff_t>(pos), tokens.end());
+                jobs.push_back(std::move(job));
+            } catch (const std::exception& e) {
+                throw std::runtime_error(where + e.what());
+            }
+        }
+    }
+    jobs_ = std::move(jobs);
+
+    const std::time_t now = std::time(nullptr);
+    for (auto& job : jobs_) {
+        schedule(job, now);
+        if (job.due == -1) std::cerr << "[Daemon] Schedule never fires: " << job.line << std::endl;
+    }
+}
+
+void Daemon::schedule(Job& job, std::time_t now) {
+    job.due = job.schedule.next(now);
+    if (job.due != -1 && job.jitter > 0) {
+        job.due += std::uniform_int_distribution<unsigned>(0, job.jitter)(random_);
+    }
+}
+
+int Daemon::execute(const std::vector<std::string>& args) {
+    try {
+        return runner_(args);
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// 到点的任务逐个跑; 跑完再按当前时间排下一次 (错过的几次只补跑一次)
+void Daemon::runDue() {
+    for (size_t i = 0; i < jobs_.size() && !stopped_; ++i) {
+        Job& job = jobs_[i];
+        if (job.due == -1 || job.due > std::time(nullptr)) continue;
+
+        std::cout << "[Daemon] Job #" << i + 1 << ": " << joinArgs(job.args) << std::endl;
+        const auto start = std::chrono::steady_clock::now();
+        job.lastExit = execute(job.args);
+        job.runs++;
+        if (job.lastExit != 0) job.failures++;
+        const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        std::cout << "[Daemon] Job #" << i + 1 << " finished with exit code " << job.lastExit << " (" << std::fixed
+                  << std::setprecision(2) << took.count() << " s)" << std::defaultfloat << std::endl;
+        schedule(job, std::time(nullptr));
+    }
+}
+
+void Daemon::status(std::ostream& out) const {
+    out << "[Daemon] " << jobs_.size() << " scheduled jobs; warm: " << ScanCache::residentCount()
+        << " scan caches, " << ChunkStore::residentCount() << " repositories, " << ThreadPool::shared().size()
+        << " pool threads\n";
+    for (size_t i = 0; i < jobs_.size(); ++i) {
+        const Job& job = jobs_[i];
+        out << "  #" << i + 1 << " next ";
+        if (job.due == -1) {
+            out << "never";
+        } else {
+            const std::tm tm = localTime(job.due);
+            out << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+        }
+        out << " (runs " << job.runs << ", failed " << job.failures << ", last exit " << job.lastExit
+            << "): " << job.line << "\n";
+    }
+}
+
+// ==========================================
+// 4. 本地套接字
+// ==========================================
+#ifndef _WIN32
+namespace {
+struct SocketFd {
+    int fd = -1;
+    ~SocketFd() { if (fd >= 0) ::close(fd); }
+};
+
+sockaddr_un socketAddress(const fs::path& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    const std::string s = path.string();
+    if (s.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Socket path too long: " + s);
+    std::copy(s.begin(), s.end(), addr.sun_path);
+    return addr;
+}
+
+int connectTo(const fs::path& path) {
+    const sockaddr_un addr = socketAddress(path);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void sendAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("Lost connection to daemon");
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// 任务输出直接写进套接字 (不缓冲, 任务里的多个线程同时写也没问题);
+// 客户端中途断开时任务照样跑完, 之后的输出丢掉
+class SocketBuf : public std::streambuf {
+public:
+    explicit SocketBuf(int fd) : fd_(fd) {}
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) return traits_type::not_eof(ch);
+        const char c = traits_type::to_char_type(ch);
+        xsputn(&c, 1);
+        return ch;
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        std::streamsize done = 0;
+        while (done < n && !closed_) {
+            const ssize_t w = ::send(fd_, s + done, static_cast<size_t>(n - done), MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) closed_ = true;
+            else done += w;
+        }
+        return n;
+    }
+
+private:
+    int fd_;
+    std::atomic<bool> closed_{false};
+};
+
+// 任务运行期间 std::cout / std::cerr 都转到客户端
+struct Redirect {
+    std::streambuf* out;
+    std::streambuf* err;
+    explicit Redirect(std::streambuf* to) : out(std::cout.rdbuf(to)), err(std::cerr.rdbuf(to)) {}
+    ~Redirect() {
+        std::cout.rdbuf(out);
+        std::cerr.rdbuf(err);
+    }
+};
+
+// 只接受同一用户或 root 的连接 (提交的任务以 daemon 的身份读写文件)
+bool trustedPeer(int fd) {
+#ifdef __linux__
+    struct ucred cred{};
+    socklen_t len = sizeof(cred);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return false;
+    const uid_t uid = cred.uid;
+#else
+    uid_t uid = 0;
+    gid_t gid = 0;
+    if (::getpeereid(fd, &uid, &gid) != 0) return false;
+#endif
+    return uid == ::geteuid() || uid == 0;
+}
+
+// 读一行请求 (最多 64 KiB, 5 秒内要发完)
+bool readRequest(int fd, std::string& line) {
+    timeval timeout{5, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char buf[4096];
+    while (line.size() < (64u << 10)) {
+        const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        line.append(buf, static_cast<size_t>(n));
+        const size_t nl = line.find('\n');
+        if (nl != std::string::npos) {
+            line.erase(nl);
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+void Daemon::serve(int fd) {
+    if (!trustedPeer(fd)) {
+        std::cerr << "[Daemon] Rejected connection from another user" << std::endl;
+        return;
+    }
+    std::string line;
+    if (!readRequest(fd, line)) return;
+
+    SocketBuf buf(fd);
+    std::ostream out(&buf);
+    int code = 0;
+    try {
+        const std::vector<std::string> args = splitArgs(line);
+        if (args.empty()) {
+            out << "[Daemon] Empty request\n";
+            code = 2;
+        } else if (args.size() == 1 && args[0] == "status") {
+            status(out);
+        } else if (args.size() == 1 && args[0] == "reload") {
+            loadJobs();
+            out << "[Daemon] Reloaded " << jobs_.size() << " scheduled jobs\n";
+        } else if (args.size() == 1 && args[0] == "shutdown") {
+            out << "[Daemon] Shutting down\n";
+            stopped_ = true;
+        } else {
+            std::cout << "[Daemon] Submitted: " << joinArgs(args) << std::endl;
+            const auto start = std::chrono::steady_clock::now();
+            {
+                Redirect redirect(&buf);
+                code = execute(args);
+            }
+            const std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+            std::cout << "[Daemon] Submitted job finished with exit code " << code << " (" << std::fixed
+                      << std::setprecision(2) << took.count() << " s)" << std::defaultfloat << std::endl;
+        }
+    } catch (const std::exception& e) {
+        out << "[ERROR] " << e.what() << "\n";
+        code = 1;
+    }
+    out << "#exit " << code << "\n";
+}
+
+void Daemon::run() {
+    loadJobs();
+
+    // 已经有 daemon 在听这个套接字时不抢; 没人听的旧文件 (上次没正常退出) 删掉
+    const fs::path& path = options_.socket;
+    const int probe = connectTo(path);
+    if (probe >= 0) {
+        ::close(probe);
+        throw std::runtime_error("Another daemon is already listening on " + path.string());
+    }
+    ::unlink(path.c_str());
+
+    const sockaddr_un addr = socketAddress(path);
+    listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0 || ::bind(listenFd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        throw std::runtime_error("Cannot bind socket: " + path.string());
+    }
+    ::chmod(path.c_str(), 0600);
+    if (::listen(listenFd_, 64) != 0) throw std::runtime_error("Cannot listen on socket: " + path.string());
+
+    // 任务之间留在内存里的东西
+    ScanCache::setResident(true);
+    ChunkStore::setResident(true);
+    const size_t threads = ThreadPool::shared().size();
+    std::cout << "[Daemon] Listening on " << path.string() << " (" << jobs_.size() << " scheduled jobs, "
+              << threads << " pool threads)" << std::endl;
+
+    while (!stopped_) {
+        runDue();
+
+        // 等到下一个任务到点或有人连上; 最多等一分钟 (系统时间被调过 / 挂起过也能及时发现)
+        long long waitMs = 60000;
+        const std::time_t now = std::time(nullptr);
+        for (const auto& job : jobs_) {
+            if (job.due != -1) waitMs = std::min<long long>(waitMs, std::max<long long>(0, (job.due - now) * 1000LL));
+        }
+        struct pollfd p{listenFd_, POLLIN, 0};
+        const int ready = ::poll(&p, 1, static_cast<int>(waitMs));
+        if (ready < 0 && errno != EINTR) throw std::runtime_error("poll failed");
+        if (ready > 0 && (p.revents & POLLIN)) {
+            SocketFd client;
+            client.fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client.fd >= 0) serve(client.fd);
+        }
+    }
+}
+
+Daemon::~Daemon() {
+    if (listenFd_ < 0) return;
+    ::close(listenFd_);
+    ::unlink(options_.socket.c_str());
+    ScanCache::setResident(false);
+    ChunkStore::setResident(false);
+}
+
+int Daemon::submit(const fs::path& socket, const std::vector<std::string>& args, std::ostream& out) {
+    SocketFd conn;
+    conn.fd = connectTo(socket);
+    if (conn.fd < 0) throw std::runtime_error("Cannot connect to daemon at " + socket.string());
+    const std::string request = joinArgs(args) + "\n";
+    sendAll(conn.fd, request.data(), request.size());
+
+    // 输出边收边转, 最后一行是退出码
+    int code = -1;
+    std::string pending;
+    char buf[65536];
+    while (true) {
+        const ssize_t n = ::recv(conn.fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        pending.append(buf, static_cast<size_t>(n));
+        size_t start = 0;
+        for (size_t nl; (nl = pending.find('\n', start)) != std::string::npos; start = nl + 1) {
+            if (pending.compare(start, 6, "#exit ") == 0) code = std::atoi(pending.c_str() + start + 6);
+            else out.write(pending.data() + start, static_cast<std::streamsize>(nl + 1 - start));
+        }
+        pending.erase(0, start);
+        out.flush();
+    }
+    out << pending;
+    if (code < 0) throw std::runtime_error("Daemon closed the connection before the job finished");
+    return code;
+}
+#else
+// Windows: 没有 Unix 域套接字
+void Daemon::run() {
+    throw std::runtime_error("Daemon mode requires Unix domain sockets");
+}
+
+Daemon::~Daemon() {}
+
+int Daemon::submit(const fs::path&, const std::vector<std::string>&, std::ostream&) {
+    throw std::runtime_error("Daemon mode requires Unix domain sockets");
+}
+#endif
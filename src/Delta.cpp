@@ -0,0 +1,320 @@
+// src/Delta.cpp
+#include "Delta.h"
+#include "ByteBuffer.h"
+#include "SHA256.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <streambuf>
+#include <unordered_map>
+
+const char SIGNATURE_MAGIC[8] = {'M', 'B', 'S', 'I', 'G', '0', '0', '1'};
+
+// 读缓冲; 未匹配的新数据攒到这么多就先输出, 内存占用固定
+constexpr size_t DELTA_READ_SIZE = 4u << 20;
+constexpr size_t LITERAL_FLUSH_SIZE = 1u << 20;
+
+uint32_t FileSignature::chooseBlockSize(uint64_t fileSize) {
+    uint32_t bs = 4u << 10;
+    while (bs < (128u << 10) && static_cast<uint64_t>(bs) * bs < fileSize) bs <<= 1;
+    return bs;
+}
+
+// [magic 8][目标大小 8][目标 mtime 8][块大小 4][块数 8][{弱 4, 强 16} ...]
+void FileSignature::save(const std::filesystem::path& path, int64_t targetMtimeNs) const {
+    std::vector<char> buf(SIGNATURE_MAGIC, SIGNATURE_MAGIC + 8);
+    appendPod(buf, fileSize);
+    appendPod(buf, targetMtimeNs);
+    appendPod(buf, blockSize);
+    appendPod(buf, static_cast<uint64_t>(blocks.size()));
+    for (const auto& b : blocks) {
+        appendPod(buf, b.weak);
+        buf.insert(buf.end(), b.strong.begin(), b.strong.end());
+    }
+
+    if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path());
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(buf.data(), buf.size());
+        if (!out) throw std::runtime_error("Cannot write signature: " + path.string());
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+bool FileSignature::load(const std::filesystem::path& path, uint64_t targetSize, int64_t targetMtimeNs,
+                         FileSignature& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<char> buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    try {
+        if (buf.size() < 8 || std::memcmp(buf.data(), SIGNATURE_MAGIC, 8) != 0) return false;
+        size_t pos = 8;
+        out.fileSize = readPod<uint64_t>(buf, pos);
+        const auto mtime = readPod<int64_t>(buf, pos);
+        out.blockSize = readPod<uint32_t>(buf, pos);
+        const auto count = readPod<uint64_t>(buf, pos);
+        if (out.fileSize != targetSize || mtime != targetMtimeNs || out.blockSize == 0) return false;
+        if (count != (out.fileSize + out.blockSize - 1) / out.blockSize || count * 20 != buf.size() - pos) return false;
+        out.blocks.resize(count);
+        for (auto& b : out.blocks) {
+            b.weak = readPod<uint32_t>(buf, pos);
+            std::memcpy(b.strong.data(), buf.data() + pos, 16);
+            pos += 16;
+        }
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+uint32_t weakChecksum(const char* data, size_t size) {
+    uint32_t a = 0, b = 0;
+    for (size_t i = 0; i < size; ++i) {
+        a += static_cast<uint8_t>(data[i]);
+        b += static_cast<uint32_t>(size - i) * static_cast<uint8_t>(data[i]);
+    }
+    return (a & 0xFFFF) | (b << 16);
+}
+
+std::array<uint8_t, 16> strongChecksum(const char* data, size_t size) {
+    const SHA256::Digest d = SHA256::hash(data, size);
+    std::array<uint8_t, 16> out;
+    std::memcpy(out.data(), d.data(), 16);
+    return out;
+}
+
+// ==========================================
+// 签名
+// ==========================================
+SignatureBuilder::SignatureBuilder(uint32_t blockSize) {
+    sig_.blockSize = blockSize;
+    pending_.reserve(blockSize);
+}
+
+void SignatureBuilder::update(const char* data, size_t size) {
+    sig_.fileSize += size;
+    const size_t bs = sig_.blockSize;
+    while (size > 0) {
+        // 缓冲为空且够一整块时直接算, 不拷贝
+        if (pending_.empty() && size >= bs) {
+            sig_.blocks.push_back({weakChecksum(data, bs), strongChecksum(data, bs)});
+            data += bs;
+            size -= bs;
+            continue;
+        }
+        const size_t take = std::min(size, bs - pending_.size());
+        pending_.insert(pending_.end(), data, data + take);
+        data += take;
+        size -= take;
+        if (pending_.size() == bs) {
+            sig_.blocks.push_back({weakChecksum(pending_.data(), bs), strongChecksum(pending_.data(), bs)});
+            pending_.clear();
+        }
+    }
+}
+
+FileSignature SignatureBuilder::finish() {
+    if (!pending_.empty()) {
+        sig_.blocks.push_back({weakChecksum(pending_.data(), pending_.size()),
+                               strongChecksum(pending_.data(), pending_.size())});
+        pending_.clear();
+    }
+    return std::move(sig_);
+}
+
+FileSignature computeSignature(std::istream& in, uint32_t blockSize) {
+    SignatureBuilder builder(blockSize);
+    std::vector<char> buf(DELTA_READ_SIZE);
+    while (in.read(buf.data(), buf.size()) || in.gcount() > 0) {
+        builder.update(buf.data(), static_cast<size_t>(in.gcount()));
+    }
+    return builder.finish();
+}
+
+// ==========================================
+// 差量编码
+// ==========================================
+DeltaStats encodeDelta(const FileSignature& base, std::istream& in, const DeltaSink& sink, bool inPlace,
+                       const std::function<void(const char*, size_t)>& onData) {
+    DeltaStats stats;
+    const size_t bs = base.blockSize;
+
+    // 弱校验 -> 块号 (只收整块; 不满的末块按新数据处理)
+    std::unordered_multimap<uint32_t, uint64_t> lookup;
+    lookup.reserve(base.blocks.size());
+    const uint64_t fullBlocks = bs ? base.fileSize / bs : 0;
+    for (uint64_t i = 0; i < fullBlocks; ++i) lookup.emplace(base.blocks[i].weak, i);
+
+    std::vector<char> buf(std::max<size_t>(DELTA_READ_SIZE, bs * 4));
+    size_t lit = 0, p = 0, end = 0;  // buf 内: 待输出 literal 起点 / 当前窗口起点 / 数据末尾
+    uint64_t bufBase = 0;            // buf[0] 在新版本中的偏移
+    bool eof = false;
+
+    uint32_t a = 0, b = 0;
+    bool rolling = false;
+
+    auto flushLiteral = [&](size_t upTo) {
+        if (upTo > lit) {
+            sink.literal(buf.data() + lit, upTo - lit, bufBase + lit);
+            stats.literalBytes += upTo - lit;
+        }
+        lit = upTo;
+    };
+
+    while (true) {
+        if (!eof && end - p < bs + 1) {
+            // 窗口前的数据都用不到了: literal 先输出, 剩余部分挪到缓冲开头再读
+            flushLiteral(p);
+            std::memmove(buf.data(), buf.data() + p, end - p);
+            bufBase += p;
+            end -= p;
+            lit = p = 0;
+            in.read(buf.data() + end, static_cast<std::streamsize>(buf.size() - end));
+            const auto got = static_cast<size_t>(in.gcount());
+            if (onData && got) onData(buf.data() + end, got);
+            end += got;
+            if (end < buf.size()) eof = true;
+            continue;
+        }
+        if (bs == 0 || end - p < bs) break;
+
+        if (!rolling) {
+            a = b = 0;
+            for (size_t i = 0; i < bs; ++i) {
+                const auto x = static_cast<uint8_t>(buf[p + i]);
+                a += x;
+                b += static_cast<uint32_t>(bs - i) * x;
+            }
+            rolling = true;
+        }
+
+        const uint32_t weak = (a & 0xFFFF) | (b << 16);
+        const uint64_t dst = bufBase + p;
+        auto range = lookup.equal_range(weak);
+        bool matched = false;
+        if (range.first != range.second) {
+            const auto strong = strongChecksum(buf.data() + p, bs);
+            // 优先选同一位置的块 (就地更新时完全不用写)
+            uint64_t best = UINT64_MAX;
+            for (auto it = range.first; it != range.second; ++it) {
+                const uint64_t src = it->second * bs;
+                if (inPlace && src < dst) continue;
+                if (base.blocks[it->second].strong != strong) continue;
+                if (best == UINT64_MAX || src == dst) best = src;
+                if (src == dst) break;
+            }
+            if (best != UINT64_MAX) {
+                flushLiteral(p);
+                sink.copy(best, bs, dst);
+                stats.matchedBytes += bs;
+                p += bs;
+                lit = p;
+                rolling = false;
+                matched = true;
+            }
+        }
+        if (matched) continue;
+
+        // 没匹配: 当前字节归入 literal, 窗口右移一个字节
+        if (p - lit >= LITERAL_FLUSH_SIZE) flushLiteral(p);
+        const auto out = static_cast<uint8_t>(buf[p]);
+        if (p + bs < end) {
+            const auto in8 = static_cast<uint8_t>(buf[p + bs]);
+            a = a - out + in8;
+            b = b - static_cast<uint32_t>(bs) * out + a;
+        } else {
+            rolling = false;
+        }
+        ++p;
+    }
+
+    flushLiteral(end);
+    return stats;
+}
+
+// 只读的内存 streambuf, 避免把整个文件再拷贝一份进 istringstream
+namespace {
+struct MemoryBuf : std::streambuf {
+    MemoryBuf(const char* data, size_t size) {
+        char* p = const_cast<char*>(data);
+        setg(p, p, p + size);
+    }
+};
+}
+
+DeltaStats encodeDelta(const FileSignature& base, const char* data, size_t size, const DeltaSink& sink) {
+    MemoryBuf buf(data, size);
+    std::istream in(&buf);
+    return encodeDelta(base, in, sink, false);
+}
+
+// 打包时的文件一般不大, 块比 backup 的小: 约 sqrt(size), 限制在 [256 B, 64 KiB]
+static uint32_t packDeltaBlockSize(size_t size) {
+    uint32_t bs = 256;
+    while (bs < (64u << 10) && static_cast<uint64_t>(bs) * bs < size) bs <<= 1;
+    return bs;
+}
+
+constexpr char DELTA_OP_COPY = 'C';
+constexpr char DELTA_OP_INSERT = 'I';
+
+std::vector<char> makeBinaryDelta(const std::vector<char>& base, const std::vector<char>& target) {
+    SignatureBuilder builder(packDeltaBlockSize(base.size()));
+    builder.update(base.data(), base.size());
+    const FileSignature sig = builder.finish();
+
+    std::vector<char> out;
+    uint64_t copyFrom = 0, copyLen = 0; // 相邻的 copy 合并成一条
+    auto flushCopy = [&] {
+        if (copyLen == 0) return;
+        out.push_back(DELTA_OP_COPY);
+        appendPod(out, copyFrom);
+        appendPod(out, copyLen);
+        copyLen = 0;
+    };
+
+    DeltaSink sink;
+    sink.copy = [&](uint64_t src, uint64_t len, uint64_t) {
+        if (copyLen && copyFrom + copyLen == src) {
+            copyLen += len;
+            return;
+        }
+        flushCopy();
+        copyFrom = src;
+        copyLen = len;
+    };
+    sink.literal = [&](const char* data, size_t size, uint64_t) {
+        flushCopy();
+        out.push_back(DELTA_OP_INSERT);
+        appendPod(out, static_cast<uint64_t>(size));
+        out.insert(out.end(), data, data + size);
+    };
+    encodeDelta(sig, target.data(), target.size(), sink);
+    flushCopy();
+    return out;
+}
+
+std::vector<char> applyBinaryDelta(const std::vector<char>& base, const std::vector<char>& delta) {
+    std::vector<char> out;
+    size_t pos = 0;
+    while (pos < delta.size()) {
+        const char op = delta[pos++];
+        if (op == DELTA_OP_COPY) {
+            const auto from = readPod<uint64_t>(delta, pos);
+            const auto len = readPod<uint64_t>(delta, pos);
+            if (from > base.size() || len > base.size() - from) throw std::runtime_error("Corrupted delta");
+            out.insert(out.end(), base.begin() + from, base.begin() + from + len);
+        } else if (op == DELTA_OP_INSERT) {
+            const auto len = readPod<uint64_t>(delta, pos);
+            if (len > delta.size() - pos) throw std::runtime_error("Corrupted delta");
+            out.insert(out.end(), delta.begin() + pos, delta.begin() + pos + len);
+            pos += len;
+        } else {
+            throw std::runtime_error("Corrupted delta");
+        }
+    }
+    return out;
+}
@@ -0,0 +1,260 @@
+// src/FileCatalog.cpp
+#include "FileCatalog.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+// 拼路径用的分隔符 (和 fs::path 的 / 运算一致)
+constexpr char SEP = static_cast<char>(fs::path::preferred_separator);
+
+bool endsWithSeparator(const std::string& s) {
+    return !s.empty() && (s.back() == '/' || s.back() == SEP);
+}
+
+// 按新顺序重排一列
+template <typename T>
+void permute(std::vector<T>& column, const std::vector<uint32_t>& order) {
+    std::vector<T> sorted;
+    sorted.reserve(column.size());
+    for (uint32_t k : order) sorted.push_back(column[k]);
+    column.swap(sorted);
+}
+
+// 排序键 = 目录路径 [+ 分隔符] + 名字, 分段比较, 不拼成完整字符串
+struct PathKey {
+    std::string_view part[3];
+};
+
+int comparePathKeys(const PathKey& x, const PathKey& y) {
+    size_t px = 0, py = 0, ox = 0, oy = 0;
+    while (true) {
+        while (px < 3 && ox == x.part[px].size()) { px++; ox = 0; }
+        while (py < 3 && oy == y.part[py].size()) { py++; oy = 0; }
+        if (px == 3 || py == 3) return (px == 3 ? 0 : 1) - (py == 3 ? 0 : 1);
+        const size_t n = std::min(x.part[px].size() - ox, y.part[py].size() - oy);
+        const int r = std::memcmp(x.part[px].data() + ox, y.part[py].data() + oy, n); // 和 std::string 一样按无符号字节比
+        if (r != 0) return r;
+        ox += n;
+        oy += n;
+    }
+}
+}
+
+uint64_t FileCatalog::Arena::store(const char* data, size_t size) {
+    if (size == 0) return 0; // 空串不占空间, 读的一方看长度为 0 就不解引用
+    if (size > BLOCK) throw std::runtime_error("Catalog entry too long");
+    if (BLOCK - used_ < size) {
+        blocks_.push_back(std::make_unique<char[]>(BLOCK));
+        used_ = 0;
+    }
+    const uint64_t ref = static_cast<uint64_t>(blocks_.size() - 1) * BLOCK + used_;
+    std::memcpy(blocks_.back().get() + used_, data, size);
+    used_ += size;
+    return ref;
+}
+
+uint64_t FileCatalog::Arena::adopt(Arena&& other) {
+    const uint64_t base = static_cast<uint64_t>(blocks_.size()) * BLOCK;
+    if (other.blocks_.empty()) return base;
+    // 自己最后一块剩下的空间就不再用了 (每个扫描线程最多浪费一块)
+    for (auto& block : other.blocks_) blocks_.push_back(std::move(block));
+    used_ = other.used_;
+    other.blocks_.clear();
+    other.used_ = BLOCK;
+    return base;
+}
+
+FileCatalog::FileCatalog(std::string root) : root_(std::move(root)) {
+    dirParent_.push_back(ROOT);
+    dirName_.push_back(0);
+    dirNameLen_.push_back(0);
+}
+
+FileCatalog::DirId FileCatalog::addDir(DirId parent, std::string_view name) {
+    if (dirParent_.size() >= UINT32_MAX) throw std::runtime_error("Too many directories in catalog");
+    if (name.size() > UINT16_MAX) throw std::runtime_error("File name too long");
+    dirParent_.push_back(parent);
+    dirName_.push_back(arena_.store(name.data(), name.size()));
+    dirNameLen_.push_back(static_cast<uint16_t>(name.size()));
+    return static_cast<DirId>(dirParent_.size() - 1);
+}
+
+void FileCatalog::add(DirId dir, std::string_view name, const FileRecord& meta) {
+    if (type_.size() >= UINT32_MAX) throw std::runtime_error("Too many entries in catalog");
+    if (name.size() > UINT16_MAX) throw std::runtime_error("File name too long");
+    dir_.push_back(dir);
+    name_.push_back(arena_.store(name.data(), name.size()));
+    nameLen_.push_back(static_cast<uint16_t>(name.size()));
+    type_.push_back(static_cast<uint8_t>(meta.type));
+    mode_.push_back(static_cast<uint16_t>(meta.mode & 07777));
+    mtimeNsec_.push_back(meta.mtimeNsec);
+    size_.push_back(meta.size);
+    mtime_.push_back(meta.mtime);
+    uid_.push_back(meta.uid);
+    gid_.push_back(meta.gid);
+    ino_.push_back(meta.ino);
+    ctime_.push_back(meta.ctime);
+    ctimeNsec_.push_back(meta.ctimeNsec);
+    if (meta.type == FileType::SYMLINK) {
+        const uint32_t len = static_cast<uint32_t>(meta.linkTarget.size());
+        std::string buf(reinterpret_cast<const char*>(&len), sizeof(len));
+        buf += meta.linkTarget;
+        link_.push_back(arena_.store(buf.data(), buf.size()));
+    } else {
+        link_.push_back(NO_LINK);
+    }
+}
+
+void FileCatalog::append(FileCatalog&& other) {
+    if (other.empty()) return;
+    if (other.type_.size() + type_.size() > UINT32_MAX) throw std::runtime_error("Too many entries in catalog");
+    const uint64_t base = arena_.adopt(std::move(other.arena_));
+    const size_t from = size();
+
+    dir_.insert(dir_.end(), other.dir_.begin(), other.dir_.end());
+    name_.insert(name_.end(), other.name_.begin(), other.name_.end());
+    nameLen_.insert(nameLen_.end(), other.nameLen_.begin(), other.nameLen_.end());
+    type_.insert(type_.end(), other.type_.begin(), other.type_.end());
+    mode_.insert(mode_.end(), other.mode_.begin(), other.mode_.end());
+    mtimeNsec_.insert(mtimeNsec_.end(), other.mtimeNsec_.begin(), other.mtimeNsec_.end());
+    size_.insert(size_.end(), other.size_.begin(), other.size_.end());
+    mtime_.insert(mtime_.end(), other.mtime_.begin(), other.mtime_.end());
+    uid_.insert(uid_.end(), other.uid_.begin(), other.uid_.end());
+    gid_.insert(gid_.end(), other.gid_.begin(), other.gid_.end());
+    ino_.insert(ino_.end(), other.ino_.begin(), other.ino_.end());
+    ctime_.insert(ctime_.end(), other.ctime_.begin(), other.ctime_.end());
+    ctimeNsec_.insert(ctimeNsec_.end(), other.ctimeNsec_.begin(), other.ctimeNsec_.end());
+    link_.insert(link_.end(), other.link_.begin(), other.link_.end());
+
+    // other 的 arena 块接在后面, 它的引用整体平移
+    for (size_t i = from; i < size(); ++i) {
+        name_[i] += base;
+        if (link_[i] != NO_LINK) link_[i] += base;
+    }
+    other = FileCatalog(other.root_);
+}
+
+void FileCatalog::sortByPath() {
+    // 目录的完整路径一次性算好 (父目录 id 总比子目录小, 顺序扫一遍即可), 排完就释放
+    std::string dirPaths;
+    std::vector<std::pair<uint64_t, uint32_t>> dirSpan(dirCount()); // (偏移, 长度)
+    for (DirId d = 1; d < dirCount(); ++d) {
+        const auto& parent = dirSpan[dirParent_[d]];
+        const uint64_t at = dirPaths.size();
+        if (dirParent_[d] != ROOT) {
+            dirPaths.append(dirPaths, parent.first, parent.second);
+            dirPaths += SEP;
+        }
+        dirPaths += dirName(d);
+        dirSpan[d] = {at, static_cast<uint32_t>(dirPaths.size() - at)};
+    }
+
+    const char sep[1] = {SEP};
+    auto keyOf = [&](uint32_t i) {
+        PathKey key;
+        if (dir_[i] != ROOT) {
+            key.part[0] = std::string_view(dirPaths.data() + dirSpan[dir_[i]].first, dirSpan[dir_[i]].second);
+            key.part[1] = std::string_view(sep, 1);
+        }
+        key.part[2] = name(i);
+        return key;
+    };
+
+    std::vector<uint32_t> order(size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (dir_[a] == dir_[b]) return name(a) < name(b);
+        return comparePathKeys(keyOf(a), keyOf(b)) < 0;
+    });
+
+    permute(dir_, order);
+    permute(name_, order);
+    permute(nameLen_, order);
+    permute(type_, order);
+    permute(mode_, order);
+    permute(mtimeNsec_, order);
+    permute(size_, order);
+    permute(mtime_, order);
+    permute(uid_, order);
+    permute(gid_, order);
+    permute(ino_, order);
+    permute(ctime_, order);
+    permute(ctimeNsec_, order);
+    permute(link_, order);
+}
+
+std::string_view FileCatalog::linkTarget(size_t i) const {
+    if (link_[i] == NO_LINK) return {};
+    const char* p = arena_.at(link_[i]);
+    uint32_t len;
+    std::memcpy(&len, p, sizeof(len));
+    return {p + sizeof(len), len};
+}
+
+void FileCatalog::appendDirPath(DirId dir, std::string& out) const {
+    // 从下往上收集, 再倒着拼; 目录一般不深, 栈上数组够用
+    DirId chain[64];
+    std::vector<DirId> deep;
+    size_t depth = 0;
+    for (DirId d = dir; d != ROOT; d = dirParent_[d]) {
+        if (depth < 64) chain[depth] = d;
+        else deep.push_back(d);
+        depth++;
+    }
+    for (size_t k = depth; k-- > 0;) {
+        const DirId d = k < 64 ? chain[k] : deep[k - 64];
+        out += dirName(d);
+        if (k) out += SEP;
+    }
+}
+
+void FileCatalog::appendRelPath(size_t i, std::string& out) const {
+    if (dir_[i] != ROOT) {
+        appendDirPath(dir_[i], out);
+        out += SEP;
+    }
+    out += name(i);
+}
+
+std::string FileCatalog::relPath(size_t i) const {
+    std::string out;
+    appendRelPath(i, out);
+    return out;
+}
+
+std::string FileCatalog::absPath(size_t i) const {
+    std::string out = root_;
+    if (!out.empty() && !endsWithSeparator(out)) out += SEP;
+    appendRelPath(i, out);
+    return out;
+}
+
+FileRecord FileCatalog::record(size_t i) const {
+    FileRecord rec;
+    rec.relPath = relPath(i);
+    rec.absPath = root_;
+    if (!rec.absPath.empty() && !endsWithSeparator(rec.absPath)) rec.absPath += SEP;
+    rec.absPath += rec.relPath;
+    rec.linkTarget = std::string(linkTarget(i));
+    rec.size = size_[i];
+    rec.mtime = mtime_[i];
+    rec.mtimeNsec = mtimeNsec_[i];
+    rec.mode = mode_[i];
+    rec.uid = uid_[i];
+    rec.gid = gid_[i];
+    rec.ino = ino_[i];
+    rec.ctime = ctime_[i];
+    rec.ctimeNsec = ctimeNsec_[i];
+    rec.type = type(i);
+    return rec;
+}
+
+size_t FileCatalog::memoryUsage() const {
+    auto bytes = [](const auto& column) { return column.capacity() * sizeof(column[0]); };
+    return arena_.bytes() + root_.capacity() + bytes(dirParent_) + bytes(dirName_) + bytes(dirNameLen_) +
+           bytes(dir_) + bytes(name_) + bytes(nameLen_) + bytes(type_) + bytes(mode_) + bytes(mtimeNsec_) +
+           bytes(size_) + bytes(mtime_) + bytes(uid_) + bytes(gid_) + bytes(ino_) +
+           bytes(ctime_) + bytes(ctimeNsec_) + bytes(link_);
+}
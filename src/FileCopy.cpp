@@ -0,0 +1,251 @@
+// src/FileCopy.cpp
+#include "FileCopy.h"
+#include "CRC32.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/ioctl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+#ifdef __linux__
+    #include <linux/fs.h>      // FICLONE / FS_IOC_FIEMAP
+    #include <linux/fiemap.h>
+    #include <sys/sendfile.h>
+#endif
+
+namespace fs = std::filesystem;
+
+constexpr size_t COPY_BUFFER_SIZE = 1u << 20;
+constexpr size_t KERNEL_COPY_CHUNK = 1u << 30; // 单次系统调用最多搬这么多
+
+const char* copyMethodName(CopyMethod method) {
+    switch (method) {
+        case CopyMethod::CLONE: return "reflink";
+        case CopyMethod::COPY_FILE_RANGE: return "copy_file_range";
+        case CopyMethod::SENDFILE: return "sendfile";
+        default: return "buffered";
+    }
+}
+
+void CopyStats::add(const CopyResult& r) {
+    const auto i = static_cast<size_t>(r.method);
+    files[i]++;
+    bytes[i] += r.bytes;
+}
+
+void CopyStats::print(std::ostream& out) const {
+    out << "[Copy]";
+    bool any = false;
+    for (size_t i = 0; i < 4; ++i) {
+        if (!files[i]) continue;
+        out << (any ? ", " : " ") << copyMethodName(static_cast<CopyMethod>(i)) << ": " << files[i]
+            << " files / " << bytes[i] << " bytes";
+        any = true;
+    }
+    if (!any) out << " nothing copied";
+    out << std::endl;
+}
+
+#ifdef _WIN32
+
+CopyResult copyFileFast(const fs::path& source, const fs::path& target) {
+    std::ifstream in(source, std::ios::binary);
+    if (!in) throw CopySourceError("Copy failed (open): " + source.string());
+    std::ofstream out(target, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Copy failed (create): " + target.string());
+
+    CopyResult result;
+    result.hasCrc = true;
+    std::vector<char> buf(COPY_BUFFER_SIZE);
+    while (in.read(buf.data(), buf.size()) || in.gcount() > 0) {
+        const auto n = static_cast<size_t>(in.gcount());
+        result.crc = CRC32::update(result.crc, buf.data(), n);
+        out.write(buf.data(), n);
+        result.bytes += n;
+    }
+    out.close();
+    if (!out) throw std::runtime_error("Copy failed (write): " + target.string());
+    fs::permissions(target, fs::status(source).permissions());
+    return result;
+}
+
+#else
+
+namespace {
+struct FdGuard {
+    int fd = -1;
+    ~FdGuard() { if (fd >= 0) ::close(fd); }
+};
+
+[[noreturn]] void copyFailed(const char* what, const fs::path& path) {
+    throw std::runtime_error(std::string("Copy failed (") + what + "): " + path.string() + ": " + std::strerror(errno));
+}
+
+[[noreturn]] void sourceFailed(const char* what, const fs::path& path) {
+    throw CopySourceError(std::string("Copy failed (") + what + "): " + path.string() + ": " + std::strerror(errno));
+}
+
+// 这种复制方式在当前文件系统 / 内核上不可用 (换下一种), 而不是真正的 IO 错误
+bool unsupported(int err) {
+    return err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == ENOTSUP ||
+           err == EBADF || err == ENOTTY;
+}
+
+void writeAll(int fd, const char* data, size_t size, const fs::path& path) {
+    while (size > 0) {
+        const ssize_t w = ::write(fd, data, size);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            copyFailed("write", path);
+        }
+        data += w;
+        size -= static_cast<size_t>(w);
+    }
+}
+
+// 从 in 的当前位置搬最多 limit 字节到 out 的当前位置, 依次尝试 copy_file_range / sendfile / 缓冲循环
+// 内核复制都用文件当前位置: 某种方式中途不可用时, 下一种从断点接着复制
+// 内核复制出真正的错时分不清是读源还是写目标出的问题, 直接交给缓冲循环从断点重试, 由它分清
+void copyStages(int in, int out, uint64_t limit, const fs::path& source, const fs::path& target,
+                CopyResult& result) {
+    bool finished = false;
+    auto chunk = [&] { return static_cast<size_t>(std::min<uint64_t>(limit - result.bytes, KERNEL_COPY_CHUNK)); };
+
+#ifdef __linux__
+    bool failed = false;
+    while (!finished) {
+        if (result.bytes == limit) { finished = true; break; }
+        const ssize_t n = ::copy_file_range(in, nullptr, out, nullptr, chunk(), 0);
+        if (n > 0) { result.bytes += n; continue; }
+        if (n == 0) { finished = true; break; }
+        if (errno == EINTR) continue;
+        failed = !unsupported(errno);
+        break;
+    }
+    if (finished) result.method = CopyMethod::COPY_FILE_RANGE;
+
+    while (!finished && !failed) {
+        if (result.bytes == limit) { finished = true; break; }
+        const ssize_t n = ::sendfile(out, in, nullptr, chunk());
+        if (n > 0) { result.bytes += n; continue; }
+        if (n == 0) { finished = true; break; }
+        if (errno == EINTR) continue;
+        break;
+    }
+    if (finished && result.method != CopyMethod::COPY_FILE_RANGE) result.method = CopyMethod::SENDFILE;
+#endif
+
+    if (!finished) {
+        // 从头开始的缓冲复制才能顺便算出整个文件的 CRC
+        result.method = CopyMethod::BUFFERED;
+        result.hasCrc = result.bytes == 0;
+        std::vector<char> buf(COPY_BUFFER_SIZE);
+        while (result.bytes < limit) {
+            const auto want = static_cast<size_t>(std::min<uint64_t>(limit - result.bytes, buf.size()));
+            const ssize_t n = ::read(in, buf.data(), want);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                sourceFailed("read", source);
+            }
+            if (n == 0) break;
+            result.crc = CRC32::update(result.crc, buf.data(), static_cast<size_t>(n));
+            writeAll(out, buf.data(), static_cast<size_t>(n), target);
+            result.bytes += n;
+        }
+    }
+}
+}
+
+CopyResult copyFileFast(const fs::path& source, const fs::path& target) {
+    FdGuard in;
+    in.fd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in.fd < 0) sourceFailed("open", source);
+    struct stat st{};
+    if (::fstat(in.fd, &st) != 0) sourceFailed("stat", source);
+
+    FdGuard out;
+    out.fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out.fd < 0) copyFailed("create", target);
+
+    CopyResult result;
+#ifdef FICLONE
+    if (::ioctl(out.fd, FICLONE, in.fd) == 0) {
+        result.method = CopyMethod::CLONE;
+        result.bytes = static_cast<uint64_t>(st.st_size);
+    } else
+#endif
+    copyStages(in.fd, out.fd, UINT64_MAX, source, target, result);
+
+    ::fchmod(out.fd, st.st_mode & 07777);
+    const int fd = out.fd;
+    out.fd = -1;
+    if (::close(fd) != 0) copyFailed("close", target);
+    return result;
+}
+
+CopyResult appendFileTo(const fs::path& source, int outFd, uint64_t maxBytes, const fs::path& target) {
+    FdGuard in;
+    in.fd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in.fd < 0) sourceFailed("open", source);
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(in.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    CopyResult result;
+    copyStages(in.fd, outFd, maxBytes, source, target, result);
+    return result;
+}
+
+uint32_t crc32OfRange(int fd, uint64_t offset, uint64_t size, const fs::path& path) {
+    std::vector<char> buf(COPY_BUFFER_SIZE);
+    uint32_t crc = 0;
+    while (size > 0) {
+        const auto want = static_cast<size_t>(std::min<uint64_t>(size, buf.size()));
+        const ssize_t n = ::pread(fd, buf.data(), want, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            copyFailed("read", path);
+        }
+        if (n == 0) throw std::runtime_error("Unexpected end of file: " + path.string());
+        crc = CRC32::update(crc, buf.data(), static_cast<size_t>(n));
+        offset += n;
+        size -= n;
+    }
+    return crc;
+}
+
+#endif
+
+bool firstPhysicalOffset(const fs::path& path, uint64_t& physical) {
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+    FdGuard file;
+    file.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (file.fd < 0) return false;
+
+    // struct fiemap 末尾是柔性数组, 只要一个区段
+    alignas(struct fiemap) char buf[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = {};
+    auto* map = reinterpret_cast<struct fiemap*>(buf);
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_flags = 0; // 不带 FIEMAP_FLAG_SYNC: 只排个顺序, 不值得逼文件系统刷脏页
+    map->fm_extent_count = 1;
+    if (::ioctl(file.fd, FS_IOC_FIEMAP, map) != 0 || map->fm_mapped_extents == 0) return false;
+
+    const struct fiemap_extent& extent = map->fm_extents[0];
+    constexpr uint32_t UNPLACED = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE;
+    if (extent.fe_flags & UNPLACED) return false;
+    physical = extent.fe_physical;
+    return true;
+#else
+    (void)path;
+    (void)physical;
+    return false;
+#endif
+}
@@ -0,0 +1,961 @@
+// src/FilterExpr.cpp
+#include "FilterExpr.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+constexpr size_t MAX_DFA_STATES = 4096; // 超过就退回 NFA 模拟 (大量 *a*b* 这类规则可能指数爆炸)
+constexpr size_t MAX_STACK = 64;        // 表达式嵌套深度上限 (求值栈放在栈上)
+
+// 三值逻辑: 还没 stat 时元数据谓词是 "未知"
+constexpr uint8_t NO = 0;
+constexpr uint8_t YES = 1;
+constexpr uint8_t UNKNOWN = 2;
+
+uint8_t not3(uint8_t a) { return a == UNKNOWN ? UNKNOWN : static_cast<uint8_t>(a ^ 1); }
+
+uint8_t and3(uint8_t a, uint8_t b) {
+    if (a == NO || b == NO) return NO;
+    return (a == UNKNOWN || b == UNKNOWN) ? UNKNOWN : YES;
+}
+
+uint8_t or3(uint8_t a, uint8_t b) {
+    if (a == YES || b == YES) return YES;
+    return (a == UNKNOWN || b == UNKNOWN) ? UNKNOWN : NO;
+}
+
+unsigned char pathByte(char ch) {
+    auto b = static_cast<unsigned char>(ch);
+#ifdef _WIN32
+    if (b == '\\') b = '/'; // Windows 相对路径里的分隔符
+#endif
+    return b;
+}
+
+std::string trim(const std::string& s) {
+    const size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return "";
+    return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+}
+
+// 解析 [...] (i 指向 '['); 没有闭合的 ']' 时返回 false, 当普通字符处理
+bool parseClass(const std::string& glob, size_t& i, std::bitset<256>& bytes, bool& negate) {
+    const size_t n = glob.size();
+    size_t j = i + 1;
+    negate = false;
+    if (j < n && (glob[j] == '!' || glob[j] == '^')) {
+        negate = true;
+        ++j;
+    }
+    bool first = true;
+    while (j < n && (glob[j] != ']' || first)) {
+        first = false;
+        auto lo = static_cast<unsigned char>(glob[j]);
+        if (lo == '\\' && j + 1 < n) lo = static_cast<unsigned char>(glob[++j]);
+        ++j;
+        if (j + 1 < n && glob[j] == '-' && glob[j + 1] != ']') {
+            const auto hi = static_cast<unsigned char>(glob[j + 1]);
+            j += 2;
+            for (int b = lo; b <= hi; ++b) bytes.set(b);
+        } else {
+            bytes.set(lo);
+        }
+    }
+    if (j >= n) return false;
+    i = j + 1;
+    return true;
+}
+
+// 常用的字节集合
+struct ByteClasses {
+    std::bitset<256> any, notSlash, slash;
+    std::bitset<256> single, lead, cont; // 一个字符 = 一个单字节 (ASCII / 孤立的续字节) 或 UTF-8 首字节 + 续字节
+
+    ByteClasses() {
+        any.set();
+        notSlash.set();
+        notSlash.reset('/');
+        slash.set('/');
+        for (int b = 0; b < 256; ++b) (b < 0xC0 ? single : lead).set(b);
+        for (int b = 0x80; b < 0xC0; ++b) cont.set(b);
+        single.reset('/');
+    }
+};
+
+const ByteClasses& byteClasses() {
+    static const ByteClasses classes;
+    return classes;
+}
+}
+
+// ==========================================
+// GlobSet
+// ==========================================
+
+uint32_t GlobSet::newState() {
+    nfa_.emplace_back();
+    return static_cast<uint32_t>(nfa_.size() - 1);
+}
+
+void GlobSet::add(const std::string& glob, uint32_t label) {
+    uint32_t cur = 0;
+    size_t i = 0;
+    while (i < glob.size()) cur = addItem(cur, glob, i);
+    auto& accepts = nfa_[cur].accepts;
+    if (std::find(accepts.begin(), accepts.end(), label) == accepts.end()) {
+        accepts.push_back(label);
+        ++globs_;
+    }
+}
+
+// 解析 glob[i] 开始的一个元素, 返回它在 NFA 里的后继状态
+// 同一状态出发的相同元素只建一次: 前缀相同的 glob (*.o / *.obj / cache1 / cache2 ...) 共用状态,
+// 子集构造时每个 DFA 状态里的 NFA 状态数不随规则条数增长
+// (注意 newState() 会让 nfa_ 重新分配, 一律用下标访问)
+uint32_t GlobSet::addItem(uint32_t from, const std::string& glob, size_t& i) {
+    enum Kind : char { LITERAL = 'L', ONE = '?', STAR = '*', GLOBSTAR = 'G', GLOBSTAR_DIR = 'D', CLASS = 'C', NEG_CLASS = 'N' };
+    const ByteClasses& bc = byteClasses();
+    const size_t n = glob.size();
+    const auto c = static_cast<unsigned char>(glob[i]);
+
+    Kind kind;
+    ByteSet bytes;
+    unsigned char lit = 0;
+    bool negate = false;
+    if (c == '*') {
+        if (i + 1 < n && glob[i + 1] == '*') {
+            i += 2;
+            kind = GLOBSTAR;
+            if (i < n && glob[i] == '/') {
+                ++i;
+                kind = GLOBSTAR_DIR;
+            }
+        } else {
+            ++i;
+            kind = STAR;
+        }
+    } else if (c == '?') {
+        ++i;
+        kind = ONE;
+    } else if (c == '[' && parseClass(glob, i, bytes, negate)) {
+        bytes.reset('/');
+        kind = negate ? NEG_CLASS : CLASS;
+    } else {
+        if (c == '\\' && i + 1 < n) ++i;
+        lit = static_cast<unsigned char>(glob[i++]);
+        bytes.set(lit);
+        kind = LITERAL;
+    }
+
+    std::string key(1, kind);
+    if (kind == LITERAL) key += static_cast<char>(lit);
+    else if (kind == CLASS || kind == NEG_CLASS) key += bytes.to_string();
+    const auto it = nfa_[from].children.find(key);
+    if (it != nfa_[from].children.end()) return it->second;
+
+    // 匹配一个字符: 单字节里属于 set 的; multibyte 时再加上任意一个 UTF-8 多字节字符
+    auto oneChar = [&](const ByteSet& set, bool multibyte) {
+        const uint32_t to = newState();
+        nfa_[from].edges.emplace_back(set, to);
+        if (multibyte) {
+            const uint32_t mid = newState();
+            nfa_[from].edges.emplace_back(bc.lead, mid);
+            nfa_[mid].edges.emplace_back(bc.cont, mid);
+            nfa_[mid].edges.emplace_back(bc.cont, to);
+        }
+        return to;
+    };
+
+    uint32_t to = 0;
+    switch (kind) {
+        case STAR:     // 零或多个非 '/' 字符
+        case GLOBSTAR:  // "**": 任意字符, 可以跨目录
+            to = newState();
+            nfa_[from].eps.push_back(to);
+            nfa_[to].edges.emplace_back(kind == STAR ? bc.notSlash : bc.any, to);
+            break;
+        case GLOBSTAR_DIR: { // "**/": 零或多级目录
+            const uint32_t inner = newState();
+            to = newState();
+            nfa_[from].eps.push_back(to);
+            nfa_[from].edges.emplace_back(bc.any, inner);
+            nfa_[inner].edges.emplace_back(bc.any, inner);
+            nfa_[inner].edges.emplace_back(bc.slash, to);
+            break;
+        }
+        case ONE: to = oneChar(bc.single, true); break;
+        // [] 里只支持单字节字符; 取反时多字节字符整个算 "不在集合里"
+        case NEG_CLASS: to = oneChar(~bytes & bc.single, true); break;
+        default: to = oneChar(bytes, false); break;
+    }
+    nfa_[from].children.emplace(key, to);
+    return to;
+}
+
+// set 扩展成 ε 闭包, 排好序去重 (mark 调用前后都全是 0)
+void GlobSet::closure(std::vector<uint32_t>& set, std::vector<char>& mark) const {
+    std::vector<uint32_t> out;
+    std::vector<uint32_t> stack;
+    for (uint32_t s : set) {
+        if (!mark[s]) {
+            mark[s] = 1;
+            stack.push_back(s);
+        }
+    }
+    while (!stack.empty()) {
+        const uint32_t s = stack.back();
+        stack.pop_back();
+        out.push_back(s);
+        for (uint32_t e : nfa_[s].eps) {
+            if (!mark[e]) {
+                mark[e] = 1;
+                stack.push_back(e);
+            }
+        }
+    }
+    for (uint32_t s : out) mark[s] = 0;
+    std::sort(out.begin(), out.end());
+    set.swap(out);
+}
+
+void GlobSet::acceptsOf(const std::vector<uint32_t>& set, uint64_t* bits) const {
+    std::fill(bits, bits + words_, 0);
+    for (uint32_t s : set) {
+        for (uint32_t label : nfa_[s].accepts) bits[label >> 6] |= uint64_t(1) << (label & 63);
+    }
+}
+
+void GlobSet::build() {
+    words_ = (labels_ + 63) / 64;
+    dfa_ = false;
+    table_.clear();
+    acceptBits_.clear();
+    if (globs_ == 0) return;
+
+    // 1. 字节等价类: 在所有边上表现都一样的字节归成一类, 转移表只按类存
+    std::vector<uint16_t> cls(256, 0);
+    uint32_t count = 1;
+    std::vector<int> remap;
+    for (const auto& state : nfa_) {
+        for (const auto& edge : state.edges) {
+            remap.assign(count * 2, -1);
+            uint32_t next = 0;
+            for (int b = 0; b < 256; ++b) {
+                int& slot = remap[cls[b] * 2 + (edge.first[b] ? 1 : 0)];
+                if (slot < 0) slot = static_cast<int>(next++);
+                cls[b] = static_cast<uint16_t>(slot);
+            }
+            count = next;
+        }
+    }
+    classes_ = count;
+    std::vector<int> rep(count, -1); // 每类挑一个代表字节
+    for (int b = 0; b < 256; ++b) {
+        classOf_[b] = static_cast<uint8_t>(cls[b]);
+        if (rep[cls[b]] < 0) rep[cls[b]] = b;
+    }
+
+    // 2. 子集构造 (0 号 = 空集 = 死状态)
+    std::map<std::vector<uint32_t>, uint32_t> ids;
+    std::vector<std::vector<uint32_t>> sets;
+    std::vector<char> mark(nfa_.size(), 0);
+    auto intern = [&](std::vector<uint32_t>& set) {
+        const auto it = ids.find(set);
+        if (it != ids.end()) return it->second;
+        const auto id = static_cast<uint32_t>(sets.size());
+        ids.emplace(set, id);
+        sets.push_back(set);
+        return id;
+    };
+    std::vector<uint32_t> empty;
+    intern(empty);
+    std::vector<uint32_t> init{0};
+    closure(init, mark);
+    start_ = intern(init);
+
+    for (size_t d = 0; d < sets.size(); ++d) {
+        if (sets.size() > MAX_DFA_STATES) {
+            table_.clear();
+            return;
+        }
+        for (uint32_t k = 0; k < classes_; ++k) {
+            std::vector<uint32_t> next;
+            for (uint32_t s : sets[d]) {
+                for (const auto& edge : nfa_[s].edges) {
+                    if (edge.first[rep[k]]) next.push_back(edge.second);
+                }
+            }
+            closure(next, mark);
+            table_.push_back(intern(next));
+        }
+    }
+
+    acceptBits_.resize(sets.size() * words_);
+    for (size_t d = 0; d < sets.size(); ++d) acceptsOf(sets[d], &acceptBits_[d * words_]);
+    dfa_ = true;
+}
+
+const uint64_t* GlobSet::match(const std::string& text, std::vector<uint64_t>& scratch) const {
+    if (dfa_) {
+        uint32_t s = start_;
+        for (char ch : text) {
+            s = table_[static_cast<size_t>(s) * classes_ + classOf_[pathByte(ch)]];
+            if (s == 0) break; // 死状态: 哪个 glob 都不可能再匹配
+        }
+        return &acceptBits_[static_cast<size_t>(s) * words_];
+    }
+
+    // NFA 模拟
+    std::vector<char> mark(nfa_.size(), 0);
+    std::vector<uint32_t> cur{0};
+    std::vector<uint32_t> next;
+    closure(cur, mark);
+    for (char ch : text) {
+        const unsigned char b = pathByte(ch);
+        next.clear();
+        for (uint32_t s : cur) {
+            for (const auto& edge : nfa_[s].edges) {
+                if (edge.first[b]) next.push_back(edge.second);
+            }
+        }
+        closure(next, mark);
+        cur.swap(next);
+        if (cur.empty()) break;
+    }
+    scratch.assign(words_, 0);
+    acceptsOf(cur, scratch.data());
+    return scratch.data();
+}
+
+// ==========================================
+// 规则 / 表达式 -> 字节码
+// ==========================================
+
+class FilterCompiler {
+public:
+    explicit FilterCompiler(FilterExpr& expr) : expr_(expr), now_(static_cast<int64_t>(std::time(nullptr))) {}
+
+    void compile(const std::string& rules) {
+        struct Where {
+            size_t lineNo;
+            std::string line;
+            std::string text;
+        };
+        std::vector<Rule> includes, excludes;
+        std::vector<Where> wheres;
+
+        std::istringstream in(rules);
+        std::string raw;
+        while (std::getline(in, raw)) {
+            ++lineNo_;
+            if (!raw.empty() && raw.back() == '\r') raw.pop_back();
+            lineText_ = trim(raw);
+            if (lineText_.empty() || lineText_[0] == '#') continue;
+
+            const size_t sp = lineText_.find_first_of(" \t");
+            const std::string keyword = lineText_.substr(0, sp);
+            const std::string rest = sp == std::string::npos ? "" : trim(lineText_.substr(sp));
+            if (keyword == "include" || keyword == "+") includes.push_back(parseRule(rest));
+            else if (keyword == "exclude" || keyword == "-") excludes.push_back(parseRule(rest));
+            else if (keyword == "where") wheres.push_back({lineNo_, lineText_, rest});
+            else fail("unknown rule '" + keyword + "' (expected include / exclude / where)");
+            expr_.rules_++;
+        }
+
+        // 选中 = (include 之一) and not (exclude 之一) and where1 and where2 ...
+        const RuleGroup inc = addGroup(includes);
+        const RuleGroup exc = addGroup(excludes);
+        std::vector<std::function<void()>> parts;
+        if (!includes.empty()) parts.emplace_back([&] { emitGroup(inc); });
+        if (!excludes.empty()) {
+            parts.emplace_back([&] {
+                emitGroup(exc);
+                emit({FilterExpr::Op::NOT});
+            });
+        }
+        for (const auto& w : wheres) {
+            parts.emplace_back([this, &w] {
+                lineNo_ = w.lineNo;
+                lineText_ = w.line;
+                parseWhere(w.text);
+            });
+        }
+
+        program_ = &expr_.select_;
+        std::vector<size_t> jumps;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            if (i > 0) jumps.push_back(emitJump(FilterExpr::Op::JUMP_FALSE));
+            parts[i]();
+            if (i > 0) emit({FilterExpr::Op::AND});
+        }
+        patch(jumps);
+
+        // 剪枝 = exclude 之一 (求值时已知是目录)
+        program_ = &expr_.prune_;
+        depth_ = 0;
+        if (!excludes.empty()) emitGroup(exc);
+
+        expr_.names_.build();
+        expr_.paths_.build();
+    }
+
+private:
+    using Op = FilterExpr::Op;
+    using Cmp = FilterExpr::Cmp;
+
+    struct Rule {
+        std::string glob;
+        bool path = false;    // 匹配整个相对路径 (否则只匹配文件名)
+        bool dirOnly = false; // 结尾带 '/'
+    };
+
+    struct RuleGroup {
+        int64_t label[4] = {-1, -1, -1, -1}; // [路径 * 2 + 只匹配目录], -1 = 这类没有规则
+    };
+
+    enum class Tok { END, WORD, STRING, LPAREN, RPAREN, OP };
+
+    FilterExpr& expr_;
+    FilterExpr::Program* program_ = nullptr;
+    size_t depth_ = 0;
+    int64_t now_;
+    std::map<std::string, uint32_t> globLabels_[2]; // where 里的 name / path glob
+
+    size_t lineNo_ = 0;
+    std::string lineText_;
+
+    std::string src_;
+    size_t pos_ = 0;
+    Tok tok_ = Tok::END;
+    std::string text_;
+
+    [[noreturn]] void fail(const std::string& msg) const {
+        throw std::runtime_error("Filter rule " + std::to_string(lineNo_) + " \"" + lineText_ + "\": " + msg);
+    }
+
+    // ---- 代码生成 ----
+
+    void emit(const FilterExpr::Insn& insn) {
+        switch (insn.op) {
+            case Op::AND:
+            case Op::OR: --depth_; break;
+            case Op::NOT:
+            case Op::JUMP_FALSE:
+            case Op::JUMP_TRUE: break;
+            default:
+                if (++depth_ > MAX_STACK) fail("expression nested too deeply");
+        }
+        program_->code.push_back(insn);
+    }
+
+    size_t emitJump(Op op) {
+        emit({op});
+        return program_->code.size() - 1;
+    }
+
+    void patch(const std::vector<size_t>& jumps) {
+        for (size_t j : jumps) program_->code[j].arg = static_cast<uint32_t>(program_->code.size());
+    }
+
+    // where 里的单个 glob: 相同的 glob 共用一个标签
+    void emitGlob(bool path, const std::string& glob) {
+        auto& known = globLabels_[path ? 1 : 0];
+        auto it = known.find(glob);
+        if (it == known.end()) {
+            GlobSet& set = path ? expr_.paths_ : expr_.names_;
+            it = known.emplace(glob, set.newLabel()).first;
+            set.add(glob, it->second);
+        }
+        FilterExpr::Insn insn{path ? Op::PATH_GLOB : Op::NAME_GLOB};
+        insn.arg = it->second;
+        emit(insn);
+    }
+
+    // 一组 include 或 exclude 规则按 (文件名 / 路径) x (是否只匹配目录) 分成四类, 每类的 glob 共用一个标签
+    RuleGroup addGroup(const std::vector<Rule>& rules) {
+        RuleGroup group;
+        for (const auto& rule : rules) {
+            const int k = (rule.path ? 2 : 0) + (rule.dirOnly ? 1 : 0);
+            GlobSet& set = rule.path ? expr_.paths_ : expr_.names_;
+            if (group.label[k] < 0) group.label[k] = set.newLabel();
+            set.add(rule.glob, static_cast<uint32_t>(group.label[k]));
+        }
+        return group;
+    }
+
+    // 组里任一规则命中: 最多四条 glob 指令, 和规则条数无关
+    void emitGroup(const RuleGroup& group) {
+        std::vector<size_t> jumps;
+        bool first = true;
+        for (int k = 0; k < 4; ++k) {
+            if (group.label[k] < 0) continue;
+            if (!first) jumps.push_back(emitJump(Op::JUMP_TRUE));
+            FilterExpr::Insn insn{k >= 2 ? Op::PATH_GLOB : Op::NAME_GLOB};
+            insn.arg = static_cast<uint32_t>(group.label[k]);
+            emit(insn);
+            if (k & 1) {
+                const size_t j = emitJump(Op::JUMP_FALSE);
+                FilterExpr::Insn type{Op::TYPE};
+                type.value = static_cast<int64_t>(FileType::DIRECTORY);
+                emit(type);
+                emit({Op::AND});
+                patch({j});
+            }
+            if (!first) emit({Op::OR});
+            first = false;
+        }
+        patch(jumps);
+    }
+
+    Rule parseRule(std::string glob) const {
+        Rule rule;
+        if (glob.size() > 1 && glob.back() == '/') {
+            rule.dirOnly = true;
+            glob.pop_back();
+        }
+        if (!glob.empty() && glob[0] == '/') {
+            rule.path = true;
+            glob.erase(0, 1);
+        }
+        if (glob.empty()) fail("missing glob");
+        if (glob.find('/') != std::string::npos) rule.path = true;
+        rule.glob = glob;
+        return rule;
+    }
+
+    // ---- 表达式词法 ----
+
+    void next() {
+        while (pos_ < src_.size() && std::isspace(static_cast<unsigned char>(src_[pos_]))) ++pos_;
+        text_.clear();
+        if (pos_ >= src_.size()) {
+            tok_ = Tok::END;
+            return;
+        }
+        const char c = src_[pos_];
+        if (c == '(' || c == ')') {
+            tok_ = c == '(' ? Tok::LPAREN : Tok::RPAREN;
+            text_ = c;
+            ++pos_;
+        } else if (c == '"' || c == '\'') {
+            // 只有 \<引号> 是转义, 其他反斜杠原样保留 (正则里的 \d \. 不用写两遍)
+            tok_ = Tok::STRING;
+            ++pos_;
+            while (pos_ < src_.size() && src_[pos_] != c) {
+                if (src_[pos_] == '\\' && pos_ + 1 < src_.size() && src_[pos_ + 1] == c) ++pos_;
+                text_ += src_[pos_++];
+            }
+            if (pos_ >= src_.size()) fail("unterminated string");
+            ++pos_;
+        } else if (std::strchr("<>=!~&|", c)) {
+            tok_ = Tok::OP;
+            while (pos_ < src_.size() && std::strchr("<>=!~&|", src_[pos_]) && src_[pos_]) text_ += src_[pos_++];
+        } else {
+            tok_ = Tok::WORD;
+            while (pos_ < src_.size() && !std::isspace(static_cast<unsigned char>(src_[pos_])) && src_[pos_] != ')') {
+                text_ += src_[pos_++];
+            }
+        }
+    }
+
+    bool isWord(const char* word) const { return tok_ == Tok::WORD && text_ == word; }
+    bool isOp(const char* op) const { return tok_ == Tok::OP && text_ == op; }
+
+    std::string near() const { return tok_ == Tok::END ? "end of line" : "'" + text_ + "'"; }
+
+    std::string expectValue(const char* what) {
+        if (tok_ != Tok::WORD && tok_ != Tok::STRING) fail(std::string("expected ") + what + " near " + near());
+        std::string value = text_;
+        next();
+        return value;
+    }
+
+    Cmp expectCmp() {
+        static const std::pair<const char*, Cmp> ops[] = {
+            {"<", Cmp::LT}, {"<=", Cmp::LE}, {">", Cmp::GT}, {">=", Cmp::GE},
+            {"==", Cmp::EQ}, {"=", Cmp::EQ}, {"!=", Cmp::NE},
+        };
+        if (tok_ == Tok::OP) {
+            for (const auto& op : ops) {
+                if (text_ == op.first) {
+                    next();
+                    return op.second;
+                }
+            }
+        }
+        fail("expected comparison (< <= > >= == !=) near " + near());
+    }
+
+    // 数字 + 单位 (units 里找不到单位就报错)
+    int64_t parseQuantity(const std::string& text, const std::map<std::string, double>& units, const char* what) const {
+        char* end = nullptr;
+        const double number = std::strtod(text.c_str(), &end);
+        if (end == text.c_str() || number < 0) fail(std::string("bad ") + what + " '" + text + "'");
+        std::string unit(end);
+        std::transform(unit.begin(), unit.end(), unit.begin(), [](unsigned char ch) { return std::tolower(ch); });
+        const auto it = units.find(unit);
+        if (it == units.end()) fail(std::string("bad ") + what + " unit '" + unit + "'");
+        return static_cast<int64_t>(number * it->second);
+    }
+
+    int64_t parseInteger(const std::string& text) const {
+        char* end = nullptr;
+        const long long v = std::strtoll(text.c_str(), &end, 10);
+        if (end == text.c_str() || *end) fail("bad number '" + text + "'");
+        return v;
+    }
+
+    // ---- 表达式语法 (递归下降, 边解析边生成) ----
+
+    void parseWhere(const std::string& text) {
+        src_ = text;
+        pos_ = 0;
+        next();
+        if (tok_ == Tok::END) fail("empty expression");
+        parseOr();
+        if (tok_ != Tok::END) fail("unexpected " + near());
+    }
+
+    void parseOr() {
+        std::vector<size_t> jumps;
+        parseAnd();
+        while (isWord("or") || isOp("||")) {
+            next();
+            jumps.push_back(emitJump(Op::JUMP_TRUE));
+            parseAnd();
+            emit({Op::OR});
+        }
+        patch(jumps);
+    }
+
+    void parseAnd() {
+        std::vector<size_t> jumps;
+        parseUnary();
+        while (isWord("and") || isOp("&&")) {
+            next();
+            jumps.push_back(emitJump(Op::JUMP_FALSE));
+            parseUnary();
+            emit({Op::AND});
+        }
+        patch(jumps);
+    }
+
+    void parseUnary() {
+        if (isWord("not") || isOp("!")) {
+            next();
+            parseUnary();
+            emit({Op::NOT});
+        } else if (tok_ == Tok::LPAREN) {
+            next();
+            parseOr();
+            if (tok_ != Tok::RPAREN) fail("missing ')' near " + near());
+            next();
+        } else {
+            parsePredicate();
+        }
+    }
+
+    void parsePredicate() {
+        if (tok_ != Tok::WORD) fail("expected a predicate near " + near());
+        const std::string key = text_;
+        next();
+
+        if (key == "name" || key == "path") {
+            const bool path = key == "path";
+            if (isOp("~")) {
+                next();
+                const std::string pattern = expectValue("regex");
+                try {
+                    expr_.regexes_.emplace_back(pattern, std::regex::ECMAScript | std::regex::optimize);
+                } catch (const std::regex_error& e) {
+                    fail("bad regex '" + pattern + "': " + e.what());
+                }
+                FilterExpr::Insn insn{path ? Op::PATH_REGEX : Op::NAME_REGEX};
+                insn.arg = static_cast<uint32_t>(expr_.regexes_.size() - 1);
+                emit(insn);
+            } else {
+                emitGlob(path, expectValue("glob"));
+            }
+            return;
+        }
+
+        if (key == "type") {
+            const std::string t = expectValue("type");
+            FilterExpr::Insn insn{Op::TYPE};
+            if (t == "file" || t == "f") insn.value = static_cast<int64_t>(FileType::REGULAR);
+            else if (t == "dir" || t == "d") insn.value = static_cast<int64_t>(FileType::DIRECTORY);
+            else if (t == "link" || t == "l") insn.value = static_cast<int64_t>(FileType::SYMLINK);
+            else fail("unknown type '" + t + "' (expected file / dir / link)");
+            emit(insn);
+            return;
+        }
+
+        static const std::map<std::string, double> sizeUnits = {
+            {"", 1}, {"b", 1},
+            {"k", 1024.0}, {"kb", 1024.0}, {"kib", 1024.0},
+            {"m", 1048576.0}, {"mb", 1048576.0}, {"mib", 1048576.0},
+            {"g", 1073741824.0}, {"gb", 1073741824.0}, {"gib", 1073741824.0},
+            {"t", 1099511627776.0}, {"tb", 1099511627776.0}, {"tib", 1099511627776.0},
+        };
+        static const std::map<std::string, double> ageUnits = {
+            {"", 86400}, {"d", 86400}, {"s", 1}, {"m", 60}, {"min", 60}, {"h", 3600}, {"w", 604800},
+        };
+
+        FilterExpr::Insn insn{Op::SIZE};
+        if (key == "size") {
+            insn.cmp = expectCmp();
+            insn.value = parseQuantity(expectValue("size"), sizeUnits, "size");
+        } else if (key == "age") {
+            // age < 7d  <=>  mtime > now - 7d: 编译成绝对时间, 比较方向反过来
+            static const Cmp flipped[] = {Cmp::GT, Cmp::GE, Cmp::LT, Cmp::LE, Cmp::EQ, Cmp::NE};
+            insn.op = Op::MTIME;
+            insn.cmp = flipped[static_cast<int>(expectCmp())];
+            insn.value = now_ - parseQuantity(expectValue("age"), ageUnits, "age");
+        } else if (key == "mtime" || key == "uid" || key == "gid") {
+            insn.op = key == "mtime" ? Op::MTIME : (key == "uid" ? Op::UID : Op::GID);
+            insn.cmp = expectCmp();
+            insn.value = parseInteger(expectValue("number"));
+        } else {
+            fail("unknown predicate '" + key + "'");
+        }
+        emit(insn);
+    }
+};
+
+// ==========================================
+// FilterExpr
+// ==========================================
+
+struct FilterExpr::Subject {
+    const std::string* relPath = nullptr;
+    const std::string* name = nullptr;
+    const FileRecord* record = nullptr; // 为空 = 还没 stat
+    bool typeKnown = false;
+    FileType type = FileType::OTHER;
+
+    // glob 匹配结果按需算, 一个条目最多各走一遍 DFA
+    const uint64_t* nameBits = nullptr;
+    const uint64_t* pathBits = nullptr;
+    std::vector<uint64_t> nameScratch;
+    std::vector<uint64_t> pathScratch;
+};
+
+std::shared_ptr<const FilterExpr> FilterExpr::compile(const std::string& rules) {
+    auto expr = std::make_shared<FilterExpr>();
+    FilterCompiler(*expr).compile(rules);
+    return expr;
+}
+
+std::string FilterExpr::readRules(const std::string& path) {
+    std::ifstream in(fs::u8path(path), std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open filter file: " + path);
+    std::ostringstream text;
+    text << in.rdbuf();
+    std::string rules = text.str();
+    if (!rules.empty() && rules.back() != '\n') rules += '\n';
+    return rules;
+}
+
+uint8_t FilterExpr::run(const Program& program, Subject& s) const {
+    auto compare = [](int64_t lhs, const Insn& in) -> uint8_t {
+        switch (in.cmp) {
+            case Cmp::LT: return lhs < in.value;
+            case Cmp::LE: return lhs <= in.value;
+            case Cmp::GT: return lhs > in.value;
+            case Cmp::GE: return lhs >= in.value;
+            case Cmp::EQ: return lhs == in.value;
+            default: return lhs != in.value;
+        }
+    };
+    auto bit = [](const uint64_t* bits, uint32_t id) -> uint8_t { return (bits[id >> 6] >> (id & 63)) & 1; };
+
+    uint8_t stack[MAX_STACK];
+    size_t sp = 0;
+    const auto& code = program.code;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        const Insn& in = code[pc];
+        switch (in.op) {
+            case Op::NAME_GLOB:
+                if (!s.nameBits) s.nameBits = names_.match(*s.name, s.nameScratch);
+                stack[sp++] = bit(s.nameBits, in.arg);
+                break;
+            case Op::PATH_GLOB:
+                if (!s.pathBits) s.pathBits = paths_.match(*s.relPath, s.pathScratch);
+                stack[sp++] = bit(s.pathBits, in.arg);
+                break;
+            case Op::NAME_REGEX:
+                stack[sp++] = std::regex_search(*s.name, regexes_[in.arg]) ? YES : NO;
+                break;
+            case Op::PATH_REGEX:
+                stack[sp++] = std::regex_search(*s.relPath, regexes_[in.arg]) ? YES : NO;
+                break;
+            case Op::TYPE:
+                stack[sp++] = s.typeKnown ? (static_cast<int64_t>(s.type) == in.value ? YES : NO) : UNKNOWN;
+                break;
+            case Op::SIZE:
+                stack[sp++] = s.record ? compare(static_cast<int64_t>(s.record->size), in) : UNKNOWN;
+                break;
+            case Op::MTIME:
+                stack[sp++] = s.record ? compare(s.record->mtime, in) : UNKNOWN;
+                break;
+            case Op::UID:
+                stack[sp++] = s.record ? compare(s.record->uid, in) : UNKNOWN;
+                break;
+            case Op::GID:
+                stack[sp++] = s.record ? compare(s.record->gid, in) : UNKNOWN;
+                break;
+            case Op::NOT:
+                stack[sp - 1] = not3(stack[sp - 1]);
+                break;
+            case Op::AND:
+                --sp;
+                stack[sp - 1] = and3(stack[sp - 1], stack[sp]);
+                break;
+            case Op::OR:
+                --sp;
+                stack[sp - 1] = or3(stack[sp - 1], stack[sp]);
+                break;
+            case Op::JUMP_FALSE:
+                if (stack[sp - 1] == NO) pc = in.arg - 1;
+                break;
+            case Op::JUMP_TRUE:
+                if (stack[sp - 1] == YES) pc = in.arg - 1;
+                break;
+        }
+    }
+    return sp ? stack[0] : YES;
+}
+
+bool FilterExpr::mayMatch(const std::string& relPath, const std::string& name) const {
+    Subject s;
+    s.relPath = &relPath;
+    s.name = &name;
+    return run(select_, s) != NO;
+}
+
+bool FilterExpr::prunes(const std::string& relPath, const std::string& name) const {
+    if (prune_.code.empty()) return false;
+    Subject s;
+    s.relPath = &relPath;
+    s.name = &name;
+    s.typeKnown = true;
+    s.type = FileType::DIRECTORY;
+    return run(prune_, s) == YES;
+}
+
+bool FilterExpr::matches(const FileRecord& record) const {
+#ifdef _WIN32
+    const size_t slash = record.relPath.find_last_of("/\\");
+#else
+    const size_t slash = record.relPath.rfind('/');
+#endif
+    const std::string name = slash == std::string::npos ? record.relPath : record.relPath.substr(slash + 1);
+    Subject s;
+    s.relPath = &record.relPath;
+    s.name = &name;
+    s.record = &record;
+    s.typeKnown = true;
+    s.type = record.type;
+    return run(select_, s) == YES;
+}
+
+void FilterExpr::describe(std::ostream& out) const {
+    auto dfa = [&out](const char* what, const GlobSet& set) {
+        out << ", " << set.size() << " " << what << " globs";
+        if (set.size()) {
+            if (set.dfaStates()) out << " (DFA " << set.dfaStates() << " states)";
+            else out << " (NFA)";
+        }
+    };
+    out << "[Filter] " << rules_ << " rules";
+    dfa("name", names_);
+    dfa("path", paths_);
+    if (!regexes_.empty()) out << ", " << regexes_.size() << " regex";
+    out << ", " << select_.code.size() << " ops" << std::endl;
+}
+
+// ==========================================
+// IgnoreMatcher
+// ==========================================
+
+std::shared_ptr<const IgnoreMatcher> IgnoreMatcher::compile(const std::string& text, const std::string& dirRel,
+                                                            std::shared_ptr<const IgnoreMatcher> parent) {
+    auto m = std::make_shared<IgnoreMatcher>();
+    m->parent_ = std::move(parent);
+    if (!dirRel.empty()) m->base_ = dirRel + "/";
+
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        // 结尾的空格去掉, 被反斜杠转义的留着
+        while (!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+            line.pop_back();
+        }
+
+        uint8_t flags = 0;
+        if (line[0] == '!') {
+            flags |= NEGATE;
+            line.erase(0, 1);
+        } else if (line.size() > 1 && line[0] == '\\' && (line[1] == '#' || line[1] == '!')) {
+            line.erase(0, 1);
+        }
+        if (line.size() > 1 && line.back() == '/') {
+            flags |= DIR_ONLY;
+            line.pop_back();
+        }
+        bool anchored = false;
+        if (!line.empty() && line[0] == '/') {
+            anchored = true;
+            line.erase(0, 1);
+        }
+        if (line.empty()) continue;
+        if (line.find('/') != std::string::npos) anchored = true;
+
+        // 两个 GlobSet 的标签保持对齐: 标签 i 就是第 i 条规则
+        const uint32_t label = m->names_.newLabel();
+        m->paths_.newLabel();
+        (anchored ? m->paths_ : m->names_).add(line, label);
+        m->flags_.push_back(flags);
+    }
+    m->names_.build();
+    m->paths_.build();
+    return m;
+}
+
+int IgnoreMatcher::lastMatch(const std::string& relPath, const std::string& name, bool isDir) const {
+    if (flags_.empty()) return -1;
+    std::vector<uint64_t> nameScratch, pathScratch;
+    const uint64_t* nameBits = names_.size() ? names_.match(name, nameScratch) : nullptr;
+    const uint64_t* pathBits = nullptr;
+    if (paths_.size()) pathBits = paths_.match(relPath.substr(std::min(base_.size(), relPath.size())), pathScratch);
+
+    for (size_t k = (flags_.size() + 63) / 64; k-- > 0;) {
+        uint64_t bits = (nameBits ? nameBits[k] : 0) | (pathBits ? pathBits[k] : 0);
+        while (bits) {
+            int top = 63;
+            while (!(bits >> top & 1)) --top;
+            const auto rule = static_cast<int>(k * 64 + top);
+            if (!(flags_[rule] & DIR_ONLY) || isDir) return rule;
+            bits &= ~(uint64_t(1) << top);
+        }
+    }
+    return -1;
+}
+
+bool IgnoreMatcher::ignored(const std::string& relPath, const std::string& name, bool isDir) const {
+    for (const IgnoreMatcher* m = this; m; m = m->parent_.get()) {
+        const int rule = m->lastMatch(relPath, name, isDir);
+        if (rule >= 0) return !(m->flags_[rule] & NEGATE);
+    }
+    return false;
+}
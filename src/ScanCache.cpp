@@ -0,0 +1,259 @@
+// src/ScanCache.cpp
+#include "ScanCache.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+const char CACHE_MAGIC[8] = {'M', 'B', 'S', 'C', 'A', 'N', '0', '2'};
+
+// 和 S_IFMT / S_IFLNK 相同的值 (Windows 上没有这两个宏)
+constexpr uint32_t TYPE_MASK = 0170000;
+constexpr uint32_t TYPE_SYMLINK = 0120000;
+
+constexpr uint8_t FLAG_STAT = 1;
+constexpr uint8_t FLAG_NODUMP = 2;
+
+template <typename T>
+void putValue(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string& out, const std::string& s) {
+    putValue(out, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+// 按顺序从一段字节里读; 越界后 ok 变 false, 之后读到的都是 0
+struct Reader {
+    const char* p;
+    const char* end;
+    bool ok = true;
+
+    template <typename T>
+    T get() {
+        T value{};
+        if (static_cast<size_t>(end - p) < sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+
+    std::string getString() {
+        const uint32_t len = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - p) < len) {
+            ok = false;
+            return std::string();
+        }
+        std::string s(p, len);
+        p += len;
+        return s;
+    }
+};
+
+void putStamp(std::string& out, const DirStamp& s) {
+    putValue(out, s.ino);
+    putValue(out, s.mtime);
+    putValue(out, s.mtimeNsec);
+    putValue(out, s.ctime);
+    putValue(out, s.ctimeNsec);
+}
+
+DirStamp getStamp(Reader& in) {
+    DirStamp s;
+    s.ino = in.get<uint64_t>();
+    s.mtime = in.get<int64_t>();
+    s.mtimeNsec = in.get<uint32_t>();
+    s.ctime = in.get<int64_t>();
+    s.ctimeNsec = in.get<uint32_t>();
+    return s;
+}
+
+// 子项列表: [个数 4] 之后每项 [名字][d_type 1][标志 1] (+ stat 字段) (+ 软链接目标)
+std::string encodeChildren(const std::vector<ScanCache::Child>& children) {
+    std::string out;
+    putValue(out, static_cast<uint32_t>(children.size()));
+    for (const auto& c : children) {
+        putString(out, c.name);
+        putValue(out, c.dtype);
+        putValue(out, static_cast<uint8_t>((c.hasStat ? FLAG_STAT : 0) | (c.nodump ? FLAG_NODUMP : 0)));
+        if (!c.hasStat) continue;
+        putValue(out, c.mode);
+        putValue(out, c.uid);
+        putValue(out, c.gid);
+        putValue(out, c.size);
+        putValue(out, c.ino);
+        putValue(out, c.dev);
+        putValue(out, c.mtime);
+        putValue(out, c.mtimeNsec);
+        putValue(out, c.ctime);
+        putValue(out, c.ctimeNsec);
+        if ((c.mode & TYPE_MASK) == TYPE_SYMLINK) putString(out, c.linkTarget);
+    }
+    return out;
+}
+
+bool decodeChildren(const std::string& data, std::vector<ScanCache::Child>& children) {
+    Reader in{data.data(), data.data() + data.size()};
+    const uint32_t count = in.get<uint32_t>();
+    children.clear();
+    children.reserve(in.ok ? count : 0);
+    for (uint32_t k = 0; k < count && in.ok; ++k) {
+        ScanCache::Child c;
+        c.name = in.getString();
+        c.dtype = in.get<uint8_t>();
+        const uint8_t flags = in.get<uint8_t>();
+        c.hasStat = flags & FLAG_STAT;
+        c.nodump = flags & FLAG_NODUMP;
+        if (c.hasStat) {
+            c.mode = in.get<uint32_t>();
+            c.uid = in.get<uint32_t>();
+            c.gid = in.get<uint32_t>();
+            c.size = in.get<uint64_t>();
+            c.ino = in.get<uint64_t>();
+            c.dev = in.get<uint64_t>();
+            c.mtime = in.get<int64_t>();
+            c.mtimeNsec = in.get<uint32_t>();
+            c.ctime = in.get<int64_t>();
+            c.ctimeNsec = in.get<uint32_t>();
+            if ((c.mode & TYPE_MASK) == TYPE_SYMLINK) c.linkTarget = in.getString();
+        }
+        children.push_back(std::move(c));
+    }
+    return in.ok;
+}
+}
+
+bool ScanCache::Child::sameStat(const Child& o) const {
+    return hasStat && o.hasStat && mode == o.mode && uid == o.uid && gid == o.gid && size == o.size &&
+           ino == o.ino && mtime == o.mtime && mtimeNsec == o.mtimeNsec && ctime == o.ctime &&
+           ctimeNsec == o.ctimeNsec;
+}
+
+void ScanCache::load(const std::string& root) {
+    root_ = root;
+    old_.clear();
+    std::ifstream in(file_, std::ios::binary);
+    if (!in) return;
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(CACHE_MAGIC) || std::memcmp(data.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) return;
+
+    Reader r{data.data() + sizeof(CACHE_MAGIC), data.data() + data.size()};
+    if (r.getString() != root || !r.ok) return;
+    const uint64_t count = r.get<uint64_t>();
+    old_.reserve(r.ok ? count : 0);
+    for (uint64_t k = 0; k < count && r.ok; ++k) {
+        std::string rel = r.getString();
+        Entry e;
+        e.stamp = getStamp(r);
+        e.children = r.getString();
+        if (r.ok) old_.emplace(std::move(rel), std::move(e));
+    }
+    if (!r.ok) old_.clear(); // 截断的文件整个不用
+}
+
+bool ScanCache::find(const std::string& relDir, const DirStamp& stamp, std::vector<Child>& children) const {
+    const auto it = old_.find(relDir);
+    if (it == old_.end() || !(it->second.stamp == stamp)) return false;
+    return decodeChildren(it->second.children, children);
+}
+
+void ScanCache::put(const std::string& relDir, const DirStamp& stamp, const std::vector<Child>& children) {
+    Entry e;
+    e.stamp = stamp;
+    e.children = encodeChildren(children);
+    std::lock_guard<std::mutex> lock(mutex_);
+    fresh_.emplace_back(relDir, std::move(e));
+}
+
+// ==========================================
+// 常驻模式
+// ==========================================
+namespace {
+std::mutex g_residentMutex;
+bool g_resident = false;
+std::unordered_map<std::string, std::shared_ptr<ScanCache>> g_residentCaches;
+}
+
+void ScanCache::setResident(bool on) {
+    std::lock_guard<std::mutex> lock(g_residentMutex);
+    g_resident = on;
+    if (!on) g_residentCaches.clear();
+}
+
+size_t ScanCache::residentCount() {
+    std::lock_guard<std::mutex> lock(g_residentMutex);
+    return g_residentCaches.size();
+}
+
+std::shared_ptr<ScanCache> ScanCache::open(const fs::path& file, const std::string& root) {
+    std::lock_guard<std::mutex> lock(g_residentMutex);
+    if (!g_resident) {
+        auto cache = std::make_shared<ScanCache>(file);
+        cache->load(root);
+        return cache;
+    }
+
+    std::error_code ec;
+    fs::path key = fs::absolute(file, ec);
+    if (ec) key = file;
+    auto& cache = g_residentCaches[key.string()];
+    if (cache && cache->root_ == root && cache->diskUnchanged()) {
+        cache->fresh_.clear(); // 上次没 save 的 (扫描中途停了) 不要
+        return cache;
+    }
+    cache = std::make_shared<ScanCache>(file);
+    cache->resident_ = true;
+    cache->load(root);
+    cache->noteDisk();
+    return cache;
+}
+
+bool ScanCache::diskUnchanged() const {
+    std::error_code ec;
+    const auto time = fs::last_write_time(file_, ec);
+    if (ec) return diskTime_ < 0;
+    return diskTime_ == static_cast<int64_t>(time.time_since_epoch().count()) && diskSize_ == fs::file_size(file_, ec);
+}
+
+void ScanCache::noteDisk() {
+    std::error_code ec;
+    const auto time = fs::last_write_time(file_, ec);
+    diskTime_ = ec ? -1 : static_cast<int64_t>(time.time_since_epoch().count());
+    diskSize_ = ec ? 0 : fs::file_size(file_, ec);
+}
+
+void ScanCache::save() {
+    fs::path tmp = file_;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        std::string buf(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        putString(buf, root_);
+        putValue(buf, static_cast<uint64_t>(fresh_.size()));
+        for (const auto& [rel, e] : fresh_) {
+            putString(buf, rel);
+            putStamp(buf, e.stamp);
+            putString(buf, e.children);
+            if (buf.size() >= (1u << 20)) {
+                out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+                buf.clear();
+            }
+        }
+        out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        if (!out) throw std::runtime_error("Cannot write scan cache: " + tmp.string());
+    }
+    fs::rename(tmp, file_);
+
+    if (resident_) {
+        old_.clear();
+        old_.reserve(fresh_.size());
+        for (auto& [rel, e] : fresh_) old_.emplace(std::move(rel), std::move(e));
+        fresh_.clear();
+        noteDisk();
+    }
+}
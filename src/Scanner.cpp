@@ -0,0 +1,867 @@
+// src/Scanner.cpp
+#include "Scanner.h"
+#include "FilterExpr.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+#ifndef _WIN32
+    #include <sys/stat.h>
+#endif
+#ifdef __linux__
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+// Linux: getdents64 一次读一大批目录项 (带 d_type), 每个条目只做一次 statx (相对目录 fd, 不跟随软链接)
+#if defined(__linux__) && defined(SYS_getdents64) && defined(STATX_BASIC_STATS)
+    #define MINIBACKUP_NATIVE_SCAN 1
+#endif
+
+// 缓存目录标记 (https://bford.info/cachedir/): ccache / pip / 浏览器缓存等都会放
+constexpr char CACHEDIR_TAG[] = "CACHEDIR.TAG";
+constexpr char CACHEDIR_SIGNATURE[] = "Signature: 8a477f597d28d172789f06886806bc55";
+
+std::string pathToString(const fs::path& p) {
+#if __cplusplus >= 202002L
+    const auto& u8str = p.u8string();
+    return std::string(u8str.begin(), u8str.end());
+#else
+    return p.u8string();
+#endif
+}
+
+#ifdef MINIBACKUP_NATIVE_SCAN
+// getdents64 的缓冲: 越大系统调用越少 (NFS 上每次都是一次往返)
+constexpr size_t DIRENT_BUFFER_SIZE = 256u << 10;
+
+// 只要这些字段; 不强制同步, NFS 上用客户端缓存的属性
+constexpr unsigned STATX_SCAN_MASK =
+    STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME | STATX_CTIME | STATX_UID | STATX_GID | STATX_INO;
+
+// chattr +d (ext4 / XFS / btrfs 都支持), statx 属性里顺带给出
+bool hasNodump(const struct statx& stx) {
+#ifdef STATX_ATTR_NODUMP
+    return (stx.stx_attributes_mask & STATX_ATTR_NODUMP) && (stx.stx_attributes & STATX_ATTR_NODUMP);
+#else
+    (void)stx;
+    return false;
+#endif
+}
+
+uint64_t deviceOf(const struct statx& stx) {
+    return (static_cast<uint64_t>(stx.stx_dev_major) << 32) | stx.stx_dev_minor;
+}
+
+// 目录自己的 stat 里和扫描缓存有关的三样 (子目录由父目录顺带 stat, 根目录在开始时 stat)
+constexpr unsigned STATX_DIR_MASK = STATX_TYPE | STATX_INO | STATX_MTIME | STATX_CTIME;
+
+bool stampOf(const struct statx& stx, DirStamp& stamp) {
+    stamp.ino = stx.stx_ino;
+    stamp.mtime = stx.stx_mtime.tv_sec;
+    stamp.mtimeNsec = stx.stx_mtime.tv_nsec;
+    stamp.ctime = stx.stx_ctime.tv_sec;
+    stamp.ctimeNsec = stx.stx_ctime.tv_nsec;
+    return (stx.stx_mask & (STATX_INO | STATX_MTIME | STATX_CTIME)) == (STATX_INO | STATX_MTIME | STATX_CTIME);
+}
+
+// statx 结果存成缓存里的子项 (类型位拿不到时用 d_type 补)
+void fillChild(const struct statx& stx, unsigned char dtype, ScanCache::Child& child) {
+    mode_t type = stx.stx_mode & S_IFMT;
+    if (!(stx.stx_mask & STATX_TYPE)) {
+        type = dtype == DT_DIR ? S_IFDIR : dtype == DT_LNK ? S_IFLNK : dtype == DT_REG ? S_IFREG : 0;
+    }
+    child.hasStat = true;
+    child.nodump = hasNodump(stx);
+    child.mode = type | (stx.stx_mode & 07777);
+    child.uid = stx.stx_uid;
+    child.gid = stx.stx_gid;
+    child.size = stx.stx_size;
+    child.ino = stx.stx_ino;
+    child.dev = deviceOf(stx);
+    child.mtime = stx.stx_mtime.tv_sec;
+    child.mtimeNsec = stx.stx_mtime.tv_nsec;
+    child.ctime = stx.stx_ctime.tv_sec;
+    child.ctimeNsec = stx.stx_ctime.tv_nsec;
+}
+
+void fillFromStatx(const struct statx& stx, FileRecord& record) {
+    record.size = stx.stx_size;
+    record.mtime = stx.stx_mtime.tv_sec;
+    record.mtimeNsec = stx.stx_mtime.tv_nsec;
+    record.mode = stx.stx_mode & 07777;
+    record.uid = stx.stx_uid;
+    record.gid = stx.stx_gid;
+    record.ino = stx.stx_ino;
+    record.ctime = stx.stx_ctime.tv_sec;
+    record.ctimeNsec = stx.stx_ctime.tv_nsec;
+}
+
+// 一次 statx 拿到大小 / 修改时间 / 权限 / 属主 (不跟随符号链接, 和目录扫描一致)
+void fillMetadata(const fs::path& fullPath, FileRecord& record) {
+    struct statx stx{};
+    if (::statx(AT_FDCWD, fullPath.c_str(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_SCAN_MASK, &stx) != 0) {
+        stx = {};
+    }
+    fillFromStatx(stx, record);
+}
+#else
+#ifdef _WIN32
+// 这种方式比 stat/_wstat 更稳定，支持 Windows 中文路径
+void fillMetadata(const fs::path& fullPath, FileRecord& record) {
+    std::error_code ec; // 用于捕获错误，防止程序崩溃
+
+    // 1. 获取大小
+    record.size = fs::file_size(fullPath, ec);
+    if (ec) record.size = 0;
+
+    // 2. 获取时间 (这是最稳的写法)
+    auto ftime = fs::last_write_time(fullPath, ec);
+    if (!ec) {
+        // 将 file_time_type 转换为系统时间戳 (Unix Timestamp)
+        auto sctp = std::chrono::time_point_cast<std::chrono::seconds>(
+            ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now()
+        );
+        record.mtime = sctp.time_since_epoch().count();
+    } else {
+        record.mtime = 0;
+    }
+
+    // 3. 权限 / 属主 (Windows 下无实际意义，填默认值保持兼容)
+    record.mode = 0644;
+    record.uid = 0;
+    record.gid = 0;
+}
+#else
+// 一次 lstat 拿全: fs::file_size / last_write_time 会跟随符号链接,
+// 那样链接条目会带上目标的大小和时间, 目标变了还会让链接被误判为已修改
+void fillMetadata(const fs::path& fullPath, FileRecord& record) {
+    struct stat st{};
+    if (::lstat(fullPath.c_str(), &st) != 0) {
+        record.size = 0;
+        record.mtime = 0;
+        return;
+    }
+    record.size = static_cast<uint64_t>(st.st_size);
+    record.mtime = st.st_mtime;
+    record.ctime = st.st_ctime;
+#if defined(__APPLE__)
+    record.mtimeNsec = st.st_mtimespec.tv_nsec;
+    record.ctimeNsec = st.st_ctimespec.tv_nsec;
+#else
+    record.mtimeNsec = st.st_mtim.tv_nsec;
+    record.ctimeNsec = st.st_ctim.tv_nsec;
+#endif
+    record.mode = st.st_mode & 07777;
+    record.uid = st.st_uid;
+    record.gid = st.st_gid;
+    record.ino = static_cast<uint64_t>(st.st_ino);
+}
+#endif
+#endif
+
+struct Scanner::Worker {
+    std::mutex mutex;             // 保护 queue (自己从队尾取, 别人从队头偷)
+    std::deque<DirTask> queue;
+    FileCatalog batch;            // 只有自己写 (目录 id 指向共用的目录表)
+    std::vector<FileRecord> records; // 流式扫描时攒着还没交出去的条目
+    ScanStats stats;
+};
+
+Scanner::Scanner(const ScanOptions& options) : options_(options) {}
+
+Scanner::~Scanner() = default;
+
+FileCatalog Scanner::scan(const fs::path& root, const ScanFilter& filter) {
+    FileCatalog files(pathToString(root));
+    catalog_ = &files;
+    run(root, filter);
+    for (auto& w : workers_) files.append(std::move(w->batch));
+    workers_.clear();
+    catalog_ = nullptr;
+
+    // 按路径排序后父目录一定排在子项前面 (前缀更短)
+    if (options_.sorted) files.sortByPath();
+    return files;
+}
+
+void Scanner::scan(const fs::path& root, const ScanFilter& filter, const ScanSink& sink) {
+    sink_ = &sink;
+    run(root, filter);
+    workers_.clear();
+    sink_ = nullptr;
+}
+
+void Scanner::run(const fs::path& root, const ScanFilter& filter) {
+    stats_ = ScanStats();
+    stopped_ = false;
+    firstOut_ = false;
+    const unsigned threads = options_.threads ? options_.threads : ThreadPool::defaultThreads();
+    workers_.clear();
+    for (unsigned i = 0; i < threads; ++i) workers_.push_back(std::make_unique<Worker>());
+
+    // 根目录所在的文件系统 (oneFileSystem 时跨出去的目录不进)
+    rootDevice_ = 0;
+    DirTask first{root, fs::path(), nullptr, true, FileCatalog::ROOT};
+#ifdef MINIBACKUP_NATIVE_SCAN
+    struct statx rootStx{};
+    if (::statx(AT_FDCWD, root.c_str(), AT_STATX_DONT_SYNC, STATX_DIR_MASK, &rootStx) == 0) {
+        rootDevice_ = deviceOf(rootStx);
+        first.stamped = stampOf(rootStx, first.stamp);
+    }
+
+    // 扫描缓存: 读入上次的; 开始之前一秒内还在变的目录不记 (时间戳粒度内的后续修改看不出来)
+    cache_.reset();
+    journal_.reset();
+    dirty_ = DirtySet();
+    if (!options_.cacheFile.empty()) {
+        cache_ = ScanCache::open(fs::u8path(options_.cacheFile), pathToString(fs::absolute(root)));
+        const auto now = std::chrono::system_clock::now().time_since_epoch();
+        racyAfterNs_ = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count() - 1000000000LL;
+
+        // 变动日志: 取走到现在为止的变动, 扫完写好缓存再确认 (中途失败下次还会读到)
+        if (!options_.journalFile.empty()) {
+            journal_ = std::make_unique<ChangeJournal>(fs::u8path(options_.journalFile));
+            dirty_ = journal_->take();
+            stats_.journal = true;
+            stats_.journalFull = dirty_.everything;
+            stats_.journalChanges = dirty_.size();
+        }
+    }
+#elif !defined(_WIN32)
+    struct stat rootSt{};
+    if (::stat(root.c_str(), &rootSt) == 0) rootDevice_ = static_cast<uint64_t>(rootSt.st_dev);
+#endif
+
+    pending_ = 1;
+    workers_[0]->queue.push_back(std::move(first));
+
+    // 当前线程充当 0 号工作线程
+    std::vector<std::thread> helpers;
+    for (unsigned i = 1; i < threads; ++i) {
+        helpers.emplace_back([this, i, &filter] { workerLoop(i, filter); });
+    }
+    workerLoop(0, filter);
+    for (auto& t : helpers) t.join();
+
+    for (auto& w : workers_) {
+        stats_.directories += w->stats.directories;
+        stats_.entries += w->stats.entries;
+        stats_.steals += w->stats.steals;
+        stats_.errors += w->stats.errors;
+        stats_.syscalls += w->stats.syscalls;
+        stats_.nameSkipped += w->stats.nameSkipped;
+        stats_.pruned += w->stats.pruned;
+        stats_.ignoreFiles += w->stats.ignoreFiles;
+        stats_.ignored += w->stats.ignored;
+        stats_.cacheDirs += w->stats.cacheDirs;
+        stats_.nodump += w->stats.nodump;
+        stats_.mountPoints += w->stats.mountPoints;
+        stats_.cachedDirs += w->stats.cachedDirs;
+        stats_.cachedStats += w->stats.cachedStats;
+    }
+
+    // 中途停下的扫描没读完所有目录, 不覆盖旧缓存
+    if (cache_ && !stopped_) {
+        cache_->save();
+        if (journal_) journal_->commit();
+    }
+    cache_.reset();
+    journal_.reset();
+}
+
+void Scanner::workerLoop(size_t self, const ScanFilter& filter) {
+    unsigned idle = 0;
+    while (true) {
+        DirTask task;
+        if (takeTask(self, task)) {
+            idle = 0;
+            if (!stopped_.load(std::memory_order_relaxed)) scanOne(self, task, filter);
+            pending_.fetch_sub(1, std::memory_order_acq_rel);
+            continue;
+        }
+        if (pending_.load(std::memory_order_acquire) == 0) return;
+        // 别的线程还在扫, 过一会儿可能有新目录可偷
+        if (++idle < 64) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+bool Scanner::takeTask(size_t self, DirTask& task) {
+    {
+        Worker& own = *workers_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty()) {
+            task = std::move(own.queue.back());
+            own.queue.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < workers_.size(); ++k) {
+        Worker& victim = *workers_[(self + k) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.queue.empty()) {
+            task = std::move(victim.queue.front());
+            victim.queue.pop_front();
+            workers_[self]->stats.steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 读 task 目录里的忽略文件, 叠加在父目录的规则上; 没有就直接沿用父目录的 (不复制, 不重新编译)
+std::shared_ptr<const IgnoreMatcher> Scanner::loadIgnore(Worker& w, const DirTask& task, const ScanFilter& filter,
+                                                         int dirFd) {
+    if (filter.ignoreFile.empty()) return task.ignore;
+    std::string text;
+#ifdef MINIBACKUP_NATIVE_SCAN
+    const int fd = ::openat(dirFd, filter.ignoreFile.c_str(), O_RDONLY | O_CLOEXEC);
+    w.stats.syscalls++;
+    if (fd < 0) return task.ignore;
+    char buf[16384];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) text.append(buf, static_cast<size_t>(n));
+    ::close(fd);
+#else
+    (void)dirFd;
+    std::ifstream in(task.absPath / fs::u8path(filter.ignoreFile), std::ios::binary);
+    if (!in) return task.ignore;
+    text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+#endif
+    w.stats.ignoreFiles++;
+    return IgnoreMatcher::compile(text, pathToString(task.relPath), task.ignore);
+}
+
+// 新发现的子目录登记进目录表 (一个目录的子目录一次锁完), 再放进自己的队列
+void Scanner::queueSubdirs(Worker& w, const DirTask& task, std::vector<DirTask>& subdirs) {
+    // 流式扫描时先把这个目录的条目交出去, 保证目录条目总在它里面的条目之前
+    flush(w);
+    if (subdirs.empty()) return;
+    if (catalog_) {
+        std::lock_guard<std::mutex> lock(dirMutex_);
+        for (auto& d : subdirs) d.dir = catalog_->addDir(task.dir, pathToString(d.relPath.filename()));
+    }
+    pending_.fetch_add(subdirs.size(), std::memory_order_acq_rel);
+    std::lock_guard<std::mutex> lock(w.mutex);
+    for (auto& d : subdirs) w.queue.push_back(std::move(d));
+}
+
+// 一批多少条交给 sink: 太小锁和唤醒太频繁, 太大第一批来得慢
+constexpr size_t STREAM_BATCH = 256;
+
+// 选中的条目: 记进自己的清单, 或者 (流式) 补上绝对路径攒进批次
+void Scanner::emit(Worker& w, const DirTask& task, const std::string& name, FileRecord& record) {
+    if (!sink_) {
+        w.batch.add(task.dir, name, record);
+        return;
+    }
+    record.absPath = pathToString(task.absPath / fs::u8path(name));
+    w.records.push_back(std::move(record));
+    // 第一个条目单独先交出去, 让下游马上开工
+    if (w.records.size() >= STREAM_BATCH || (!firstOut_.load(std::memory_order_relaxed) && !firstOut_.exchange(true))) {
+        flush(w);
+    }
+}
+
+void Scanner::flush(Worker& w) {
+    if (!sink_ || w.records.empty()) return;
+    std::vector<FileRecord> batch;
+    batch.swap(w.records);
+    if (!(*sink_)(std::move(batch))) stopped_ = true;
+}
+
+ScanStream::ScanStream(const fs::path& root, ScanFilter filter, const ScanOptions& options, size_t capacity)
+    : scanner_(options), filter_(std::move(filter)), capacity_(capacity ? capacity : 1) {
+    thread_ = std::thread([this, root] {
+        try {
+            const ScanSink sink = [this](std::vector<FileRecord>&& batch) { return push(std::move(batch)); };
+            scanner_.scan(root, filter_, sink);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        notEmpty_.notify_all();
+    });
+}
+
+ScanStream::~ScanStream() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        queue_.clear();
+    }
+    notFull_.notify_all();
+    thread_.join();
+}
+
+bool ScanStream::push(std::vector<FileRecord>&& batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+    if (closed_) return false;
+    queue_.push_back(std::move(batch));
+    lock.unlock();
+    notEmpty_.notify_one();
+    return true;
+}
+
+bool ScanStream::next(FileRecord& record) {
+    if (pos_ >= current_.size()) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return done_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            if (error_) std::rethrow_exception(error_);
+            return false;
+        }
+        current_ = std::move(queue_.front());
+        queue_.pop_front();
+        pos_ = 0;
+        lock.unlock();
+        notFull_.notify_one();
+    }
+    record = std::move(current_[pos_++]);
+    if (delivered_++ == 0) {
+        firstEntryMs_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started_).count();
+    }
+    return true;
+}
+
+#ifdef MINIBACKUP_NATIVE_SCAN
+namespace {
+struct DirFd {
+    int fd = -1;
+    ~DirFd() { if (fd >= 0) ::close(fd); }
+};
+
+// 目录里有 CACHEDIR.TAG 且以标准签名开头, 才算缓存目录
+bool isCacheDir(int dirFd) {
+    const int fd = ::openat(dirFd, CACHEDIR_TAG, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    char head[sizeof(CACHEDIR_SIGNATURE) - 1];
+    const ssize_t n = ::read(fd, head, sizeof(head));
+    ::close(fd);
+    return n == static_cast<ssize_t>(sizeof(head)) && std::memcmp(head, CACHEDIR_SIGNATURE, sizeof(head)) == 0;
+}
+}
+
+void Scanner::scanOne(size_t self, const DirTask& task, const ScanFilter& filter) {
+    Worker& w = *workers_[self];
+    DirFd dir;
+    dir.fd = ::open(task.absPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    w.stats.syscalls++;
+    if (dir.fd < 0) {
+        w.stats.errors++;
+        return;
+    }
+    // 父目录没 stat 过这个目录 (名字没通过筛选) 时才在这里补一次, 判断 nodump / 是否跨文件系统,
+    // 用扫描缓存时顺便拿到 inode / mtime / ctime
+    DirStamp stamp = task.stamp;
+    bool stamped = task.stamped;
+    if ((!task.checked && (options_.skipNodump || options_.oneFileSystem)) || (cache_ && !stamped)) {
+        struct statx own{};
+        w.stats.syscalls++;
+        if (::statx(dir.fd, "", AT_EMPTY_PATH | AT_STATX_DONT_SYNC, STATX_DIR_MASK, &own) == 0) {
+            if (!task.checked && options_.skipNodump && hasNodump(own)) {
+                w.stats.nodump++;
+                return;
+            }
+            if (!task.checked && options_.oneFileSystem && deviceOf(own) != rootDevice_) {
+                w.stats.mountPoints++;
+                return;
+            }
+            stamped = stampOf(own, stamp);
+        }
+    }
+    w.stats.directories++;
+
+    // 1. 先把目录项 (名字 + d_type) 全部读出来, 还不做任何 stat; 目录没变时直接用缓存里的名单
+    std::string names; // 名字依次排放, 各带结尾 '\0'
+    std::vector<std::pair<size_t, unsigned char>> entries; // (名字在 names 里的偏移, d_type)
+    const std::string relDir = cache_ ? pathToString(task.relPath) : std::string();
+    std::vector<ScanCache::Child> cached; // 命中时和 entries 一一对应
+    bool complete = true;                 // 目录项读全了 (才能记进缓存)
+    if (stamped && cache_ && cache_->find(relDir, stamp, cached)) {
+        w.stats.cachedDirs++;
+        for (const auto& c : cached) {
+            entries.emplace_back(names.size(), c.dtype);
+            names.append(c.name.c_str(), c.name.size() + 1);
+        }
+    } else {
+        std::vector<char> buf(DIRENT_BUFFER_SIZE);
+        while (true) {
+            const long n = ::syscall(SYS_getdents64, dir.fd, buf.data(), buf.size());
+            w.stats.syscalls++;
+            if (n < 0) {
+                w.stats.errors++;
+                complete = false;
+                break;
+            }
+            if (n == 0) break;
+
+            // linux_dirent64: [d_ino 8][d_off 8][d_reclen 2][d_type 1][d_name ...\0]
+            for (long pos = 0; pos < n;) {
+                const char* ent = buf.data() + pos;
+                uint16_t reclen;
+                std::memcpy(&reclen, ent + 16, 2);
+                pos += reclen;
+                const char* name = ent + 19;
+                if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+                entries.emplace_back(names.size(), static_cast<unsigned char>(ent[18]));
+                names.append(name, std::strlen(name) + 1);
+            }
+        }
+    }
+    // 这次读到的, 扫完写进新缓存 (没 stat 过的子项只记名字)
+    std::vector<ScanCache::Child> seen;
+    if (cache_) {
+        seen.resize(entries.size());
+        for (size_t k = 0; k < entries.size(); ++k) {
+            seen[k].name = names.data() + entries[k].first;
+            seen[k].dtype = entries[k].second;
+        }
+    }
+
+    // 2. 目录级的判断: CACHEDIR.TAG / 忽略文件只有目录项里出现了才去打开
+    bool hasTag = false;
+    bool hasIgnore = false;
+    for (const auto& e : entries) {
+        const char* name = names.data() + e.first;
+        if (std::strcmp(name, CACHEDIR_TAG) == 0) hasTag = true;
+        else if (!filter.ignoreFile.empty() && filter.ignoreFile == name) hasIgnore = true;
+    }
+    if (hasTag && options_.skipCaches) {
+        w.stats.syscalls += 2;
+        if (isCacheDir(dir.fd)) {
+            w.stats.cacheDirs++;
+            return;
+        }
+    }
+    const auto ignore = hasIgnore ? loadIgnore(w, task, filter, dir.fd) : task.ignore;
+
+    // 3. 逐个条目
+    std::vector<DirTask> subdirs;
+    for (size_t k = 0; k < entries.size(); ++k) {
+        const char* name = names.data() + entries[k].first;
+        const unsigned char dtype = entries[k].second;
+        try {
+            w.stats.entries++;
+            const std::string nameStr(name);
+            const fs::path rel = task.relPath / nameStr;
+            const std::string relStr = pathToString(rel);
+
+            // 先只凭 d_type 和名字决定: 剪掉的目录不打开, 名字不匹配的文件不 stat
+            const bool knownDir = dtype == DT_DIR;
+            const bool knownOther = dtype != DT_DIR && dtype != DT_UNKNOWN;
+            if (ignore && (knownDir || knownOther) && ignore->ignored(relStr, nameStr, knownDir)) {
+                w.stats.ignored++;
+                continue;
+            }
+            if (knownDir && filter.pruneDir && filter.pruneDir(relStr, nameStr)) {
+                w.stats.pruned++;
+                continue;
+            }
+            const bool nameOk = !filter.byName || filter.byName(relStr, nameStr);
+            if (!nameOk && (knownDir || knownOther)) {
+                w.stats.nameSkipped++;
+                if (knownDir) subdirs.push_back({task.absPath / nameStr, rel, ignore, false});
+                continue;
+            }
+
+            // 信任缓存时, 没变的目录里上次 stat 过的非目录条目直接用上次的结果; 子目录要重新 stat,
+            // 才知道它自己变没变。变动日志里没提到的 (包括子目录, 它下面也没有变动) 都直接用
+            const ScanCache::Child* before = cached.empty() || !cached[k].hasStat ? nullptr : &cached[k];
+            const bool isDir = dtype == DT_DIR || (before && (before->mode & S_IFMT) == S_IFDIR);
+            ScanCache::Child st;
+            struct statx stx{};
+            const bool trusted = before && ((options_.trustCache && !isDir) || (journal_ && dirty_.clean(relStr)));
+            if (trusted) {
+                w.stats.cachedStats++;
+                st = *before;
+            } else {
+                w.stats.syscalls++;
+                if (::statx(dir.fd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_SCAN_MASK, &stx) != 0) {
+                    w.stats.errors++;
+                    continue;
+                }
+                // 没拿到类型 (极少见) 时用 getdents 给的 d_type
+                fillChild(stx, dtype, st);
+            }
+            if (cache_) {
+                st.name = seen[k].name;
+                st.dtype = dtype;
+            }
+            // nodump 属性随 statx 一起拿到, 不用再 ioctl(FS_IOC_GETFLAGS)
+            if (options_.skipNodump && st.nodump) {
+                w.stats.nodump++;
+                if (cache_) seen[k] = std::move(st);
+                continue;
+            }
+            const mode_t type = st.mode & S_IFMT;
+            // d_type 未知 (部分 NFS / XFS) 时, 到这里才知道是不是目录
+            if (ignore && !knownDir && !knownOther && ignore->ignored(relStr, nameStr, type == S_IFDIR)) {
+                w.stats.ignored++;
+                continue;
+            }
+            if (type == S_IFDIR && !knownDir && filter.pruneDir && filter.pruneDir(relStr, nameStr)) {
+                w.stats.pruned++;
+                continue;
+            }
+            // 软链接目标: stat 和缓存里一样就不再 readlink
+            if (type == S_IFLNK) {
+                if (before && before->sameStat(st)) {
+                    st.linkTarget = before->linkTarget;
+                } else {
+                    std::vector<char> target(static_cast<size_t>(st.size) + 1);
+                    w.stats.syscalls++;
+                    const ssize_t len = ::readlinkat(dir.fd, name, target.data(), target.size());
+                    if (len >= 0) st.linkTarget.assign(target.data(), static_cast<size_t>(len));
+                }
+            }
+            if (cache_) seen[k] = st;
+            if (type == S_IFDIR) {
+                // 挂载点本身照常记录, 只是不往里走
+                if (options_.oneFileSystem && st.dev != rootDevice_) {
+                    w.stats.mountPoints++;
+                } else {
+                    DirTask sub{task.absPath / nameStr, rel, ignore, true};
+                    sub.stamp = {st.ino, st.mtime, st.mtimeNsec, st.ctime, st.ctimeNsec};
+                    sub.stamped = trusted || stampOf(stx, sub.stamp);
+                    subdirs.push_back(std::move(sub));
+                }
+            }
+            if (!nameOk) {
+                w.stats.nameSkipped++;
+                continue;
+            }
+
+            // 完整的 FileRecord 只是给元数据筛选看的临时对象, 清单里只留 (目录 id, 名字) 和定长字段
+            FileRecord record;
+            record.relPath = relStr;
+            record.size = st.size;
+            record.mtime = st.mtime;
+            record.mtimeNsec = st.mtimeNsec;
+            record.mode = st.mode & 07777;
+            record.uid = st.uid;
+            record.gid = st.gid;
+            record.ino = st.ino;
+            record.ctime = st.ctime;
+            record.ctimeNsec = st.ctimeNsec;
+
+            if (type == S_IFLNK) {
+                record.type = FileType::SYMLINK;
+                record.size = 0;
+                record.linkTarget = std::move(st.linkTarget);
+            } else if (type == S_IFDIR) {
+                record.type = FileType::DIRECTORY;
+                record.size = 0;
+            } else if (type == S_IFREG) {
+                record.type = FileType::REGULAR;
+            } else {
+                continue;
+            }
+
+            if (!filter.byMetadata || filter.byMetadata(record)) emit(w, task, nameStr, record);
+        } catch (...) {
+            w.stats.errors++;
+        }
+    }
+
+    // 刚改过的目录不记: 同一个时间戳内再改一次, 下次就看不出来了
+    if (cache_ && stamped && complete) {
+        const int64_t changedNs = std::max(stamp.mtime * 1000000000LL + stamp.mtimeNsec,
+                                           stamp.ctime * 1000000000LL + stamp.ctimeNsec);
+        if (changedNs < racyAfterNs_) cache_->put(relDir, stamp, seen);
+    }
+    queueSubdirs(w, task, subdirs);
+}
+#else
+void Scanner::scanOne(size_t self, const DirTask& task, const ScanFilter& filter) {
+    Worker& w = *workers_[self];
+    std::error_code ec;
+    fs::directory_iterator it(task.absPath, fs::directory_options::skip_permission_denied, ec);
+    if (ec) {
+        w.stats.errors++;
+        return;
+    }
+    if (options_.skipCaches) {
+        std::ifstream tag(task.absPath / CACHEDIR_TAG, std::ios::binary);
+        char head[sizeof(CACHEDIR_SIGNATURE) - 1];
+        if (tag.read(head, sizeof(head)) && std::memcmp(head, CACHEDIR_SIGNATURE, sizeof(head)) == 0) {
+            w.stats.cacheDirs++;
+            return;
+        }
+    }
+    w.stats.directories++;
+    const auto ignore = loadIgnore(w, task, filter, -1);
+
+    std::vector<DirTask> subdirs;
+    for (const fs::directory_iterator end; it != end; it.increment(ec)) {
+        if (ec) {
+            w.stats.errors++;
+            break;
+        }
+        try {
+            const fs::directory_entry& entry = *it;
+            w.stats.entries++;
+
+            const fs::path name = entry.path().filename();
+            const fs::path rel = task.relPath / name;
+            const std::string relStr = pathToString(rel);
+            const std::string nameStr = pathToString(name);
+
+            // 先看链接本身 (不跟随), 指向文件的软链接也按软链接存
+            const fs::file_status st = entry.symlink_status(ec);
+            if (ec) continue;
+            if (ignore && ignore->ignored(relStr, nameStr, fs::is_directory(st))) {
+                w.stats.ignored++;
+                continue;
+            }
+            bool otherDevice = false;
+#ifndef _WIN32
+            if (options_.skipNodump || options_.oneFileSystem) {
+                struct stat ls{};
+                if (::lstat(entry.path().c_str(), &ls) == 0) {
+    #ifdef UF_NODUMP
+                    if (options_.skipNodump && (ls.st_flags & UF_NODUMP)) {
+                        w.stats.nodump++;
+                        continue;
+                    }
+    #endif
+                    otherDevice = options_.oneFileSystem && static_cast<uint64_t>(ls.st_dev) != rootDevice_;
+                }
+            }
+#endif
+            if (fs::is_directory(st)) {
+                if (filter.pruneDir && filter.pruneDir(relStr, nameStr)) {
+                    w.stats.pruned++;
+                    continue;
+                }
+                if (otherDevice) w.stats.mountPoints++;
+                else subdirs.push_back({entry.path(), rel, ignore, true});
+            }
+            if (filter.byName && !filter.byName(relStr, nameStr)) {
+                w.stats.nameSkipped++;
+                continue;
+            }
+
+            FileRecord record;
+            record.relPath = relStr;
+            fillMetadata(entry.path(), record);
+            if (fs::is_symlink(st)) {
+                record.type = FileType::SYMLINK;
+                record.size = 0;
+                try { record.linkTarget = pathToString(fs::read_symlink(entry.path())); } catch (...) {}
+            } else if (fs::is_directory(st)) {
+                record.type = FileType::DIRECTORY;
+                record.size = 0;
+            } else if (fs::is_regular_file(st)) {
+                record.type = FileType::REGULAR;
+            } else {
+                continue;
+            }
+
+            if (!filter.byMetadata || filter.byMetadata(record)) emit(w, task, nameStr, record);
+        } catch (...) {
+            w.stats.errors++;
+        }
+    }
+
+    queueSubdirs(w, task, subdirs);
+}
+#endif
+
+// ==========================================
+// [新增] 单个路径过一遍扫描规则
+// ==========================================
+namespace {
+struct EntryStat {
+    bool isDir = false;
+    bool nodump = false;
+    uint64_t dev = 0;
+};
+
+// 不跟随软链接
+bool statEntry(const fs::path& path, EntryStat& out) {
+#ifdef MINIBACKUP_NATIVE_SCAN
+    struct statx stx{};
+    if (::statx(AT_FDCWD, path.c_str(), AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, STATX_TYPE, &stx) != 0) return false;
+    out.isDir = S_ISDIR(stx.stx_mode);
+    out.nodump = hasNodump(stx);
+    out.dev = deviceOf(stx);
+    return true;
+#elif !defined(_WIN32)
+    struct stat st{};
+    if (::lstat(path.c_str(), &st) != 0) return false;
+    out.isDir = S_ISDIR(st.st_mode);
+    #ifdef UF_NODUMP
+    out.nodump = (st.st_flags & UF_NODUMP) != 0;
+    #endif
+    out.dev = static_cast<uint64_t>(st.st_dev);
+    return true;
+#else
+    std::error_code ec;
+    const fs::file_status st = fs::symlink_status(path, ec);
+    if (ec || !fs::exists(st)) return false;
+    out.isDir = fs::is_directory(st);
+    return true;
+#endif
+}
+
+bool hasCacheTag(const fs::path& dir) {
+    std::ifstream tag(dir / CACHEDIR_TAG, std::ios::binary);
+    char head[sizeof(CACHEDIR_SIGNATURE) - 1];
+    return tag.read(head, sizeof(head)) && std::memcmp(head, CACHEDIR_SIGNATURE, sizeof(head)) == 0;
+}
+}
+
+bool Scanner::admits(const fs::path& root, const std::string& relPath, const ScanFilter& filter, bool* descend) const {
+    if (descend) *descend = false;
+    EntryStat rootSt;
+    if (relPath.empty() || !statEntry(root, rootSt)) return false;
+
+    std::shared_ptr<const IgnoreMatcher> ignore;
+    fs::path dirAbs = root;
+    std::string dirRel;
+    for (size_t start = 0;;) {
+        // dirAbs 这一级目录会被读: 缓存目录的内容不要, 它的忽略文件对下面都有效
+        if (options_.skipCaches && hasCacheTag(dirAbs)) return false;
+        if (!filter.ignoreFile.empty()) {
+            std::ifstream in(dirAbs / fs::u8path(filter.ignoreFile), std::ios::binary);
+            if (in) {
+                const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                ignore = IgnoreMatcher::compile(text, dirRel, ignore);
+            }
+        }
+
+        const size_t cut = relPath.find('/', start);
+        const std::string rel = relPath.substr(0, cut);
+        const std::string name = relPath.substr(start, cut == std::string::npos ? std::string::npos : cut - start);
+        const fs::path abs = dirAbs / fs::u8path(name);
+        EntryStat st;
+        if (name.empty() || !statEntry(abs, st)) return false;
+        if (ignore && ignore->ignored(rel, name, st.isDir)) return false;
+        if (options_.skipNodump && st.nodump) return false;
+        if (st.isDir && filter.pruneDir && filter.pruneDir(rel, name)) return false;
+        const bool otherDevice = options_.oneFileSystem && st.dev != rootSt.dev;
+
+        if (cut == std::string::npos) {
+            // 挂载点 / 缓存目录自己照常记录, 只是不往里走
+            if (descend) *descend = st.isDir && !otherDevice && !(options_.skipCaches && hasCacheTag(abs));
+            return true;
+        }
+        if (!st.isDir || otherDevice) return false;
+        dirAbs = abs;
+        dirRel = rel;
+        start = cut + 1;
+    }
+}
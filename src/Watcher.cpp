@@ -0,0 +1,304 @@
+// src/Watcher.cpp
+#include "Watcher.h"
+#include "Scanner.h"
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+#include <iterator>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef __linux__
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+std::string joinRel(const std::string& dir, const std::string& name) {
+    return dir.empty() ? name : dir + "/" + name;
+}
+}
+
+Watcher::Watcher(const fs::path& root, const std::vector<fs::path>& journals, const WatchOptions& options)
+    : root_(root), options_(options) {
+    if (options_.shards == 0) options_.shards = 1;
+    for (const auto& j : journals) journals_.push_back(std::make_unique<ChangeJournal>(j));
+}
+
+Watcher::~Watcher() {
+#ifdef __linux__
+    for (auto& s : shards_) {
+        if (s.fd >= 0) ::close(s.fd);
+    }
+#endif
+}
+
+// 根目录自己在 0 号实例; 顶层子目录 (连同下面所有目录) 按名字哈希分到 1..N-1 号
+size_t Watcher::shardOf(const std::string& rel) const {
+    if (rel.empty() || shards_.size() == 1) return 0;
+    const std::string top = rel.substr(0, rel.find('/'));
+    return 1 + std::hash<std::string>()(top) % (shards_.size() - 1);
+}
+
+void Watcher::note(char op, const std::string& rel) {
+    pendingChanged_ = true;
+    const auto now = Clock::now();
+    auto it = pending_.find(rel);
+    if (it == pending_.end()) {
+        pending_.emplace(rel, Pending{op, now, now});
+        return;
+    }
+    if (op == 'T') it->second.op = 'T'; // 子树待重扫盖过条目自己变了
+    it->second.last = now;
+}
+
+void Watcher::journal(const std::vector<ChangeJournal::Change>& changes) {
+    for (auto& j : journals_) j->append(changes);
+}
+
+// 安静够 debounceMs (或攒够 maxDelayMs) 的路径写进日志; all 时全部写
+void Watcher::flush(bool all) {
+    const auto now = Clock::now();
+    const auto quiet = std::chrono::milliseconds(options_.debounceMs);
+    const auto maxDelay = std::chrono::milliseconds(options_.maxDelayMs);
+    std::vector<ChangeJournal::Change> changes;
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (all || now - it->second.last >= quiet || now - it->second.first >= maxDelay) {
+            changes.push_back({it->second.op, it->first});
+            it = pending_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (changes.empty()) return;
+    pendingChanged_ = true;
+
+    // 同一批里已经在待重扫子树下面的就不用再写了 (溢出 / 删除整个目录时常见)
+    DirtySet subtrees;
+    for (const auto& c : changes) {
+        if (c.op == 'T') subtrees.subtrees.insert(c.path);
+    }
+    if (subtrees.subtrees.count("")) {
+        changes = {{'T', ""}};
+    } else if (!subtrees.subtrees.empty()) {
+        changes.erase(std::remove_if(changes.begin(), changes.end(), [&](const ChangeJournal::Change& c) {
+                          const size_t cut = c.path.rfind('/');
+                          return (c.op == 'M' && subtrees.subtrees.count(c.path)) ||
+                                 (cut != std::string::npos && subtrees.inSubtree(c.path.substr(0, cut)));
+                      }),
+                      changes.end());
+    }
+    std::sort(changes.begin(), changes.end(), [](const auto& a, const auto& b) { return a.path < b.path; });
+    journal(changes);
+    stats_.changes += changes.size();
+    std::cout << "[Watch] " << changes.size() << " changes journaled (" << stats_.events << " events so far)"
+              << std::endl;
+}
+
+// 水位文件: 有变化时马上换, 没变化也至少每秒换一次 (读取方靠它判断监视进程有没有卡住)
+void Watcher::publish() {
+    const auto now = Clock::now();
+    if (!pendingChanged_ && now - published_ < std::chrono::seconds(1)) return;
+    std::vector<ChangeJournal::Change> changes;
+    changes.reserve(pending_.size() + unwatched_.size());
+    for (const auto& [rel, p] : pending_) changes.push_back({p.op, rel});
+    for (const auto& rel : unwatched_) changes.push_back({'T', rel});
+    const auto wall = std::chrono::system_clock::now().time_since_epoch();
+    const int64_t drainedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count();
+    for (auto& j : journals_) j->publishPending(changes, drainedNs);
+    pendingChanged_ = false;
+    published_ = now;
+}
+
+#ifdef __linux__
+namespace {
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW |
+                                IN_EXCL_UNLINK;
+
+// rel 是 dir 自己或在 dir 下面
+bool underDir(const std::string& rel, const std::string& dir) {
+    return rel.size() >= dir.size() && rel.compare(0, dir.size(), dir) == 0 &&
+           (rel.size() == dir.size() || rel[dir.size()] == '/');
+}
+}
+
+// 登记 rel 和它下面的所有目录 (已经登记过的 inotify 返回同一个描述符, 只更新路径)
+void Watcher::addTree(const std::string& rel) {
+    std::vector<std::string> stack{rel};
+    while (!stack.empty()) {
+        const std::string dir = std::move(stack.back());
+        stack.pop_back();
+        const fs::path abs = dir.empty() ? root_ : root_ / fs::u8path(dir);
+        struct stat st{};
+        if (!dir.empty() && ::lstat(abs.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_dev) != rootDevice_) {
+            // 别的文件系统: 不进去, 交给读取方每次整棵重看
+            if (unwatched_.insert(dir).second) pendingChanged_ = true;
+            continue;
+        }
+        Shard& shard = shards_[shardOf(dir)];
+        const int wd = ::inotify_add_watch(shard.fd, abs.c_str(), WATCH_MASK);
+        if (wd < 0) {
+            if (errno == ENOSPC) {
+                throw std::runtime_error("inotify watch limit reached, raise fs.inotify.max_user_watches");
+            }
+            continue; // 刚删掉 / 没权限 / 不是目录了
+        }
+        shard.dirs[wd] = dir;
+
+        std::error_code ec;
+        for (fs::directory_iterator it(abs, fs::directory_options::skip_permission_denied, ec), end;
+             !ec && it != end; it.increment(ec)) {
+            std::error_code sec;
+            if (it->symlink_status(sec).type() == fs::file_type::directory) {
+                stack.push_back(joinRel(dir, pathToString(it->path().filename())));
+            }
+        }
+    }
+}
+
+// 移走 / 删掉的目录: 旧路径下的 watch 都撤掉 (移到的新位置另外登记)
+void Watcher::removeTree(const std::string& rel) {
+    for (auto it = unwatched_.begin(); it != unwatched_.end();) {
+        if (underDir(*it, rel)) {
+            it = unwatched_.erase(it);
+            pendingChanged_ = true;
+        } else {
+            ++it;
+        }
+    }
+    Shard& shard = shards_[shardOf(rel)];
+    for (auto it = shard.dirs.begin(); it != shard.dirs.end();) {
+        if (underDir(it->second, rel)) {
+            ::inotify_rm_watch(shard.fd, it->first);
+            it = shard.dirs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// 队列溢出: 丢了哪些事件不知道, 这个实例负责的顶层子树补登记 (期间新建的目录) 并整棵记为待重扫
+void Watcher::overflow(size_t s) {
+    stats_.overflows++;
+    if (s == 0) {
+        std::cerr << "[Watch] Event queue overflow on root directory, full rescan needed" << std::endl;
+        note('T', "");
+        return;
+    }
+    std::vector<std::string> tops;
+    for (const auto& [wd, dir] : shards_[s].dirs) {
+        if (dir.find('/') == std::string::npos) tops.push_back(dir);
+    }
+    std::cerr << "[Watch] Event queue overflow, rescanning " << tops.size() << " top-level subtrees" << std::endl;
+    for (const auto& top : tops) {
+        addTree(top);
+        note('T', top);
+    }
+    // 这些子树下面还没写出去的变动都包含在重扫里了
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        const bool covered = std::any_of(tops.begin(), tops.end(), [&](const std::string& top) {
+            return it->first.size() > top.size() && underDir(it->first, top);
+        });
+        it = covered ? pending_.erase(it) : std::next(it);
+    }
+}
+
+void Watcher::readEvents(size_t s) {
+    alignas(struct inotify_event) char buf[65536];
+    while (true) {
+        const ssize_t n = ::read(shards_[s].fd, buf, sizeof(buf));
+        if (n <= 0) return; // EAGAIN: 读空了
+        for (ssize_t pos = 0; pos < n;) {
+            const auto* ev = reinterpret_cast<const struct inotify_event*>(buf + pos);
+            pos += static_cast<ssize_t>(sizeof(struct inotify_event) + ev->len);
+            stats_.events++;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                overflow(s);
+                continue;
+            }
+            auto dirIt = shards_[s].dirs.find(ev->wd);
+            if (dirIt == shards_[s].dirs.end()) continue;
+            if (ev->mask & IN_IGNORED) {
+                shards_[s].dirs.erase(dirIt);
+                continue;
+            }
+            const std::string dir = dirIt->second;
+
+            // 目录自己被删 / 移走: 父目录那边会报; 只有根目录要自己处理
+            if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                if (dir.empty()) {
+                    std::cerr << "[Watch] Watched root was moved or deleted" << std::endl;
+                    note('T', "");
+                }
+                continue;
+            }
+            if (ev->len == 0) continue;
+
+            const std::string rel = joinRel(dir, ev->name);
+            const bool isDir = ev->mask & IN_ISDIR;
+            if (isDir && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                addTree(rel);
+                note('T', rel);
+            } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                if (isDir) removeTree(rel);
+                note('T', rel);
+            } else {
+                note('M', rel);
+            }
+        }
+    }
+}
+
+void Watcher::run() {
+    for (auto& j : journals_) {
+        j->lockWriter();
+        j->append({{'T', ""}});
+    }
+    struct stat rootSt{};
+    if (::stat(root_.c_str(), &rootSt) != 0) throw std::runtime_error("Cannot watch " + root_.string());
+    rootDevice_ = static_cast<uint64_t>(rootSt.st_dev);
+    shards_.assign(options_.shards, Shard());
+    for (auto& s : shards_) {
+        s.fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (s.fd < 0) throw std::runtime_error("inotify_init1 failed (too many instances? lower -shards)");
+    }
+    addTree("");
+    // 登记期间的变动可能漏了, 再要求一次整棵树重扫
+    journal({{'T', ""}});
+    publish();
+    for (const auto& s : shards_) stats_.directories += s.dirs.size();
+    stats_.mountPoints = unwatched_.size();
+    std::cout << "[Watch] Watching " << stats_.directories << " directories under " << root_.string() << " ("
+              << shards_.size() << " inotify instances, debounce " << options_.debounceMs << " ms)" << std::endl;
+    if (!unwatched_.empty()) {
+        std::cout << "[Watch] " << unwatched_.size() << " mount points not watched, readers rescan them every time"
+                  << std::endl;
+    }
+
+    std::vector<struct pollfd> fds(shards_.size());
+    for (size_t i = 0; i < shards_.size(); ++i) fds[i] = {shards_[i].fd, POLLIN, 0};
+    const int tick = static_cast<int>(std::clamp(options_.debounceMs / 2, 10u, 200u));
+    while (!stopped_) {
+        const int ready = ::poll(fds.data(), fds.size(), tick);
+        if (ready < 0 && errno != EINTR) throw std::runtime_error("poll failed");
+        for (size_t i = 0; ready > 0 && i < fds.size(); ++i) {
+            if (fds[i].revents & POLLIN) readEvents(i);
+        }
+        flush(false);
+        publish();
+    }
+    flush(true);
+    publish();
+
+    stats_.directories = 0;
+    for (const auto& s : shards_) stats_.directories += s.dirs.size();
+}
+#else
+void Watcher::run() {
+    throw std::runtime_error("Watching requires Linux inotify");
+}
+#endif
@@ -3,7 +3,11 @@
 #include <vector>
 #include <cstring>
 #include <ctime>
+#include <csignal>
 #include "BackupEngine.h"
+#include "Daemon.h"
+#include "FilterExpr.h"
+#include "Watcher.h"
 
 // 简单的 ANSI 颜色，方便助教在 Linux 终端看结果
 #define RESET   "\033[0m"
@@ -16,26 +20,105 @@ void printUsage() {
               << "--------------------------------------\n"
               << "Usage:\n"
               << "  [Basic Mode]\n"
-              << "    backup  <src_dir> <dst_dir>          Mirror copy with checksum index\n"
+              << "    backup  <src_dir> <dst_dir> [-inc]   Mirror copy with checksum index\n"
+              << "                                         -inc: copy only files changed since last run\n"
+              << "                                         -link-dest <prev>: hard-link files unchanged since <prev>\n"
+              << "                                         -delta: rewrite only changed blocks of large files\n"
+              << "                                         -scan-threads <n>: directory scan threads (default: CPUs)\n"
+              << "                                         -one-file-system: do not cross mount points\n"
+              << "                                         -keep-caches: also copy directories marked with CACHEDIR.TAG\n"
+              << "                                         -keep-nodump: also copy files with the nodump attribute (chattr +d)\n"
+              << "                                         -scan-cache <file>: reuse listings of unchanged directories\n"
+              << "                                         -journal <file>: with -inc, only look at paths the watcher logged\n"
               << "    restore <src_dir> <dst_dir>          Restore from mirror\n"
-              << "    verify  <dst_dir>                    Check integrity of mirror\n\n"
+              << "    verify  <dst_dir>                    Check integrity of mirror\n"
+              << "    watch   <src_dir> <journal>... [-debounce ms] [-max-delay ms] [-shards n]\n"
+              << "                                         Log changes (inotify) for backup/pack -journal; one journal per reader\n\n"
+              << "  [Daemon]\n"
+              << "    daemon  <socket> [-jobs <file>]      Stay resident: run scheduled jobs, accept jobs on a Unix socket,\n"
+              << "                                         keep scan caches / chunk indexes / threads warm between jobs\n"
+              << "                                         jobs file lines: <min> <hour> <day> <month> <weekday> [jitter=sec] <command...>\n"
+              << "    submit  <socket> <command> [args...] Run a command in the daemon (also: status, reload, shutdown)\n\n"
               << "  [Pro Mode (Pack/Unpack)]\n"
               << "    pack    <src> <pck_file> [options]   Create archive\n"
-              << "    unpack  <pck_file> <dst_dir> [pwd]   Extract archive\n\n"
+              << "    unpack  <pck_file> <dst_dir> [pwd]   Extract archive\n"
+              << "    extract <pck_file> <path> <dst_dir> [pwd]  Extract one file (solid pack)\n\n"
+              << "  [Dedup Repository]\n"
+              << "    repo-backup  <src> <repo_dir> [-rle|-lz]   Store a deduplicated snapshot\n"
+              << "    repo-restore <repo_dir> <snapshot|latest> <dst_dir>\n"
+              << "    repo-list    <repo_dir>                    List snapshots\n"
+              << "    repo-gc      <repo_dir> [-keep N] [-threshold R] [-budget MB]\n"
+              << "                 Prune old snapshots, drop unreferenced chunks, compact sparse packs\n\n"
               << "  [Pack Options]\n"
               << "    -pwd <password>      Set encryption password\n"
               << "    -xor                 Use XOR encryption\n"
               << "    -rc4                 Use RC4 encryption\n"
               << "    -rle                 Enable RLE compression\n"
+              << "    -lz                  Enable LZ77 compression\n"
+              << "    -dict                Train a shared dictionary for small files (implies -lz)\n"
+              << "    -dict-size <bytes>   Dictionary size (default 32 KiB, max 64 KiB)\n"
+              << "    -solid               Solid mode: small files share compressed blocks\n"
+              << "    -block <bytes>       Solid block size (default 4 MiB)\n"
+              << "    -scan-threads <n>    Directory scan threads (default: CPUs)\n"
+              << "    -stream              Pack while scanning: less memory, entries in discovery order (not reproducible)\n"
+              << "    -read-order <o>      scan (default) | inode | extent: read files in on-disk order (spinning disks)\n"
+              << "    -one-file-system     Do not descend into other mounted file systems\n"
+              << "    -keep-caches         Also pack directories marked with CACHEDIR.TAG\n"
+              << "    -keep-nodump         Also pack files with the nodump attribute (chattr +d)\n"
+              << "    -scan-cache <file>   Keep directory listings here; unchanged directories are not re-read\n"
+              << "    -scan-cache-trust    Also reuse cached file stats in unchanged directories (write-once trees)\n"
+              << "    -journal <file>      With -scan-cache: trust the cache for everything the watcher did not log\n"
+              << "    -base <pck_file>     Delta against an older solid pack (implies -solid, same dir & password)\n"
               << "    -name <str>          Filter by filename (contains)\n"
               << "    -path <str>          Filter by path (contains)\n"
               << "    -min <bytes>         Min file size\n"
               << "    -max <bytes>         Max file size\n"
               << "    -days <n>            Only files modified in last N days\n"
+              << "    -uid <n>             Only files owned by this user ID\n"
+              << "    -exclude-dir <name>  Skip directories with this name and their subtrees (repeatable)\n"
+              << "    -filter <rule>       Filter rule, e.g. \"exclude *.o\" or \"where size > 1M and not name *.log\" (repeatable)\n"
+              << "    -filter-file <file>  Read filter rules from a file (one rule per line, see FilterExpr.h)\n"
+              << "    -ignore-file <name>  Per-directory gitignore-style exclude file (default .backupignore)\n"
+              << "    -no-ignore           Do not read per-directory exclude files\n"
               << std::endl;
 }
 
+// Ctrl+C / kill 时让 watch 写完手上的变动再退出
+static Watcher* g_watcher = nullptr;
+
+static void stopWatcher(int) {
+    if (g_watcher) g_watcher->stop();
+}
+
+// daemon 同理: 手上的任务跑完再退出
+static Daemon* g_daemon = nullptr;
+
+static void stopDaemon(int) {
+    if (g_daemon) g_daemon->stop();
+}
+
+static int runCommand(int argc, char* argv[]);
+
+// daemon 里跑一个任务: 参数和命令行上的一样, 不能再套 daemon / watch 这种不返回的命令
+static int runJob(const std::vector<std::string>& args) {
+    if (args.empty() || args[0] == "daemon" || args[0] == "watch" || args[0] == "submit") {
+        std::cerr << RED << "[ERROR] Not allowed inside the daemon: " << (args.empty() ? "" : args[0]) << RESET
+                  << std::endl;
+        return 2;
+    }
+    std::vector<std::string> storage{"minibackup"};
+    storage.insert(storage.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for (auto& s : storage) argv.push_back(s.data());
+    argv.push_back(nullptr);
+    return runCommand(static_cast<int>(storage.size()), argv.data());
+}
+
 int main(int argc, char* argv[]) {
+    return runCommand(argc, argv);
+}
+
+static int runCommand(int argc, char* argv[]) {
     if (argc < 2) {
         printUsage();
         return 0;
@@ -49,7 +132,22 @@ int main(int argc, char* argv[]) {
         // ==========================================
         if (command == "backup") {
             if (argc < 4) { printUsage(); return 1; }
-            BackupEngine::backup(argv[2], argv[3]);
+            BackupOptions options;
+            for (int i = 4; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-inc") options.incremental = true;
+                else if (arg == "-keep-deleted") options.deleteRemoved = false;
+                else if (arg == "-delta") options.delta = options.incremental = true;
+                else if ((arg == "-link-dest" || arg == "--link-dest") && i + 1 < argc) options.linkDest = argv[++i];
+                else if (arg == "-scan-threads" && i + 1 < argc) options.scan.threads = std::stoul(argv[++i]);
+                else if (arg == "-one-file-system" || arg == "--one-file-system") options.scan.oneFileSystem = true;
+                else if (arg == "-keep-caches") options.scan.skipCaches = false;
+                else if (arg == "-keep-nodump") options.scan.skipNodump = false;
+                else if (arg == "-scan-cache" && i + 1 < argc) options.scan.cacheFile = argv[++i];
+                else if (arg == "-scan-cache-trust") options.scan.trustCache = true;
+                else if (arg == "-journal" && i + 1 < argc) options.journal = argv[++i];
+            }
+            BackupEngine::backup(argv[2], argv[3], options);
 
         // ==========================================
         // 2. Basic Restore
@@ -88,6 +186,8 @@ int main(int argc, char* argv[]) {
             EncryptionMode enc = EncryptionMode::NONE;
             CompressionMode comp = CompressionMode::NONE;
             FilterOptions filter;
+            PackOptions options;
+            std::string rules;     // -filter / -filter-file 收集的规则文本
             filter.type = -1;      // Default: All types
             filter.targetUid = -1; // Default: Any UID
 
@@ -102,6 +202,43 @@ int main(int argc, char* argv[]) {
                     enc = EncryptionMode::RC4;
                 } else if (arg == "-rle") {
                     comp = CompressionMode::RLE;
+                } else if (arg == "-lz") {
+                    comp = CompressionMode::LZ77;
+                } else if (arg == "-dict") {
+                    options.trainDictionary = true;
+                } else if (arg == "-dict-size" && i + 1 < argc) {
+                    options.dictionarySize = std::stoull(argv[++i]);
+                } else if (arg == "-solid") {
+                    options.solid = true;
+                } else if (arg == "-block" && i + 1 < argc) {
+                    options.solidBlockSize = std::stoull(argv[++i]);
+                } else if (arg == "-scan-threads" && i + 1 < argc) {
+                    options.scan.threads = std::stoul(argv[++i]);
+                } else if (arg == "-stream") {
+                    options.streaming = true;
+                } else if (arg == "-no-stream") {
+                    options.streaming = false; // 默认就是先扫完再打包, 保留给旧脚本
+                } else if (arg == "-read-order" && i + 1 < argc) {
+                    const std::string order = argv[++i];
+                    if (order == "scan") options.readOrder = ReadOrder::SCAN;
+                    else if (order == "inode") options.readOrder = ReadOrder::INODE;
+                    else if (order == "extent") options.readOrder = ReadOrder::EXTENT;
+                    else throw std::runtime_error("Unknown read order: " + order + " (scan / inode / extent)");
+                } else if (arg == "-one-file-system" || arg == "--one-file-system") {
+                    options.scan.oneFileSystem = true;
+                } else if (arg == "-keep-caches") {
+                    options.scan.skipCaches = false;
+                } else if (arg == "-keep-nodump") {
+                    options.scan.skipNodump = false;
+                } else if (arg == "-scan-cache" && i + 1 < argc) {
+                    options.scan.cacheFile = argv[++i];
+                } else if (arg == "-scan-cache-trust") {
+                    options.scan.trustCache = true;
+                } else if (arg == "-journal" && i + 1 < argc) {
+                    options.scan.journalFile = argv[++i];
+                } else if (arg == "-base" && i + 1 < argc) {
+                    options.basePack = argv[++i];
+                    options.solid = true;
                 } else if (arg == "-name" && i + 1 < argc) {
                     filter.nameContains = argv[++i];
                 } else if (arg == "-path" && i + 1 < argc) {
@@ -110,6 +247,18 @@ int main(int argc, char* argv[]) {
                     filter.minSize = std::stoull(argv[++i]);
                 } else if (arg == "-max" && i + 1 < argc) {
                     filter.maxSize = std::stoull(argv[++i]);
+                } else if (arg == "-exclude-dir" && i + 1 < argc) {
+                    filter.excludeDirs.push_back(argv[++i]);
+                } else if (arg == "-filter" && i + 1 < argc) {
+                    rules += std::string(argv[++i]) + "\n";
+                } else if (arg == "-filter-file" && i + 1 < argc) {
+                    rules += FilterExpr::readRules(argv[++i]);
+                } else if (arg == "-ignore-file" && i + 1 < argc) {
+                    filter.ignoreFile = argv[++i];
+                } else if (arg == "-no-ignore") {
+                    filter.ignoreFile.clear();
+                } else if (arg == "-uid" && i + 1 < argc) {
+                    filter.targetUid = std::stoi(argv[++i]);
                 } else if (arg == "-days" && i + 1 < argc) {
                     int days = std::stoi(argv[++i]);
                     if (days > 0) {
@@ -118,11 +267,22 @@ int main(int argc, char* argv[]) {
                 }
             }
 
+            if (!rules.empty()) filter.expr = FilterExpr::compile(rules);
+
+            // 字典只对 LZ77 有效
+            if (options.trainDictionary) comp = CompressionMode::LZ77;
+
             std::cout << "Packing " << src << " -> " << dest << " ..." << std::endl;
             if (enc != EncryptionMode::NONE) std::cout << "Encryption: Enabled" << std::endl;
-            if (comp != CompressionMode::NONE) std::cout << "Compression: RLE" << std::endl;
+            if (comp == CompressionMode::RLE) std::cout << "Compression: RLE" << std::endl;
+            if (comp == CompressionMode::LZ77) std::cout << "Compression: LZ77" << (options.trainDictionary ? " + dictionary" : "") << std::endl;
+            if (options.solid) std::cout << "Solid: " << options.solidBlockSize << " bytes/block" << std::endl;
+            if (!options.basePack.empty()) std::cout << "Base: " << options.basePack << std::endl;
 
-            BackupEngine::pack(src, dest, pwd, enc, filter, comp);
+            if (!options.scan.journalFile.empty() && options.scan.cacheFile.empty()) {
+                throw std::runtime_error("-journal needs -scan-cache (the journal lists changes since the cached scan)");
+            }
+            BackupEngine::pack(src, dest, pwd, enc, filter, comp, options);
             std::cout << GREEN << "[SUCCESS] Pack created." << RESET << std::endl;
 
         // ==========================================
@@ -152,6 +312,108 @@ int main(int argc, char* argv[]) {
             BackupEngine::unpack(pck, dest, pwd);
             std::cout << GREEN << "[SUCCESS] Unpack complete & Verified." << RESET << std::endl;
 
+        // ==========================================
+        // 6. 单文件提取 (固实包)
+        // ==========================================
+        } else if (command == "extract") {
+            if (argc < 5) {
+                std::cerr << "Error: extract requires <pck_file> <path> <dest>" << std::endl;
+                printUsage();
+                return 1;
+            }
+            std::string pwd = "";
+            if (argc >= 6) {
+                std::string arg5 = argv[5];
+                if (arg5 == "-pwd" && argc >= 7) pwd = argv[6];
+                else pwd = arg5;
+            }
+
+            BackupEngine::extract(argv[2], argv[3], argv[4], pwd);
+            std::cout << GREEN << "[SUCCESS] Extracted " << argv[3] << RESET << std::endl;
+
+        // ==========================================
+        // 7. 去重仓库
+        // ==========================================
+        } else if (command == "repo-backup") {
+            if (argc < 4) { printUsage(); return 1; }
+            CompressionMode comp = CompressionMode::NONE;
+            for (int i = 4; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-rle") comp = CompressionMode::RLE;
+                else if (arg == "-lz") comp = CompressionMode::LZ77;
+            }
+            std::string id = BackupEngine::repoBackup(argv[2], argv[3], FilterOptions(), comp);
+            std::cout << GREEN << "[SUCCESS] Snapshot " << id << " stored." << RESET << std::endl;
+
+        } else if (command == "repo-restore") {
+            if (argc < 5) { printUsage(); return 1; }
+            BackupEngine::repoRestore(argv[2], argv[3], argv[4]);
+            std::cout << GREEN << "Restore complete." << RESET << std::endl;
+
+        // ==========================================
+        // [新增] 实时监视: 变动写进日志, 增量 backup / pack 读日志代替重扫
+        // ==========================================
+        } else if (command == "watch") {
+            if (argc < 4) { printUsage(); return 1; }
+            std::vector<fs::path> journals;
+            WatchOptions watch;
+            for (int i = 3; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-debounce" && i + 1 < argc) watch.debounceMs = std::stoul(argv[++i]);
+                else if (arg == "-max-delay" && i + 1 < argc) watch.maxDelayMs = std::stoul(argv[++i]);
+                else if (arg == "-shards" && i + 1 < argc) watch.shards = std::stoul(argv[++i]);
+                else journals.push_back(fs::u8path(arg));
+            }
+            if (journals.empty()) { printUsage(); return 1; }
+            Watcher watcher(fs::u8path(argv[2]), journals, watch);
+            g_watcher = &watcher;
+            std::signal(SIGINT, stopWatcher);
+            std::signal(SIGTERM, stopWatcher);
+            watcher.run();
+            g_watcher = nullptr;
+            std::cout << GREEN << "[Watch] Stopped after " << watcher.stats().events << " events ("
+                      << watcher.stats().changes << " changes journaled, " << watcher.stats().overflows
+                      << " overflows)." << RESET << std::endl;
+
+        // ==========================================
+        // [新增] 常驻进程: 定时任务 + 套接字提交, 缓存 / 索引 / 线程池在任务之间保持热的
+        // ==========================================
+        } else if (command == "daemon") {
+            if (argc < 3) { printUsage(); return 1; }
+            DaemonOptions daemonOptions;
+            daemonOptions.socket = fs::u8path(argv[2]);
+            for (int i = 3; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-jobs" && i + 1 < argc) daemonOptions.jobsFile = fs::u8path(argv[++i]);
+            }
+            Daemon daemon(daemonOptions, runJob);
+            g_daemon = &daemon;
+            std::signal(SIGINT, stopDaemon);
+            std::signal(SIGTERM, stopDaemon);
+            daemon.run();
+            g_daemon = nullptr;
+            std::cout << GREEN << "[Daemon] Stopped." << RESET << std::endl;
+
+        } else if (command == "submit") {
+            if (argc < 4) { printUsage(); return 1; }
+            return Daemon::submit(fs::u8path(argv[2]), std::vector<std::string>(argv + 3, argv + argc), std::cout);
+
+        } else if (command == "repo-list") {
+            if (argc < 3) { printUsage(); return 1; }
+            for (const auto& id : BackupEngine::listSnapshots(argv[2])) std::cout << id << std::endl;
+
+        } else if (command == "repo-gc") {
+            if (argc < 3) { printUsage(); return 1; }
+            GcOptions gc;
+            for (int i = 3; i < argc; ++i) {
+                std::string arg = argv[i];
+                if (arg == "-keep" && i + 1 < argc) gc.keepLast = std::stoul(argv[++i]);
+                else if (arg == "-threshold" && i + 1 < argc) gc.liveThreshold = std::stod(argv[++i]);
+                else if (arg == "-budget" && i + 1 < argc) gc.ioBudget = std::stoull(argv[++i]) << 20;
+            }
+            BackupEngine::repoGc(argv[2], gc);
+            std::cout << GREEN << "[SUCCESS] Garbage collection finished." << RESET << std::endl;
+
         } else {
             std::cout << RED << "Unknown command: " << command << RESET << std::endl;
             printUsage();
@@ -4,6 +4,13 @@ import os
 import shutil
 import time
 import platform
+import signal
+import subprocess
+import tempfile
+import zlib
+import calendar
+import re
+import socket
 
 # ==========================================
 # C 结构体定义 (已对齐)
@@ -20,6 +27,20 @@ class CFilter(ctypes.Structure):
         ("targetUid", ctypes.c_int)
     ]
 
+class CPackOptions(ctypes.Structure):
+    _fields_ = [
+        ("solid", ctypes.c_int),
+        ("_pad", ctypes.c_int),
+        ("solidBlockSize", ctypes.c_ulonglong),
+        ("solidFileLimit", ctypes.c_ulonglong),
+        ("trainDictionary", ctypes.c_int),
+        ("_pad2", ctypes.c_int),
+        ("dictionarySize", ctypes.c_ulonglong),
+        ("streaming", ctypes.c_int),
+        ("readOrder", ctypes.c_int),
+        ("excludeDirs", ctypes.c_char_p)
+    ]
+
 # ==========================================
 # 单元测试类
 # ==========================================
@@ -49,6 +70,7 @@ class TestMiniBackup(unittest.TestCase):
             raise RuntimeError("Cannot find core library! Please build first.")
 
         cls.lib = ctypes.cdll.LoadLibrary(lib_path)
+        cls.lib_dir = os.path.dirname(lib_path)
 
         # 设置函数参数类型
         cls.lib.C_PackWithFilter.argtypes = [
@@ -56,6 +78,28 @@ class TestMiniBackup(unittest.TestCase):
             ctypes.c_int, ctypes.POINTER(CFilter), ctypes.c_int
         ]
         cls.lib.C_Unpack.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+        cls.lib.C_PackWithOptions.argtypes = [
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p,
+            ctypes.c_int, ctypes.POINTER(CFilter), ctypes.c_int, ctypes.POINTER(CPackOptions)
+        ]
+        cls.lib.C_ExtractOne.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+        cls.lib.C_BackupIncremental.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+        cls.lib.C_VerifySimple.argtypes = [ctypes.c_char_p]
+        cls.lib.C_VerifySimple.restype = ctypes.c_char_p
+        cls.lib.C_PackWithFilterExpr.argtypes = [
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_char_p, ctypes.c_int
+        ]
+        cls.lib.C_CheckFilterExpr.argtypes = [ctypes.c_char_p]
+        cls.lib.C_CheckFilterExpr.restype = ctypes.c_char_p
+        cls.lib.C_JournalTake.argtypes = [ctypes.c_char_p, ctypes.c_int]
+        cls.lib.C_JournalTake.restype = ctypes.c_char_p
+        cls.lib.C_DirtyQuery.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+        cls.lib.C_CronNext.argtypes = [ctypes.c_char_p, ctypes.c_longlong]
+        cls.lib.C_CronNext.restype = ctypes.c_longlong
+        cls.lib.C_SplitArgs.argtypes = [ctypes.c_char_p]
+        cls.lib.C_SplitArgs.restype = ctypes.c_char_p
+        cls.lib.C_JoinArgs.argtypes = [ctypes.c_char_p]
+        cls.lib.C_JoinArgs.restype = ctypes.c_char_p
 
     # [每个测试前] 准备干净的临时目录
     def setUp(self):
@@ -84,10 +128,51 @@ class TestMiniBackup(unittest.TestCase):
     # --- 辅助函数：创建文件 ---
     def create_dummy_file(self, name, content=b"data"):
         path = os.path.join(self.src_dir, name)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
         with open(path, "wb") as f:
             f.write(content)
         return path
 
+    # --- 辅助函数：调用命令行程序 (和库在同一个构建目录里) ---
+    def run_cli(self, *args, **kwargs):
+        exe = os.path.join(self.lib_dir, "minibackup.exe" if platform.system() == "Windows" else "minibackup")
+        if not os.path.exists(exe):
+            self.skipTest("minibackup CLI not built")
+        if kwargs.get("user") is not None:
+            # 换用户跑时构建目录可能进不去 (比如在 /root 下), 先把程序复制到 /tmp
+            exe_dir = tempfile.mkdtemp()
+            os.chmod(exe_dir, 0o755)
+            self.addCleanup(shutil.rmtree, exe_dir, True)
+            exe = shutil.copy(exe, exe_dir)
+        return subprocess.run([exe] + [str(a) for a in args], capture_output=True, text=True, **kwargs)
+
+    # --- 辅助函数：读出目录树 {相对路径: 内容} ---
+    @staticmethod
+    def read_tree(root):
+        tree = {}
+        for dirpath, _, files in os.walk(root):
+            for name in files:
+                path = os.path.join(dirpath, name)
+                with open(path, "rb") as f:
+                    tree[os.path.relpath(path, root).replace(os.sep, "/")] = f.read()
+        return tree
+
+    # --- 辅助函数：临时换时区 (库里的 localtime / mktime 跟着 TZ 走) ---
+    def use_timezone(self, tz):
+        if not hasattr(time, "tzset"):
+            self.skipTest("time.tzset not available")
+        old = os.environ.get("TZ")
+
+        def restore():
+            if old is None:
+                os.environ.pop("TZ", None)
+            else:
+                os.environ["TZ"] = old
+            time.tzset()
+        self.addCleanup(restore)
+        os.environ["TZ"] = tz
+        time.tzset()
+
     # ==========================================
     # 测试用例 (Test Cases)
     # ==========================================
@@ -175,6 +260,60 @@ class TestMiniBackup(unittest.TestCase):
         # 允许 2 秒误差
         self.assertAlmostEqual(restored_time, old_time, delta=2, msg="Mtime not restored")
 
+    @unittest.skipIf(platform.system() == "Windows", "POSIX 权限 / 属主")
+    def test_04b_mode_and_uid_filter(self):
+        """测试元数据：真实权限位还原 + 按 UID 筛选"""
+        path = self.create_dummy_file("private.sh", b"#!/bin/sh\n")
+        os.chmod(path, 0o750)
+
+        pck_path = os.path.join(self.test_dir, "mode.pck")
+        self.lib.C_PackWithFilter(self.src_dir.encode(), pck_path.encode(), b"", 0, None, 0)
+        self.lib.C_Unpack(pck_path.encode(), self.out_dir.encode(), b"")
+        restored = os.path.join(self.out_dir, "private.sh")
+        self.assertEqual(os.stat(restored).st_mode & 0o7777, 0o750)
+
+        # 没人拥有的 UID: 一个文件都不该打进包
+        f = CFilter()
+        f.type = -1; f.minSize=0; f.maxSize=0; f.startTime=0; f.targetUid = os.getuid() + 4242
+        uid_pck = os.path.join(self.test_dir, "uid.pck")
+        uid_out = os.path.join(self.test_dir, "uid_out")
+        self.lib.C_PackWithFilter(self.src_dir.encode(), uid_pck.encode(), b"", 0, ctypes.byref(f), 0)
+        self.lib.C_Unpack(uid_pck.encode(), uid_out.encode(), b"")
+        self.assertFalse(os.path.exists(os.path.join(uid_out, "private.sh")))
+
+    @unittest.skipIf(platform.system() == "Windows", "POSIX 权限")
+    def test_04c_readonly_directory_restore(self):
+        """只读目录 (0555): 目录权限等里面的条目都写完才设, 非 root 用户也能完整还原"""
+        os.makedirs(os.path.join(self.src_dir, "ro", "inner"))
+        self.create_dummy_file("ro/inner/f.txt", b"inside")
+        self.create_dummy_file("ro/g.txt", b"top")
+        ro_dirs = [os.path.join(self.src_dir, "ro", "inner"), os.path.join(self.src_dir, "ro")]
+        for d in ro_dirs:
+            os.chmod(d, 0o555)
+        outs = []
+        try:
+            for solid in (0, 1):
+                out = os.path.join(self.test_dir, "ro_out%d" % solid)
+                outs.append(out)
+                pck_path = os.path.join(self.test_dir, "ro%d.pck" % solid)
+                opts = CPackOptions()
+                opts.solid = solid
+                self.assertEqual(self.lib.C_PackWithOptions(self.src_dir.encode(), pck_path.encode(), b"", 0, None, 0,
+                                                            ctypes.byref(opts)), 1)
+                self.assertEqual(self.lib.C_Unpack(pck_path.encode(), out.encode(), b""), 1)
+                with open(os.path.join(out, "ro", "inner", "f.txt"), "rb") as f:
+                    self.assertEqual(f.read(), b"inside")
+                with open(os.path.join(out, "ro", "g.txt"), "rb") as f:
+                    self.assertEqual(f.read(), b"top")
+                self.assertEqual(os.stat(os.path.join(out, "ro")).st_mode & 0o777, 0o555)
+                self.assertEqual(os.stat(os.path.join(out, "ro", "inner")).st_mode & 0o777, 0o555)
+        finally:
+            # 改回可写, 下一个测试才能删掉临时目录
+            for root in [self.src_dir] + outs:
+                for d in (os.path.join(root, "ro"), os.path.join(root, "ro", "inner")):
+                    if os.path.isdir(d):
+                        os.chmod(d, 0o755)
+
     def test_05_complex_scenario(self):
         """[综合测试] 复杂目录结构 + 混合文件 + RLE压缩 + RC4加密"""
         print("\n   [Complex] Generating nested directory structure...")
@@ -250,6 +389,932 @@ class TestMiniBackup(unittest.TestCase):
         with open(deep_path, "rb") as f:
             self.assertTrue(b"#include" in f.read())
 
+    def test_06_solid_mode(self):
+        """固实模式：小文件合并成块 + 中央索引单文件提取"""
+        os.makedirs(os.path.join(self.src_dir, "cfg"), exist_ok=True)
+        for i in range(200):
+            self.create_dummy_file(os.path.join("cfg", f"app{i}.json"), b'{"key": "value", "id": %d}' % i)
+        big = bytes(range(256)) * 2048
+        self.create_dummy_file("big.bin", big)
+
+        pck_path = os.path.join(self.test_dir, "solid.pck")
+        opts = CPackOptions()
+        opts.solid = 1
+        opts.solidBlockSize = 4096  # 小块，确保生成多个块
+        res = self.lib.C_PackWithOptions(
+            self.src_dir.encode(), pck_path.encode(), b"pwd", 2, None, 1, ctypes.byref(opts)
+        )
+        self.assertEqual(res, 1, "Solid pack failed")
+
+        # 全量解包
+        self.lib.C_Unpack(pck_path.encode(), self.out_dir.encode(), b"pwd")
+        with open(os.path.join(self.out_dir, "cfg", "app123.json"), "rb") as f:
+            self.assertEqual(f.read(), b'{"key": "value", "id": 123}')
+        with open(os.path.join(self.out_dir, "big.bin"), "rb") as f:
+            self.assertEqual(f.read(), big)
+
+        # 单文件提取：只还原这一个文件
+        one_dir = os.path.join(self.test_dir, "one")
+        res = self.lib.C_ExtractOne(pck_path.encode(), b"cfg/app7.json", one_dir.encode(), b"pwd")
+        self.assertEqual(res, 1, "Extract failed")
+        with open(os.path.join(one_dir, "cfg", "app7.json"), "rb") as f:
+            self.assertEqual(f.read(), b'{"key": "value", "id": 7}')
+        self.assertFalse(os.path.exists(os.path.join(one_dir, "big.bin")))
+
+    def test_07_dictionary_compression(self):
+        """字典压缩：相似的小 JSON 文件，字典预热后应明显变小"""
+        for i in range(300):
+            self.create_dummy_file(f"svc{i}.json",
+                b'{\n  "name": "service-%d",\n  "enabled": true,\n  "image": "registry.example.com/app:%d"\n}' % (i, i))
+
+        plain_pck = os.path.join(self.test_dir, "plain.pck")
+        dict_pck = os.path.join(self.test_dir, "dict.pck")
+        opts = CPackOptions()
+        self.assertEqual(self.lib.C_PackWithOptions(
+            self.src_dir.encode(), plain_pck.encode(), b"", 0, None, 2, ctypes.byref(opts)), 1)
+        opts.trainDictionary = 1
+        self.assertEqual(self.lib.C_PackWithOptions(
+            self.src_dir.encode(), dict_pck.encode(), b"k", 1, None, 2, ctypes.byref(opts)), 1)
+
+        print(f"\n   [Dict] LZ77: {os.path.getsize(plain_pck)} -> LZ77+dict: {os.path.getsize(dict_pck)}")
+        self.assertLess(os.path.getsize(dict_pck), os.path.getsize(plain_pck))
+
+        self.lib.C_Unpack(dict_pck.encode(), self.out_dir.encode(), b"k")
+        with open(os.path.join(self.out_dir, "svc42.json"), "rb") as f:
+            self.assertIn(b'"service-42"', f.read())
+
+    def test_08_incremental_backup(self):
+        """增量备份：只复制变化的文件，删掉源里已删除的文件，清单仍能校验"""
+        self.create_dummy_file("keep.txt", b"unchanged")
+        self.create_dummy_file("edit.txt", b"old")
+        self.create_dummy_file("gone.txt", b"bye")
+        mirror = os.path.join(self.test_dir, "mirror")
+        self.assertEqual(self.lib.C_BackupIncremental(self.src_dir.encode(), mirror.encode()), 1)
+
+        # 未变的文件不会被重新复制 (备份副本的 mtime 保持不变)
+        keep_stat = os.stat(os.path.join(mirror, "keep.txt"))
+        self.create_dummy_file("edit.txt", b"new content")
+        os.remove(os.path.join(self.src_dir, "gone.txt"))
+        self.assertEqual(self.lib.C_BackupIncremental(self.src_dir.encode(), mirror.encode()), 1)
+
+        self.assertEqual(os.stat(os.path.join(mirror, "keep.txt")).st_mtime_ns, keep_stat.st_mtime_ns)
+        with open(os.path.join(mirror, "edit.txt"), "rb") as f:
+            self.assertEqual(f.read(), b"new content")
+        self.assertFalse(os.path.exists(os.path.join(mirror, "gone.txt")))
+        self.assertEqual(self.lib.C_VerifySimple(mirror.encode()), b"")
+
+    def test_09_filter_expr(self):
+        """筛选规则: exclude glob / 目录剪枝 / ** / 正则 + 大小组合"""
+        for d in ["a/node_modules", "sub/deep"]:
+            os.makedirs(os.path.join(self.src_dir, d))
+        self.create_dummy_file("keep_me.bin", os.urandom(5000))
+        self.create_dummy_file("big.bin", os.urandom(5000))
+        self.create_dummy_file("small.bin", b"s")
+        self.create_dummy_file("drop.log", b"log")
+        self.create_dummy_file("a/node_modules/m.js", b"js")
+        self.create_dummy_file("sub/y.tmp", b"t")
+        self.create_dummy_file("sub/deep/x.tmp", b"t")
+        self.create_dummy_file("sub/deep/z.txt", b"z")
+        rules = ("# 注释\n"
+                 "exclude *.log\n"
+                 "exclude node_modules/\n"
+                 "exclude sub/**/*.tmp\n"
+                 "where type dir or name ~ \"^keep\" or size < 1K\n")
+        self.assertEqual(self.lib.C_CheckFilterExpr(rules.encode()), b"")
+        self.assertIn(b"rule 1", self.lib.C_CheckFilterExpr(b"where size >"))
+
+        pck_path = os.path.join(self.test_dir, "expr.pck")
+        self.assertEqual(self.lib.C_PackWithFilterExpr(self.src_dir.encode(), pck_path.encode(), b"", 0,
+                                                       rules.encode(), 0), 1)
+        self.lib.C_Unpack(pck_path.encode(), self.out_dir.encode(), b"")
+        for kept in ["keep_me.bin", "small.bin", "sub/deep/z.txt"]:
+            self.assertTrue(os.path.exists(os.path.join(self.out_dir, kept)), kept)
+        for gone in ["big.bin", "drop.log", "a/node_modules", "sub/y.tmp", "sub/deep/x.tmp"]:
+            self.assertFalse(os.path.exists(os.path.join(self.out_dir, gone)), gone)
+
+    def test_10_backupignore(self):
+        """分层 .backupignore: 子目录继承父目录规则, ! 重新包含, 目录规则剪掉整棵子树"""
+        os.makedirs(os.path.join(self.src_dir, "proj", "build"))
+        os.makedirs(os.path.join(self.src_dir, "proj", "logs"))
+        self.create_dummy_file(".backupignore", b"*.log\n!keep.log\n")
+        self.create_dummy_file("proj/.backupignore", b"build/\n")
+        self.create_dummy_file("proj/logs/.backupignore", b"!*.log\n")
+        for name in ["a.log", "keep.log", "proj/b.log", "proj/build/x.o", "proj/logs/c.log", "proj/main.c"]:
+            self.create_dummy_file(name)
+
+        pck_path = os.path.join(self.test_dir, "ignore.pck")
+        self.lib.C_PackWithFilter(self.src_dir.encode(), pck_path.encode(), b"", 0, None, 0)
+        self.lib.C_Unpack(pck_path.encode(), self.out_dir.encode(), b"")
+        for kept in ["keep.log", "proj/logs/c.log", "proj/main.c", "proj/.backupignore"]:
+            self.assertTrue(os.path.exists(os.path.join(self.out_dir, kept)), kept)
+        for gone in ["a.log", "proj/b.log", "proj/build"]:
+            self.assertFalse(os.path.exists(os.path.join(self.out_dir, gone)), gone)
+
+    def test_11_cachedir_tag(self):
+        """带标准签名 CACHEDIR.TAG 的目录内容不打包, 签名不对的照常打包"""
+        os.makedirs(os.path.join(self.src_dir, "cache"))
+        os.makedirs(os.path.join(self.src_dir, "notcache"))
+        self.create_dummy_file("cache/CACHEDIR.TAG", b"Signature: 8a477f597d28d172789f06886806bc55\n")
+        self.create_dummy_file("cache/blob", b"x" * 100)
+        self.create_dummy_file("notcache/CACHEDIR.TAG", b"Signature: wrong\n")
+        self.create_dummy_file("notcache/data", b"d")
+
+        pck_path = os.path.join(self.test_dir, "cache.pck")
+        self.lib.C_PackWithFilter(self.src_dir.encode(), pck_path.encode(), b"", 0, None, 0)
+        self.lib.C_Unpack(pck_path.encode(), self.out_dir.encode(), b"")
+        self.assertFalse(os.path.exists(os.path.join(self.out_dir, "cache", "blob")))
+        self.assertTrue(os.path.exists(os.path.join(self.out_dir, "notcache", "data")))
+
+    def test_12_streaming_pack(self):
+        """边扫边打包: 多个目录、一个目录超过一批 (256 条) 时, 解包出来的文件一个不少"""
+        expected = {}
+        for d in range(6):
+            os.makedirs(os.path.join(self.src_dir, "d%d" % d, "sub"))
+            for f in range(120 if d else 600):
+                rel = os.path.join("d%d" % d, "sub", "f%03d.txt" % f)
+                self.create_dummy_file(rel, rel.encode())
+                expected[rel] = rel.encode()
+
+        pck_path = os.path.join(self.test_dir, "stream.pck")
+        opts = CPackOptions()
+        opts.streaming = 1
+        self.assertEqual(self.lib.C_PackWithOptions(self.src_dir.encode(), pck_path.encode(), b"", 0, None, 2,
+                                                    ctypes.byref(opts)), 1)
+        self.lib.C_Unpack(pck_path.encode(), self.out_dir.encode(), b"")
+        for rel, data in expected.items():
+            with open(os.path.join(self.out_dir, rel), "rb") as fh:
+                self.assertEqual(fh.read(), data)
+
+    def test_13_directory_mtime_restored(self):
+        """目录的修改时间在里面的文件都写完之后才设, 不会被后写的文件改掉"""
+        os.makedirs(os.path.join(self.src_dir, "docs", "old"))
+        self.create_dummy_file("docs/old/a.txt", b"a")
+        self.create_dummy_file("docs/b.txt", b"b")
+        old_time = 1577836800
+        for rel in ("docs/old", "docs"):
+            os.utime(os.path.join(self.src_dir, rel), (old_time, old_time))
+
+        for solid in (0, 1):
+            out = os.path.join(self.test_dir, "out%d" % solid)
+            pck_path = os.path.join(self.test_dir, "dirs%d.pck" % solid)
+            opts = CPackOptions()
+            opts.solid = solid
+            self.lib.C_PackWithOptions(self.src_dir.encode(), pck_path.encode(), b"", 0, None, 0, ctypes.byref(opts))
+            self.lib.C_Unpack(pck_path.encode(), out.encode(), b"")
+            for rel in ("docs/old", "docs"):
+                self.assertAlmostEqual(os.path.getmtime(os.path.join(out, rel)), old_time, delta=2, msg=rel)
+
+    @unittest.skipIf(platform.system() == "Windows", "needs POSIX permissions / rlimit")
+    def test_14_unreadable_file_skipped(self):
+        """直通打包: 读不了的文件告警跳过, 其余照常进包; 写包失败时不留下半截的包"""
+        import resource
+        # root 读得了 000 的文件, 所以换成 nobody 来跑; 目录放在 nobody 进得去的 /tmp 下
+        work = tempfile.mkdtemp()
+        try:
+            os.chmod(work, 0o777)
+            src = os.path.join(work, "src")
+            os.makedirs(os.path.join(src, "sub"))
+            files = {"a.txt": b"a" * 5000, "sub/secret.txt": b"s" * 5000, "z.txt": b"z" * 5000}
+            for rel, data in files.items():
+                with open(os.path.join(src, rel), "wb") as fh:
+                    fh.write(data)
+            os.chmod(os.path.join(src, "sub", "secret.txt"), 0)
+
+            pck = os.path.join(work, "p.pck")
+            user = 65534 if os.geteuid() == 0 else None
+            r = self.run_cli("pack", src, pck, user=user)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            self.assertIn("Skipped sub/secret.txt", r.stderr)
+
+            out = os.path.join(work, "out")
+            self.assertEqual(self.lib.C_Unpack(pck.encode(), out.encode(), b""), 1)
+            for rel in ("a.txt", "z.txt"):
+                with open(os.path.join(out, rel), "rb") as fh:
+                    self.assertEqual(fh.read(), files[rel])
+            self.assertFalse(os.path.exists(os.path.join(out, "sub", "secret.txt")))
+
+            # 包超过文件大小上限 (写包出错): 整个打包失败, 不能当成跳过一个文件
+            with open(os.path.join(src, "big.bin"), "wb") as fh:
+                fh.write(os.urandom(64 * 1024))
+            def limit_size():
+                signal.signal(signal.SIGXFSZ, signal.SIG_IGN)
+                resource.setrlimit(resource.RLIMIT_FSIZE, (32 * 1024, 32 * 1024))
+            bad = os.path.join(work, "bad.pck")
+            r = self.run_cli("pack", src, bad, preexec_fn=limit_size)
+            self.assertNotIn("Skipped big.bin", r.stderr)
+            self.assertFalse(os.path.exists(bad), "partial pack left behind")
+        finally:
+            shutil.rmtree(work, ignore_errors=True)
+
+    def test_15_dirty_set(self):
+        """变动集合: 条目自己 / 上级目录 / 整棵子树 各自是否还算没变"""
+        changes = b"M|a/b/c.txt\nT|x/y\n"
+        clean = lambda rel: self.lib.C_DirtyQuery(changes, rel.encode()) & 1
+        in_subtree = lambda rel: self.lib.C_DirtyQuery(changes, rel.encode()) & 2
+        for rel in ("a", "a/b", "a/b/c.txt", "x", "x/y", "x/y/z/w"):  # 上级目录的列表也变了
+            self.assertFalse(clean(rel), rel)
+        for rel in ("a/b/d.txt", "a/bc", "x/yz", "other"):
+            self.assertTrue(clean(rel), rel)
+        for rel in ("x/y", "x/y/z"):
+            self.assertTrue(in_subtree(rel), rel)
+        for rel in ("x", "x/yz", "a/b/c.txt"):
+            self.assertFalse(in_subtree(rel), rel)
+        # "T|" 空路径 = 整棵树
+        self.assertFalse(self.lib.C_DirtyQuery(b"T|\n", b"anything") & 1)
+
+    @unittest.skipIf(platform.system() == "Windows", "change journal needs flock")
+    def test_16_journal_take_commit(self):
+        """变动日志: 没 commit 的 .taken 下次和新日志合并再读; 水位文件里的变动只读不取走; 水位太旧整棵重扫"""
+        import fcntl
+        journal = os.path.join(self.test_dir, "j")
+        take = lambda commit: self.lib.C_JournalTake(journal.encode(), commit).decode().splitlines()
+
+        with open(journal, "w") as fh:
+            fh.write("M|a\nT|b\n")
+        self.assertEqual(take(0), ["everything|1", "M|a", "T|b"])  # 没有监视进程: 整棵重扫
+        self.assertTrue(os.path.exists(journal + ".taken"))
+        self.assertFalse(os.path.exists(journal))
+
+        with open(journal, "w") as fh:
+            fh.write("M|c\n")
+        self.assertEqual(take(1), ["everything|1", "M|a", "M|c", "T|b"])
+        self.assertFalse(os.path.exists(journal + ".taken"))
+        self.assertEqual(take(1), ["everything|1"])
+
+        # 假装有监视进程: 锁住 .lock, 写水位文件
+        with open(journal + ".lock", "w") as lock:
+            fcntl.flock(lock, fcntl.LOCK_EX)
+            with open(journal + ".pending", "w") as fh:
+                fh.write("W|%d\nM|settling\nT|mnt\n" % time.time_ns())
+            with open(journal, "w") as fh:
+                fh.write("M|d\n")
+            self.assertEqual(take(1), ["everything|0", "M|d", "M|settling", "T|mnt"])
+            self.assertEqual(take(1), ["everything|0", "M|settling", "T|mnt"])
+
+            with open(journal + ".pending", "w") as fh:
+                fh.write("W|%d\n" % (time.time_ns() - 60 * 10**9))
+            self.assertEqual(take(1)[0], "everything|1")
+
+    @unittest.skipIf(platform.system() != "Linux", "watch needs inotify")
+    def test_17_journal_incremental_backup(self):
+        """监视进程在跑时 backup -inc -journal 只看日志里的路径, 结果和整棵重扫一样"""
+        for rel, data in (("a/x.txt", b"x"), ("a/keep.txt", b"k"), ("c/d/y.txt", b"y"), ("gone.txt", b"g")):
+            self.create_dummy_file(rel, data)
+        outside = os.path.join(self.test_dir, "outside.txt")
+        with open(outside, "wb") as fh:
+            fh.write(b"v1")
+        os.symlink(os.path.abspath(outside), os.path.join(self.src_dir, "a", "link.txt"))
+
+        journal = os.path.join(self.test_dir, "j")
+        dst = os.path.join(self.test_dir, "dst")
+        exe = os.path.join(self.lib_dir, "minibackup")
+        watcher = subprocess.Popen([exe, "watch", self.src_dir, journal, "-debounce", "50"],
+                                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        try:
+            deadline = time.time() + 5
+            while not os.path.exists(journal + ".pending") and time.time() < deadline:
+                time.sleep(0.05)
+            r = self.run_cli("backup", self.src_dir, dst, "-inc", "-journal", journal)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+
+            self.create_dummy_file("a/x.txt", b"x2")
+            self.create_dummy_file("a/new.txt", b"n")
+            os.remove(os.path.join(self.src_dir, "gone.txt"))
+            self.create_dummy_file("c/CACHEDIR.TAG", b"Signature: 8a477f597d28d172789f06886806bc55\n")
+            with open(outside, "wb") as fh:
+                fh.write(b"v2")  # 链接目标在树外: 没有事件
+            time.sleep(0.3)
+
+            r = self.run_cli("backup", self.src_dir, dst, "-inc", "-journal", journal)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            self.assertIn("[Journal]", r.stdout)
+            self.assertNotIn("Full rescan", r.stdout)
+        finally:
+            watcher.terminate()
+            watcher.wait()
+
+        def rows(d):
+            with open(os.path.join(d, "index.txt")) as fh:
+                return sorted(line.split("|")[0] for line in fh)
+        full = os.path.join(self.test_dir, "full")
+        self.run_cli("backup", self.src_dir, full)
+        self.assertEqual(rows(dst), rows(full))
+        self.assertEqual(rows(dst), ["a/keep.txt", "a/link.txt", "a/new.txt", "a/x.txt"])
+        for rel, data in (("a/x.txt", b"x2"), ("a/new.txt", b"n"), ("a/link.txt", b"v2")):
+            with open(os.path.join(dst, rel), "rb") as fh:
+                self.assertEqual(fh.read(), data, rel)
+        self.assertFalse(os.path.exists(os.path.join(dst, "gone.txt")))
+        self.assertFalse(os.path.exists(os.path.join(dst, "c", "d", "y.txt")))
+
+    @staticmethod
+    def forge_crc32(data, target):
+        """把 data 的最后 4 个字节换掉, 让整段的 CRC32 等于 target (长度不变, 内容不同)"""
+        table = []
+        for i in range(256):
+            c = i
+            for _ in range(8):
+                c = (c >> 1) ^ 0xEDB88320 if c & 1 else c >> 1
+            table.append(c)
+        top = {t >> 24: i for i, t in enumerate(table)}
+        # 从结果往回推出 4 个表下标, 再从前缀的状态往前推出这 4 个字节
+        reg, idx = target ^ 0xFFFFFFFF, []
+        for _ in range(4):
+            i = top[reg >> 24]
+            idx.insert(0, i)
+            reg = ((reg ^ table[i]) << 8) & 0xFFFFFFFF
+        reg = zlib.crc32(data[:-4]) ^ 0xFFFFFFFF
+        patch = bytearray()
+        for i in idx:
+            patch.append((reg ^ i) & 0xFF)
+            reg = (reg >> 8) ^ table[i]
+        return data[:-4] + bytes(patch)
+
+    def test_18_delta_pack_base(self):
+        """差量包 (-base): 没变的存引用、改了的存差量、新文件照常; CRC 撞上但内容不同的不能当成没变; 缺基准包时报错"""
+        big = bytes(range(256)) * 64
+        files = {"same.txt": b"unchanged " * 20, "big.bin": big, "coll.bin": b"original content!" * 8,
+                 "gone.txt": b"old"}
+        for rel, data in files.items():
+            self.create_dummy_file(rel, data)
+        base = os.path.join(self.test_dir, "base.pck")
+        r = self.run_cli("pack", self.src_dir, base, "-solid")
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+
+        files["big.bin"] = big[:1000] + b"CHANGED" + big[1007:]
+        forged = self.forge_crc32(b"X" + files["coll.bin"][1:], zlib.crc32(files["coll.bin"]))
+        self.assertEqual(zlib.crc32(forged), zlib.crc32(files["coll.bin"]))
+        self.assertNotEqual(forged, files["coll.bin"])
+        files["coll.bin"] = forged
+        files["new.txt"] = b"brand new"
+        del files["gone.txt"]
+        os.remove(os.path.join(self.src_dir, "gone.txt"))
+        for rel, data in files.items():
+            self.create_dummy_file(rel, data)
+
+        delta = os.path.join(self.test_dir, "delta.pck")
+        r = self.run_cli("pack", self.src_dir, delta, "-base", base)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertLess(os.path.getsize(delta), os.path.getsize(base))
+
+        self.assertEqual(self.lib.C_Unpack(delta.encode(), self.out_dir.encode(), b""), 1)
+        for rel, data in files.items():
+            with open(os.path.join(self.out_dir, rel), "rb") as fh:
+                self.assertEqual(fh.read(), data, rel)
+        self.assertFalse(os.path.exists(os.path.join(self.out_dir, "gone.txt")))
+
+        # 基准包不在旁边: 解包失败并说明缺的是哪个包
+        moved = os.path.join(self.test_dir, "elsewhere.pck")
+        os.rename(base, moved)
+        r = self.run_cli("unpack", delta, os.path.join(self.test_dir, "out2"))
+        self.assertNotEqual(r.returncode, 0)
+        self.assertIn("Base pack not found", r.stdout + r.stderr)
+
+    def test_19_repo_lock(self):
+        """仓库锁: 别的进程锁着 <repo>/lock 时仓库操作先等, 放开后照常完成"""
+        if platform.system() == "Windows":
+            self.skipTest("flock not available")
+        import fcntl
+        self.create_dummy_file("a.txt", b"locked " * 100)
+        repo = os.path.join(self.test_dir, "repo")
+        r = self.run_cli("repo-backup", self.src_dir, repo)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+
+        exe = os.path.join(self.lib_dir, "minibackup")
+        with open(os.path.join(repo, "lock"), "a") as held:
+            fcntl.flock(held, fcntl.LOCK_EX)
+            proc = subprocess.Popen([exe, "repo-gc", repo], stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+            time.sleep(0.5)
+            self.assertIsNone(proc.poll(), "repo-gc ran while the repository was locked")
+            fcntl.flock(held, fcntl.LOCK_UN)
+        out, _ = proc.communicate(timeout=30)
+        self.assertEqual(proc.returncode, 0, out)
+        self.assertIn("Waiting for", out)
+        self.assertIn("1 kept", out)
+
+    def test_20_cron_schedule(self):
+        """cron 时间表: 范围、步长、日和周任一满足、@daily、2 月 29 日、不存在的日期、格式错误"""
+        self.use_timezone("UTC0")
+
+        def at(*fields):
+            return calendar.timegm(fields + (0,) * (6 - len(fields)))
+
+        def nxt(spec, after):
+            return self.lib.C_CronNext(spec.encode(), after)
+
+        # 工作日 9-17 点每 15 分钟: 周五 (2026-10-16) 17:50 之后是周一 9:00
+        self.assertEqual(nxt("*/15 9-17 * * 1-5", at(2026, 10, 16, 17, 50)), at(2026, 10, 19, 9, 0))
+        self.assertEqual(nxt("*/15 9-17 * * 1-5", at(2026, 10, 19, 9, 0)), at(2026, 10, 19, 9, 15))
+        # "5/20" = 5,25,45; 逗号列表
+        self.assertEqual(nxt("5/20 * * * *", at(2026, 10, 16, 10, 26)), at(2026, 10, 16, 10, 45))
+        self.assertEqual(nxt("10,50 * * * *", at(2026, 10, 16, 10, 10)), at(2026, 10, 16, 10, 50))
+        # 日和周都限定时满足其一即可: 13 号或周一
+        self.assertEqual(nxt("0 0 13 * 1", at(2026, 10, 1)), at(2026, 10, 5))
+        self.assertEqual(nxt("0 0 13 * 1", at(2026, 11, 10)), at(2026, 11, 13))
+        # 周里的 7 也是周日 (2026-10-18)
+        self.assertEqual(nxt("0 0 * * 7", at(2026, 10, 16)), at(2026, 10, 18))
+        # @daily: 正好在零点时取下一个零点 (不含 after 本身)
+        self.assertEqual(nxt("@daily", at(2026, 10, 16, 12, 34)), at(2026, 10, 17))
+        self.assertEqual(nxt("@daily", at(2026, 10, 17)), at(2026, 10, 18))
+        # 2 月 29 日要等到闰年; 2 月 30 日永远没有
+        self.assertEqual(nxt("0 12 29 2 *", at(2026, 3, 1)), at(2028, 2, 29, 12, 0))
+        self.assertEqual(nxt("0 0 30 2 *", at(2026, 3, 1)), -1)
+        for bad in ["61 * * * *", "* * *", "* * * * 8", "a * * * *", "*/0 * * * *"]:
+            self.assertEqual(nxt(bad, 0), -2, bad)
+
+    def test_21_cron_dst_fall_back(self):
+        """夏令时结束 (纽约 2026-11-01 02:00 EDT -> 01:00 EST): 下次时间一定晚于 after, 每半小时的任务两遍都跑, 定点任务只跑一遍"""
+        if not os.path.exists("/usr/share/zoneinfo/America/New_York"):
+            self.skipTest("tzdata not installed")
+        self.use_timezone("America/New_York")
+        edt_0045 = calendar.timegm((2026, 11, 1, 4, 45, 0))  # 00:45 EDT
+        t, seen = edt_0045, []
+        for _ in range(5):
+            n = self.lib.C_CronNext(b"*/30 * * * *", t)
+            self.assertGreater(n, t)
+            seen.append(n)
+            t = n
+        # 01:00 EDT, 01:30 EDT, 01:00 EST, 01:30 EST, 02:00 EST
+        self.assertEqual([n - edt_0045 for n in seen], [900, 2700, 4500, 6300, 8100])
+
+        est_0100 = calendar.timegm((2026, 11, 1, 6, 0, 0))
+        self.assertEqual(self.lib.C_CronNext(b"*/30 * * * *", est_0100), est_0100 + 1800)
+        self.assertEqual(self.lib.C_CronNext(b"*/30 * * * *", est_0100 - 1), est_0100)
+
+        edt_0130 = calendar.timegm((2026, 11, 1, 5, 30, 0))
+        n = self.lib.C_CronNext(b"30 1 * * *", edt_0130)
+        self.assertEqual(n, calendar.timegm((2026, 11, 2, 6, 30, 0)))  # 第二天 01:30 EST
+
+    def test_22_split_join_args(self):
+        """任务命令行: 引号、转义、空参数切分正确, joinArgs 之后再切分得到原样"""
+        def split(line):
+            out = self.lib.C_SplitArgs(line.encode()).decode()
+            if out.startswith("error|"):
+                return out
+            return out.split("\x1f")[:-1]
+
+        def join(args):
+            return self.lib.C_JoinArgs("\x1f".join(args).encode()).decode()
+
+        self.assertEqual(split('backup  /a\t"/b c" -x'), ["backup", "/a", "/b c", "-x"])
+        self.assertEqual(split('a"b c"d "" e'), ["ab cd", "", "e"])
+        self.assertEqual(split(r'"say \"hi\"" "back\\slash" plain\x'), ['say "hi"', "back\\slash", "plain\\x"])
+        self.assertTrue(split('"open').startswith("error|"))
+
+        cases = [["backup", "/home/me", "/mnt/my backups", "-inc"],
+                 ["pack", 'quote"d', "back\\slash", "tab\there", "new\nline", "-filter", "size > 1M && name ~ '*.log'"],
+                 ["x", "", "y"]]
+        for args in cases:
+            self.assertEqual(split(join(args)), args, join(args))
+        self.assertEqual(join(["plain", "args"]), "plain args")
+
+    def test_23_daemon_submit(self):
+        """常驻进程: 提交的任务照常执行并回传输出和返回码, 任务之间仓库没被锁着, status / shutdown 可用"""
+        if platform.system() == "Windows":
+            self.skipTest("unix sockets only")
+        import fcntl
+        self.create_dummy_file("a.txt", b"daemon " * 200)
+        repo = os.path.abspath(os.path.join(self.test_dir, "repo"))
+        src = os.path.abspath(self.src_dir)
+        sock = os.path.join(tempfile.mkdtemp(), "d.sock")  # 套接字路径有长度限制, 放在短路径下
+        self.addCleanup(shutil.rmtree, os.path.dirname(sock), True)
+        jobs = os.path.join(self.test_dir, "jobs.txt")
+        with open(jobs, "w") as f:
+            f.write("# 测试\n@daily repo-gc " + repo + "\n")
+
+        exe = os.path.join(self.lib_dir, "minibackup")
+        daemon = subprocess.Popen([exe, "daemon", sock, "-jobs", jobs], stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+        self.addCleanup(lambda: daemon.poll() is None and daemon.kill())
+        for _ in range(100):
+            if os.path.exists(sock):
+                break
+            time.sleep(0.05)
+
+        r = self.run_cli("submit", sock, "status")
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("repo-gc", r.stdout)
+
+        for _ in range(2):
+            r = self.run_cli("submit", sock, "repo-backup", src, repo)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            self.assertIn("Snapshot", r.stdout)
+            with open(os.path.join(repo, "lock"), "a") as lock:
+                fcntl.flock(lock, fcntl.LOCK_EX | fcntl.LOCK_NB)  # 任务之间锁是放开的
+                fcntl.flock(lock, fcntl.LOCK_UN)
+
+        r = self.run_cli("submit", sock, "repo-restore", repo, "latest", os.path.abspath(self.out_dir))
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        with open(os.path.join(self.out_dir, "a.txt"), "rb") as f:
+            self.assertEqual(f.read(), b"daemon " * 200)
+
+        r = self.run_cli("submit", sock, "repo-restore", repo, "no-such-snapshot", os.path.abspath(self.out_dir))
+        self.assertNotEqual(r.returncode, 0)
+
+        self.run_cli("submit", sock, "shutdown")
+        out, _ = daemon.communicate(timeout=30)
+        self.assertEqual(daemon.returncode, 0, out)
+
+    def test_24_scan_cache(self):
+        """扫描缓存: 没变的树直接命中; 缓存目录里增删改名、原地改写都能看到; 缓存坏了当作空缓存; 信任模式沿用 stat"""
+        cache = os.path.join(self.test_dir, "scan.cache")
+        runs = [0]
+
+        def pack(*extra):
+            # 一秒内改过的目录不进缓存 (可能还在变), 先等一下
+            time.sleep(1.1)
+            runs[0] += 1
+            pck = os.path.join(self.test_dir, "p%d.pck" % runs[0])
+            r = self.run_cli("pack", self.src_dir, pck, "-scan-cache", cache, *extra)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            out = os.path.join(self.test_dir, "u%d" % runs[0])
+            self.assertEqual(self.lib.C_Unpack(pck.encode(), out.encode(), b""), 1)
+            self.assertEqual(self.read_tree(out), self.read_tree(self.src_dir))
+            m = re.search(r"(\d+) dirs from scan cache", r.stdout)
+            n = re.search(r"(\d+) stats reused", r.stdout)
+            return int(m.group(1)) if m else 0, int(n.group(1)) if n else 0
+
+        self.create_dummy_file("a/x.txt", b"x" * 10)
+        self.create_dummy_file("a/b/y.txt", b"y" * 20)
+        self.create_dummy_file("a/b/z.txt", b"z" * 30)
+        self.create_dummy_file("c.txt", b"c" * 40)
+
+        self.assertEqual(pack(), (0, 0))   # 第一次: 没有缓存
+        self.assertEqual(pack(), (3, 0))   # 没变: 根、a、a/b 都命中, 文件仍逐个 stat
+
+        # a 里新增, a/b 里删除和改名: 这两个目录重读, 根目录仍命中
+        self.create_dummy_file("a/new.txt", b"new")
+        os.remove(os.path.join(self.src_dir, "a/b/y.txt"))
+        os.rename(os.path.join(self.src_dir, "a/b/z.txt"), os.path.join(self.src_dir, "a/b/renamed.txt"))
+        self.assertEqual(pack(), (1, 0))
+
+        # 原地改写 (目录不变): 默认模式照样 stat, 新内容进包
+        with open(os.path.join(self.src_dir, "a/x.txt"), "wb") as f:
+            f.write(b"rewritten in place")
+        self.assertEqual(pack(), (3, 0))
+
+        # 缓存被截断 / 内容是垃圾: 当作空缓存, 结果照样正确, 之后重新写好
+        with open(cache, "r+b") as f:
+            f.truncate(os.path.getsize(cache) // 2)
+        self.assertEqual(pack(), (0, 0))
+        self.assertEqual(pack(), (3, 0))
+        with open(cache, "wb") as f:
+            f.write(os.urandom(256))
+        self.assertEqual(pack(), (0, 0))
+
+        # 信任模式: 没变的目录里文件的 stat 也沿用 (只有子目录还要 stat);
+        # 换名保存的新文件改了目录, 照样看得到
+        pack()
+        dirs, reused = pack("-scan-cache-trust")
+        self.assertEqual(dirs, 3)
+        self.assertEqual(reused, 4)  # 4 个文件; 子目录 a、a/b 仍要 stat
+        tmp = os.path.join(self.src_dir, "a", "saved.tmp")
+        with open(tmp, "wb") as f:
+            f.write(b"saved by rename")
+        os.rename(tmp, os.path.join(self.src_dir, "a", "saved.txt"))
+        dirs, reused = pack("-scan-cache-trust")
+        self.assertEqual(dirs, 2)
+
+    def test_25_repo_gc_keeps_snapshots_intact(self):
+        """仓库 GC: 删掉最老的快照、回收它独占的块并压缩 pack 之后, 留下的快照逐字节还原; GC 之后还能接着备份"""
+        repo = os.path.join(self.test_dir, "repo")
+        trees = []
+
+        def snapshot():
+            r = self.run_cli("repo-backup", self.src_dir, repo)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            trees.append(self.read_tree(self.src_dir))
+
+        def packs_size():
+            d = os.path.join(repo, "packs")
+            return sum(os.path.getsize(os.path.join(d, n)) for n in os.listdir(d))
+
+        shared = os.urandom(300000)
+        self.create_dummy_file("shared.bin", shared)
+        self.create_dummy_file("old_only.bin", os.urandom(2000000))
+        snapshot()
+        os.remove(os.path.join(self.src_dir, "old_only.bin"))
+        self.create_dummy_file("sub/new.bin", os.urandom(200000))
+        self.create_dummy_file("shared.bin", shared[:100000] + os.urandom(1000) + shared[100000:])
+        snapshot()
+        self.create_dummy_file("sub/more.txt", b"more " * 1000)
+        snapshot()
+
+        before = packs_size()
+        r = self.run_cli("repo-gc", repo, "-keep", "2")
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("1 removed", r.stdout)
+        self.assertLess(packs_size(), before - 1500000)  # old_only.bin 的块已回收
+
+        ids = self.run_cli("repo-list", repo).stdout.split()
+        self.assertEqual(len(ids), 2)
+        for i, sid in enumerate(ids):
+            out = os.path.join(self.test_dir, "restore_" + sid)
+            r = self.run_cli("repo-restore", repo, sid, out)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            self.assertEqual(self.read_tree(out), trees[i + 1], sid)
+
+        # GC 之后索引仍然一致: 再备份一次, 去重照常, 还原正确
+        self.create_dummy_file("after_gc.txt", b"after")
+        snapshot()
+        out = os.path.join(self.test_dir, "restore_latest")
+        r = self.run_cli("repo-restore", repo, "latest", out)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertEqual(self.read_tree(out), trees[-1])
+
+    def test_26_repo_round_trip(self):
+        """去重仓库: 备份 -> 还原逐字节一致 (空文件、软链接、权限、修改时间、深层目录); 中间插入数据后只存新增的块"""
+        big = os.urandom(1500000)
+        self.create_dummy_file("big.bin", big)
+        self.create_dummy_file("empty.txt", b"")
+        self.create_dummy_file("d/e/f.txt", b"nested " * 300)
+        os.chmod(os.path.join(self.src_dir, "big.bin"), 0o600)
+        os.utime(os.path.join(self.src_dir, "d/e/f.txt"), (1600000000, 1600000000))
+        if hasattr(os, "symlink"):
+            os.symlink("big.bin", os.path.join(self.src_dir, "link"))
+
+        def check(out):
+            self.assertEqual(self.read_tree(out), self.read_tree(self.src_dir))
+            self.assertEqual(os.stat(os.path.join(out, "big.bin")).st_mode & 0o777, 0o600)
+            self.assertEqual(int(os.stat(os.path.join(out, "d/e/f.txt")).st_mtime), 1600000000)
+            if hasattr(os, "symlink"):
+                self.assertEqual(os.readlink(os.path.join(out, "link")), "big.bin")
+
+        for mode in ["", "-lz"]:
+            repo = os.path.join(self.test_dir, "repo" + mode)
+            r = self.run_cli("repo-backup", self.src_dir, repo, *([mode] if mode else []))
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            out = os.path.join(self.test_dir, "out" + mode)
+            r = self.run_cli("repo-restore", repo, "latest", out)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            check(out)
+
+        # 中间插入 1000 字节: 内容定义分块只影响插入点附近的块, 其余都去重
+        repo = os.path.join(self.test_dir, "repo")
+        self.create_dummy_file("big.bin", big[:700000] + os.urandom(1000) + big[700000:])
+        r = self.run_cli("repo-backup", self.src_dir, repo)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        m = re.search(r"New chunks: (\d+) \((\d+) bytes\), deduplicated chunks: (\d+)", r.stdout)
+        self.assertIsNotNone(m, r.stdout)
+        self.assertLess(int(m.group(2)), 100000)
+        self.assertGreater(int(m.group(3)), 50)
+        out = os.path.join(self.test_dir, "out2")
+        r = self.run_cli("repo-restore", repo, "latest", out)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        check(out)
+
+    def test_27_link_dest_hard_links(self):
+        """-link-dest: 没变的文件硬链接到上一份 (同一个 inode), 改过的重新复制; 之后再更新新快照不会改到旧快照"""
+        if platform.system() == "Windows":
+            self.skipTest("hard links checked by inode")
+        self.create_dummy_file("same.txt", b"same " * 100)
+        self.create_dummy_file("d/kept.bin", os.urandom(5000))
+        self.create_dummy_file("changed.txt", b"v1")
+        s1 = os.path.join(self.test_dir, "s1")
+        s2 = os.path.join(self.test_dir, "s2")
+        r = self.run_cli("backup", self.src_dir, s1)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        snap1 = self.read_tree(s1)
+        del snap1["index.txt"]
+
+        self.create_dummy_file("changed.txt", b"version 2")
+        self.create_dummy_file("added.txt", b"new")
+        r = self.run_cli("backup", self.src_dir, s2, "-link-dest", s1)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("hard-linked 2", r.stdout)
+
+        def ino(root, rel):
+            return os.stat(os.path.join(root, rel)).st_ino
+        self.assertEqual(ino(s1, "same.txt"), ino(s2, "same.txt"))
+        self.assertEqual(ino(s1, "d/kept.bin"), ino(s2, "d/kept.bin"))
+        self.assertNotEqual(ino(s1, "changed.txt"), ino(s2, "changed.txt"))
+        r = self.run_cli("verify", s2)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("PASS", r.stdout)
+
+        # 新快照里改动共享的文件 (增量更新) 必须换新 inode, 旧快照保持原样
+        self.create_dummy_file("same.txt", b"edited after snapshot")
+        r = self.run_cli("backup", self.src_dir, s2, "-inc")
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        with open(os.path.join(s2, "same.txt"), "rb") as f:
+            self.assertEqual(f.read(), b"edited after snapshot")
+        after = self.read_tree(s1)
+        del after["index.txt"]
+        self.assertEqual(after, snap1)
+
+        out = os.path.join(self.test_dir, "restored")
+        r = self.run_cli("restore", s2, out)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        restored = self.read_tree(out)
+        restored.pop("index.txt", None)
+        self.assertEqual(restored, self.read_tree(self.src_dir))
+
+    def test_28_delta_mirror_round_trip(self):
+        """-delta: 大文件插入 / 改写 / 截短后镜像逐字节一致并通过校验, 只写改动的部分; 硬链接的旧快照不受影响"""
+        big = bytearray(os.urandom(9 << 20))  # 超过 8 MB 才走差量
+        self.create_dummy_file("big.bin", bytes(big))
+        self.create_dummy_file("small.txt", b"small")
+        s1 = os.path.join(self.test_dir, "s1")
+        mirror = os.path.join(self.test_dir, "mirror")
+        for args in [(s1,), (mirror, "-link-dest", s1)]:
+            r = self.run_cli("backup", self.src_dir, *args)
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        original = bytes(big)
+
+        def delta_backup():
+            r = self.run_cli("backup", self.src_dir, mirror, "-delta")
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            m = re.search(r"\[DELTA\] big.bin \(matched (\d+) bytes, wrote (\d+) bytes\)", r.stdout)
+            self.assertIsNotNone(m, r.stdout)
+            with open(os.path.join(mirror, "big.bin"), "rb") as f:
+                self.assertEqual(f.read(), bytes(big))
+            r = self.run_cli("verify", mirror)
+            self.assertIn("PASS", r.stdout)
+            return int(m.group(1)), int(m.group(2))
+
+        # 副本硬链接到 s1: 写到新文件再换上, 插入点后面错位的块也能对上
+        big[1000:1000] = os.urandom(3000)
+        self.create_dummy_file("big.bin", bytes(big))
+        matched, wrote = delta_backup()
+        self.assertGreater(matched, (9 << 20) - (64 << 10))
+        self.assertLess(wrote, 64 << 10)
+        with open(os.path.join(s1, "big.bin"), "rb") as f:
+            self.assertEqual(f.read(), original)
+        r = self.run_cli("verify", s1)
+        self.assertIn("PASS", r.stdout)
+
+        # 之后副本只有一个链接: 就地更新, 没变的块一个字节都不写
+        big[4000000:4000008] = b"XXXXXXXX"
+        self.create_dummy_file("big.bin", bytes(big))
+        matched, wrote = delta_backup()
+        self.assertLess(wrote, 64 << 10)
+
+        # 就地更新时插入点之后的数据整体后移, 只能重写; 前面的照样不动
+        big[5000000:5000000] = os.urandom(3000)
+        self.create_dummy_file("big.bin", bytes(big))
+        matched, wrote = delta_backup()
+        self.assertGreater(matched, 4900000)
+
+        del big[-(1 << 20):]
+        self.create_dummy_file("big.bin", bytes(big))
+        matched, wrote = delta_backup()
+        self.assertLess(wrote, 64 << 10)
+
+    def test_29_pack_reproducible_by_default(self):
+        """默认先扫完再按路径排序打包: 多线程扫描下同一棵树两次打出的包逐字节相同; -stream 空目录不报负的耗时"""
+        for d in range(6):
+            for f in range(60):
+                self.create_dummy_file("d%d/f%02d.txt" % (d, f), b"%d-%d" % (d, f))
+        packs = []
+        for i in range(2):
+            pck = os.path.join(self.test_dir, "r%d.pck" % i)
+            r = self.run_cli("pack", self.src_dir, pck, "-scan-threads", "4", "-lz")
+            self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+            self.assertNotIn("streamed", r.stdout)
+            with open(pck, "rb") as f:
+                packs.append(f.read())
+        self.assertEqual(packs[0], packs[1])
+
+        empty = os.path.join(self.test_dir, "empty")
+        os.makedirs(empty)
+        r = self.run_cli("pack", empty, os.path.join(self.test_dir, "e.pck"), "-stream")
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("streamed, no entries", r.stdout)
+        self.assertNotIn("-1", r.stdout)
+
+    def test_30_skip_nodump(self):
+        """nodump 属性 (chattr +d) 的文件和目录默认不备份 / 不打包, -keep-nodump 时照常; 文件系统不支持时跳过"""
+        self.create_dummy_file("keep.txt", b"keep")
+        self.create_dummy_file("scratch.bin", b"scratch")
+        self.create_dummy_file("tmpdir/inner.txt", b"inner")
+        targets = [os.path.join(self.src_dir, "scratch.bin"), os.path.join(self.src_dir, "tmpdir")]
+        try:
+            r = subprocess.run(["chattr", "+d"] + targets, capture_output=True)
+        except OSError:
+            self.skipTest("chattr not available")
+        if r.returncode != 0:
+            self.skipTest("nodump attribute not supported here: " + r.stderr.decode(errors="replace"))
+
+        mirror = os.path.join(self.test_dir, "mirror")
+        r = self.run_cli("backup", self.src_dir, mirror)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertTrue(os.path.exists(os.path.join(mirror, "keep.txt")))
+        self.assertFalse(os.path.exists(os.path.join(mirror, "scratch.bin")))
+        self.assertFalse(os.path.exists(os.path.join(mirror, "tmpdir")))
+
+        pck = os.path.join(self.test_dir, "nd.pck")
+        r = self.run_cli("pack", self.src_dir, pck)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("2 nodump", r.stdout)
+        out = os.path.join(self.test_dir, "nd_out")
+        self.assertEqual(self.lib.C_Unpack(pck.encode(), out.encode(), b""), 1)
+        self.assertEqual(self.read_tree(out), {"keep.txt": b"keep"})
+
+        mirror2 = os.path.join(self.test_dir, "mirror2")
+        r = self.run_cli("backup", self.src_dir, mirror2, "-keep-nodump")
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertTrue(os.path.exists(os.path.join(mirror2, "scratch.bin")))
+        self.assertTrue(os.path.exists(os.path.join(mirror2, "tmpdir", "inner.txt")))
+        r = self.run_cli("pack", self.src_dir, pck, "-keep-nodump")
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        out = os.path.join(self.test_dir, "nd_out2")
+        self.assertEqual(self.lib.C_Unpack(pck.encode(), out.encode(), b""), 1)
+        self.assertEqual(self.read_tree(out), self.read_tree(self.src_dir))
+
+    def test_31_read_order_round_trip(self):
+        """按 inode / 物理区段顺序读文件: 普通包和固实包解出来都和源目录一致 (包里条目顺序不影响还原)"""
+        for d in range(4):
+            for f in range(25):
+                self.create_dummy_file("d%d/s%d/f%02d.txt" % (d, f % 3, f), os.urandom(100 + 97 * f))
+        self.create_dummy_file("big.bin", os.urandom(300000))
+        self.create_dummy_file("empty.txt", b"")
+        os.utime(os.path.join(self.src_dir, "d1"), (1500000000, 1500000000))
+        expected = self.read_tree(self.src_dir)
+
+        for order in (1, 2):
+            for solid in (0, 1):
+                for comp in (0, 2):
+                    name = "o%d_s%d_c%d" % (order, solid, comp)
+                    opts = CPackOptions()
+                    opts.solid = solid
+                    opts.readOrder = order
+                    pck = os.path.join(self.test_dir, name + ".pck")
+                    self.assertEqual(self.lib.C_PackWithOptions(self.src_dir.encode(), pck.encode(), b"", 0, None,
+                                                                comp, ctypes.byref(opts)), 1, name)
+                    out = os.path.join(self.test_dir, name)
+                    self.assertEqual(self.lib.C_Unpack(pck.encode(), out.encode(), b""), 1, name)
+                    self.assertEqual(self.read_tree(out), expected, name)
+                    self.assertEqual(int(os.stat(os.path.join(out, "d1")).st_mtime), 1500000000, name)
+
+    def test_32_exclude_dir(self):
+        """-exclude-dir: 同名目录在任何深度连同子树剪掉, 扫描统计里被剪的子树一个目录都没读; 名字只是包含它的目录不受影响"""
+        self.create_dummy_file("app/main.js", b"main")
+        self.create_dummy_file("app/node_modules_notes.txt", b"notes")
+        self.create_dummy_file("node_modules_backup/keep.js", b"keep")
+        for i in range(5):
+            self.create_dummy_file("node_modules/pkg%d/lib/deep/x.js" % i, b"dep")
+            self.create_dummy_file("app/sub/node_modules/pkg%d/y.js" % i, b"dep")
+        self.create_dummy_file(".git/objects/ab/cd", b"obj")
+        expected = {k: v for k, v in self.read_tree(self.src_dir).items()
+                    if not k.startswith(("node_modules/", "app/sub/node_modules/", ".git/"))}
+
+        pck = os.path.join(self.test_dir, "ex.pck")
+        r = self.run_cli("pack", self.src_dir, pck, "-exclude-dir", "node_modules", "-exclude-dir", ".git")
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        m = re.search(r"\[Scan\] (\d+) dirs, .*?(\d+) dirs pruned", r.stdout)
+        self.assertIsNotNone(m, r.stdout)
+        # 读过的目录: 根、app、app/sub、node_modules_backup; 剪掉的: 两个 node_modules 和 .git
+        self.assertEqual((int(m.group(1)), int(m.group(2))), (4, 3))
+        out = os.path.join(self.test_dir, "ex_out")
+        self.assertEqual(self.lib.C_Unpack(pck.encode(), out.encode(), b""), 1)
+        self.assertEqual(self.read_tree(out), expected)
+        self.assertTrue(os.path.isdir(os.path.join(out, "app", "sub")))
+        self.assertFalse(os.path.exists(os.path.join(out, "node_modules")))
+
+        # C 接口: CPackOptions.excludeDirs 一行一个
+        opts = CPackOptions()
+        opts.excludeDirs = b"node_modules\n.git\n"
+        pck2 = os.path.join(self.test_dir, "ex2.pck")
+        self.assertEqual(self.lib.C_PackWithOptions(self.src_dir.encode(), pck2.encode(), b"", 0, None, 0,
+                                                    ctypes.byref(opts)), 1)
+        out2 = os.path.join(self.test_dir, "ex_out2")
+        self.assertEqual(self.lib.C_Unpack(pck2.encode(), out2.encode(), b""), 1)
+        self.assertEqual(self.read_tree(out2), expected)
+
+    def test_33_repo_unchanged_detection(self):
+        """去重仓库: 同一秒内改成同样大小的内容也要重新分块; 上一个快照按源目录找, 不会拿别的目录的快照来比"""
+        path = os.path.join(self.src_dir, "f.txt")
+        self.create_dummy_file("f.txt", b"AAAA")
+        os.utime(path, ns=(1600000000123456789, 1600000000123456789))
+        repo = os.path.join(self.test_dir, "repo")
+        r = self.run_cli("repo-backup", self.src_dir, repo)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+
+        # 大小和修改时间 (连纳秒) 都和上次一样, 只有 ctime 变了
+        self.create_dummy_file("f.txt", b"BBBB")
+        os.utime(path, ns=(1600000000123456789, 1600000000123456789))
+        r = self.run_cli("repo-backup", self.src_dir, repo)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("(0 files unchanged)", r.stdout)
+        out = os.path.join(self.test_dir, "out")
+        r = self.run_cli("repo-restore", repo, "latest", out)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertEqual(self.read_tree(out), {"f.txt": b"BBBB"})
+
+        # 中间插一个别的目录的快照, 再备份原目录时上一个快照仍是原目录的那个
+        other = os.path.join(self.test_dir, "other")
+        os.makedirs(other)
+        with open(os.path.join(other, "f.txt"), "wb") as f:
+            f.write(b"CCCC")
+        r = self.run_cli("repo-backup", other, repo)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("(0 files unchanged)", r.stdout)
+        r = self.run_cli("repo-backup", self.src_dir, repo)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertIn("(1 files unchanged)", r.stdout)
+        out2 = os.path.join(self.test_dir, "out2")
+        r = self.run_cli("repo-restore", repo, "latest", out2)
+        self.assertEqual(r.returncode, 0, r.stdout + r.stderr)
+        self.assertEqual(self.read_tree(out2), {"f.txt": b"BBBB"})
+
     def test_verify_alignment_explicitly(self):
         """🔍 专门用于验证内存对齐的测试：发送特殊数值"""
         print("\n=== [Alignment Test] Sending Magic Numbers ===")